@@ -14,10 +14,15 @@
  * distribution in a file called "COPYING" or "LICENSE".
  ***********************************************************************/
 
+
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
 
+#include "gilcc.h"
 #include "analysis_print.h"
+#include "out_sink.h"
 
 static char *ap_msgs[APRINT_TYPES_NUM] = {
     [APRINT_INFO]       = "INFO    ",
@@ -25,20 +30,734 @@ static char *ap_msgs[APRINT_TYPES_NUM] = {
     [APRINT_ERROR]      = "ERROR   "
 };
 
-int analysis_print(enum analysis_print_type ap_type, int p_num, char *msg)
+static const char *ap_levels[APRINT_TYPES_NUM] = {
+    [APRINT_INFO]       = "note",
+    [APRINT_WARNING]    = "warning",
+    [APRINT_ERROR]      = "error"
+};
+
+static const char *ap_severities[APRINT_TYPES_NUM] = {
+    [APRINT_INFO]       = "info",
+    [APRINT_WARNING]    = "warning",
+    [APRINT_ERROR]      = "error"
+};
+
+struct aprint_rule {
+    const char *apl_id;
+    enum analysis_print_type apl_type;
+    int apl_p_num;
+
+    /* Argument kinds: 'd' - int, 'u' - unsigned long, 's' - string */
+    const char *apl_args;
+
+    /* Messages of the text format, and of the structured formats: %L and
+     * %C stand for the line and column, %d, %u and %s for the arguments.
+     */
+    const char *apl_text;
+    const char *apl_msg;
+
+    /* What the rule reports, in plain text (SARIF) */
+    const char *apl_desc;
+};
+
+static const struct aprint_rule ap_rules[APRINT_RULES_NUM] = {
+    [APRINT_R_PROCESSING] = {
+        "info.processing", APRINT_INFO, 2, "s",
+        "processing source file (%s)",
+        "processing source file %s",
+        "Processing a source file" },
+    [APRINT_R_CACHE_SUMMARY] = {
+        "info.result-cache", APRINT_INFO, 2, "uuuu",
+        "result cache: %u hits, %u misses, %u stored, %u evicted",
+        "result cache: %u hits, %u misses, %u stored, %u evicted",
+        "Result cache summary" },
+    [APRINT_R_SERVER_LISTEN] = {
+        "info.server-listen", APRINT_INFO, 2, "s",
+        "server listening on (%s)",
+        "server listening on %s",
+        "Server listening" },
+    [APRINT_R_CLI_STD_MULTIPLE] = {
+        "cli.std-multiple", APRINT_WARNING, 2, "dsds",
+        "CLI flag: (%d, %s) multiple standard declarations [previous: (%d, %s)]",
+        "multiple standard declarations: argument %d (%s), previously argument %d (%s)",
+        "Multiple standard declarations" },
+    [APRINT_R_CLI_FLAG_DUPLICATE] = {
+        "cli.flag-duplicate", APRINT_WARNING, 2, "ds",
+        "CLI flag: (%d, %s) flag duplicate",
+        "duplicate flag: argument %d (%s)",
+        "Duplicate flag" },
+    [APRINT_R_CLI_TRIGRAPHS_ALLOWED] = {
+        "cli.trigraphs-allowed", APRINT_WARNING, 2, "ds",
+        "CLI flag: (%d, %s) trigraphs are already allowed by the standard",
+        "trigraphs are already allowed by the standard: argument %d (%s)",
+        "Trigraphs already allowed by the standard" },
+    [APRINT_R_CLI_IPATH_DUPLICATE] = {
+        "cli.include-path-duplicate", APRINT_WARNING, 2, "s",
+        "CLI parameter: (%s) duplicate inclusiong path parameter",
+        "duplicate include path: %s",
+        "Duplicate include path" },
+    [APRINT_R_CLI_DEF_DUPLICATE] = {
+        "cli.define-duplicate", APRINT_WARNING, 2, "s",
+        "CLI parameter: (%s) duplicate definition parameter",
+        "duplicate definition: %s",
+        "Duplicate definition" },
+    [APRINT_R_TRIGRAPH_UNSUPPORTED] = {
+        "cpp.trigraph-unsupported", APRINT_WARNING, 2, "",
+        "CPP code: (line %L, at %C) unsupported trigraph sequence.",
+        "unsupported trigraph sequence",
+        "Unsupported trigraph sequence" },
+    [APRINT_R_MIXED_INDENT] = {
+        "style.mixed-indent", APRINT_WARNING, 2, "",
+        "CPP code: (line %L, at %C) Mixing spaces and tabs",
+        "mixing spaces and tabs",
+        "Mixing spaces and tabs" },
+    [APRINT_R_BLANK_LINE] = {
+        "style.blank-line", APRINT_WARNING, 2, "",
+        "CPP code: (line %L) Line contains only white spaces",
+        "line contains only white spaces",
+        "Line contains only white spaces" },
+    [APRINT_R_MULTIPLE_NEW_LINES] = {
+        "style.multiple-new-lines", APRINT_WARNING, 2, "",
+        "CPP code: (line %L) Multiple sequential new-lines",
+        "multiple sequential new-lines",
+        "Multiple sequential new-lines" },
+    [APRINT_R_UNTERMINATED_COMMENT] = {
+        "cpp.unterminated-comment", APRINT_ERROR, 2, "",
+        "file ends with an unterminated comment.",
+        "file ends with an unterminated comment",
+        "File ends with an unterminated comment" },
+    [APRINT_R_PP_INCLUDE_NOT_FOUND] = {
+        "cpp.include-not-found", APRINT_WARNING, 2, "ss",
+        "CPP code: (%s, line %L, at %C) header not found (%s)",
+        "%s: header %s not found",
+        "Header not found" },
+    [APRINT_R_PP_INCLUDE_DEPTH] = {
+        "cpp.include-depth", APRINT_ERROR, 2, "su",
+        "CPP code: (%s, line %L, at %C) includes nested over %u levels deep",
+        "%s: includes nested over %u levels deep",
+        "Includes nested too deep" },
+    [APRINT_R_PP_DIRECTIVE_INVALID] = {
+        "cpp.directive-invalid", APRINT_ERROR, 2, "ss",
+        "CPP code: (%s, line %L, at %C) invalid preprocessing directive (#%s)",
+        "%s: invalid preprocessing directive #%s",
+        "Invalid preprocessing directive" },
+    [APRINT_R_PP_DIRECTIVE_MALFORMED] = {
+        "cpp.directive-malformed", APRINT_ERROR, 2, "ss",
+        "CPP code: (%s, line %L, at %C) malformed #%s directive",
+        "%s: malformed #%s directive",
+        "Malformed preprocessing directive" },
+    [APRINT_R_PP_ERROR_DIRECTIVE] = {
+        "cpp.error-directive", APRINT_ERROR, 2, "ss",
+        "CPP code: (%s, line %L, at %C) #error %s",
+        "%s: #error %s",
+        "#error directive" },
+    [APRINT_R_PP_WARNING_DIRECTIVE] = {
+        "cpp.warning-directive", APRINT_WARNING, 2, "ss",
+        "CPP code: (%s, line %L, at %C) #warning %s",
+        "%s: #warning %s",
+        "#warning directive" },
+    [APRINT_R_PP_COND_UNBALANCED] = {
+        "cpp.cond-unbalanced", APRINT_ERROR, 2, "ss",
+        "CPP code: (%s, line %L, at %C) #%s out of place",
+        "%s: #%s out of place",
+        "Conditional directive out of place" },
+    [APRINT_R_PP_COND_UNTERMINATED] = {
+        "cpp.cond-unterminated", APRINT_ERROR, 2, "s",
+        "CPP code: (%s, line %L, at %C) unterminated conditional directive",
+        "%s: unterminated conditional directive",
+        "Unterminated conditional directive" },
+    [APRINT_R_PP_MACRO_REDEFINED] = {
+        "cpp.macro-redefined", APRINT_WARNING, 2, "ss",
+        "CPP code: (%s, line %L, at %C) macro redefined (%s)",
+        "%s: macro %s redefined",
+        "Macro redefined" },
+    [APRINT_R_PP_MACRO_ARGS] = {
+        "cpp.macro-args", APRINT_ERROR, 2, "ssuu",
+        "CPP code: (%s, line %L, at %C) macro (%s) takes %u arguments, %u given",
+        "%s: macro %s takes %u arguments, %u given",
+        "Wrong number of macro arguments" },
+    [APRINT_R_PP_MACRO_UNTERMINATED] = {
+        "cpp.macro-unterminated", APRINT_ERROR, 2, "ss",
+        "CPP code: (%s, line %L, at %C) unterminated invocation of macro (%s)",
+        "%s: unterminated invocation of macro %s",
+        "Unterminated macro invocation" },
+    [APRINT_R_PP_EXPR_INVALID] = {
+        "cpp.expr-invalid", APRINT_ERROR, 2, "ss",
+        "CPP code: (%s, line %L, at %C) invalid #%s expression",
+        "%s: invalid #%s expression",
+        "Invalid conditional expression" },
+    [APRINT_R_PP_DIV_ZERO] = {
+        "cpp.div-zero", APRINT_ERROR, 2, "ss",
+        "CPP code: (%s, line %L, at %C) division by zero in #%s",
+        "%s: division by zero in #%s",
+        "Division by zero in a conditional expression" },
+    [APRINT_R_PP_PASTE_INVALID] = {
+        "cpp.paste-invalid", APRINT_ERROR, 2, "sss",
+        "CPP code: (%s, line %L, at %C) pasting (%s) and (%s) does not give a valid token",
+        "%s: pasting %s and %s does not give a valid token",
+        "Token pasting does not give a valid token" },
+    [APRINT_R_LIMIT_MACROS] = {
+        "limit.macros", APRINT_WARNING, 2, "su",
+        "CPP code: (%s, line %L, at %C) over %u macros defined (the standard's limit)",
+        "%s: over %u macros defined (the standard's limit)",
+        "Macros defined over the standard's limit" },
+    [APRINT_R_LIMIT_MACRO_PARAMS] = {
+        "limit.macro-params", APRINT_WARNING, 2, "ssu",
+        "CPP code: (%s, line %L, at %C) macro (%s) has over %u parameters (the standard's limit)",
+        "%s: macro %s has over %u parameters (the standard's limit)",
+        "Macro parameters over the standard's limit" },
+    [APRINT_R_LIMIT_MACRO_ARGS] = {
+        "limit.macro-args", APRINT_WARNING, 2, "ssu",
+        "CPP code: (%s, line %L, at %C) macro (%s) invoked with over %u arguments (the standard's limit)",
+        "%s: macro %s invoked with over %u arguments (the standard's limit)",
+        "Macro arguments over the standard's limit" },
+    [APRINT_R_LIMIT_LINE_LENGTH] = {
+        "limit.line-length", APRINT_WARNING, 2, "u",
+        "CPP code: (line %L) logical source line over %u characters (the standard's limit)",
+        "logical source line over %u characters (the standard's limit)",
+        "Logical source line over the standard's limit" },
+    [APRINT_R_LIMIT_STRING_LENGTH] = {
+        "limit.string-length", APRINT_WARNING, 2, "su",
+        "CPP code: (%s, line %L, at %C) string literal over %u characters (the standard's limit)",
+        "%s: string literal over %u characters (the standard's limit)",
+        "String literal over the standard's limit" },
+    [APRINT_R_LIMIT_PAREN_NESTING] = {
+        "limit.paren-nesting", APRINT_WARNING, 2, "su",
+        "CPP code: (%s, line %L, at %C) parentheses nested over %u levels deep (the standard's limit)",
+        "%s: parentheses nested over %u levels deep (the standard's limit)",
+        "Parentheses nested over the standard's limit" },
+    [APRINT_R_LIMIT_BLOCK_NESTING] = {
+        "limit.block-nesting", APRINT_WARNING, 2, "su",
+        "CPP code: (%s, line %L, at %C) blocks nested over %u levels deep (the standard's limit)",
+        "%s: blocks nested over %u levels deep (the standard's limit)",
+        "Blocks nested over the standard's limit" },
+    [APRINT_R_LIMIT_STRUCT_NESTING] = {
+        "limit.struct-nesting", APRINT_WARNING, 2, "su",
+        "CPP code: (%s, line %L, at %C) struct or union definitions nested over %u levels deep (the standard's limit)",
+        "%s: struct or union definitions nested over %u levels deep (the standard's limit)",
+        "Struct or union definitions nested over the standard's limit" },
+    [APRINT_R_LIMIT_CASE_LABELS] = {
+        "limit.case-labels", APRINT_WARNING, 2, "su",
+        "CPP code: (%s, line %L, at %C) switch statement with over %u case labels (the standard's limit)",
+        "%s: switch statement with over %u case labels (the standard's limit)",
+        "Case labels over the standard's limit" },
+    [APRINT_R_LIMIT_MEMBERS] = {
+        "limit.struct-members", APRINT_WARNING, 2, "su",
+        "CPP code: (%s, line %L, at %C) struct or union with over %u members (the standard's limit)",
+        "%s: struct or union with over %u members (the standard's limit)",
+        "Struct or union members over the standard's limit" },
+    [APRINT_R_LIMIT_ENUM_CONSTS] = {
+        "limit.enum-constants", APRINT_WARNING, 2, "su",
+        "CPP code: (%s, line %L, at %C) enumeration with over %u constants (the standard's limit)",
+        "%s: enumeration with over %u constants (the standard's limit)",
+        "Enumeration constants over the standard's limit" },
+    [APRINT_R_LIMIT_COND_NESTING] = {
+        "limit.cond-nesting", APRINT_WARNING, 2, "su",
+        "CPP code: (%s, line %L, at %C) conditional inclusion nested over %u levels deep (the standard's limit)",
+        "%s: conditional inclusion nested over %u levels deep (the standard's limit)",
+        "Conditional inclusion nested over the standard's limit" },
+    [APRINT_R_LIMIT_INCLUDE_NESTING] = {
+        "limit.include-nesting", APRINT_WARNING, 2, "su",
+        "CPP code: (%s, line %L, at %C) includes nested over %u levels deep (the standard's limit)",
+        "%s: includes nested over %u levels deep (the standard's limit)",
+        "Includes nested over the standard's limit" },
+    [APRINT_R_LIMIT_IDENT_SIGNIFICANCE] = {
+        "limit.ident-significance", APRINT_WARNING, 2, "sssu",
+        "CPP code: (%s, line %L, at %C) identifier (%s) same as (%s) in its first %u characters (the standard's limit)",
+        "%s: identifier %s same as %s in its first %u characters (the standard's limit)",
+        "Identifiers the same in their significant characters" },
+};
+
+static __thread struct aprint_buf *ap_cur;
+static __thread unsigned long ap_diags;
+
+struct aprint_buf *aprint_cur(void)
 {
-    if ((ap_type >= APRINT_TYPES_NUM) || (ap_type < 0))
-        return -1;
+    return ap_cur;
+}
+
+void aprint_set_cur(struct aprint_buf *buf)
+{
+    ap_cur = buf;
+}
+
+unsigned long analysis_print_diags(void)
+{
+    return ap_diags;
+}
+
+void aprint_buf_init(struct aprint_buf *buf)
+{
+    memset(buf, 0, sizeof(struct aprint_buf));
+}
+
+void aprint_buf_clear(struct aprint_buf *buf)
+{
+    buf->apb_num = 0;
+    buf->apb_strs_size = 0;
+}
+
+void aprint_buf_release(struct aprint_buf *buf)
+{
+    free(buf->apb_recs);
+    free(buf->apb_strs);
+    aprint_buf_init(buf);
+}
+
+unsigned long aprint_buf_diags(const struct aprint_buf *buf, size_t from)
+{
+    unsigned long num = 0;
+    size_t i;
+
+    for (i = from; i < buf->apb_num; i++) {
+        if (ap_rules[buf->apb_recs[i].apr_rule].apl_type != APRINT_INFO)
+            num++;
+    }
+
+    return num;
+}
+
+static struct aprint_rec *aprint_buf_add(struct aprint_buf *buf, size_t num)
+{
+    if (buf->apb_num + num > buf->apb_cap) {
+        size_t new_cap = buf->apb_cap ? buf->apb_cap : 64;
+        struct aprint_rec *new_recs;
+
+        while (new_cap < buf->apb_num + num)
+            new_cap <<= 1;
+
+        new_recs = (struct aprint_rec *)realloc(buf->apb_recs, sizeof(struct aprint_rec) * new_cap);
+        if (!new_recs)
+            return NULL;
+
+        buf->apb_recs = new_recs;
+        buf->apb_cap = new_cap;
+    }
+
+    buf->apb_num += num;
+
+    return &buf->apb_recs[buf->apb_num - num];
+}
+
+/* Copies data into the buffer's strings, returning its offset (or -1). */
+static ssize_t aprint_buf_strs(struct aprint_buf *buf, const char *data, size_t size)
+{
+    size_t offs = buf->apb_strs_size;
+
+    if (offs + size > buf->apb_strs_cap) {
+        size_t new_cap = buf->apb_strs_cap ? buf->apb_strs_cap : 256;
+        char *new_strs;
+
+        while (new_cap < offs + size)
+            new_cap <<= 1;
+
+        new_strs = (char *)realloc(buf->apb_strs, new_cap);
+        if (!new_strs)
+            return -1;
+
+        buf->apb_strs = new_strs;
+        buf->apb_strs_cap = new_cap;
+    }
+
+    memcpy(&buf->apb_strs[offs], data, size);
+    buf->apb_strs_size += size;
+
+    return offs;
+}
+
+static void aprint_msg_format(struct osink *out, const char *tmpl,
+                              const struct aprint_buf *buf, const struct aprint_rec *rec)
+{
+    const char *run = tmpl;
+    const char *str;
+    const char *c;
+    int arg = 0;
+
+    for (c = tmpl; *c; c++) {
+        if (*c != '%')
+            continue;
+
+        osink_write(out, run, c - run);
+        c++;
+
+        switch (*c) {
+        case 'L':
+            osink_printf(out, "%u", rec->apr_line);
+            break;
+
+        case 'C':
+            osink_printf(out, "%u", rec->apr_col);
+            break;
+
+        case 'd':
+            osink_printf(out, "%d", (int)rec->apr_args[arg++]);
+            break;
+
+        case 'u':
+            osink_printf(out, "%lu", (unsigned long)rec->apr_args[arg++]);
+            break;
+
+        case 's':
+            str = &buf->apb_strs[rec->apr_args[arg++]];
+            osink_write(out, str, strlen(str));
+            break;
+        }
+
+        run = c + 1;
+    }
+
+    osink_write(out, run, c - run);
+}
+
+static void aprint_rec_text(struct osink *out, const struct aprint_buf *buf,
+                            const struct aprint_rec *rec)
+{
+    const struct aprint_rule *rule = &ap_rules[rec->apr_rule];
+
+    osink_printf(out, "%s:%4d:", ap_msgs[rule->apl_type], rule->apl_p_num);
+    aprint_msg_format(out, rule->apl_text, buf, rec);
+    osink_put_char(out, '\n');
+}
+
+void aprint_report(enum analysis_print_rule rule, unsigned int line, unsigned int col, ...)
+{
+    const struct aprint_rule *apl = &ap_rules[rule];
+    struct aprint_buf *buf = ap_cur;
+    struct aprint_buf tmp;
+    struct aprint_rec *rec;
+    const char *str;
+    ssize_t offs;
+    va_list ap;
+    int i;
+
+    if (apl->apl_type != APRINT_INFO)
+        ap_diags++;
+
+    /* With no buffer to collect it, it's printed right away. */
+    if (!buf) {
+        aprint_buf_init(&tmp);
+        buf = &tmp;
+    }
+
+    rec = aprint_buf_add(buf, 1);
+    if (!rec)
+        goto out;
+
+    rec->apr_rule = rule;
+    rec->apr_line = line;
+    rec->apr_col = col;
+
+    va_start(ap, col);
+
+    for (i = 0; apl->apl_args[i]; i++) {
+        switch (apl->apl_args[i]) {
+        case 'd':
+            rec->apr_args[i] = (uint64_t)(int64_t)va_arg(ap, int);
+            break;
+
+        case 'u':
+            rec->apr_args[i] = va_arg(ap, unsigned long);
+            break;
+
+        default:
+            str = va_arg(ap, const char *);
+            offs = aprint_buf_strs(buf, str, strlen(str) + 1);
+            if (offs < 0) {
+                /* Keep the record, without the argument. */
+                offs = aprint_buf_strs(buf, "", 1);
+                if (offs < 0) {
+                    buf->apb_num--;
+                    va_end(ap);
+                    goto out;
+                }
+            }
+
+            rec->apr_args[i] = offs;
+        }
+    }
+
+    va_end(ap);
+
+    if (buf == &tmp)
+        aprint_rec_text(osink_cur(), buf, rec);
 
-    printf("%s:%4d:%s\n", ap_msgs[ap_type], p_num, msg);
-    return 0;
+out:
+    if (buf == &tmp)
+        aprint_buf_release(&tmp);
 }
 
-int analysis_print_param_1(enum analysis_print_type ap_type, int p_num, char *msg, char *param)
+/* Serialized buffer: number of records and size of the strings (32 bit
+ * each), the records and the strings.
+ */
+int aprint_buf_save(const struct aprint_buf *buf, size_t from, struct osink *out)
 {
-    if ((ap_type >= APRINT_TYPES_NUM) || (ap_type < 0))
+    uint32_t hdr[2];
+
+    hdr[0] = buf->apb_num - from;
+    hdr[1] = buf->apb_strs_size;
+
+    osink_write(out, (const char *)hdr, sizeof(hdr));
+    osink_write(out, (const char *)&buf->apb_recs[from], sizeof(struct aprint_rec) * hdr[0]);
+    osink_write(out, buf->apb_strs, buf->apb_strs_size);
+
+    return out->osk_err ? -1 : 0;
+}
+
+ssize_t aprint_buf_load(struct aprint_buf *buf, const char *data, size_t size)
+{
+    struct aprint_rec *recs;
+    uint32_t hdr[2];
+    size_t recs_size;
+    ssize_t strs_offs;
+    size_t i;
+    int j;
+
+    if (size < sizeof(hdr))
         return -1;
 
-    printf("%s:%4d:%s (%s)\n", ap_msgs[ap_type], p_num, msg, param);
-    return 0;
+    memcpy(hdr, data, sizeof(hdr));
+    recs_size = sizeof(struct aprint_rec) * hdr[0];
+
+    if (size - sizeof(hdr) < recs_size + hdr[1])
+        return -1;
+
+    data += sizeof(hdr);
+
+    /* String arguments are offset past the strings already held. */
+    strs_offs = aprint_buf_strs(buf, data + recs_size, hdr[1]);
+    if (strs_offs < 0)
+        return -1;
+
+    recs = aprint_buf_add(buf, hdr[0]);
+    if (!recs) {
+        buf->apb_strs_size = strs_offs;
+        return -1;
+    }
+
+    memcpy(recs, data, recs_size);
+
+    for (i = 0; i < hdr[0]; i++) {
+        const struct aprint_rule *apl;
+
+        if (recs[i].apr_rule >= APRINT_RULES_NUM)
+            goto err;
+
+        apl = &ap_rules[recs[i].apr_rule];
+        for (j = 0; apl->apl_args[j]; j++) {
+            if (apl->apl_args[j] != 's')
+                continue;
+
+            if (recs[i].apr_args[j] >= hdr[1])
+                goto err;
+
+            recs[i].apr_args[j] += strs_offs;
+        }
+    }
+
+    return sizeof(hdr) + recs_size + hdr[1];
+
+err:
+    buf->apb_num -= hdr[0];
+    buf->apb_strs_size = strs_offs;
+    return -1;
+}
+
+void aprint_emit_init(struct aprint_emit *emit, enum analysis_print_fmt fmt, struct osink *out)
+{
+    memset(emit->ape_counts, 0, sizeof(emit->ape_counts));
+    emit->ape_fmt = fmt;
+    emit->ape_out = out;
+    emit->ape_fn = NULL;
+    emit->ape_ctx = NULL;
+    osink_init_mem(&emit->ape_msg);
+}
+
+void aprint_emit_init_cb(struct aprint_emit *emit, aprint_diag_fn fn, void *ctx)
+{
+    aprint_emit_init(emit, APRINT_FMT_CB, NULL);
+    emit->ape_fn = fn;
+    emit->ape_ctx = ctx;
+}
+
+void aprint_emit_begin(struct aprint_emit *emit)
+{
+    struct osink *out = emit->ape_out;
+    int i;
+
+    if (emit->ape_fmt != APRINT_FMT_SARIF)
+        return;
+
+    osink_printf(out, "{\"version\": \"2.1.0\", "
+                 "\"$schema\": \"https://json.schemastore.org/sarif-2.1.0.json\", "
+                 "\"runs\": [{\"tool\": {\"driver\": {\"name\": \"gilcc\", "
+                 "\"version\": \"%.1f\", \"rules\": [", GILCC_VERSION);
+
+    for (i = 0; i < APRINT_RULES_NUM; i++) {
+        osink_printf(out, "%s\n{\"id\": \"%s\", \"shortDescription\": {\"text\": ",
+                     i ? "," : "", ap_rules[i].apl_id);
+        osink_json_str(out, ap_rules[i].apl_desc, strlen(ap_rules[i].apl_desc));
+        osink_printf(out, "}}");
+    }
+
+    osink_printf(out, "]}}, \"results\": [");
+}
+
+static unsigned long aprint_emit_num(const struct aprint_emit *emit)
+{
+    return emit->ape_counts[APRINT_INFO] + emit->ape_counts[APRINT_WARNING] +
+           emit->ape_counts[APRINT_ERROR];
+}
+
+static void aprint_rec_json(struct aprint_emit *emit, const struct aprint_buf *buf,
+                            const struct aprint_rec *rec, const char *file)
+{
+    const struct aprint_rule *rule = &ap_rules[rec->apr_rule];
+    struct osink *out = emit->ape_out;
+    const char *str;
+    int i;
+
+    emit->ape_msg.osk_size = 0;
+    aprint_msg_format(&emit->ape_msg, rule->apl_msg, buf, rec);
+
+    osink_printf(out, "{\"severity\": \"%s\", \"rule\": \"%s\", \"file\": ",
+                 ap_severities[rule->apl_type], rule->apl_id);
+
+    if (file)
+        osink_json_str(out, file, strlen(file));
+    else
+        osink_printf(out, "null");
+
+    if (rec->apr_line)
+        osink_printf(out, ", \"line\": %u", rec->apr_line);
+    if (rec->apr_col)
+        osink_printf(out, ", \"column\": %u", rec->apr_col);
+
+    osink_printf(out, ", \"message\": ");
+    osink_json_str(out, emit->ape_msg.osk_buf, emit->ape_msg.osk_size);
+
+    osink_printf(out, ", \"args\": [");
+    for (i = 0; rule->apl_args[i]; i++) {
+        if (i)
+            osink_printf(out, ", ");
+
+        switch (rule->apl_args[i]) {
+        case 'd':
+            osink_printf(out, "%d", (int)rec->apr_args[i]);
+            break;
+
+        case 'u':
+            osink_printf(out, "%lu", (unsigned long)rec->apr_args[i]);
+            break;
+
+        default:
+            str = &buf->apb_strs[rec->apr_args[i]];
+            osink_json_str(out, str, strlen(str));
+        }
+    }
+
+    osink_printf(out, "]}\n");
+}
+
+static void aprint_rec_sarif(struct aprint_emit *emit, const struct aprint_buf *buf,
+                             const struct aprint_rec *rec, const char *file)
+{
+    const struct aprint_rule *rule = &ap_rules[rec->apr_rule];
+    struct osink *out = emit->ape_out;
+
+    emit->ape_msg.osk_size = 0;
+    aprint_msg_format(&emit->ape_msg, rule->apl_msg, buf, rec);
+
+    osink_printf(out, "%s\n{\"ruleId\": \"%s\", \"ruleIndex\": %d, \"level\": \"%s\", "
+                 "\"message\": {\"text\": ", aprint_emit_num(emit) ? "," : "",
+                 rule->apl_id, rec->apr_rule, ap_levels[rule->apl_type]);
+    osink_json_str(out, emit->ape_msg.osk_buf, emit->ape_msg.osk_size);
+    osink_printf(out, "}");
+
+    if (file) {
+        osink_printf(out, ", \"locations\": [{\"physicalLocation\": "
+                     "{\"artifactLocation\": {\"uri\": ");
+        osink_json_str(out, file, strlen(file));
+        osink_printf(out, "}");
+
+        if (rec->apr_line) {
+            osink_printf(out, ", \"region\": {\"startLine\": %u", rec->apr_line);
+            if (rec->apr_col)
+                osink_printf(out, ", \"startColumn\": %u", rec->apr_col);
+            osink_printf(out, "}");
+        }
+
+        osink_printf(out, "}}]");
+    }
+
+    osink_printf(out, "}");
+}
+
+static void aprint_rec_cb(struct aprint_emit *emit, const struct aprint_buf *buf,
+                          const struct aprint_rec *rec, const char *file)
+{
+    const struct aprint_rule *rule = &ap_rules[rec->apr_rule];
+    struct aprint_diag diag;
+
+    emit->ape_msg.osk_size = 0;
+    aprint_msg_format(&emit->ape_msg, rule->apl_msg, buf, rec);
+    osink_put_char(&emit->ape_msg, '\0');
+    if (emit->ape_msg.osk_err)
+        return;
+
+    diag.apd_rule = rule->apl_id;
+    diag.apd_type = rule->apl_type;
+    diag.apd_file = file;
+    diag.apd_line = rec->apr_line;
+    diag.apd_col = rec->apr_col;
+    diag.apd_msg = emit->ape_msg.osk_buf;
+
+    emit->ape_fn(emit->ape_ctx, &diag);
+}
+
+void aprint_emit_buf(struct aprint_emit *emit, struct aprint_buf *buf, const char *file)
+{
+    const struct aprint_rec *rec;
+    size_t i;
+
+    for (i = 0; i < buf->apb_num; i++) {
+        rec = &buf->apb_recs[i];
+
+        switch (emit->ape_fmt) {
+        case APRINT_FMT_TEXT:
+            aprint_rec_text(emit->ape_out, buf, rec);
+            break;
+
+        case APRINT_FMT_JSONL:
+            aprint_rec_json(emit, buf, rec, file);
+            break;
+
+        case APRINT_FMT_SARIF:
+            aprint_rec_sarif(emit, buf, rec, file);
+            break;
+
+        case APRINT_FMT_CB:
+            aprint_rec_cb(emit, buf, rec, file);
+            break;
+
+        default:
+            /* Counted only. */
+            break;
+        }
+
+        emit->ape_counts[ap_rules[rec->apr_rule].apl_type]++;
+    }
+
+    aprint_buf_clear(buf);
+}
+
+void aprint_emit_end(struct aprint_emit *emit)
+{
+    if (emit->ape_fmt == APRINT_FMT_SARIF)
+        osink_printf(emit->ape_out, "\n]}]}\n");
+    else if (emit->ape_fmt == APRINT_FMT_COUNT)
+        osink_printf(emit->ape_out, "%lu errors, %lu warnings, %lu info\n",
+                     emit->ape_counts[APRINT_ERROR], emit->ape_counts[APRINT_WARNING],
+                     emit->ape_counts[APRINT_INFO]);
+
+    osink_release(&emit->ape_msg);
 }
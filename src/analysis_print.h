@@ -14,9 +14,25 @@
  * distribution in a file called "COPYING" or "LICENSE".
  ***********************************************************************/
 
+
 #ifndef _ANALYSIS_PRINTER_H__
 #define _ANALYSIS_PRINTER_H__
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "out_sink.h"
+
+/* Analysis Printer.
+ *
+ * Diagnostics are reported as compact records: the rule, the location and
+ * the arguments of the message. The records of a thread are collected in
+ * the diagnostics buffer set by aprint_set_cur(), and are only formatted
+ * when emitted, once the file is done. Reports of a thread with no buffer
+ * are printed right away, as text.
+ */
+
 enum analysis_print_type {
     APRINT_INFO,
     APRINT_WARNING,
@@ -25,9 +41,143 @@ enum analysis_print_type {
     APRINT_TYPES_NUM
 };
 
+enum analysis_print_rule {
+    APRINT_R_PROCESSING,
+    APRINT_R_CACHE_SUMMARY,
+    APRINT_R_SERVER_LISTEN,
+    APRINT_R_CLI_STD_MULTIPLE,
+    APRINT_R_CLI_FLAG_DUPLICATE,
+    APRINT_R_CLI_TRIGRAPHS_ALLOWED,
+    APRINT_R_CLI_IPATH_DUPLICATE,
+    APRINT_R_CLI_DEF_DUPLICATE,
+    APRINT_R_TRIGRAPH_UNSUPPORTED,
+    APRINT_R_MIXED_INDENT,
+    APRINT_R_BLANK_LINE,
+    APRINT_R_MULTIPLE_NEW_LINES,
+    APRINT_R_UNTERMINATED_COMMENT,
+    APRINT_R_PP_INCLUDE_NOT_FOUND,
+    APRINT_R_PP_INCLUDE_DEPTH,
+    APRINT_R_PP_DIRECTIVE_INVALID,
+    APRINT_R_PP_DIRECTIVE_MALFORMED,
+    APRINT_R_PP_ERROR_DIRECTIVE,
+    APRINT_R_PP_WARNING_DIRECTIVE,
+    APRINT_R_PP_COND_UNBALANCED,
+    APRINT_R_PP_COND_UNTERMINATED,
+    APRINT_R_PP_MACRO_REDEFINED,
+    APRINT_R_PP_MACRO_ARGS,
+    APRINT_R_PP_MACRO_UNTERMINATED,
+    APRINT_R_PP_EXPR_INVALID,
+    APRINT_R_PP_DIV_ZERO,
+    APRINT_R_PP_PASTE_INVALID,
+    APRINT_R_LIMIT_MACROS,
+    APRINT_R_LIMIT_MACRO_PARAMS,
+    APRINT_R_LIMIT_MACRO_ARGS,
+    APRINT_R_LIMIT_LINE_LENGTH,
+    APRINT_R_LIMIT_STRING_LENGTH,
+    APRINT_R_LIMIT_PAREN_NESTING,
+    APRINT_R_LIMIT_BLOCK_NESTING,
+    APRINT_R_LIMIT_STRUCT_NESTING,
+    APRINT_R_LIMIT_CASE_LABELS,
+    APRINT_R_LIMIT_MEMBERS,
+    APRINT_R_LIMIT_ENUM_CONSTS,
+    APRINT_R_LIMIT_COND_NESTING,
+    APRINT_R_LIMIT_INCLUDE_NESTING,
+    APRINT_R_LIMIT_IDENT_SIGNIFICANCE,
+
+    APRINT_RULES_NUM
+};
+
+enum analysis_print_fmt {
+    APRINT_FMT_TEXT,
+    APRINT_FMT_JSONL,
+    APRINT_FMT_SARIF,
+    APRINT_FMT_COUNT,
+
+    /* Handed to a callback, one by one */
+    APRINT_FMT_CB,
+};
+
+#define APRINT_ARGS_MAX     4
+
+/* A diagnostic; string arguments are offsets into the buffer's strings. */
+struct aprint_rec {
+    uint16_t apr_rule;
+    uint32_t apr_line;
+    uint32_t apr_col;
+    uint64_t apr_args[APRINT_ARGS_MAX];
+};
+
+/* Diagnostics buffer */
+struct aprint_buf {
+    struct aprint_rec *apb_recs;
+    size_t apb_num;
+    size_t apb_cap;
+
+    char *apb_strs;
+    size_t apb_strs_size;
+    size_t apb_strs_cap;
+};
+
+/* A diagnostic handed to a callback. The message is that of the structured
+ * formats; it and the file are only valid during the call.
+ */
+struct aprint_diag {
+    const char *apd_rule;
+    enum analysis_print_type apd_type;
+    const char *apd_file;
+    unsigned int apd_line;
+    unsigned int apd_col;
+    const char *apd_msg;
+};
+
+typedef void (*aprint_diag_fn)(void *ctx, const struct aprint_diag *diag);
+
+/* Diagnostics emitter: formats buffers onto an output sink, or hands them
+ * to a callback.
+ */
+struct aprint_emit {
+    enum analysis_print_fmt ape_fmt;
+    struct osink *ape_out;
+    aprint_diag_fn ape_fn;
+    void *ape_ctx;
+
+    /* Number of diagnostics emitted, per type */
+    unsigned long ape_counts[APRINT_TYPES_NUM];
+
+    /* Scratch sink for formatting messages */
+    struct osink ape_msg;
+};
+
 /* Analysis Printer API */
 
-int analysis_print(enum analysis_print_type ap_type, int p_num, char *msg);
-int analysis_print_param_1(enum analysis_print_type ap_type, int p_num, char *msg, char *param);
+/* Reports a diagnostic of rule at line:col (0 - none). The arguments
+ * follow the rule's message.
+ */
+void aprint_report(enum analysis_print_rule rule, unsigned int line, unsigned int col, ...);
+
+struct aprint_buf *aprint_cur(void);
+void aprint_set_cur(struct aprint_buf *buf);
+
+/* Number of warnings and errors reported so far by the calling thread */
+unsigned long analysis_print_diags(void);
+
+void aprint_buf_init(struct aprint_buf *buf);
+void aprint_buf_clear(struct aprint_buf *buf);
+void aprint_buf_release(struct aprint_buf *buf);
+
+/* Number of warnings and errors among the records from index from on */
+unsigned long aprint_buf_diags(const struct aprint_buf *buf, size_t from);
+
+/* Serializes the records from index from on; aprint_buf_load() reads them
+ * back, appended to buf, and returns the size read (-1 - malformed).
+ */
+int aprint_buf_save(const struct aprint_buf *buf, size_t from, struct osink *out);
+ssize_t aprint_buf_load(struct aprint_buf *buf, const char *data, size_t size);
+
+void aprint_emit_init(struct aprint_emit *emit, enum analysis_print_fmt fmt, struct osink *out);
+void aprint_emit_init_cb(struct aprint_emit *emit, aprint_diag_fn fn, void *ctx);
+void aprint_emit_begin(struct aprint_emit *emit);
+void aprint_emit_buf(struct aprint_emit *emit, struct aprint_buf *buf, const char *file);
+void aprint_emit_end(struct aprint_emit *emit);
 
 #endif /* _ANALYSIS_PRINTER_H__ */
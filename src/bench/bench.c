@@ -0,0 +1,648 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+/* Translation phases benchmark.
+ *
+ * Generates synthetic source corpora from a fixed seed, so every run
+ * measures the very same input, and reports the throughput of every
+ * translation stage and of the whole pipeline as JSON.
+ *
+ * The stages are internal to the parser, so it is built into the benchmark
+ * as is.
+ */
+
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "../src_parser.c"
+#include "../gilcc.h"
+#include "../hash.h"
+
+#define BENCH_DEFAULT_SIZE      (4 * 1024 * 1024)
+#define BENCH_DEFAULT_REPS      5
+#define BENCH_DEFAULT_SEED      0x67696c6363ULL
+#define BENCH_REPS_MAX          100
+
+enum bench_stage {
+    BENCH_TSTAGE_1,
+    BENCH_TSTAGE_2,
+    BENCH_TSTAGE_3,
+    BENCH_LEX,
+    BENCH_TSTAGE_4,
+    BENCH_END_TO_END,
+    BENCH_STAGES_NUM,
+};
+
+static const char *bench_stage_names[BENCH_STAGES_NUM] = {
+    "tstage_1",
+    "tstage_2",
+    "tstage_3",
+    "lex",
+    "tstage_4",
+    "end_to_end",
+};
+
+/* Corpus generator state */
+struct bench_gen {
+    struct osink *out;
+    uint64_t rnd;
+};
+
+struct bench_corpus {
+    const char *name;
+    void (*gen)(struct bench_gen *gen);
+
+    /* Trigraphs are replaced, rather than warned about. */
+    bool exp_trigraphs;
+};
+
+struct bench_result {
+    size_t bytes_in;
+    double best;
+    double median;
+};
+
+/* xorshift64*: fast, and the same sequence on every platform. */
+static uint32_t bench_rnd(struct bench_gen *gen, uint32_t range)
+{
+    gen->rnd ^= gen->rnd >> 12;
+    gen->rnd ^= gen->rnd << 25;
+    gen->rnd ^= gen->rnd >> 27;
+
+    return (uint32_t)((gen->rnd * 0x2545f4914f6cdd1dULL) >> 32) % range;
+}
+
+static void bench_puts(struct bench_gen *gen, const char *str)
+{
+    osink_write(gen->out, str, strlen(str));
+}
+
+static void bench_ident(struct bench_gen *gen)
+{
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyz_0123456789";
+    int len = 1 + bench_rnd(gen, 12);
+    int i;
+
+    osink_put_char(gen->out, chars[bench_rnd(gen, 27)]);
+    for (i = 1; i < len; i++)
+        osink_put_char(gen->out, chars[bench_rnd(gen, sizeof(chars) - 1)]);
+}
+
+static void bench_words(struct bench_gen *gen, int num)
+{
+    while (num--) {
+        bench_ident(gen);
+        osink_put_char(gen->out, ' ');
+    }
+}
+
+static void bench_statement(struct bench_gen *gen, const char *indent, const char *eol)
+{
+    bench_puts(gen, indent);
+
+    switch (bench_rnd(gen, 4)) {
+    case 0:
+        bench_ident(gen);
+        bench_puts(gen, " = ");
+        bench_ident(gen);
+        bench_puts(gen, " + 42;");
+        break;
+
+    case 1:
+        bench_puts(gen, "if (");
+        bench_ident(gen);
+        bench_puts(gen, " < 0x10) ");
+        bench_ident(gen);
+        bench_puts(gen, "();");
+        break;
+
+    case 2:
+        bench_puts(gen, "printf(\"");
+        bench_words(gen, 1 + bench_rnd(gen, 6));
+        bench_puts(gen, "\\n\", ");
+        bench_ident(gen);
+        bench_puts(gen, ");");
+        break;
+
+    default:
+        bench_puts(gen, "return ");
+        bench_ident(gen);
+        bench_puts(gen, "[3];");
+    }
+
+    bench_puts(gen, eol);
+}
+
+static void bench_function(struct bench_gen *gen, const char *eol)
+{
+    int num = 2 + bench_rnd(gen, 10);
+
+    bench_puts(gen, "static int ");
+    bench_ident(gen);
+    bench_puts(gen, "(int ");
+    bench_ident(gen);
+    bench_puts(gen, ")");
+    bench_puts(gen, eol);
+    bench_puts(gen, "{");
+    bench_puts(gen, eol);
+
+    while (num--)
+        bench_statement(gen, "    ", eol);
+
+    bench_puts(gen, "}");
+    bench_puts(gen, eol);
+    bench_puts(gen, eol);
+}
+
+/* Plain code, with a comment here and there */
+static void bench_gen_code(struct bench_gen *gen)
+{
+    if (!bench_rnd(gen, 4)) {
+        bench_puts(gen, "/* ");
+        bench_words(gen, 3 + bench_rnd(gen, 8));
+        bench_puts(gen, "*/\n");
+    }
+
+    bench_function(gen, "\n");
+}
+
+/* Mostly block and line comments */
+static void bench_gen_comments(struct bench_gen *gen)
+{
+    int num = 3 + bench_rnd(gen, 10);
+
+    bench_puts(gen, "/*\n");
+    while (num--) {
+        bench_puts(gen, " * ");
+        bench_words(gen, 4 + bench_rnd(gen, 8));
+        bench_puts(gen, "\n");
+    }
+    bench_puts(gen, " */\n");
+
+    num = 2 + bench_rnd(gen, 6);
+    while (num--) {
+        bench_puts(gen, "// ");
+        bench_words(gen, 4 + bench_rnd(gen, 8));
+        bench_puts(gen, "\n");
+    }
+
+    bench_statement(gen, "", " /* ");
+    bench_words(gen, 2 + bench_rnd(gen, 4));
+    bench_puts(gen, "*/\n");
+}
+
+/* Trigraph sequences all over */
+static void bench_gen_trigraphs(struct bench_gen *gen)
+{
+    static const char *trigraphs[] = {
+        "??=", "??(", "??)", "??<", "??>", "??'", "??!", "??-", "?? ", "???",
+    };
+    int num = 4 + bench_rnd(gen, 12);
+
+    bench_puts(gen, "??=define ");
+    bench_ident(gen);
+    bench_puts(gen, "\n");
+
+    while (num--) {
+        bench_ident(gen);
+        bench_puts(gen, trigraphs[bench_rnd(gen, 10)]);
+        if (!bench_rnd(gen, 3))
+            bench_puts(gen, "\n");
+    }
+
+    bench_puts(gen, "\n");
+}
+
+/* Windows line endings */
+static void bench_gen_crlf(struct bench_gen *gen)
+{
+    bench_function(gen, "\r\n");
+}
+
+/* Long macros, spliced with backslash-newline */
+static void bench_gen_splices(struct bench_gen *gen)
+{
+    int num = 2 + bench_rnd(gen, 10);
+
+    bench_puts(gen, "#define ");
+    bench_ident(gen);
+    bench_puts(gen, "(x) \\\n");
+
+    while (num--)
+        bench_statement(gen, "    ", " \\\n");
+
+    bench_puts(gen, "    x\n\n");
+}
+
+/* Lines of a megabyte or so */
+static void bench_gen_long_line(struct bench_gen *gen)
+{
+    size_t line_end = gen->out->osk_size + (1024 * 1024);
+
+    while (gen->out->osk_size < line_end) {
+        bench_statement(gen, "", " ");
+        if (!bench_rnd(gen, 8)) {
+            bench_puts(gen, "/* ");
+            bench_words(gen, 3);
+            bench_puts(gen, "*/ ");
+        }
+    }
+
+    bench_puts(gen, "\n");
+}
+
+static const struct bench_corpus bench_corpora[] = {
+    { "code",       bench_gen_code,         false },
+    { "comments",   bench_gen_comments,     false },
+    { "trigraphs",  bench_gen_trigraphs,    true },
+    { "crlf",       bench_gen_crlf,         false },
+    { "splices",    bench_gen_splices,      false },
+    { "long_line",  bench_gen_long_line,    false },
+};
+
+#define BENCH_CORPORA_NUM   (sizeof(bench_corpora) / sizeof(bench_corpora[0]))
+
+static int bench_corpus_gen(const struct bench_corpus *corpus, size_t size,
+                            uint64_t seed, struct osink *out)
+{
+    struct bench_gen gen = {
+        .out = out,
+        .rnd = seed ^ hash64(corpus->name, strlen(corpus->name), 0),
+    };
+
+    if (!gen.rnd)
+        gen.rnd = BENCH_DEFAULT_SEED;
+
+    osink_init_mem(out);
+    while ((out->osk_size < size) && !out->osk_err)
+        corpus->gen(&gen);
+
+    return out->osk_err ? -1 : 0;
+}
+
+static int bench_discard(void *ctx, const char *data, size_t size)
+{
+    (void)ctx;
+    (void)data;
+    (void)size;
+
+    return 0;
+}
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int bench_time_cmp(const void *a, const void *b)
+{
+    double time_a = *(const double *)a;
+    double time_b = *(const double *)b;
+
+    return (time_a > time_b) - (time_a < time_b);
+}
+
+/* Runs one stage reps times, with its input prepared by the stages before. */
+static int bench_stage(enum bench_stage stage, const struct osink *corpus,
+                       const struct trans_config *cfg, int reps, struct bench_result *res)
+{
+    struct osink tbuf1, tbuf2, tbuf3, tbuf4;
+    struct src_toks toks;
+    struct src_locs locs;
+    struct src_input src_in;
+    double times[BENCH_REPS_MAX];
+    double start;
+    int ret_val = 0;
+    int i;
+
+    osink_init_mem(&tbuf1);
+    osink_init_mem(&tbuf2);
+    osink_init_mem(&tbuf3);
+    osink_init_mem(&tbuf4);
+    src_toks_init(&toks);
+    src_locs_init(&locs);
+
+    if (stage > BENCH_TSTAGE_1) {
+        src_input_open_mem(&src_in, corpus->osk_buf, corpus->osk_size);
+        src_parser_tstage_1(&tbuf1, &src_in, cfg->exp_trigraphs, &locs, NULL);
+        src_input_close(&src_in);
+    }
+
+    if (stage > BENCH_TSTAGE_2)
+        src_parser_tstage_2(&tbuf2, &tbuf1, cfg->lim.char_src_line_num, &locs, NULL);
+
+    if (stage > BENCH_TSTAGE_3)
+        src_parser_tstage_3(&tbuf4, &tbuf2, cfg->exp_cpp_cmnts, &locs, NULL);
+
+    for (i = 0; i < reps; i++) {
+        src_input_open_mem(&src_in, corpus->osk_buf, corpus->osk_size);
+        tbuf3.osk_size = 0;
+        toks.stk_num = 0;
+
+        /* The stage timed maps its locations anew. */
+        if (stage == BENCH_TSTAGE_1) {
+            sloc_map_release(&locs.sl_phases[SLOC_PHASE_1]);
+            sloc_map_release(&locs.sl_lines);
+        } else if (stage == BENCH_TSTAGE_2) {
+            sloc_map_release(&locs.sl_phases[SLOC_PHASE_2]);
+        } else if (stage == BENCH_TSTAGE_3) {
+            sloc_map_release(&locs.sl_phases[SLOC_PHASE_3]);
+        }
+
+        start = bench_now();
+
+        switch (stage) {
+        case BENCH_TSTAGE_1:
+            ret_val = src_parser_tstage_1(&tbuf3, &src_in, cfg->exp_trigraphs, &locs, NULL);
+            break;
+
+        case BENCH_TSTAGE_2:
+            ret_val = src_parser_tstage_2(&tbuf3, &tbuf1, cfg->lim.char_src_line_num,
+                                          &locs, NULL);
+            break;
+
+        case BENCH_TSTAGE_3:
+            ret_val = src_parser_tstage_3(&tbuf3, &tbuf2, cfg->exp_cpp_cmnts, &locs, NULL);
+            break;
+
+        case BENCH_LEX:
+            ret_val = src_lex(&toks, tbuf4.osk_buf, tbuf4.osk_size);
+            break;
+
+        /* With no headers to include, nor a header cache to keep */
+        case BENCH_TSTAGE_4:
+            ret_val = pp_run(&tbuf3, &tbuf4, "<bench>", &locs, cfg, NULL, NULL, NULL);
+            break;
+
+        default:
+            ret_val = src_parser_cpp_input(&src_in, "<bench>", cfg, NULL, NULL, NULL);
+        }
+
+        times[i] = bench_now() - start;
+
+        src_input_close(&src_in);
+
+        if (ret_val < 0)
+            break;
+    }
+
+    switch (stage) {
+    case BENCH_TSTAGE_2:
+        res->bytes_in = tbuf1.osk_size;
+        break;
+
+    case BENCH_TSTAGE_3:
+        res->bytes_in = tbuf2.osk_size;
+        break;
+
+    case BENCH_LEX:
+    case BENCH_TSTAGE_4:
+        res->bytes_in = tbuf4.osk_size;
+        break;
+
+    default:
+        res->bytes_in = corpus->osk_size;
+    }
+
+    qsort(times, reps, sizeof(double), bench_time_cmp);
+    res->best = times[0];
+    res->median = times[reps / 2];
+
+    src_locs_release(&locs);
+    src_toks_release(&toks);
+    osink_release(&tbuf1);
+    osink_release(&tbuf2);
+    osink_release(&tbuf3);
+    osink_release(&tbuf4);
+
+    return ret_val;
+}
+
+static void bench_result_print(struct osink *out, const struct bench_result *res)
+{
+    osink_printf(out, "{\"bytes_in\": %zu, \"best_s\": %.6f, \"median_s\": %.6f, "
+                 "\"mb_s\": %.1f, \"best_mb_s\": %.1f}",
+                 res->bytes_in, res->best, res->median,
+                 res->bytes_in / (res->median * 1e6), res->bytes_in / (res->best * 1e6));
+}
+
+static int bench_corpus_write(const char *dir, const char *name, const struct osink *corpus)
+{
+    char path[4096];
+    FILE *f;
+    size_t write_size;
+
+    snprintf(path, sizeof(path), "%s/%s.c", dir, name);
+
+    f = fopen(path, "wb");
+    if (!f) {
+        osink_err_printf(NULL, "**Error: Could not create corpus file: %s\n", path);
+        return -1;
+    }
+
+    write_size = fwrite(corpus->osk_buf, 1, corpus->osk_size, f);
+    if (fclose(f) || (write_size != corpus->osk_size)) {
+        osink_err_printf(NULL, "**Error: Could not write corpus file: %s\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static bool bench_corpus_selected(const char *list, const char *name)
+{
+    size_t name_len = strlen(name);
+    const char *item = list;
+
+    if (!list)
+        return true;
+
+    while (item) {
+        if (!strncmp(item, name, name_len) && ((item[name_len] == ',') || !item[name_len]))
+            return true;
+
+        item = strchr(item, ',');
+        if (item)
+            item++;
+    }
+
+    return false;
+}
+
+static void bench_usage(void)
+{
+    osink_printf(&osink_stdout,
+            "usage: gilcc_bench [OPTIONS]\n"
+            "\t-s N        - Size of every corpus in bytes (default: %d).\n"
+            "\t-r N        - Runs of every stage; the median is reported (default: %d).\n"
+            "\t-S SEED     - Corpora generator seed.\n"
+            "\t-c LIST     - Comma separated corpora to run (default: all).\n"
+            "\t-o FILE     - Write the JSON results to FILE (default: standard output).\n"
+            "\t-w DIR      - Write the corpora to DIR, rather than running them.\n"
+            "Corpora: code, comments, trigraphs, crlf, splices, long_line.\n",
+            BENCH_DEFAULT_SIZE, BENCH_DEFAULT_REPS);
+}
+
+int main(int argc, char **argv)
+{
+    struct osink discard;
+    struct osink out;
+    struct osink corpus;
+    size_t size = BENCH_DEFAULT_SIZE;
+    int reps = BENCH_DEFAULT_REPS;
+    uint64_t seed = BENCH_DEFAULT_SEED;
+    const char *list = NULL;
+    const char *out_path = NULL;
+    const char *corpora_dir = NULL;
+    bool first = true;
+    int ret_val = 0;
+    unsigned int i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:r:S:c:o:w:h")) != -1) {
+        switch (opt) {
+        case 's':
+            size = strtoull(optarg, NULL, 0);
+            break;
+
+        case 'r':
+            reps = atoi(optarg);
+            break;
+
+        case 'S':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+
+        case 'c':
+            list = optarg;
+            break;
+
+        case 'o':
+            out_path = optarg;
+            break;
+
+        case 'w':
+            corpora_dir = optarg;
+            break;
+
+        default:
+            bench_usage();
+            osink_release(&osink_stdout);
+            return (opt == 'h') ? 0 : 2;
+        }
+    }
+
+    if (!size || (reps < 1) || (reps > BENCH_REPS_MAX)) {
+        osink_err_printf(NULL, "**Error: invalid corpus size or number of runs.\n");
+        return 2;
+    }
+
+    osink_init_mem(&out);
+
+    /* Diagnostics are formatted, as in a real run, and dropped. */
+    osink_init_cb(&discard, bench_discard, NULL);
+    osink_set_cur(&discard);
+
+    osink_printf(&out, "{\n  \"version\": \"%.1f\",\n  \"simd\": \"%s\",\n"
+                 "  \"size\": %zu,\n  \"reps\": %d,\n  \"seed\": %llu,\n  \"corpora\": [",
+                 GILCC_VERSION, fscan_impl_name(), size, reps, (unsigned long long)seed);
+
+    for (i = 0; i < BENCH_CORPORA_NUM; i++) {
+        const struct bench_corpus *bc = &bench_corpora[i];
+        struct trans_config cfg = {
+            .std = C_STANDARD_C11_GNU,
+            .exp_trigraphs = bc->exp_trigraphs,
+            .exp_cpp_cmnts = true,
+            .last_phase = 4,
+        };
+        struct bench_result res;
+        int stage;
+
+        if (!bench_corpus_selected(list, bc->name))
+            continue;
+
+        if (bench_corpus_gen(bc, size, seed, &corpus)) {
+            osink_err_printf(NULL, "**Error: Could not generate corpus: %s\n", bc->name);
+            ret_val = 1;
+            break;
+        }
+
+        if (corpora_dir) {
+            if (bench_corpus_write(corpora_dir, bc->name, &corpus))
+                ret_val = 1;
+
+            osink_release(&corpus);
+            continue;
+        }
+
+        set_std_limits(&cfg.lim, cfg.std);
+
+        osink_printf(&out, "%s\n    {\n      \"name\": \"%s\",\n      \"bytes\": %zu,\n"
+                     "      \"stages\": {", first ? "" : ",", bc->name, corpus.osk_size);
+        first = false;
+
+        for (stage = 0; stage < BENCH_STAGES_NUM; stage++) {
+            if (bench_stage(stage, &corpus, &cfg, reps, &res) < 0) {
+                osink_err_printf(NULL, "**Error: stage %s failed on corpus: %s\n",
+                                 bench_stage_names[stage], bc->name);
+                ret_val = 1;
+            }
+
+            osink_printf(&out, "%s\n        \"%s\": ", stage ? "," : "", bench_stage_names[stage]);
+            bench_result_print(&out, &res);
+        }
+
+        osink_printf(&out, "\n      }\n    }");
+        osink_release(&corpus);
+    }
+
+    osink_printf(&out, "\n  ]\n}\n");
+
+    osink_set_cur(NULL);
+    osink_release(&discard);
+
+    if (!corpora_dir) {
+        struct osink file_out;
+        int fd = 1;
+
+        if (out_path) {
+            fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                osink_err_printf(NULL, "**Error: Could not create results file: %s\n", out_path);
+                osink_release(&out);
+                return 1;
+            }
+        }
+
+        osink_init_fd(&file_out, fd);
+        osink_write(&file_out, out.osk_buf, out.osk_size);
+        osink_release(&file_out);
+
+        if (out_path)
+            close(fd);
+    }
+
+    osink_release(&out);
+    osink_release(&osink_stdout);
+
+    return ret_val;
+}
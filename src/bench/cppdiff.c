@@ -0,0 +1,531 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+/* Differential harness against the system preprocessor.
+ *
+ * Runs gilcc and the system preprocessor on the same files, each as a
+ * process of its own, and reports the time and the peak memory of both as
+ * JSON. Their outputs are compared as well, once normalized, and the first
+ * divergence is reported.
+ *
+ * Phases 1-3 are compared with "cpp -fpreprocessed -dD", which only
+ * replaces comments, and phase 4 with "cpp -undef -nostdinc". The outputs
+ * are normalized alike: lines spliced, directive lines dropped, and white
+ * space runs made a single space.
+ *
+ * The preprocessor's warnings are turned off: it takes quadratic time to
+ * print them with the source lines, and they would be timed rather than the
+ * preprocessing itself.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "../out_sink.h"
+
+#define CPPDIFF_DEFAULT_REPS    3
+#define CPPDIFF_REPS_MAX        100
+#define CPPDIFF_FLAGS_MAX       64
+#define CPPDIFF_ARGS_MAX        (CPPDIFF_FLAGS_MAX + 16)
+
+/* Characters of either output shown, around a divergence */
+#define CPPDIFF_CONTEXT         16
+#define CPPDIFF_SNIPPET         64
+
+struct cppdiff_cfg {
+    const char *gilcc;
+    const char *cpp;
+    int reps;
+
+    /* Flags for both programs */
+    const char *flags[CPPDIFF_FLAGS_MAX];
+    int flags_num;
+
+    /* Files the outputs are written to */
+    char gilcc_out[64];
+    char cpp_out[64];
+};
+
+struct cppdiff_result {
+    double median;
+    long max_rss_kb;
+    int status;
+};
+
+static double cppdiff_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int cppdiff_time_cmp(const void *a, const void *b)
+{
+    double time_a = *(const double *)a;
+    double time_b = *(const double *)b;
+
+    return (time_a > time_b) - (time_a < time_b);
+}
+
+/* Runs argv once, with its standard output to out_path. Returns its exit
+ * status, or -1 if it could not be run.
+ */
+static int cppdiff_spawn(char *const argv[], const char *out_path, double *time, long *rss)
+{
+    struct rusage ru;
+    double start;
+    pid_t pid;
+    int status;
+    int fd;
+
+    start = cppdiff_now();
+
+    pid = fork();
+    if (pid < 0)
+        return -1;
+
+    if (!pid) {
+        fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if ((fd < 0) || (dup2(fd, 1) < 0))
+            _exit(127);
+
+        fd = open("/dev/null", O_WRONLY);
+        if (fd >= 0)
+            dup2(fd, 2);
+
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    if (wait4(pid, &status, 0, &ru) < 0)
+        return -1;
+
+    *time = cppdiff_now() - start;
+    *rss = ru.ru_maxrss;
+
+    if (!WIFEXITED(status) || (WEXITSTATUS(status) == 127))
+        return -1;
+
+    return WEXITSTATUS(status);
+}
+
+/* Runs argv reps times; the median time, and the peak memory of all runs */
+static int cppdiff_run(const struct cppdiff_cfg *cfg, char *const argv[], const char *out_path,
+                       struct cppdiff_result *res)
+{
+    double times[CPPDIFF_REPS_MAX];
+    long rss;
+    int i;
+
+    res->max_rss_kb = 0;
+
+    for (i = 0; i < cfg->reps; i++) {
+        res->status = cppdiff_spawn(argv, out_path, &times[i], &rss);
+        if (res->status < 0) {
+            osink_err_printf(NULL, "**Error: Could not run: %s\n", argv[0]);
+            return -1;
+        }
+
+        if (rss > res->max_rss_kb)
+            res->max_rss_kb = rss;
+    }
+
+    qsort(times, cfg->reps, sizeof(double), cppdiff_time_cmp);
+    res->median = times[cfg->reps / 2];
+
+    return 0;
+}
+
+static int cppdiff_read(const char *path, struct osink *buf)
+{
+    char chunk[64 * 1024];
+    ssize_t read_size;
+    int fd;
+
+    osink_init_mem(buf);
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    while ((read_size = read(fd, chunk, sizeof(chunk))) > 0)
+        osink_write(buf, chunk, read_size);
+
+    close(fd);
+
+    return ((read_size < 0) || buf->osk_err) ? -1 : 0;
+}
+
+/* Normalizes an output: lines spliced, directive lines dropped, and runs of
+ * white space (newlines included) made a single space.
+ */
+static void cppdiff_norm(struct osink *dst, const char *src, size_t size)
+{
+    bool bol = true;
+    bool dir = false;
+    bool space = false;
+    size_t i;
+    char c;
+
+    osink_init_mem(dst);
+
+    for (i = 0; i < size; i++) {
+        c = src[i];
+
+        if ((c == '\\') && (i + 1 < size) && (src[i + 1] == '\n')) {
+            i++;
+            continue;
+        }
+
+        if (c == '\n') {
+            bol = true;
+            dir = false;
+            space = true;
+            continue;
+        }
+
+        if (dir)
+            continue;
+
+        if (isspace((unsigned char)c)) {
+            space = true;
+            continue;
+        }
+
+        if (bol && (c == '#')) {
+            dir = true;
+            continue;
+        }
+
+        if (space && dst->osk_size)
+            osink_put_char(dst, ' ');
+
+        osink_put_char(dst, c);
+        bol = false;
+        space = false;
+    }
+}
+
+/* The text following the line marker, in the output of gilcc (NULL - none) */
+static const char *cppdiff_text(const struct osink *buf, const char *marker, size_t *size)
+{
+    size_t len = strlen(marker);
+    size_t i;
+
+    for (i = 0; i + len <= buf->osk_size; i++) {
+        if (((i == 0) || (buf->osk_buf[i - 1] == '\n')) &&
+                !memcmp(&buf->osk_buf[i], marker, len)) {
+            *size = buf->osk_size - i - len;
+            return &buf->osk_buf[i + len];
+        }
+    }
+
+    *size = 0;
+
+    return NULL;
+}
+
+static void cppdiff_result_print(struct osink *out, const char *name,
+                                 const struct cppdiff_result *res, size_t bytes)
+{
+    osink_printf(out, "\"%s\": {\"median_s\": %.6f, \"mb_s\": %.1f, \"max_rss_kb\": %ld, "
+                 "\"status\": %d}", name, res->median, bytes / (res->median * 1e6),
+                 res->max_rss_kb, res->status);
+}
+
+static void cppdiff_snippet(struct osink *out, const struct osink *text, size_t at)
+{
+    size_t start = (at > CPPDIFF_CONTEXT) ? (at - CPPDIFF_CONTEXT) : 0;
+    size_t size = text->osk_size - start;
+
+    if (size > CPPDIFF_SNIPPET)
+        size = CPPDIFF_SNIPPET;
+
+    osink_json_str(out, &text->osk_buf[start], size);
+}
+
+/* Compares one file, in one phase. Returns 1 if the outputs diverge. */
+static int cppdiff_file(const struct cppdiff_cfg *cfg, const char *path, int phase,
+                        struct osink *out, bool first)
+{
+    char *gilcc_argv[CPPDIFF_ARGS_MAX];
+    char *cpp_argv[CPPDIFF_ARGS_MAX];
+    char last_phase[32];
+    char marker[32];
+    struct cppdiff_result gilcc_res, cpp_res;
+    struct osink gilcc_text, cpp_text;
+    struct osink gilcc_norm, cpp_norm;
+    const char *text;
+    struct stat st;
+    size_t text_size;
+    size_t at;
+    int gilcc_argc = 0;
+    int cpp_argc = 0;
+    int ret_val = -1;
+    int i;
+
+    if (stat(path, &st)) {
+        osink_err_printf(NULL, "**Error: Could not open file: %s\n", path);
+        return -1;
+    }
+
+    snprintf(last_phase, sizeof(last_phase), "--last-phase=%d", phase);
+    snprintf(marker, sizeof(marker), "Stage %d output:\n", phase);
+
+    gilcc_argv[gilcc_argc++] = (char *)cfg->gilcc;
+    gilcc_argv[gilcc_argc++] = "-j";
+    gilcc_argv[gilcc_argc++] = "1";
+    gilcc_argv[gilcc_argc++] = last_phase;
+
+    cpp_argv[cpp_argc++] = (char *)cfg->cpp;
+    cpp_argv[cpp_argc++] = "-P";
+    cpp_argv[cpp_argc++] = "-w";
+    if (phase < 4) {
+        cpp_argv[cpp_argc++] = "-fpreprocessed";
+        cpp_argv[cpp_argc++] = "-dD";
+    } else {
+        cpp_argv[cpp_argc++] = "-undef";
+        cpp_argv[cpp_argc++] = "-nostdinc";
+    }
+
+    for (i = 0; i < cfg->flags_num; i++) {
+        gilcc_argv[gilcc_argc++] = (char *)cfg->flags[i];
+        cpp_argv[cpp_argc++] = (char *)cfg->flags[i];
+    }
+
+    gilcc_argv[gilcc_argc++] = (char *)path;
+    gilcc_argv[gilcc_argc] = NULL;
+    cpp_argv[cpp_argc++] = (char *)path;
+    cpp_argv[cpp_argc] = NULL;
+
+    if (cppdiff_run(cfg, gilcc_argv, cfg->gilcc_out, &gilcc_res) ||
+            cppdiff_run(cfg, cpp_argv, cfg->cpp_out, &cpp_res))
+        return -1;
+
+    if (cppdiff_read(cfg->gilcc_out, &gilcc_text) || cppdiff_read(cfg->cpp_out, &cpp_text)) {
+        osink_err_printf(NULL, "**Error: Could not read the outputs of: %s\n", path);
+        osink_release(&gilcc_text);
+        return -1;
+    }
+
+    /* The translation output follows the diagnostics. */
+    text = cppdiff_text(&gilcc_text, marker, &text_size);
+
+    cppdiff_norm(&gilcc_norm, text, text_size);
+    cppdiff_norm(&cpp_norm, cpp_text.osk_buf, cpp_text.osk_size);
+
+    for (at = 0; (at < gilcc_norm.osk_size) && (at < cpp_norm.osk_size); at++) {
+        if (gilcc_norm.osk_buf[at] != cpp_norm.osk_buf[at])
+            break;
+    }
+
+    osink_printf(out, "%s\n    {\n      \"file\": ", first ? "" : ",");
+    osink_json_str(out, path, strlen(path));
+    osink_printf(out, ",\n      \"phase\": %d,\n      \"bytes\": %lld,\n      ",
+                 phase, (long long)st.st_size);
+    cppdiff_result_print(out, "gilcc", &gilcc_res, st.st_size);
+    osink_printf(out, ",\n      ");
+    cppdiff_result_print(out, "cpp", &cpp_res, st.st_size);
+    osink_printf(out, ",\n      \"speedup\": %.2f,\n      \"rss_ratio\": %.2f,\n",
+                 cpp_res.median / gilcc_res.median,
+                 cpp_res.max_rss_kb ? ((double)gilcc_res.max_rss_kb / cpp_res.max_rss_kb) : 0.0);
+
+    if (!text || (at < gilcc_norm.osk_size) || (at < cpp_norm.osk_size)) {
+        osink_printf(out, "      \"diverges\": true,\n      \"diverge_at\": %zu,\n"
+                     "      \"gilcc_text\": ", at);
+        cppdiff_snippet(out, &gilcc_norm, at);
+        osink_printf(out, ",\n      \"cpp_text\": ");
+        cppdiff_snippet(out, &cpp_norm, at);
+        osink_printf(out, "\n    }");
+
+        osink_err_printf(NULL, "**Warning: %s (phase %d): outputs diverge at character %zu%s\n",
+                         path, phase, at, text ? "" : " (no gilcc output)");
+        ret_val = 1;
+    } else {
+        osink_printf(out, "      \"diverges\": false\n    }");
+        ret_val = 0;
+    }
+
+    osink_release(&gilcc_text);
+    osink_release(&cpp_text);
+    osink_release(&gilcc_norm);
+    osink_release(&cpp_norm);
+
+    return ret_val;
+}
+
+static void cppdiff_usage(void)
+{
+    osink_printf(&osink_stdout,
+            "usage: gilcc_cppdiff [OPTIONS] FILE...\n"
+            "\t-g PROG     - gilcc program to run (default: ./gilcc).\n"
+            "\t-p PROG     - System preprocessor to run (default: cpp).\n"
+            "\t-m LIST     - Comma separated phases to compare: 3 (comments\n"
+            "\t              replaced) and 4 (preprocessed) (default: 3,4).\n"
+            "\t-f FLAG     - Pass FLAG to both programs (-I, -D, -std=...).\n"
+            "\t-r N        - Runs of every program; the median is reported (default: %d).\n"
+            "\t-o FILE     - Write the JSON results to FILE (default: standard output).\n"
+            "Exits with 1 if any outputs diverge.\n",
+            CPPDIFF_DEFAULT_REPS);
+}
+
+int main(int argc, char **argv)
+{
+    struct cppdiff_cfg cfg = {
+        .gilcc = "./gilcc",
+        .cpp = "cpp",
+        .reps = CPPDIFF_DEFAULT_REPS,
+    };
+    struct osink file_out;
+    struct osink out;
+    const char *phases = "3,4";
+    const char *out_path = NULL;
+    const char *tmp_dir;
+    bool first = true;
+    int ret_val = 0;
+    int phase;
+    int opt;
+    int fd;
+    int r;
+    int i;
+
+    while ((opt = getopt(argc, argv, "g:p:m:f:r:o:h")) != -1) {
+        switch (opt) {
+        case 'g':
+            cfg.gilcc = optarg;
+            break;
+
+        case 'p':
+            cfg.cpp = optarg;
+            break;
+
+        case 'm':
+            phases = optarg;
+            break;
+
+        case 'f':
+            if (cfg.flags_num == CPPDIFF_FLAGS_MAX) {
+                osink_err_printf(NULL, "**Error: over %d flags.\n", CPPDIFF_FLAGS_MAX);
+                return 2;
+            }
+            cfg.flags[cfg.flags_num++] = optarg;
+            break;
+
+        case 'r':
+            cfg.reps = atoi(optarg);
+            break;
+
+        case 'o':
+            out_path = optarg;
+            break;
+
+        default:
+            cppdiff_usage();
+            osink_release(&osink_stdout);
+            return (opt == 'h') ? 0 : 2;
+        }
+    }
+
+    if ((optind == argc) || (cfg.reps < 1) || (cfg.reps > CPPDIFF_REPS_MAX)) {
+        cppdiff_usage();
+        osink_release(&osink_stdout);
+        return 2;
+    }
+
+    tmp_dir = getenv("TMPDIR");
+    if (!tmp_dir || (strlen(tmp_dir) > 32))
+        tmp_dir = "/tmp";
+
+    snprintf(cfg.gilcc_out, sizeof(cfg.gilcc_out), "%s/cppdiff.XXXXXX", tmp_dir);
+    snprintf(cfg.cpp_out, sizeof(cfg.cpp_out), "%s/cppdiff.XXXXXX", tmp_dir);
+
+    fd = mkstemp(cfg.gilcc_out);
+    if (fd >= 0) {
+        close(fd);
+        fd = mkstemp(cfg.cpp_out);
+    }
+
+    if (fd < 0) {
+        osink_err_printf(NULL, "**Error: Could not create output files in: %s\n", tmp_dir);
+        unlink(cfg.gilcc_out);
+        return 1;
+    }
+    close(fd);
+
+    osink_init_mem(&out);
+    osink_printf(&out, "{\n  \"gilcc\": ");
+    osink_json_str(&out, cfg.gilcc, strlen(cfg.gilcc));
+    osink_printf(&out, ",\n  \"cpp\": ");
+    osink_json_str(&out, cfg.cpp, strlen(cfg.cpp));
+    osink_printf(&out, ",\n  \"reps\": %d,\n  \"files\": [", cfg.reps);
+
+    for (i = optind; i < argc; i++) {
+        for (phase = 3; phase <= 4; phase++) {
+            if (!strchr(phases, '0' + phase))
+                continue;
+
+            r = cppdiff_file(&cfg, argv[i], phase, &out, first);
+            if (r < 0) {
+                osink_err_printf(NULL, "**Error: phase %d comparison failed on: %s\n",
+                                 phase, argv[i]);
+                ret_val = 1;
+                continue;
+            }
+
+            if (r)
+                ret_val = 1;
+            first = false;
+        }
+    }
+
+    osink_printf(&out, "\n  ]\n}\n");
+
+    unlink(cfg.gilcc_out);
+    unlink(cfg.cpp_out);
+
+    fd = 1;
+    if (out_path) {
+        fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            osink_err_printf(NULL, "**Error: Could not create results file: %s\n", out_path);
+            osink_release(&out);
+            return 1;
+        }
+    }
+
+    osink_init_fd(&file_out, fd);
+    osink_write(&file_out, out.osk_buf, out.osk_size);
+    osink_release(&file_out);
+
+    if (out_path)
+        close(fd);
+
+    osink_release(&out);
+    osink_release(&osink_stdout);
+
+    return ret_val;
+}
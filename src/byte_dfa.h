@@ -0,0 +1,119 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _BYTE_DFA_H__
+#define _BYTE_DFA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fast_scan.h"
+
+/* Byte-class DFA.
+ *
+ * Bytes are mapped to a small number of classes, and each state has a row
+ * of transitions, one per class. A transition holds the row of the next
+ * state (the state number times the number of classes, so it indexes the
+ * table as is) and an action number above it. Both tables are static,
+ * filled in at compile time.
+ *
+ * Running the DFA follows transitions with no action; the first one with
+ * an action stops it, and the caller carries it out. A byte costs two
+ * table lookups, and no branch on its value.
+ *
+ * A state looping over long runs (a comment body, say) may have the set of
+ * bytes leaving it; once it loops, the rest of the run is skipped by the
+ * fast scanner.
+ */
+
+#define BDFA_ACT_SHIFT      10
+#define BDFA_ROW_MASK       ((1 << BDFA_ACT_SHIFT) - 1)
+
+/* Transition to state (of a DFA of classes_num classes), taking action act
+ * (0 - none).
+ */
+#define BDFA_TRANS(STATE, CLASSES_NUM, ACT) \
+    ((uint16_t)(((ACT) << BDFA_ACT_SHIFT) | ((STATE) * (CLASSES_NUM))))
+
+#define BDFA_ACT(T) ((T) >> BDFA_ACT_SHIFT)
+#define BDFA_NEXT(T) ((T) & BDFA_ROW_MASK)
+
+struct byte_dfa {
+    /* Class of each byte value */
+    const uint8_t *bd_classes;
+
+    /* Transitions, a row of bd_classes_num per state */
+    const uint16_t *bd_trans;
+    unsigned int bd_classes_num;
+
+    /* Bytes leaving each state, by state number (NULL - no skipping at
+     * all, or in that state).
+     */
+    const struct fscan_set *const *bd_skips;
+};
+
+/* Runs the DFA over data, from row *row, up to the first byte whose
+ * transition has an action. Returns the number of bytes consumed before it
+ * (size if none), leaving *row at the state reached and *act_trans at the
+ * transition of that byte.
+ */
+static inline size_t bdfa_run(const struct byte_dfa *dfa, unsigned int *row,
+                              uint16_t *act_trans, const char *data, size_t size)
+{
+    const uint8_t *classes = dfa->bd_classes;
+    const uint16_t *trans = dfa->bd_trans;
+    const struct fscan_set *skip;
+    unsigned int cur = *row;
+    uint16_t t = 0;
+    size_t i = 0;
+
+    if (!dfa->bd_skips) {
+        for (; i < size; i++) {
+            t = trans[cur + classes[(unsigned char)data[i]]];
+            if (t > BDFA_ROW_MASK)
+                break;
+            cur = t;
+        }
+
+        *row = cur;
+        *act_trans = t;
+        return i;
+    }
+
+    skip = dfa->bd_skips[cur / dfa->bd_classes_num];
+
+    while (i < size) {
+        t = trans[cur + classes[(unsigned char)data[i]]];
+        if (t > BDFA_ROW_MASK)
+            break;
+
+        i++;
+        if (t != cur) {
+            cur = t;
+            skip = dfa->bd_skips[cur / dfa->bd_classes_num];
+        } else if (skip) {
+            /* Staying: the rest of the run at once */
+            i += fscan_span(&data[i], size - i, skip);
+        }
+    }
+
+    *row = cur;
+    *act_trans = t;
+
+    return i;
+}
+
+#endif /* _BYTE_DFA_H__ */
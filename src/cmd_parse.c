@@ -0,0 +1,771 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "gilcc.h"
+#include "cmd_parse.h"
+#include "analysis_print.h"
+#include "out_sink.h"
+#include "thread_pool.h"
+
+static void print_usage(void)
+{
+    osink_printf(osink_cur(),
+            "usage: gilcc [OPTIONS] [Input files]\n"
+            "GilCC options:\n"
+            "\t-h, --help           - Print this help menu and quit.\n"
+            "\t-v, --version        - Print program version and quit.\n"
+            "\t-j N, --jobs=N       - Analyze up to N files in parallel\n"
+            "\t                       (default: number of CPUs).\n"
+            "\t--files-from=FILE    - Read input file names from FILE, one per\n"
+            "\t                       line ('-' for standard input).\n"
+            "\t@FILE                - Read command-line options from FILE.\n"
+            "\t-                    - Analyze the source on standard input. Like\n"
+            "\t                       any source, it's held in memory in full.\n"
+            "\t--assume-filename=NAME - Name of the source on standard input,\n"
+            "\t                       in diagnostics and for the headers it\n"
+            "\t                       includes (default: <stdin>).\n"
+            "\t--src-exts=LIST      - Comma separated extensions of the source\n"
+            "\t                       files to analyze in input directories.\n"
+            "\t--cache-dir=DIR      - Keep analysis results in DIR, and reuse them\n"
+            "\t                       for unchanged files (or $GILCC_CACHE_DIR).\n"
+            "\t--cache-size=N[KMG]  - Cache size cap (default: 256M).\n"
+            "\t--cache-evict=POLICY - Cache eviction policy: lru (default) or fifo.\n"
+            "\t--diag-format=FMT    - Diagnostics format: text (default), jsonl\n"
+            "\t                       (JSON Lines) or sarif. Only the text format\n"
+            "\t                       carries the translation output.\n"
+            "\t--count-only         - Only count the diagnostics.\n"
+            "\t--stats[=FORMAT]     - Report time, bytes and events per translation\n"
+            "\t                       phase, per file and in total (text or json).\n"
+            "\t--stats-file=FILE    - Write the statistics report to FILE rather\n"
+            "\t                       than to standard error.\n"
+            "\t--server=SOCKET      - Run as a resident server, analyzing the\n"
+            "\t                       requests of clients on Unix socket SOCKET.\n"
+            "\t--connect=SOCKET     - Have the server on SOCKET do the analysis.\n"
+            "\t--inline=FILE        - With --connect: send the contents of FILE\n"
+            "\t                       to the server, rather than its name.\n"
+            "\t--last-phase=N       - Last translation phase to run: 3 (comments\n"
+            "\t                       replaced, default) or 4 (preprocessed).\n"
+            "GCC compatible options:\n"
+            "\tMost GCC compatible flags, which influence the way source files\n"
+            "\tare parsed by GCC.\n"
+            "*Unknown flags will be ignored.\n");
+}
+
+static void print_version(void)
+{
+    osink_printf(osink_cur(), "gilcc - Gil's Code Cleanup, version %.1f\n", GILCC_VERSION);
+}
+
+/* Path resolved against the base directory; paths are kept resolved. */
+static char *opts_path(const struct gilcc_opts *opts, const char *path)
+{
+    const char *base_dir = opts->cfg.base_dir;
+    size_t base_len;
+    size_t path_len;
+    char *res;
+
+    if (!base_dir || (path[0] == '/'))
+        return strdup(path);
+
+    base_len = strlen(base_dir);
+    path_len = strlen(path);
+
+    res = (char *)malloc(base_len + path_len + 2);
+    if (!res)
+        return NULL;
+
+    memcpy(res, base_dir, base_len);
+    res[base_len] = '/';
+    memcpy(&res[base_len + 1], path, path_len + 1);
+
+    return res;
+}
+
+int gilcc_opts_add_src(struct gilcc_opts *opts, const char *src)
+{
+    if (opts->srcs_num == opts->srcs_cap) {
+        int new_cap = opts->srcs_cap ? (opts->srcs_cap << 1) : GILCC_SRCS_INIT_NUM;
+        char **new_srcs;
+
+        new_srcs = (char **)realloc(opts->srcs, sizeof(char *) * new_cap);
+        if (!new_srcs)
+            return -1;
+
+        opts->srcs = new_srcs;
+        opts->srcs_cap = new_cap;
+    }
+
+    opts->srcs[opts->srcs_num] = opts_path(opts, src);
+    if (!opts->srcs[opts->srcs_num])
+        return -1;
+
+    opts->srcs_num++;
+
+    return 0;
+}
+
+static void srcs_clear(struct gilcc_opts *opts)
+{
+    while (opts->srcs_num)
+        free(opts->srcs[--opts->srcs_num]);
+
+    opts->stdin_src = false;
+}
+
+static int srcs_add_from(struct gilcc_opts *opts, const char *list)
+{
+    FILE *f;
+    char *path = NULL;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    int ret_val = 0;
+
+    /* The list is read line by line, it may be arbitrarily long. Its paths
+     * are all kept before the analysis starts, though: the run sizes its
+     * jobs, and the order of the results, by the inputs given.
+     */
+    if (!strcmp(list, "-")) {
+        f = stdin;
+    } else {
+        path = opts_path(opts, list);
+        f = path ? fopen(path, "r") : NULL;
+        free(path);
+    }
+
+    if (!f) {
+        osink_err_printf(NULL, "**Error: Could not open file list: %s.\n", list);
+        return -1;
+    }
+
+    while ((len = getline(&line, &line_cap, f)) > 0) {
+        while (len && ((line[len - 1] == '\n') || (line[len - 1] == '\r')))
+            line[--len] = '\0';
+
+        if (!len)
+            continue;
+
+        if (gilcc_opts_add_src(opts, line) < 0) {
+            osink_err_printf(NULL, "**Error: too many input files.\n");
+            ret_val = -1;
+            break;
+        }
+    }
+
+    free(line);
+
+    if (f != stdin)
+        fclose(f);
+
+    return ret_val;
+}
+
+int cmd_args_add(struct cmd_args *args, char *arg)
+{
+    if (args->argc == args->cap) {
+        int new_cap = args->cap ? (args->cap << 1) : 16;
+        char **new_argv;
+
+        new_argv = (char **)realloc(args->argv, sizeof(char *) * new_cap);
+        if (!new_argv)
+            return -1;
+
+        args->argv = new_argv;
+        args->cap = new_cap;
+    }
+
+    args->argv[args->argc++] = arg;
+
+    return 0;
+}
+
+static int rsp_file_expand(struct cmd_args *args, FILE *f, int nst_lvl)
+{
+    char *tok = NULL;
+    size_t tok_len = 0;
+    size_t tok_cap = 0;
+    bool in_tok = false;
+    char quote = '\0';
+    int c;
+
+    /* GCC style response file: white-space separated arguments, which may
+     * be quoted with '' or "", and may escape any character with '\'.
+     */
+    for (;;) {
+        c = getc(f);
+
+        if ((c == EOF) || (!quote && ((c == ' ') || (c == '\t') ||
+                                      (c == '\n') || (c == '\r')))) {
+            if (in_tok) {
+                tok[tok_len] = '\0';
+                if (cmd_args_expand(args, tok, nst_lvl) < 0)
+                    return -1;
+
+                tok = NULL;
+                tok_len = 0;
+                tok_cap = 0;
+                in_tok = false;
+            }
+
+            if (c == EOF)
+                break;
+
+            continue;
+        }
+
+        in_tok = true;
+
+        if (c == '\\') {
+            c = getc(f);
+            if (c == EOF)
+                continue;
+
+        } else if (quote && (c == quote)) {
+            quote = '\0';
+            continue;
+
+        } else if (!quote && ((c == '\'') || (c == '\"'))) {
+            quote = c;
+            continue;
+        }
+
+        if (tok_len + 1 >= tok_cap) {
+            size_t new_cap = tok_cap ? (tok_cap << 1) : 32;
+            char *new_tok = (char *)realloc(tok, new_cap);
+
+            if (!new_tok) {
+                free(tok);
+                return -1;
+            }
+
+            tok = new_tok;
+            tok_cap = new_cap;
+        }
+
+        tok[tok_len++] = c;
+    }
+
+    return 0;
+}
+
+int cmd_args_expand(struct cmd_args *args, char *arg, int nst_lvl)
+{
+    FILE *f;
+    int ret_val;
+
+    /* The arguments list takes ownership of arg.
+     * Like GCC, an unreadable response file is kept as a plain argument.
+     */
+    if ((arg[0] != '@') || !(f = fopen(arg + 1, "r")))
+        return cmd_args_add(args, arg);
+
+    if (nst_lvl >= GILCC_RSP_FILE_NST_LVL) {
+        osink_err_printf(NULL, "**Error: response files nested too deeply: %s.\n", arg);
+        fclose(f);
+        return -1;
+    }
+
+    ret_val = rsp_file_expand(args, f, nst_lvl + 1);
+    fclose(f);
+    free(arg);
+
+    return ret_val;
+}
+
+void cmd_args_release(struct cmd_args *args)
+{
+    int i;
+
+    for (i = 0; i < args->argc; i++)
+        free(args->argv[i]);
+
+    free(args->argv);
+    args->argv = NULL;
+    args->argc = 0;
+    args->cap = 0;
+}
+
+static int pre_parse_cmd(struct gilcc_opts *opts, int argc, char** argv)
+{
+    struct trans_config *cfg = &opts->cfg;
+    char *cmd;
+    int f_indx = 1;
+    char *std_name = NULL;
+    int std_indx = -1;
+
+    /* We count the number of include-path and macro definition parameters,
+     * and allocate a buffer for storring them in proper order.
+     * We also determin the standard to be used, before we parse all the other
+     * flags.
+     */
+
+    while (argc) {
+        cmd = argv[0];
+
+        if (cmd[0] == '-') {
+
+            if (!strncmp(cmd, "-D", 2)) {
+                opts->defs_num++;
+
+            } else if (!strncmp(cmd, "-I", 2)) {
+                opts->ipaths_num++;
+
+            } else if ( !strcmp(cmd, "-ansi") ||
+                        !strncmp(cmd, "-std=", 5)) {
+
+                int i;
+
+                for (i = 0; i < STD_SUPPORTED_NUM; i++) {
+
+                    int j = 0;
+
+                    while (std_configs[i].cli_flags[j]) {
+                        if (!strcmp(cmd, std_configs[i].cli_flags[j])) {
+                            if (cfg->std)
+                                aprint_report(APRINT_R_CLI_STD_MULTIPLE, 0, 0,
+                                              f_indx, cmd, std_indx, std_name);
+
+                            if (cfg->std < std_configs[i].std) {
+                                cfg->std = std_configs[i].std;
+                                cfg->exp_trigraphs = std_configs[i].exp_trigraphs;
+                                cfg->exp_cpp_cmnts = std_configs[i].exp_cpp_cmnts;
+                            }
+
+                            std_name = cmd;
+                            std_indx = f_indx;
+
+                            i = STD_SUPPORTED_NUM;
+                            break;
+                        }
+
+                        j++;
+                    }
+                }
+            }
+        }
+
+        argc--;
+        argv++;
+        f_indx++;
+    }
+
+    if (opts->ipaths_num) {
+        opts->ipaths = (char **)calloc(opts->ipaths_num, sizeof(char *));
+        if (!opts->ipaths)
+            return -1;
+    }
+
+    if (opts->defs_num) {
+        opts->defs = (char **)malloc(sizeof(char *) * opts->defs_num);
+        if (!opts->defs)
+            return -1;
+    }
+
+    /* This is the defautl standard if none is provided */
+    if (!cfg->std) {
+        cfg->std = C_STANDARD_C11_GNU;
+        cfg->exp_cpp_cmnts = true;
+        cfg->exp_trigraphs = false;
+    }
+
+    /* TODO: print working standard by referencing std struct */
+
+    return 0;
+}
+
+static int parse_jobs_num(struct gilcc_opts *opts, const char *param)
+{
+    char *end;
+    long num;
+
+    num = strtol(param, &end, 10);
+    if (*end || (num < 1) || (num > TPOOL_WORKERS_MAX)) {
+        osink_err_printf(NULL, "**Error: invalid number of jobs: %s.\n", param);
+        return -1;
+    }
+
+    opts->jobs_num = num;
+
+    return 0;
+}
+
+static int parse_cache_size(struct gilcc_opts *opts, const char *param)
+{
+    unsigned long long size;
+    char *end;
+
+    size = strtoull(param, &end, 10);
+
+    switch (*end) {
+    case 'G':
+    case 'g':
+        size <<= 10;
+        /* fall through */
+    case 'M':
+    case 'm':
+        size <<= 10;
+        /* fall through */
+    case 'K':
+    case 'k':
+        size <<= 10;
+        end++;
+        /* fall through */
+    case '\0':
+        break;
+
+    default:
+        size = 0;
+    }
+
+    if (*end || !size) {
+        osink_err_printf(NULL, "**Error: invalid cache size: %s.\n", param);
+        return -1;
+    }
+
+    opts->cache_size_max = size;
+
+    return 0;
+}
+
+static int parse_cmd(struct gilcc_opts *opts, int argc, char** argv)
+{
+    struct trans_config *cfg = &opts->cfg;
+    char *cmd;
+    int ipath_cntr = 0;
+    int defs_cntr = 0;
+    int f_indx = 1;
+    int trigraphs_flg = 0;
+    bool stdin_list = false;
+
+    while (argc) {
+        cmd = argv[0];
+
+        if (!strcmp(cmd, "-")) {
+            /* The source on standard input */
+
+            if (opts->stdin_src) {
+                osink_err_printf(NULL, "**Error: standard input given more than once.\n");
+                return -1;
+            }
+
+            opts->stdin_src = true;
+            opts->stdin_indx = opts->srcs_num;
+
+        } else if (cmd[0] == '-') {
+            /* Probably a flag. */
+
+            if (!strcmp(cmd, "-h") || !strcmp(cmd, "--help")) {
+                print_usage();
+                srcs_clear(opts);
+                return 0;
+
+            } else if (!strcmp(cmd, "-v") || !strcmp(cmd, "--version")) {
+                print_version();
+                srcs_clear(opts);
+                return 0;
+
+            } else if (!strncmp(cmd, "--cache-dir=", 12)) {
+                free(opts->cache_dir);
+                opts->cache_dir = opts_path(opts, cmd + 12);
+                if (!opts->cache_dir)
+                    return -1;
+
+            } else if (!strncmp(cmd, "--cache-size=", 13)) {
+                if (parse_cache_size(opts, cmd + 13) < 0)
+                    return -1;
+
+            } else if (!strncmp(cmd, "--cache-evict=", 14)) {
+                if (!strcmp(cmd + 14, "lru")) {
+                    opts->cache_evict = RCACHE_EVICT_LRU;
+                } else if (!strcmp(cmd + 14, "fifo")) {
+                    opts->cache_evict = RCACHE_EVICT_FIFO;
+                } else {
+                    osink_err_printf(NULL, "**Error: unknown cache eviction policy: %s.\n", cmd + 14);
+                    return -1;
+                }
+
+            } else if (!strcmp(cmd, "--stats") || !strcmp(cmd, "--stats=text")) {
+                opts->stats = GILCC_STATS_TEXT;
+
+            } else if (!strcmp(cmd, "--stats=json")) {
+                opts->stats = GILCC_STATS_JSON;
+
+            } else if (!strncmp(cmd, "--stats-file=", 13)) {
+                free(opts->stats_file);
+                opts->stats_file = opts_path(opts, cmd + 13);
+                if (!opts->stats_file)
+                    return -1;
+
+            } else if (!strncmp(cmd, "--src-exts=", 11)) {
+                opts->src_exts = cmd + 11;
+
+            } else if (!strncmp(cmd, "--inline=", 9)) {
+                /* Only makes a difference with a server. */
+                if (gilcc_opts_add_src(opts, cmd + 9) < 0) {
+                    osink_err_printf(NULL, "**Error: too many input files.\n");
+                    return -1;
+                }
+
+            } else if (!strncmp(cmd, "--last-phase=", 13)) {
+                if (!strcmp(cmd + 13, "3")) {
+                    cfg->last_phase = 3;
+                } else if (!strcmp(cmd + 13, "4")) {
+                    cfg->last_phase = 4;
+                } else {
+                    osink_err_printf(NULL, "**Error: invalid last translation phase: %s.\n", cmd + 13);
+                    return -1;
+                }
+
+            } else if (!strncmp(cmd, "--files-from=", 13)) {
+                if (srcs_add_from(opts, cmd + 13) < 0)
+                    return -1;
+
+                if (!strcmp(cmd + 13, "-"))
+                    stdin_list = true;
+
+            } else if (!strncmp(cmd, "--assume-filename=", 18)) {
+                free(opts->stdin_name);
+                opts->stdin_name = opts_path(opts, cmd + 18);
+                if (!opts->stdin_name)
+                    return -1;
+
+            } else if (!strcmp(cmd, "-trigraphs")) {
+
+                if (cfg->exp_trigraphs)
+                    if (trigraphs_flg)
+                        aprint_report(APRINT_R_CLI_FLAG_DUPLICATE, 0, 0, f_indx, cmd);
+                    else
+                        aprint_report(APRINT_R_CLI_TRIGRAPHS_ALLOWED, 0, 0, f_indx, cmd);
+                else
+                    cfg->exp_trigraphs = true;
+
+                trigraphs_flg++;
+
+            } else if (!strncmp(cmd, "--jobs=", 7)) {
+                if (parse_jobs_num(opts, cmd + 7) < 0)
+                    return -1;
+
+            } else if (!strncmp(cmd, "-j", 2)) {
+                if (strlen(cmd) > 2) {
+                    if (parse_jobs_num(opts, cmd + 2) < 0)
+                        return -1;
+
+                } else {
+                    if (argc == 1) {
+                        osink_err_printf(NULL, "**Error: missing jobs number parameter.\n");
+                        return -1;
+                    }
+
+                    argc--;
+                    argv++;
+                    if (parse_jobs_num(opts, argv[0]) < 0)
+                        return -1;
+                }
+
+            } else if (!strncmp(cmd, "-D", 2)) {
+                if (defs_cntr >= opts->defs_num) {
+                    osink_err_printf(NULL, "**Error: too many defines.\n");
+                    return -1;
+                }
+
+                if (strlen(cmd) > 2) {
+                    opts->defs[defs_cntr++] = (cmd + 2);
+                } else {
+                    if (argc == 1) {
+                        osink_err_printf(NULL, "**Error: missing define parameter.\n");
+                        return -1;
+                    }
+
+                    argc--;
+                    argv++;
+                    opts->defs[defs_cntr++] = argv[0];
+                }
+
+            } else if (!strncmp(cmd, "-I", 2)) {
+                if (ipath_cntr >= opts->ipaths_num) {
+                    osink_err_printf(NULL, "**Error: too many defines.\n");
+                    return -1;
+                }
+
+                if (strlen(cmd) > 2) {
+                    opts->ipaths[ipath_cntr] = opts_path(opts, cmd + 2);
+
+                } else {
+                    if (argc == 1) {
+                        osink_err_printf(NULL, "**Error: missing include path parameter.\n");
+                        return -1;
+                    }
+
+                    argc--;
+                    argv++;
+                    opts->ipaths[ipath_cntr] = opts_path(opts, argv[0]);
+                }
+
+                if (!opts->ipaths[ipath_cntr++])
+                    return -1;
+            }
+
+            /* Unmatched flags will be ignored. */
+
+        } else {
+            /* Probably a file. */
+
+            if (gilcc_opts_add_src(opts, cmd) < 0) {
+                osink_err_printf(NULL, "**Error: too many input files.\n");
+                return -1;
+            }
+        }
+
+        argc--;
+        argv++;
+        f_indx++;
+    }
+
+    if (opts->stdin_src && stdin_list) {
+        osink_err_printf(NULL, "**Error: standard input is both a source and a file list.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+void gilcc_opts_init(struct gilcc_opts *opts)
+{
+    memset(opts, 0, sizeof(struct gilcc_opts));
+
+    opts->cache_size_max = RCACHE_DEFAULT_SIZE_MAX;
+    opts->cache_evict = RCACHE_EVICT_LRU;
+    opts->cfg.last_phase = 3;
+}
+
+static int parse_diag_fmt(struct gilcc_opts *opts, int argc, char **argv)
+{
+    const char *fmt;
+    int i;
+
+    /* The format applies to the diagnostics of the command-line as well,
+     * so it's looked for first.
+     */
+    for (i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "--count-only")) {
+            opts->diag_fmt = APRINT_FMT_COUNT;
+
+        } else if (!strncmp(argv[i], "--diag-format=", 14)) {
+            fmt = argv[i] + 14;
+
+            if (!strcmp(fmt, "text")) {
+                opts->diag_fmt = APRINT_FMT_TEXT;
+            } else if (!strcmp(fmt, "jsonl")) {
+                opts->diag_fmt = APRINT_FMT_JSONL;
+            } else if (!strcmp(fmt, "sarif")) {
+                opts->diag_fmt = APRINT_FMT_SARIF;
+            } else {
+                osink_err_printf(NULL, "**Error: unknown diagnostics format: %s.\n", fmt);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int gilcc_opts_parse(struct gilcc_opts *opts, int argc, char **argv)
+{
+    struct aprint_buf *prev_diags = aprint_cur();
+    struct aprint_emit emit;
+    int ret_val = -1;
+    int i,j;
+
+    opts->args_num = argc;
+
+    if (parse_diag_fmt(opts, argc, argv) < 0)
+        return -1;
+
+    /* Text diagnostics are printed as they come, the others are emitted
+     * along with the analysis results.
+     */
+    if (opts->diag_fmt != APRINT_FMT_TEXT)
+        aprint_set_cur(&opts->diags);
+
+    if (pre_parse_cmd(opts, argc, argv) < 0)
+        goto out;
+
+    if (parse_cmd(opts, argc, argv) < 0)
+        /* Something went wrong during CLI command parsing. */
+        goto out;
+
+    /* Check duplications in command-line arguments */
+    if (opts->ipaths_num) {
+        for (i = 0; i < (opts->ipaths_num - 1); i++) {
+            for (j = i + 1; j < opts->ipaths_num; j++) {
+                if (!strcmp(opts->ipaths[i], opts->ipaths[j]))
+                    aprint_report(APRINT_R_CLI_IPATH_DUPLICATE, 0, 0, opts->ipaths[i]);
+            }
+        }
+    }
+
+    if (opts->defs_num) {
+        for (i = 0; i < (opts->defs_num - 1); i++) {
+            for (j = i + 1; j < opts->defs_num; j++) {
+                if (!strcmp(opts->defs[i], opts->defs[j]))
+                    aprint_report(APRINT_R_CLI_DEF_DUPLICATE, 0, 0, opts->defs[i]);
+            }
+        }
+    }
+
+    /* TODO: check environment variables (relevant to compiler) */
+
+    opts->cfg.ipaths = opts->ipaths;
+    opts->cfg.ipaths_num = opts->ipaths_num;
+    opts->cfg.defs = opts->defs;
+    opts->cfg.defs_num = opts->defs_num;
+
+    ret_val = 0;
+
+out:
+    aprint_set_cur(prev_diags);
+
+    if (ret_val && opts->diags.apb_num) {
+        /* There will be no analysis run to emit them. */
+        aprint_emit_init(&emit, APRINT_FMT_TEXT, osink_cur());
+        aprint_emit_buf(&emit, &opts->diags, NULL);
+        aprint_emit_end(&emit);
+    }
+
+    return ret_val;
+}
+
+void gilcc_opts_release(struct gilcc_opts *opts)
+{
+    int i;
+
+    for (i = 0; opts->ipaths && (i < opts->ipaths_num); i++)
+        free(opts->ipaths[i]);
+
+    free(opts->ipaths);
+    free(opts->defs);
+    free(opts->cache_dir);
+    free(opts->stats_file);
+    free(opts->stdin_name);
+    aprint_buf_release(&opts->diags);
+
+    srcs_clear(opts);
+    free(opts->srcs);
+}
@@ -0,0 +1,97 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _CMD_PARSE_H__
+#define _CMD_PARSE_H__
+
+#include <stdbool.h>
+
+#include "std_comp.h"
+#include "result_cache.h"
+#include "analysis_print.h"
+
+/* Statistics report formats */
+enum gilcc_stats {
+    GILCC_STATS_NONE,
+    GILCC_STATS_TEXT,
+    GILCC_STATS_JSON,
+};
+
+/* Command-line arguments, after expanding response files */
+struct cmd_args {
+    char **argv;
+    int argc;
+    int cap;
+};
+
+/* Options of a single analysis run, as given on the command-line */
+struct gilcc_opts {
+    struct trans_config cfg;
+
+    /* Number of command-line arguments */
+    int args_num;
+
+    char **srcs;
+    int srcs_num;
+    int srcs_cap;
+
+    /* Standard input is a source too ("-"), analyzed in its place among
+     * srcs, and under the name given (NULL - "<stdin>").
+     */
+    bool stdin_src;
+    int stdin_indx;
+    char *stdin_name;
+
+    char **ipaths;
+    int ipaths_num;
+
+    char **defs;
+    int defs_num;
+
+    /* Number of files analyzed in parallel (0 - number of CPUs) */
+    unsigned int jobs_num;
+
+    /* Source file extensions to look for in directories (NULL - defaults) */
+    char *src_exts;
+
+    /* Result cache configurations (no directory - no cache) */
+    char *cache_dir;
+    unsigned long long cache_size_max;
+    enum rcache_evict cache_evict;
+
+    /* Diagnostics output format, and the command-line's own diagnostics
+     * (collected for formats other than text).
+     */
+    enum analysis_print_fmt diag_fmt;
+    struct aprint_buf diags;
+
+    /* Statistics report, and where it goes (NULL - standard error) */
+    enum gilcc_stats stats;
+    char *stats_file;
+};
+
+/* Command-line Arguments API */
+int cmd_args_add(struct cmd_args *args, char *arg);
+int cmd_args_expand(struct cmd_args *args, char *arg, int nst_lvl);
+void cmd_args_release(struct cmd_args *args);
+
+/* Options API */
+void gilcc_opts_init(struct gilcc_opts *opts);
+int gilcc_opts_add_src(struct gilcc_opts *opts, const char *src);
+int gilcc_opts_parse(struct gilcc_opts *opts, int argc, char **argv);
+void gilcc_opts_release(struct gilcc_opts *opts);
+
+#endif /* _CMD_PARSE_H__ */
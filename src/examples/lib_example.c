@@ -0,0 +1,143 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+/* libgilcc example.
+ *
+ * Reads a source file into memory and analyzes it through the library
+ * alone: its diagnostics are printed as "file:line:col: type: message
+ * [rule]" and the output of the last phase follows them.
+ *
+ *   lib_example [-std=STD] [-4] FILE
+ *
+ * Built against libgilcc.a and libgilcc.h only, as a program of its own
+ * would be.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libgilcc.h"
+
+static const char *example_types[] = {
+    [GILCC_DIAG_INFO] = "info",
+    [GILCC_DIAG_WARNING] = "warning",
+    [GILCC_DIAG_ERROR] = "error",
+};
+
+static void example_diag(void *user_ctx, const struct gilcc_diag *diag)
+{
+    const char *path = (const char *)user_ctx;
+
+    printf("%s:%u:%u: %s: %s [%s]\n", path, diag->gd_line, diag->gd_col,
+           example_types[diag->gd_type], diag->gd_msg, diag->gd_rule);
+}
+
+static int example_out(void *user_ctx, const char *data, size_t size)
+{
+    (void)user_ctx;
+
+    return (fwrite(data, 1, size, stdout) == size) ? 0 : -1;
+}
+
+/* The whole file at path, in a buffer of its own (NULL - failed) */
+static char *example_read(const char *path, size_t *size)
+{
+    char *data = NULL;
+    char *new_data;
+    size_t cap = 0;
+    size_t read_size;
+    FILE *f;
+
+    f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+
+    *size = 0;
+    do {
+        if (*size == cap) {
+            cap = cap ? (cap << 1) : 4096;
+            new_data = (char *)realloc(data, cap);
+            if (!new_data) {
+                free(data);
+                fclose(f);
+                return NULL;
+            }
+            data = new_data;
+        }
+
+        read_size = fread(&data[*size], 1, cap - *size, f);
+        *size += read_size;
+    } while (read_size);
+
+    if (ferror(f)) {
+        free(data);
+        data = NULL;
+    }
+
+    fclose(f);
+
+    return data;
+}
+
+int main(int argc, char **argv)
+{
+    struct gilcc_config *cfg;
+    const char *std = NULL;
+    const char *path = NULL;
+    unsigned int phase = 3;
+    char *data;
+    size_t size;
+    int ret_val;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "-std=", 5))
+            std = argv[i] + 5;
+        else if (!strcmp(argv[i], "-4"))
+            phase = 4;
+        else
+            path = argv[i];
+    }
+
+    if (!path) {
+        fprintf(stderr, "usage: lib_example [-std=STD] [-4] FILE\n");
+        return 2;
+    }
+
+    cfg = gilcc_config_create(std);
+    if (!cfg || gilcc_config_set_last_phase(cfg, phase)) {
+        fprintf(stderr, "**Error: unknown standard: %s\n", std);
+        gilcc_config_free(cfg);
+        return 2;
+    }
+
+    data = example_read(path, &size);
+    if (!data) {
+        fprintf(stderr, "**Error: Could not read file: %s\n", path);
+        gilcc_config_free(cfg);
+        return 1;
+    }
+
+    ret_val = gilcc_analyze_buffer(data, size, cfg, example_diag, example_out, (void *)path);
+    if (ret_val < 0)
+        fprintf(stderr, "**Error: analysis failed: %s\n", path);
+
+    free(data);
+    gilcc_config_free(cfg);
+
+    return (ret_val == 0) ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FSCAN_X86
+#include <immintrin.h>
+#endif
+
+#include "fast_scan.h"
+
+struct fscan_impl {
+    const char *name;
+    size_t (*span)(const char *data, size_t size, const struct fscan_set *set);
+};
+
+static size_t fscan_span_scalar(const char *data, size_t size, const struct fscan_set *set)
+{
+    const unsigned char s0 = set->fs_stop[0];
+    const unsigned char s1 = set->fs_stop[1];
+    const unsigned char s2 = set->fs_stop[2];
+    const unsigned char s3 = set->fs_stop[3];
+    const unsigned char s4 = set->fs_stop[4];
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if ((p[i] == s0) || (p[i] == s1) || (p[i] == s2) || (p[i] == s3) ||
+            (p[i] == s4))
+            break;
+    }
+
+    return i;
+}
+
+#ifdef FSCAN_X86
+
+__attribute__((target("sse2")))
+static size_t fscan_span_sse2(const char *data, size_t size, const struct fscan_set *set)
+{
+    const __m128i s0 = _mm_set1_epi8((char)set->fs_stop[0]);
+    const __m128i s1 = _mm_set1_epi8((char)set->fs_stop[1]);
+    const __m128i s2 = _mm_set1_epi8((char)set->fs_stop[2]);
+    const __m128i s3 = _mm_set1_epi8((char)set->fs_stop[3]);
+    const __m128i s4 = _mm_set1_epi8((char)set->fs_stop[4]);
+    size_t i;
+
+    for (i = 0; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&data[i]);
+        __m128i m = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, s0), _mm_cmpeq_epi8(v, s1)),
+                _mm_or_si128(_mm_cmpeq_epi8(v, s2), _mm_cmpeq_epi8(v, s3)));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, s4));
+        unsigned int mask = _mm_movemask_epi8(m);
+
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + fscan_span_scalar(&data[i], size - i, set);
+}
+
+__attribute__((target("avx2")))
+static size_t fscan_span_avx2(const char *data, size_t size, const struct fscan_set *set)
+{
+    const __m256i s0 = _mm256_set1_epi8((char)set->fs_stop[0]);
+    const __m256i s1 = _mm256_set1_epi8((char)set->fs_stop[1]);
+    const __m256i s2 = _mm256_set1_epi8((char)set->fs_stop[2]);
+    const __m256i s3 = _mm256_set1_epi8((char)set->fs_stop[3]);
+    const __m256i s4 = _mm256_set1_epi8((char)set->fs_stop[4]);
+    size_t i;
+
+    for (i = 0; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&data[i]);
+        __m256i m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, s0), _mm256_cmpeq_epi8(v, s1)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, s2), _mm256_cmpeq_epi8(v, s3)));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, s4));
+        unsigned int mask = _mm256_movemask_epi8(m);
+
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + fscan_span_sse2(&data[i], size - i, set);
+}
+
+#endif /* FSCAN_X86 */
+
+static const struct fscan_impl fscan_impls[] = {
+#ifdef FSCAN_X86
+    { "avx2", fscan_span_avx2 },
+    { "sse2", fscan_span_sse2 },
+#endif
+    { "scalar", fscan_span_scalar },
+};
+
+#define FSCAN_IMPLS_NUM (sizeof(fscan_impls) / sizeof(fscan_impls[0]))
+
+static const struct fscan_impl *fscan_select(void)
+{
+    static const struct fscan_impl *impl;
+    unsigned int i = FSCAN_IMPLS_NUM - 1;
+
+    /* Selection is idempotent, so racing threads agree on the result. */
+    if (__atomic_load_n(&impl, __ATOMIC_RELAXED))
+        return impl;
+
+    if (!getenv("GILCC_NO_SIMD")) {
+#ifdef FSCAN_X86
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2"))
+            i = 0;
+        else if (__builtin_cpu_supports("sse2"))
+            i = 1;
+#endif
+    }
+
+    __atomic_store_n(&impl, &fscan_impls[i], __ATOMIC_RELAXED);
+
+    return &fscan_impls[i];
+}
+
+size_t fscan_span(const char *data, size_t size, const struct fscan_set *set)
+{
+    return fscan_select()->span(data, size, set);
+}
+
+const char *fscan_impl_name(void)
+{
+    return fscan_select()->name;
+}
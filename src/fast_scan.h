@@ -0,0 +1,52 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _FAST_SCAN_H__
+#define _FAST_SCAN_H__
+
+#include <stddef.h>
+
+/* Fast scanning of "plain" byte runs.
+ *
+ * The translation phases only act on a handful of byte values. The scanners
+ * below find the next byte out of a small stop-set using SSE2/AVX2 strides
+ * where the CPU supports them, and a scalar loop otherwise. The
+ * implementation is selected on first use; setting GILCC_NO_SIMD in the
+ * environment forces the scalar one.
+ */
+
+#define FSCAN_SET_MAX   5
+
+struct fscan_set {
+    /* Stop bytes, unused slots repeat one of the used ones. */
+    unsigned char fs_stop[FSCAN_SET_MAX];
+};
+
+#define FSCAN_SET_1(A)              { .fs_stop = { (A), (A), (A), (A), (A) } }
+#define FSCAN_SET_2(A, B)           { .fs_stop = { (A), (B), (B), (B), (B) } }
+#define FSCAN_SET_3(A, B, C)        { .fs_stop = { (A), (B), (C), (C), (C) } }
+#define FSCAN_SET_4(A, B, C, D)     { .fs_stop = { (A), (B), (C), (D), (D) } }
+#define FSCAN_SET_5(A, B, C, D, E)  { .fs_stop = { (A), (B), (C), (D), (E) } }
+
+/* Fast Scan API */
+
+/* Length of the leading run of data holding none of the set's stop bytes. */
+size_t fscan_span(const char *data, size_t size, const struct fscan_set *set);
+
+/* Name of the selected implementation ("avx2", "sse2" or "scalar"). */
+const char *fscan_impl_name(void);
+
+#endif /* _FAST_SCAN_H__ */
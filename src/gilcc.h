@@ -21,6 +21,7 @@
 
 /* General configurations */
 #define GILCC_DEFAULT_VERBOSITY_LEVEL   1
-#define GILCC_SRCS_MAX_NUM              20
+#define GILCC_SRCS_INIT_NUM             64
+#define GILCC_RSP_FILE_NST_LVL          16
 
 #endif /* _GILCC_H__ */
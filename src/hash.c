@@ -0,0 +1,119 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <string.h>
+
+#include "hash.h"
+
+#define HASH_P1 11400714785074694791ULL
+#define HASH_P2 14029467366897019727ULL
+#define HASH_P3 1609587929392839161ULL
+#define HASH_P4 9650029242287828579ULL
+#define HASH_P5 2870177450012600261ULL
+
+static inline uint64_t hash_rotl(uint64_t v, int r)
+{
+    return (v << r) | (v >> (64 - r));
+}
+
+static inline uint64_t hash_read64(const unsigned char *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static inline uint32_t hash_read32(const unsigned char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t v)
+{
+    acc += v * HASH_P2;
+    acc = hash_rotl(acc, 31);
+
+    return acc * HASH_P1;
+}
+
+static inline uint64_t hash_merge(uint64_t h, uint64_t v)
+{
+    h ^= hash_round(0, v);
+
+    return h * HASH_P1 + HASH_P4;
+}
+
+uint64_t hash64(const void *data, size_t size, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + HASH_P1 + HASH_P2;
+        uint64_t v2 = seed + HASH_P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - HASH_P1;
+
+        do {
+            v1 = hash_round(v1, hash_read64(p));
+            v2 = hash_round(v2, hash_read64(p + 8));
+            v3 = hash_round(v3, hash_read64(p + 16));
+            v4 = hash_round(v4, hash_read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+
+        h = hash_rotl(v1, 1) + hash_rotl(v2, 7) + hash_rotl(v3, 12) + hash_rotl(v4, 18);
+        h = hash_merge(h, v1);
+        h = hash_merge(h, v2);
+        h = hash_merge(h, v3);
+        h = hash_merge(h, v4);
+    } else {
+        h = seed + HASH_P5;
+    }
+
+    h += size;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= hash_round(0, hash_read64(p));
+        h = hash_rotl(h, 27) * HASH_P1 + HASH_P4;
+    }
+
+    if (p + 4 <= end) {
+        h ^= (uint64_t)hash_read32(p) * HASH_P1;
+        h = hash_rotl(h, 23) * HASH_P2 + HASH_P3;
+        p += 4;
+    }
+
+    for (; p < end; p++) {
+        h ^= (*p) * HASH_P5;
+        h = hash_rotl(h, 11) * HASH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= HASH_P2;
+    h ^= h >> 29;
+    h *= HASH_P3;
+    h ^= h >> 32;
+
+    return h;
+}
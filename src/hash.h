@@ -0,0 +1,28 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _HASH_H__
+#define _HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hash API */
+
+/* 64-bit non-cryptographic hash (XXH64 construction) */
+uint64_t hash64(const void *data, size_t size, uint64_t seed);
+
+#endif /* _HASH_H__ */
@@ -0,0 +1,187 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libgilcc.h"
+#include "std_comp.h"
+#include "analysis_print.h"
+#include "src_parser.h"
+#include "src_input.h"
+#include "src_loc.h"
+#include "src_pp.h"
+#include "out_sink.h"
+
+struct gilcc_config {
+    struct trans_config gc_cfg;
+};
+
+/* The caller's diagnostic callback, behind the emitter's */
+struct gilcc_diag_cb {
+    gilcc_diag_fn fn;
+    void *user_ctx;
+};
+
+static const enum gilcc_diag_type gilcc_diag_types[APRINT_TYPES_NUM] = {
+    [APRINT_INFO] = GILCC_DIAG_INFO,
+    [APRINT_WARNING] = GILCC_DIAG_WARNING,
+    [APRINT_ERROR] = GILCC_DIAG_ERROR,
+};
+
+/* Standard named as by "-std=", in std_configs (-1 - none) */
+static int gilcc_std_find(const char *std)
+{
+    const char *flag;
+    int i, j;
+
+    for (i = 0; i < STD_SUPPORTED_NUM; i++) {
+        for (j = 0; std_configs[i].cli_flags[j]; j++) {
+            flag = std_configs[i].cli_flags[j];
+            if (!strncmp(flag, "-std=", 5) && !strcmp(flag + 5, std))
+                return i;
+        }
+    }
+
+    return -1;
+}
+
+struct gilcc_config *gilcc_config_create(const char *std)
+{
+    struct gilcc_config *cfg;
+    int i;
+
+    if (std) {
+        i = gilcc_std_find(std);
+    } else {
+        for (i = 0; i < STD_SUPPORTED_NUM; i++)
+            if (std_configs[i].std == C_STANDARD_C11_GNU)
+                break;
+    }
+
+    if ((i < 0) || (i == STD_SUPPORTED_NUM))
+        return NULL;
+
+    cfg = (struct gilcc_config *)calloc(1, sizeof(struct gilcc_config));
+    if (!cfg)
+        return NULL;
+
+    cfg->gc_cfg.std = std_configs[i].std;
+    cfg->gc_cfg.exp_trigraphs = std_configs[i].exp_trigraphs;
+    cfg->gc_cfg.exp_cpp_cmnts = std_configs[i].exp_cpp_cmnts;
+    cfg->gc_cfg.last_phase = 3;
+
+    if (set_std_limits(&cfg->gc_cfg.lim, cfg->gc_cfg.std)) {
+        free(cfg);
+        return NULL;
+    }
+
+    return cfg;
+}
+
+void gilcc_config_free(struct gilcc_config *cfg)
+{
+    free(cfg);
+}
+
+int gilcc_config_set_last_phase(struct gilcc_config *cfg, unsigned int phase)
+{
+    if ((phase != 3) && (phase != 4))
+        return -1;
+
+    cfg->gc_cfg.last_phase = phase;
+
+    return 0;
+}
+
+static void gilcc_diag_hand(void *ctx, const struct aprint_diag *diag)
+{
+    struct gilcc_diag_cb *cb = (struct gilcc_diag_cb *)ctx;
+    struct gilcc_diag gd = {
+        .gd_rule = diag->apd_rule,
+        .gd_type = gilcc_diag_types[diag->apd_type],
+        .gd_file = diag->apd_file,
+        .gd_line = diag->apd_line,
+        .gd_col = diag->apd_col,
+        .gd_msg = diag->apd_msg,
+    };
+
+    cb->fn(cb->user_ctx, &gd);
+}
+
+int gilcc_analyze_buffer(const char *data, size_t len, const struct gilcc_config *config,
+                         gilcc_diag_fn diag_fn, gilcc_out_fn out_fn, void *user_ctx)
+{
+    const struct trans_config *cfg = &config->gc_cfg;
+    struct gilcc_diag_cb cb = {
+        .fn = diag_fn,
+        .user_ctx = user_ctx,
+    };
+    struct aprint_buf *prev_diags = aprint_cur();
+    unsigned long diags = analysis_print_diags();
+    struct aprint_buf diags_buf;
+    struct aprint_emit emit;
+    struct src_input src_in;
+    struct src_locs locs;
+    struct osink tbuf3, tbuf4;
+    const struct osink *res = &tbuf3;
+    int ret_val;
+
+    osink_init_mem(&tbuf3);
+    osink_init_mem(&tbuf4);
+    src_locs_init(&locs);
+
+    /* The diagnostics are collected, and handed over once done. */
+    aprint_buf_init(&diags_buf);
+    aprint_set_cur(&diags_buf);
+
+    src_input_open_mem(&src_in, data, len);
+
+    ret_val = src_parser_phases(&src_in, cfg, &tbuf3, &locs, NULL);
+
+    /* With no header cache to keep across calls */
+    if ((ret_val >= 0) && (cfg->last_phase >= 4)) {
+        ret_val = pp_run(&tbuf4, &tbuf3, GILCC_BUFFER_NAME, &locs, cfg, NULL, NULL, NULL);
+        res = &tbuf4;
+    } else if (ret_val >= 0) {
+        ret_val = pp_check(&tbuf3, GILCC_BUFFER_NAME, &locs, cfg);
+    }
+
+    src_input_close(&src_in);
+    aprint_set_cur(prev_diags);
+
+    if (diag_fn) {
+        aprint_emit_init_cb(&emit, gilcc_diag_hand, &cb);
+        aprint_emit_buf(&emit, &diags_buf, GILCC_BUFFER_NAME);
+        aprint_emit_end(&emit);
+    }
+
+    if ((ret_val >= 0) && res->osk_err)
+        ret_val = -1;
+
+    if ((ret_val >= 0) && out_fn && out_fn(user_ctx, res->osk_buf, res->osk_size))
+        ret_val = -1;
+
+    if (ret_val >= 0)
+        ret_val = analysis_print_diags() - diags;
+
+    aprint_buf_release(&diags_buf);
+    src_locs_release(&locs);
+    osink_release(&tbuf3);
+    osink_release(&tbuf4);
+
+    return ret_val;
+}
@@ -0,0 +1,91 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _LIBGILCC_H__
+#define _LIBGILCC_H__
+
+#include <stddef.h>
+
+/* gilcc library.
+ *
+ * Analyzes sources held in memory, in the calling thread: the caller's
+ * buffer is read where it is, neither copied nor modified, and the
+ * diagnostics and the output of the last phase are handed to callbacks.
+ * Calls on separate threads are independent.
+ *
+ * This header is all there is to the interface: the settings are opaque,
+ * and none of the program's own headers are needed.
+ */
+
+/* Name of the buffer, in diagnostics and for including headers relative
+ * to it.
+ */
+#define GILCC_BUFFER_NAME   "<buffer>"
+
+/* Analysis settings */
+struct gilcc_config;
+
+enum gilcc_diag_type {
+    GILCC_DIAG_INFO,
+    GILCC_DIAG_WARNING,
+    GILCC_DIAG_ERROR,
+};
+
+/* A diagnostic, valid during the callback only */
+struct gilcc_diag {
+    /* Name of the rule reported (as in the SARIF output) */
+    const char *gd_rule;
+    enum gilcc_diag_type gd_type;
+    const char *gd_file;
+
+    /* Position in the source (0 - none) */
+    unsigned int gd_line;
+    unsigned int gd_col;
+
+    const char *gd_msg;
+};
+
+/* Diagnostic callback, called for each diagnostic in turn. */
+typedef void (*gilcc_diag_fn)(void *user_ctx, const struct gilcc_diag *diag);
+
+/* Translation output callback: the whole output at once, valid during the
+ * call only. Returns non-zero to fail the analysis.
+ */
+typedef int (*gilcc_out_fn)(void *user_ctx, const char *data, size_t size);
+
+/* gilcc library API */
+
+/* Creates settings for standard std, named as -std= names it ("c99",
+ * "gnu11"...; NULL - the default, gnu11), running up to phase 3 as the
+ * command-line does. Returns NULL for an unknown standard, or with no
+ * memory.
+ */
+struct gilcc_config *gilcc_config_create(const char *std);
+void gilcc_config_free(struct gilcc_config *cfg);
+
+/* Sets the last translation phase run: 3 (comments replaced) or 4
+ * (preprocessed). Returns -1 for any other.
+ */
+int gilcc_config_set_last_phase(struct gilcc_config *cfg, unsigned int phase);
+
+/* Analyzes the len bytes at data. Either callback may be NULL.
+ *
+ * Returns the number of warnings and errors, or -1 if the analysis failed.
+ */
+int gilcc_analyze_buffer(const char *data, size_t len, const struct gilcc_config *cfg,
+                         gilcc_diag_fn diag_fn, gilcc_out_fn out_fn, void *user_ctx);
+
+#endif /* _LIBGILCC_H__ */
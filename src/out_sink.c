@@ -0,0 +1,290 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#include "out_sink.h"
+
+struct osink osink_stdout = {
+    .osk_type = OSINK_FD,
+    .osk_fd = STDOUT_FILENO,
+};
+
+struct osink osink_stderr = {
+    .osk_type = OSINK_FD,
+    .osk_fd = STDERR_FILENO,
+};
+
+static __thread struct osink *cur_sink;
+static __thread struct osink *cur_err_sink;
+
+/* Serializes error messages, which may come from any thread. */
+static pthread_mutex_t err_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct osink *osink_cur(void)
+{
+    return cur_sink ? cur_sink : &osink_stdout;
+}
+
+void osink_set_cur(struct osink *sink)
+{
+    cur_sink = sink;
+}
+
+struct osink *osink_cur_err(void)
+{
+    return cur_err_sink ? cur_err_sink : &osink_stderr;
+}
+
+void osink_set_cur_err(struct osink *sink)
+{
+    cur_err_sink = sink;
+}
+
+void osink_init_fd(struct osink *sink, int fd)
+{
+    sink->osk_type = OSINK_FD;
+    sink->osk_fd = fd;
+    sink->osk_flush_fn = NULL;
+    sink->osk_ctx = NULL;
+    sink->osk_buf = NULL;
+    sink->osk_size = 0;
+    sink->osk_cap = 0;
+    sink->osk_err = false;
+}
+
+void osink_init_mem(struct osink *sink)
+{
+    osink_init_fd(sink, -1);
+    sink->osk_type = OSINK_MEM;
+}
+
+void osink_init_cb(struct osink *sink, osink_flush_fn fn, void *ctx)
+{
+    osink_init_fd(sink, -1);
+    sink->osk_type = OSINK_CB;
+    sink->osk_flush_fn = fn;
+    sink->osk_ctx = ctx;
+}
+
+static int osink_drain(struct osink *sink, const char *data, size_t size)
+{
+    ssize_t write_size;
+
+    if (sink->osk_type == OSINK_CB) {
+        if (sink->osk_flush_fn(sink->osk_ctx, data, size)) {
+            sink->osk_err = true;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    while (size) {
+        write_size = write(sink->osk_fd, data, size);
+        if (write_size < 0) {
+            if (errno == EINTR)
+                continue;
+
+            sink->osk_err = true;
+            return -1;
+        }
+
+        data += write_size;
+        size -= write_size;
+    }
+
+    return 0;
+}
+
+/* Writes str as a quoted and escaped JSON string. */
+int osink_json_str(struct osink *sink, const char *str, size_t size)
+{
+    size_t run = 0;
+    size_t i;
+
+    osink_put_char(sink, '\"');
+
+    for (i = 0; i < size; i++) {
+        unsigned char c = str[i];
+
+        if ((c >= 0x20) && (c != '\"') && (c != '\\'))
+            continue;
+
+        osink_write(sink, &str[run], i - run);
+        run = i + 1;
+
+        if (c >= 0x20)
+            osink_printf(sink, "\\%c", c);
+        else
+            osink_printf(sink, "\\u%04x", c);
+    }
+
+    osink_write(sink, &str[run], size - run);
+    osink_put_char(sink, '\"');
+
+    return sink->osk_err ? -1 : 0;
+}
+
+int osink_flush(struct osink *sink)
+{
+    if ((sink->osk_type == OSINK_MEM) || !sink->osk_size)
+        return 0;
+
+    if (osink_drain(sink, sink->osk_buf, sink->osk_size))
+        return -1;
+
+    sink->osk_size = 0;
+
+    return 0;
+}
+
+int osink_make_room(struct osink *sink, size_t size)
+{
+    size_t new_cap;
+    char *new_buf;
+
+    if (sink->osk_cap - sink->osk_size >= size)
+        return 0;
+
+    if (sink->osk_type != OSINK_MEM) {
+        if (osink_flush(sink))
+            return -1;
+
+        if (sink->osk_cap >= size)
+            return 0;
+
+        new_cap = OSINK_FD_BUF_SIZE;
+    } else {
+        new_cap = sink->osk_cap ? sink->osk_cap : OSINK_MEM_INIT_SIZE;
+    }
+
+    while (new_cap - sink->osk_size < size)
+        new_cap <<= 1;
+
+    new_buf = (char *)realloc(sink->osk_buf, new_cap);
+    if (!new_buf) {
+        sink->osk_err = true;
+        return -1;
+    }
+
+    sink->osk_buf = new_buf;
+    sink->osk_cap = new_cap;
+
+    return 0;
+}
+
+int osink_write(struct osink *sink, const char *data, size_t size)
+{
+    /* Large writes to a file descriptor are not worth copying. */
+    if ((sink->osk_type != OSINK_MEM) && (size >= OSINK_FD_BUF_SIZE)) {
+        if (osink_flush(sink) || osink_drain(sink, data, size))
+            return -1;
+
+        return size;
+    }
+
+    if (osink_make_room(sink, size))
+        return -1;
+
+    memcpy(&sink->osk_buf[sink->osk_size], data, size);
+    sink->osk_size += size;
+
+    return size;
+}
+
+int osink_printf(struct osink *sink, const char *fmt, ...)
+{
+    va_list args;
+    char *dst = sink->osk_buf ? &sink->osk_buf[sink->osk_size] : NULL;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(dst, sink->osk_cap - sink->osk_size, fmt, args);
+    va_end(args);
+
+    if (len < 0) {
+        sink->osk_err = true;
+        return -1;
+    }
+
+    if ((size_t)len >= sink->osk_cap - sink->osk_size) {
+        if (osink_make_room(sink, len + 1))
+            return -1;
+
+        va_start(args, fmt);
+        vsnprintf(&sink->osk_buf[sink->osk_size], sink->osk_cap - sink->osk_size, fmt, args);
+        va_end(args);
+    }
+
+    sink->osk_size += len;
+
+    return len;
+}
+
+void osink_release(struct osink *sink)
+{
+    osink_flush(sink);
+    free(sink->osk_buf);
+
+    sink->osk_buf = NULL;
+    sink->osk_size = 0;
+    sink->osk_cap = 0;
+}
+
+int osink_err_printf(struct osink *sink, const char *fmt, ...)
+{
+    char msg_buf[512];
+    char *msg = msg_buf;
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(msg, sizeof(msg_buf), fmt, args);
+    va_end(args);
+
+    if (len < 0)
+        return -1;
+
+    if ((size_t)len >= sizeof(msg_buf)) {
+        msg = (char *)malloc(len + 1);
+        if (!msg)
+            return -1;
+
+        va_start(args, fmt);
+        vsnprintf(msg, len + 1, fmt, args);
+        va_end(args);
+    }
+
+    if (!sink)
+        sink = osink_cur_err();
+
+    pthread_mutex_lock(&err_lock);
+    osink_write(sink, msg, len);
+    osink_flush(sink);
+    pthread_mutex_unlock(&err_lock);
+
+    if (msg != msg_buf)
+        free(msg);
+
+    return len;
+}
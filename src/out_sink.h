@@ -0,0 +1,101 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _OUT_SINK_H__
+#define _OUT_SINK_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Buffer size of sinks writing to a file descriptor */
+#define OSINK_FD_BUF_SIZE       (64 * 1024)
+
+/* Initial buffer size of sinks collecting output in memory */
+#define OSINK_MEM_INIT_SIZE     4096
+
+enum osink_type {
+    OSINK_FD,
+    OSINK_MEM,
+    OSINK_CB,
+};
+
+typedef int (*osink_flush_fn)(void *ctx, const char *data, size_t size);
+
+/* Output sink:
+ *  - OSINK_FD sinks buffer the output and write it to a file descriptor
+ *    whenever the buffer fills up, or when explicitly flushed.
+ *  - OSINK_MEM sinks keep growing their buffer, and hold the complete
+ *    output in osk_buf/osk_size.
+ *  - OSINK_CB sinks buffer like OSINK_FD sinks, but hand the output to a
+ *    callback instead of writing it.
+ */
+struct osink {
+    enum osink_type osk_type;
+    int osk_fd;
+
+    osink_flush_fn osk_flush_fn;
+    void *osk_ctx;
+
+    char *osk_buf;
+    size_t osk_size;
+    size_t osk_cap;
+
+    /* Set on the first failed allocation or write. */
+    bool osk_err;
+};
+
+/* Standard output and error of the program */
+extern struct osink osink_stdout;
+extern struct osink osink_stderr;
+
+/* Per-thread output: analysis results of the calling thread go to the sink
+ * set by osink_set_cur(), or to osink_stdout if none is set. Errors go to
+ * the sink set by osink_set_cur_err(), or to osink_stderr.
+ */
+struct osink *osink_cur(void);
+void osink_set_cur(struct osink *sink);
+struct osink *osink_cur_err(void);
+void osink_set_cur_err(struct osink *sink);
+
+/* Output Sink API */
+void osink_init_fd(struct osink *sink, int fd);
+void osink_init_mem(struct osink *sink);
+void osink_init_cb(struct osink *sink, osink_flush_fn fn, void *ctx);
+int osink_make_room(struct osink *sink, size_t size);
+int osink_write(struct osink *sink, const char *data, size_t size);
+int osink_printf(struct osink *sink, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+int osink_json_str(struct osink *sink, const char *str, size_t size);
+int osink_flush(struct osink *sink);
+void osink_release(struct osink *sink);
+
+/* Print an error message to sink (NULL - the thread's error sink) right
+ * away. Safe to call on a sink shared between threads.
+ */
+int osink_err_printf(struct osink *sink, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static inline int osink_put_char(struct osink *sink, const char c)
+{
+    if ((sink->osk_size == sink->osk_cap) && osink_make_room(sink, 1))
+        return -1;
+
+    sink->osk_buf[sink->osk_size++] = c;
+
+    return 1;
+}
+
+#endif /* _OUT_SINK_H__ */
@@ -0,0 +1,395 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "gilcc.h"
+#include "hash.h"
+#include "result_cache.h"
+
+/* Entry files start with a magic, followed by the cached results. The magic
+ * carries the entry format version; bump it when the results change shape.
+ */
+#define RCACHE_MAGIC        "GILCCRC3"
+#define RCACHE_MAGIC_SIZE   8
+#define RCACHE_SUFFIX       ".gcr"
+
+/* Entry file name: 32 hex digits, suffix and a terminating null. */
+#define RCACHE_NAME_SIZE    (32 + sizeof(RCACHE_SUFFIX))
+
+/* Holds the size cap the cache was last trimmed to (not an entry name). */
+#define RCACHE_CAP_NAME     "size-max"
+
+struct rcache_entry {
+    char name[RCACHE_NAME_SIZE];
+    off_t size;
+    time_t mtime;
+};
+
+static int rcache_mkdir(char *dir)
+{
+    char *sep = dir;
+
+    /* mkdir -p */
+    while ((sep = strchr(sep + 1, '/'))) {
+        *sep = '\0';
+        if (mkdir(dir, 0755) && (errno != EEXIST)) {
+            *sep = '/';
+            return -1;
+        }
+        *sep = '/';
+    }
+
+    if (mkdir(dir, 0755) && (errno != EEXIST))
+        return -1;
+
+    return 0;
+}
+
+int rcache_init(struct rcache *rc, const char *dir, unsigned long long size_max,
+                enum rcache_evict evict, const struct trans_config *cfg)
+{
+    struct osink cfg_buf;
+    int i;
+
+    memset(rc, 0, sizeof(struct rcache));
+
+    rc->rc_dir = strdup(dir);
+    if (!rc->rc_dir)
+        return -1;
+
+    if (rcache_mkdir(rc->rc_dir)) {
+        osink_err_printf(NULL, "**Error: Could not create cache directory: %s\n", dir);
+        free(rc->rc_dir);
+        return -1;
+    }
+
+    rc->rc_size_max = size_max;
+    rc->rc_evict = evict;
+
+    /* Everything in the configuration which changes the results. */
+    osink_init_mem(&cfg_buf);
+    osink_printf(&cfg_buf, "%s %.1f %lu %d %d %u", RCACHE_MAGIC, GILCC_VERSION,
+                 cfg->std, cfg->exp_trigraphs, cfg->exp_cpp_cmnts, cfg->last_phase);
+    osink_write(&cfg_buf, (const char *)&cfg->lim, sizeof(struct std_trans_lim));
+
+    for (i = 0; i < cfg->ipaths_num; i++)
+        osink_printf(&cfg_buf, " -I%s", cfg->ipaths[i]);
+
+    for (i = 0; i < cfg->defs_num; i++)
+        osink_printf(&cfg_buf, " -D%s", cfg->defs[i]);
+
+    /* The paths in the results are shown relative to it. */
+    if (cfg->base_dir)
+        osink_printf(&cfg_buf, " -C%s", cfg->base_dir);
+
+    if (cfg_buf.osk_err) {
+        osink_release(&cfg_buf);
+        free(rc->rc_dir);
+        return -1;
+    }
+
+    rc->rc_cfg_seed = hash64(cfg_buf.osk_buf, cfg_buf.osk_size, 0);
+    osink_release(&cfg_buf);
+
+    return 0;
+}
+
+void rcache_key(const struct rcache *rc, const char *name, const char *data, size_t size,
+                struct rcache_key *key)
+{
+    uint64_t seed = rc->rc_cfg_seed;
+
+    /* Quoted includes are looked for next to the file, and __FILE__ spells
+     * its name.
+     */
+    if (name)
+        seed = hash64(name, strlen(name), seed);
+
+    key->rck_hash[0] = hash64(data, size, seed);
+    key->rck_hash[1] = hash64(data, size, ~seed);
+}
+
+static void rcache_entry_path(const struct rcache *rc, const struct rcache_key *key,
+                              char *path, size_t path_size)
+{
+    snprintf(path, path_size, "%s/%016llx%016llx" RCACHE_SUFFIX, rc->rc_dir,
+             (unsigned long long)key->rck_hash[0], (unsigned long long)key->rck_hash[1]);
+}
+
+int rcache_load(struct rcache *rc, const struct rcache_key *key, struct osink *out)
+{
+    size_t path_size = strlen(rc->rc_dir) + RCACHE_NAME_SIZE + 1;
+    char magic[RCACHE_MAGIC_SIZE];
+    size_t out_size = out->osk_size;
+    struct stat st;
+    ssize_t read_size;
+    off_t left;
+    char *path;
+    int fd;
+
+    path = (char *)malloc(path_size);
+    if (!path)
+        return -1;
+
+    rcache_entry_path(rc, key, path, path_size);
+    fd = open(path, O_RDONLY);
+    free(path);
+
+    if (fd == -1)
+        goto miss;
+
+    if (fstat(fd, &st) || (st.st_size < RCACHE_MAGIC_SIZE) ||
+            (read(fd, magic, RCACHE_MAGIC_SIZE) != RCACHE_MAGIC_SIZE) ||
+            memcmp(magic, RCACHE_MAGIC, RCACHE_MAGIC_SIZE))
+        goto miss_close;
+
+    left = st.st_size - RCACHE_MAGIC_SIZE;
+    if (osink_make_room(out, left))
+        goto miss_close;
+
+    while (left) {
+        read_size = read(fd, &out->osk_buf[out->osk_size], left);
+        if (read_size <= 0) {
+            if ((read_size < 0) && (errno == EINTR))
+                continue;
+
+            /* Entry was cut short (trimmed by someone else?) */
+            out->osk_size = out_size;
+            goto miss_close;
+        }
+
+        out->osk_size += read_size;
+        left -= read_size;
+    }
+
+    /* Refresh the entry's age */
+    if (rc->rc_evict == RCACHE_EVICT_LRU)
+        futimens(fd, NULL);
+
+    close(fd);
+    __atomic_add_fetch(&rc->rc_hits, 1, __ATOMIC_RELAXED);
+
+    return 0;
+
+miss_close:
+    close(fd);
+miss:
+    __atomic_add_fetch(&rc->rc_misses, 1, __ATOMIC_RELAXED);
+
+    return -1;
+}
+
+void rcache_reject(struct rcache *rc)
+{
+    __atomic_sub_fetch(&rc->rc_hits, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&rc->rc_misses, 1, __ATOMIC_RELAXED);
+}
+
+int rcache_store(struct rcache *rc, const struct rcache_key *key, const char *data, size_t size)
+{
+    size_t path_size = strlen(rc->rc_dir) + RCACHE_NAME_SIZE + 64;
+    struct osink entry;
+    char *path, *tmp_path;
+    int ret_val = -1;
+    int fd;
+
+    path = (char *)malloc(path_size);
+    tmp_path = (char *)malloc(path_size);
+    if (!path || !tmp_path)
+        goto out;
+
+    rcache_entry_path(rc, key, path, path_size);
+
+    /* Unique within the cache users: process and thread. */
+    snprintf(tmp_path, path_size, "%s.%ld.%lx.tmp", path,
+             (long)getpid(), (unsigned long)pthread_self());
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        goto out;
+
+    osink_init_fd(&entry, fd);
+    osink_write(&entry, RCACHE_MAGIC, RCACHE_MAGIC_SIZE);
+    osink_write(&entry, data, size);
+    osink_release(&entry);
+
+    if (close(fd) || entry.osk_err || rename(tmp_path, path)) {
+        unlink(tmp_path);
+        goto out;
+    }
+
+    __atomic_add_fetch(&rc->rc_stores, 1, __ATOMIC_RELAXED);
+    ret_val = 0;
+
+out:
+    free(path);
+    free(tmp_path);
+
+    return ret_val;
+}
+
+static int rcache_entry_cmp(const void *a, const void *b)
+{
+    const struct rcache_entry *ent_a = (const struct rcache_entry *)a;
+    const struct rcache_entry *ent_b = (const struct rcache_entry *)b;
+
+    if (ent_a->mtime != ent_b->mtime)
+        return (ent_a->mtime < ent_b->mtime) ? -1 : 1;
+
+    return strcmp(ent_a->name, ent_b->name);
+}
+
+/* Size cap the cache was last trimmed to (0 - unknown). */
+static unsigned long long rcache_cap_read(int dfd)
+{
+    unsigned long long cap = 0;
+    char buf[32];
+    ssize_t len;
+    int fd;
+
+    fd = openat(dfd, RCACHE_CAP_NAME, O_RDONLY);
+    if (fd == -1)
+        return 0;
+
+    len = read(fd, buf, sizeof(buf) - 1);
+    if (len > 0) {
+        buf[len] = '\0';
+        cap = strtoull(buf, NULL, 10);
+    }
+
+    close(fd);
+
+    return cap;
+}
+
+static void rcache_cap_write(const struct rcache *rc, int dfd)
+{
+    char tmp_name[64];
+    char buf[32];
+    int len;
+    int fd;
+
+    snprintf(tmp_name, sizeof(tmp_name), RCACHE_CAP_NAME ".%ld.%lx.tmp",
+             (long)getpid(), (unsigned long)pthread_self());
+    len = snprintf(buf, sizeof(buf), "%llu\n", rc->rc_size_max);
+
+    fd = openat(dfd, tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        return;
+
+    if (write(fd, buf, len) != len) {
+        close(fd);
+        unlinkat(dfd, tmp_name, 0);
+        return;
+    }
+
+    if (close(fd) || renameat(dfd, tmp_name, dfd, RCACHE_CAP_NAME))
+        unlinkat(dfd, tmp_name, 0);
+}
+
+void rcache_trim(struct rcache *rc)
+{
+    struct rcache_entry *ents = NULL;
+    size_t ents_num = 0, ents_cap = 0;
+    unsigned long long total = 0;
+    unsigned long long target;
+    unsigned long long cap;
+    struct dirent *de;
+    struct stat st;
+    size_t i;
+    DIR *dir;
+    int dfd;
+
+    dir = opendir(rc->rc_dir);
+    if (!dir)
+        return;
+
+    dfd = dirfd(dir);
+
+    /* Without new entries, the cache is only over the cap if it's lower
+     * than the one last trimmed to (or that's unknown).
+     */
+    if (!rc->rc_stores) {
+        cap = rcache_cap_read(dfd);
+        if (cap && (cap <= rc->rc_size_max)) {
+            closedir(dir);
+            return;
+        }
+    }
+
+    while ((de = readdir(dir))) {
+        size_t len = strlen(de->d_name);
+
+        if ((len != RCACHE_NAME_SIZE - 1) ||
+                strcmp(&de->d_name[len - strlen(RCACHE_SUFFIX)], RCACHE_SUFFIX))
+            continue;
+
+        if (fstatat(dfd, de->d_name, &st, 0))
+            continue;
+
+        if (ents_num == ents_cap) {
+            size_t new_cap = ents_cap ? (ents_cap << 1) : 256;
+            struct rcache_entry *new_ents;
+
+            new_ents = (struct rcache_entry *)realloc(ents, sizeof(struct rcache_entry) * new_cap);
+            if (!new_ents)
+                break;
+
+            ents = new_ents;
+            ents_cap = new_cap;
+        }
+
+        memcpy(ents[ents_num].name, de->d_name, RCACHE_NAME_SIZE);
+        ents[ents_num].size = st.st_size;
+        ents[ents_num].mtime = st.st_mtime;
+        ents_num++;
+
+        total += st.st_size;
+    }
+
+    if (total > rc->rc_size_max) {
+        target = rc->rc_size_max / 100 * RCACHE_TRIM_RATIO;
+        qsort(ents, ents_num, sizeof(struct rcache_entry), rcache_entry_cmp);
+
+        for (i = 0; (i < ents_num) && (total > target); i++) {
+            if (unlinkat(dfd, ents[i].name, 0))
+                continue;
+
+            total -= ents[i].size;
+            rc->rc_evicted++;
+        }
+    }
+
+    rcache_cap_write(rc, dfd);
+
+    closedir(dir);
+    free(ents);
+}
+
+void rcache_release(struct rcache *rc)
+{
+    free(rc->rc_dir);
+    rc->rc_dir = NULL;
+}
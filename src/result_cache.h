@@ -0,0 +1,87 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _RESULT_CACHE_H__
+#define _RESULT_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "std_comp.h"
+#include "out_sink.h"
+
+/* Persistent analysis result cache.
+ *
+ * Results are stored on disk, one file per entry, keyed by a hash of the
+ * source contents and of the translation configuration. Entries are
+ * written atomically (rename), so several gilcc processes may share a
+ * cache directory.
+ */
+
+#define RCACHE_DEFAULT_SIZE_MAX     (256ULL * 1024 * 1024)
+
+/* After eviction the cache holds at most this share (%) of its cap. */
+#define RCACHE_TRIM_RATIO           90
+
+enum rcache_evict {
+    /* Least recently used entries go first (hits refresh entries). */
+    RCACHE_EVICT_LRU,
+
+    /* Oldest entries go first. */
+    RCACHE_EVICT_FIFO,
+};
+
+struct rcache_key {
+    uint64_t rck_hash[2];
+};
+
+struct rcache {
+    char *rc_dir;
+    unsigned long long rc_size_max;
+    enum rcache_evict rc_evict;
+
+    /* Hash of the translation configuration */
+    uint64_t rc_cfg_seed;
+
+    /* Statistics (updated atomically) */
+    unsigned long rc_hits;
+    unsigned long rc_misses;
+    unsigned long rc_stores;
+    unsigned long rc_evicted;
+};
+
+/* Result Cache API */
+int rcache_init(struct rcache *rc, const char *dir, unsigned long long size_max,
+                enum rcache_evict evict, const struct trans_config *cfg);
+
+/* Key of the results of data; of file name (NULL - any file holding data)
+ * when they depend on where the file is.
+ */
+void rcache_key(const struct rcache *rc, const char *name, const char *data, size_t size,
+                struct rcache_key *key);
+int rcache_load(struct rcache *rc, const struct rcache_key *key, struct osink *out);
+
+/* Counts an entry just loaded as a miss, its results out of date. */
+void rcache_reject(struct rcache *rc);
+int rcache_store(struct rcache *rc, const struct rcache_key *key, const char *data, size_t size);
+
+/* Evicts entries down from over the size cap. Without new entries stored,
+ * only does so if the cap was lowered since the cache was last trimmed.
+ */
+void rcache_trim(struct rcache *rc);
+void rcache_release(struct rcache *rc);
+
+#endif /* _RESULT_CACHE_H__ */
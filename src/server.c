@@ -0,0 +1,831 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "src_analysis.h"
+#include "analysis_print.h"
+#include "out_sink.h"
+#include "thread_pool.h"
+
+struct gsrv {
+    struct tpool *pool;
+
+    /* Number of connected clients */
+    int clients;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+/* A reply frame waiting to be sent */
+struct gsrv_qframe {
+    struct gsrv_qframe *next;
+    enum gsrv_frame type;
+    size_t size;
+    char data[];
+};
+
+/* A connected client, and its request */
+struct gsrv_client {
+    struct gsrv *srv;
+    int fd;
+
+    /* Output and errors of the request, as the workers of the pool hand
+     * them over, wait in a queue: the socket is only written by the
+     * client's own thread, so a client which stops reading holds up no
+     * one but itself. Frames are dropped once the client is gone.
+     */
+    pthread_mutex_t q_lock;
+    pthread_cond_t q_cond;
+    struct gsrv_qframe *q_head;
+    struct gsrv_qframe **q_tail;
+    bool q_done;
+    bool gone;
+
+    /* Exit status of the request */
+    int status;
+
+    char *cwd;
+    struct cmd_args args;
+    struct cmd_args srcs;
+
+    struct src_buf *bufs;
+    char **bufs_data;
+    int bufs_num;
+    int bufs_cap;
+};
+
+static volatile sig_atomic_t gsrv_quit;
+static int gsrv_listen_fd = -1;
+
+static int gsrv_read_full(int fd, void *buf, size_t size)
+{
+    ssize_t read_size;
+
+    while (size) {
+        read_size = read(fd, buf, size);
+        if (read_size < 0) {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        if (!read_size)
+            return -1;
+
+        buf = (char *)buf + read_size;
+        size -= read_size;
+    }
+
+    return 0;
+}
+
+static int gsrv_write_full(int fd, const void *buf, size_t size)
+{
+    ssize_t write_size;
+
+    while (size) {
+        /* A client gone away must not bring the server down with SIGPIPE. */
+        write_size = send(fd, buf, size, MSG_NOSIGNAL);
+        if (write_size < 0) {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        buf = (const char *)buf + write_size;
+        size -= write_size;
+    }
+
+    return 0;
+}
+
+static int gsrv_frame_write(int fd, enum gsrv_frame type, const void *data, size_t size)
+{
+    unsigned char hdr[GSRV_FRAME_HDR_SIZE];
+    uint32_t len = htonl(size);
+
+    hdr[0] = type;
+    memcpy(&hdr[1], &len, sizeof(len));
+
+    if (gsrv_write_full(fd, hdr, GSRV_FRAME_HDR_SIZE))
+        return -1;
+
+    return size ? gsrv_write_full(fd, data, size) : 0;
+}
+
+/* Reads a frame into a new buffer, '\0' terminated past its size. */
+static int gsrv_frame_read(int fd, enum gsrv_frame *type, char **data, size_t *size)
+{
+    unsigned char hdr[GSRV_FRAME_HDR_SIZE];
+    uint32_t len;
+
+    if (gsrv_read_full(fd, hdr, GSRV_FRAME_HDR_SIZE))
+        return -1;
+
+    memcpy(&len, &hdr[1], sizeof(len));
+    len = ntohl(len);
+
+    if (len > GSRV_FRAME_MAX)
+        return -1;
+
+    *data = (char *)malloc(len + 1);
+    if (!*data)
+        return -1;
+
+    if (gsrv_read_full(fd, *data, len)) {
+        free(*data);
+        return -1;
+    }
+
+    (*data)[len] = '\0';
+    *type = hdr[0];
+    *size = len;
+
+    return 0;
+}
+
+/* Queues a frame for the client's thread to send. */
+static int gsrv_client_queue(struct gsrv_client *client, enum gsrv_frame type,
+                             const char *data, size_t size)
+{
+    struct gsrv_qframe *frame;
+    int ret_val = -1;
+
+    pthread_mutex_lock(&client->q_lock);
+
+    if (client->gone)
+        goto out;
+
+    frame = (struct gsrv_qframe *)malloc(sizeof(struct gsrv_qframe) + size);
+    if (!frame)
+        goto out;
+
+    frame->next = NULL;
+    frame->type = type;
+    frame->size = size;
+    memcpy(frame->data, data, size);
+
+    *client->q_tail = frame;
+    client->q_tail = &frame->next;
+    pthread_cond_signal(&client->q_cond);
+    ret_val = 0;
+
+out:
+    pthread_mutex_unlock(&client->q_lock);
+
+    return ret_val;
+}
+
+/* Sends the queued frames as they come, up to the end of the request. */
+static void gsrv_client_drain(struct gsrv_client *client)
+{
+    struct gsrv_qframe *frames, *frame;
+    bool gone;
+
+    pthread_mutex_lock(&client->q_lock);
+
+    for (;;) {
+        while (!client->q_head && !client->q_done)
+            pthread_cond_wait(&client->q_cond, &client->q_lock);
+
+        if (!client->q_head)
+            break;
+
+        frames = client->q_head;
+        client->q_head = NULL;
+        client->q_tail = &client->q_head;
+        gone = client->gone;
+        pthread_mutex_unlock(&client->q_lock);
+
+        while ((frame = frames)) {
+            frames = frame->next;
+            if (!gone && gsrv_frame_write(client->fd, frame->type, frame->data, frame->size))
+                gone = true;
+            free(frame);
+        }
+
+        pthread_mutex_lock(&client->q_lock);
+        client->gone = gone;
+    }
+
+    pthread_mutex_unlock(&client->q_lock);
+}
+
+static int gsrv_out_flush(void *ctx, const char *data, size_t size)
+{
+    return gsrv_client_queue((struct gsrv_client *)ctx, GSRV_OUT, data, size);
+}
+
+static int gsrv_err_flush(void *ctx, const char *data, size_t size)
+{
+    return gsrv_client_queue((struct gsrv_client *)ctx, GSRV_ERR, data, size);
+}
+
+static int gsrv_client_add_buf(struct gsrv_client *client, char *data, size_t size)
+{
+    size_t name_len = strlen(data);
+
+    if (name_len == size)
+        return -1;
+
+    if (client->bufs_num == client->bufs_cap) {
+        int new_cap = client->bufs_cap ? (client->bufs_cap << 1) : 16;
+        struct src_buf *new_bufs;
+        char **new_data;
+
+        new_bufs = (struct src_buf *)realloc(client->bufs, sizeof(struct src_buf) * new_cap);
+        if (!new_bufs)
+            return -1;
+        client->bufs = new_bufs;
+
+        new_data = (char **)realloc(client->bufs_data, sizeof(char *) * new_cap);
+        if (!new_data)
+            return -1;
+        client->bufs_data = new_data;
+
+        client->bufs_cap = new_cap;
+    }
+
+    client->bufs[client->bufs_num].sb_name = data;
+    client->bufs[client->bufs_num].sb_data = &data[name_len + 1];
+    client->bufs[client->bufs_num].sb_size = size - name_len - 1;
+    client->bufs_data[client->bufs_num] = data;
+    client->bufs_num++;
+
+    return 0;
+}
+
+static int gsrv_request_read(struct gsrv_client *client)
+{
+    enum gsrv_frame type;
+    char *data;
+    size_t size;
+    int ret_val;
+
+    for (;;) {
+        if (gsrv_frame_read(client->fd, &type, &data, &size))
+            return -1;
+
+        switch (type) {
+        case GSRV_CWD:
+            free(client->cwd);
+            client->cwd = data;
+            ret_val = 0;
+            break;
+
+        case GSRV_ARG:
+            ret_val = cmd_args_add(&client->args, data);
+            break;
+
+        case GSRV_SRC:
+            ret_val = cmd_args_add(&client->srcs, data);
+            break;
+
+        case GSRV_BUF:
+            ret_val = gsrv_client_add_buf(client, data, size);
+            break;
+
+        case GSRV_END:
+            free(data);
+            return 0;
+
+        default:
+            ret_val = -1;
+        }
+
+        if (ret_val) {
+            free(data);
+            return -1;
+        }
+    }
+}
+
+static int gsrv_request_run(struct gsrv_client *client)
+{
+    struct gilcc_opts opts;
+    int ret_val = 1;
+    int i;
+
+    gilcc_opts_init(&opts);
+    opts.cfg.base_dir = client->cwd;
+
+    if (gilcc_opts_parse(&opts, client->args.argc, client->args.argv) < 0)
+        goto out;
+
+    for (i = 0; i < client->srcs.argc; i++) {
+        if (gilcc_opts_add_src(&opts, client->srcs.argv[i]) < 0) {
+            osink_err_printf(NULL, "**Error: too many input files.\n");
+            goto out;
+        }
+    }
+
+    /* The number of jobs is up to the server. */
+    ret_val = src_analysis_run(&opts, client->bufs, client->bufs_num, client->srv->pool,
+                               osink_cur(), osink_cur_err());
+
+out:
+    gilcc_opts_release(&opts);
+
+    return ret_val;
+}
+
+static void gsrv_client_release(struct gsrv_client *client)
+{
+    int i;
+
+    for (i = 0; i < client->bufs_num; i++)
+        free(client->bufs_data[i]);
+
+    free(client->bufs);
+    free(client->bufs_data);
+    free(client->cwd);
+    cmd_args_release(&client->args);
+    cmd_args_release(&client->srcs);
+
+    pthread_cond_destroy(&client->q_cond);
+    pthread_mutex_destroy(&client->q_lock);
+    close(client->fd);
+    free(client);
+}
+
+/* Runs the request of a client, its output queued. */
+static void *gsrv_request_thread(void *arg)
+{
+    struct gsrv_client *client = (struct gsrv_client *)arg;
+    struct osink out;
+    struct osink err;
+    int status;
+
+    osink_init_cb(&out, gsrv_out_flush, client);
+    osink_init_cb(&err, gsrv_err_flush, client);
+    osink_set_cur(&out);
+    osink_set_cur_err(&err);
+
+    status = gsrv_request_run(client);
+
+    osink_set_cur(NULL);
+    osink_set_cur_err(NULL);
+    osink_release(&out);
+    osink_release(&err);
+
+    pthread_mutex_lock(&client->q_lock);
+    client->status = status;
+    client->q_done = true;
+    pthread_cond_signal(&client->q_cond);
+    pthread_mutex_unlock(&client->q_lock);
+
+    return NULL;
+}
+
+static void *gsrv_client_run(void *arg)
+{
+    struct gsrv_client *client = (struct gsrv_client *)arg;
+    struct gsrv *srv = client->srv;
+    pthread_t thread;
+    uint32_t status;
+    bool joined;
+
+    if (!gsrv_request_read(client)) {
+        /* This thread sends what the request's thread queues. */
+        joined = !pthread_create(&thread, NULL, gsrv_request_thread, client);
+        if (!joined)
+            gsrv_request_thread(client);
+
+        gsrv_client_drain(client);
+
+        if (joined)
+            pthread_join(thread, NULL);
+
+        status = htonl(client->status);
+        if (!client->gone)
+            gsrv_frame_write(client->fd, GSRV_EXIT, (const char *)&status, sizeof(status));
+    }
+
+    gsrv_client_release(client);
+
+    pthread_mutex_lock(&srv->lock);
+    if (!--srv->clients)
+        pthread_cond_broadcast(&srv->cond);
+    pthread_mutex_unlock(&srv->lock);
+
+    return NULL;
+}
+
+static void gsrv_quit_handler(int sig)
+{
+    (void)sig;
+
+    /* Wakes up the accept() of the main thread. */
+    gsrv_quit = 1;
+    shutdown(gsrv_listen_fd, SHUT_RDWR);
+}
+
+static int gsrv_addr_set(struct sockaddr_un *addr, const char *sock_path)
+{
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+
+    if (strlen(sock_path) >= sizeof(addr->sun_path)) {
+        osink_err_printf(NULL, "**Error: socket path too long: %s\n", sock_path);
+        return -1;
+    }
+
+    strcpy(addr->sun_path, sock_path);
+
+    return 0;
+}
+
+static int gsrv_listen(const char *sock_path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+
+    if (gsrv_addr_set(&addr, sock_path))
+        return -1;
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        goto err;
+
+    /* A socket left behind by a server which is gone is taken over. */
+    if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        osink_err_printf(NULL, "**Error: a server is already running on: %s\n", sock_path);
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+
+    /* Anything but a socket is left alone. */
+    if (!lstat(sock_path, &st)) {
+        if (!S_ISSOCK(st.st_mode)) {
+            osink_err_printf(NULL, "**Error: not a socket: %s\n", sock_path);
+            return -1;
+        }
+
+        unlink(sock_path);
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        goto err;
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, SOMAXCONN)) {
+        close(fd);
+        goto err;
+    }
+
+    return fd;
+
+err:
+    osink_err_printf(NULL, "**Error: Could not listen on socket: %s\n", sock_path);
+    return -1;
+}
+
+int gilcc_server(const char *sock_path, const struct gilcc_opts *opts)
+{
+    struct gsrv srv = {
+        .pool = NULL,
+        .clients = 0,
+    };
+    struct sigaction sa;
+    pthread_attr_t attr;
+    pthread_t thread;
+    unsigned int jobs_num = opts->jobs_num;
+    int ret_val = 0;
+    int fd;
+
+    gsrv_listen_fd = gsrv_listen(sock_path);
+    if (gsrv_listen_fd < 0)
+        return 1;
+
+    if (!jobs_num)
+        jobs_num = tpool_cpus_num();
+
+    srv.pool = tpool_create(jobs_num);
+    if (!srv.pool) {
+        osink_err_printf(NULL, "**Error: Could not create thread pool.\n");
+        close(gsrv_listen_fd);
+        unlink(sock_path);
+        return 1;
+    }
+
+    pthread_mutex_init(&srv.lock, NULL);
+    pthread_cond_init(&srv.cond, NULL);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = gsrv_quit_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    aprint_report(APRINT_R_SERVER_LISTEN, 0, 0, sock_path);
+    osink_flush(osink_cur());
+
+    while (!gsrv_quit) {
+        struct gsrv_client *client;
+
+        fd = accept(gsrv_listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (gsrv_quit || (errno == EINTR) || (errno == ECONNABORTED))
+                continue;
+
+            osink_err_printf(NULL, "**Error: Could not accept connection: %s\n", strerror(errno));
+            ret_val = 1;
+            break;
+        }
+
+        client = (struct gsrv_client *)calloc(1, sizeof(struct gsrv_client));
+        if (!client) {
+            close(fd);
+            continue;
+        }
+
+        client->srv = &srv;
+        client->fd = fd;
+        client->q_tail = &client->q_head;
+        pthread_mutex_init(&client->q_lock, NULL);
+        pthread_cond_init(&client->q_cond, NULL);
+
+        pthread_mutex_lock(&srv.lock);
+        srv.clients++;
+        pthread_mutex_unlock(&srv.lock);
+
+        if (pthread_create(&thread, &attr, gsrv_client_run, client)) {
+            pthread_mutex_lock(&srv.lock);
+            srv.clients--;
+            pthread_mutex_unlock(&srv.lock);
+
+            gsrv_client_release(client);
+        }
+    }
+
+    close(gsrv_listen_fd);
+    unlink(sock_path);
+
+    /* Requests in progress are seen through. */
+    pthread_mutex_lock(&srv.lock);
+    while (srv.clients)
+        pthread_cond_wait(&srv.cond, &srv.lock);
+    pthread_mutex_unlock(&srv.lock);
+
+    pthread_attr_destroy(&attr);
+    pthread_cond_destroy(&srv.cond);
+    pthread_mutex_destroy(&srv.lock);
+    tpool_destroy(srv.pool);
+
+    return ret_val;
+}
+
+/* Reads all of fd, the source named path. */
+static int gcln_fd_read(int fd, const char *path, char **data, size_t *size)
+{
+    size_t name_len = strlen(path);
+    size_t cap = name_len + 1 + 4096;
+    size_t len;
+    ssize_t read_size;
+    char *buf;
+
+    /* GSRV_BUF payload: the name, '\0' and the contents. */
+    buf = (char *)malloc(cap);
+    if (!buf)
+        goto err;
+
+    memcpy(buf, path, name_len + 1);
+    len = name_len + 1;
+
+    for (;;) {
+        if (len == cap) {
+            char *new_buf;
+
+            if (cap >= GSRV_FRAME_MAX)
+                goto err;
+
+            cap <<= 1;
+            new_buf = (char *)realloc(buf, cap);
+            if (!new_buf)
+                goto err;
+
+            buf = new_buf;
+        }
+
+        read_size = read(fd, &buf[len], cap - len);
+        if (read_size < 0) {
+            if (errno == EINTR)
+                continue;
+
+            goto err;
+        }
+
+        if (!read_size)
+            break;
+
+        len += read_size;
+    }
+
+    if (len > GSRV_FRAME_MAX)
+        goto err;
+
+    *data = buf;
+    *size = len;
+
+    return 0;
+
+err:
+    osink_err_printf(NULL, "**Error: Could not read source file: %s.\n", path);
+    free(buf);
+    return -1;
+}
+
+static int gcln_file_read(const char *path, char **data, size_t *size)
+{
+    int ret_val;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        osink_err_printf(NULL, "**Error: Could not open source file: %s.\n", path);
+        return -1;
+    }
+
+    ret_val = gcln_fd_read(fd, path, data, size);
+    close(fd);
+
+    return ret_val;
+}
+
+static int gcln_srcs_send(int fd, FILE *f)
+{
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    int ret_val = 0;
+
+    while ((len = getline(&line, &line_cap, f)) > 0) {
+        while (len && ((line[len - 1] == '\n') || (line[len - 1] == '\r')))
+            line[--len] = '\0';
+
+        if (len && gsrv_frame_write(fd, GSRV_SRC, line, len)) {
+            ret_val = -1;
+            break;
+        }
+    }
+
+    free(line);
+
+    return ret_val;
+}
+
+static int gcln_request_send(int fd, int argc, char **argv)
+{
+    const char *stdin_name = "<stdin>";
+    char cwd[PATH_MAX];
+    char *data;
+    size_t size;
+    int ret_val;
+    int i;
+
+    if (!getcwd(cwd, sizeof(cwd)))
+        return -1;
+
+    for (i = 0; i < argc; i++) {
+        if (!strncmp(argv[i], "--assume-filename=", 18))
+            stdin_name = argv[i] + 18;
+    }
+
+    if (gsrv_frame_write(fd, GSRV_CWD, cwd, strlen(cwd)))
+        return -1;
+
+    for (i = 0; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (!strncmp(arg, "--connect=", 10)) {
+            continue;
+
+        } else if (!strncmp(arg, "--inline=", 9)) {
+            if (gcln_file_read(arg + 9, &data, &size))
+                return -1;
+
+            ret_val = gsrv_frame_write(fd, GSRV_BUF, data, size);
+            free(data);
+
+        } else if (!strcmp(arg, "--files-from=-")) {
+            /* The server has no access to our standard input. */
+            ret_val = gcln_srcs_send(fd, stdin);
+
+        } else if (!strcmp(arg, "-")) {
+            /* Nor to the source on it. */
+            if (gcln_fd_read(STDIN_FILENO, stdin_name, &data, &size))
+                return -1;
+
+            ret_val = gsrv_frame_write(fd, GSRV_BUF, data, size);
+            free(data);
+
+        } else {
+            ret_val = gsrv_frame_write(fd, GSRV_ARG, arg, strlen(arg));
+        }
+
+        if (ret_val)
+            return -1;
+    }
+
+    return gsrv_frame_write(fd, GSRV_END, NULL, 0);
+}
+
+int gilcc_client(const char *sock_path, int argc, char **argv)
+{
+    struct sockaddr_un addr;
+    enum gsrv_frame type;
+    uint32_t status;
+    char *data;
+    size_t size;
+    int fd;
+
+    if (gsrv_addr_set(&addr, sock_path))
+        return 1;
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ((fd < 0) || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        osink_err_printf(NULL, "**Error: Could not connect to server: %s\n", sock_path);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+
+    if (gcln_request_send(fd, argc, argv))
+        goto err;
+
+    for (;;) {
+        if (gsrv_frame_read(fd, &type, &data, &size))
+            goto err;
+
+        switch (type) {
+        case GSRV_OUT:
+            osink_write(&osink_stdout, data, size);
+            osink_flush(&osink_stdout);
+            break;
+
+        case GSRV_ERR:
+            osink_write(&osink_stderr, data, size);
+            osink_flush(&osink_stderr);
+            break;
+
+        case GSRV_EXIT:
+            if (size != sizeof(status)) {
+                free(data);
+                goto err;
+            }
+
+            memcpy(&status, data, sizeof(status));
+            free(data);
+            close(fd);
+            return ntohl(status);
+
+        default:
+            break;
+        }
+
+        free(data);
+    }
+
+err:
+    osink_err_printf(NULL, "**Error: Connection to server lost: %s\n", sock_path);
+    close(fd);
+    return 1;
+}
@@ -0,0 +1,57 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _SERVER_H__
+#define _SERVER_H__
+
+#include "cmd_parse.h"
+
+/* Resident analysis server.
+ *
+ * The server listens on a Unix domain socket, and analyzes the requests of
+ * any number of concurrent clients on one shared thread pool. A request is
+ * the command-line of a gilcc run, and the results are streamed back to the
+ * client as every file is done.
+ *
+ * Both directions carry frames: a type byte, a 4 byte payload length (in
+ * network order) and the payload. A request is a GSRV_CWD frame followed
+ * by any number of GSRV_ARG, GSRV_SRC and GSRV_BUF frames, and a GSRV_END
+ * frame. The reply is any number of GSRV_OUT and GSRV_ERR frames, and a
+ * GSRV_EXIT frame.
+ */
+
+#define GSRV_FRAME_HDR_SIZE     5
+#define GSRV_FRAME_MAX          (256U * 1024 * 1024)
+
+enum gsrv_frame {
+    /* Client to server */
+    GSRV_CWD = 1,       /* Working directory of the client */
+    GSRV_ARG,           /* A command-line argument */
+    GSRV_SRC,           /* A source file name */
+    GSRV_BUF,           /* An in-memory source: name, '\0' and contents */
+    GSRV_END,           /* End of the request */
+
+    /* Server to client */
+    GSRV_OUT,           /* Standard output data */
+    GSRV_ERR,           /* Standard error data */
+    GSRV_EXIT,          /* Exit status of the request (4 bytes) */
+};
+
+/* Server API */
+int gilcc_server(const char *sock_path, const struct gilcc_opts *opts);
+int gilcc_client(const char *sock_path, int argc, char **argv);
+
+#endif /* _SERVER_H__ */
@@ -0,0 +1,590 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "src_analysis.h"
+#include "src_parser.h"
+#include "src_input.h"
+#include "analysis_print.h"
+#include "src_walk.h"
+#include "result_cache.h"
+#include "src_stats.h"
+#include "src_pp.h"
+
+/* Analysis of all the input sources */
+struct src_run {
+    const struct trans_config *cfg;
+    struct tpool *pool;
+    struct tgroup grp;
+    struct rcache *cache;
+
+    /* Headers, shared by all the files */
+    struct pp_hcache hdrs;
+
+    struct osink *out;
+    struct osink *err;
+
+    /* Number of files which failed analysis */
+    int failed;
+
+    /* Diagnostics are emitted, in the requested format, under the walk's
+     * lock.
+     */
+    struct aprint_emit emit;
+
+    /* Results are emitted in a fixed order, as soon as all the ones
+     * before are: the files and directories of the command-line as given,
+     * the files found in a directory by path. The walk keeps the order.
+     */
+    struct src_walk walk;
+
+    /* Statistics: totals, number of file records reported, and the
+     * report file (NULL - the error sink). File records go out with the
+     * results, in order.
+     */
+    enum gilcc_stats stats;
+    struct src_stats stats_total;
+    unsigned long stats_num;
+    struct osink *stats_out;
+};
+
+/* A source file analysis job */
+struct src_job {
+    struct src_run *run;
+    char *path;
+
+    /* Its path as shown (see src_input_path_shown()) */
+    const char *name;
+    int indx;
+    off_t size;
+
+    /* Position in the output order */
+    struct src_walk_slot *slot;
+
+    /* In-memory source (NULL - read the file at path, or standard input) */
+    const struct src_buf *buf;
+    bool in_stdin;
+
+    /* Output and diagnostics of the analysis, handed over in one piece
+     * when done.
+     */
+    struct osink out;
+    struct aprint_buf diags;
+
+    struct src_stats st;
+};
+
+static struct src_job *src_job_alloc(struct src_run *run, const char *path)
+{
+    struct src_job *job;
+
+    job = (struct src_job *)calloc(1, sizeof(struct src_job));
+    if (!job)
+        return NULL;
+
+    job->path = strdup(path);
+    if (!job->path) {
+        free(job);
+        return NULL;
+    }
+
+    job->name = src_input_path_shown(run->cfg->base_dir, job->path);
+    job->run = run;
+
+    return job;
+}
+
+static void src_job_free(struct src_job *job)
+{
+    osink_release(&job->out);
+    aprint_buf_release(&job->diags);
+    free(job->path);
+    free(job);
+}
+
+/* Reports a stats record: one per file, in the order of the results, and
+ * the total (name NULL) at the end.
+ */
+static void src_run_stats_print(struct src_run *run, const char *name, const struct src_stats *st)
+{
+    struct osink rec;
+
+    osink_init_mem(&rec);
+
+    if (run->stats == GILCC_STATS_JSON) {
+        if (name) {
+            osink_printf(&rec, run->stats_num ? ",\n  " : "{\"files\": [\n  ");
+            src_stats_print_json(&rec, name, st);
+        } else {
+            osink_printf(&rec, run->stats_num ? "\n], \"total\": " : "{\"files\": [], \"total\": ");
+            src_stats_print_json(&rec, NULL, st);
+            osink_printf(&rec, "}\n");
+        }
+    } else {
+        src_stats_print(&rec, name, st);
+    }
+
+    if (name)
+        run->stats_num++;
+
+    if (rec.osk_err) {
+        /* Nothing to report. */
+    } else if (run->stats_out) {
+        osink_write(run->stats_out, rec.osk_buf, rec.osk_size);
+    } else {
+        osink_err_printf(run->err, "%.*s", (int)rec.osk_size, rec.osk_buf);
+    }
+
+    osink_release(&rec);
+}
+
+/* Hands a file's results over, and its stats record. All diagnostics
+ * precede the translation output, which only the text format carries.
+ */
+static void src_job_emit(struct src_job *job)
+{
+    struct src_run *run = job->run;
+
+    aprint_emit_buf(&run->emit, &job->diags, job->name);
+    if (run->emit.ape_fmt == APRINT_FMT_TEXT)
+        osink_write(run->out, job->out.osk_buf, job->out.osk_size);
+    osink_flush(run->out);
+
+    if (run->stats) {
+        job->st.ss_files = 1;
+
+        src_stats_add(&run->stats_total, &job->st);
+        src_run_stats_print(run, job->name, &job->st);
+    }
+
+    src_job_free(job);
+}
+
+/* Takes a done job, and emits whatever's next in order. */
+static void src_job_done(struct src_job *job)
+{
+    src_walk_done(&job->run->walk, job->slot, job);
+}
+
+static void src_walk_emit(struct src_walk *walk, void *item)
+{
+    (void)walk;
+
+    src_job_emit((struct src_job *)item);
+}
+
+/* Loads the cached results of job, if there are any, and none of the
+ * headers they depend on changed since.
+ */
+static int src_job_load(struct src_job *job, const struct rcache_key *key, struct osink *res)
+{
+    struct rcache *cache = job->run->cache;
+    ssize_t deps_size, diags_size;
+
+    if (rcache_load(cache, key, res))
+        return -1;
+
+    deps_size = pp_deps_check(&job->run->hdrs, res->osk_buf, res->osk_size);
+    if (deps_size < 0)
+        goto stale;
+
+    diags_size = aprint_buf_load(&job->diags, &res->osk_buf[deps_size],
+                                 res->osk_size - deps_size);
+    if (diags_size < 0)
+        goto stale;
+
+    osink_write(&job->out, &res->osk_buf[deps_size + diags_size],
+                res->osk_size - deps_size - diags_size);
+
+    return 0;
+
+stale:
+    rcache_reject(cache);
+
+    return -1;
+}
+
+static int src_job_analyze(struct src_job *job)
+{
+    const struct trans_config *cfg = job->run->cfg;
+    struct rcache *cache = job->run->cache;
+    struct src_input src_in;
+    struct rcache_key key;
+    size_t diags_start = job->diags.apb_num;
+    struct pp_deps deps;
+    struct osink res;
+    const char *data;
+    size_t size;
+    bool keyed = false;
+    int ret_val;
+
+    if (job->buf) {
+        src_input_open_mem(&src_in, job->buf->sb_data, job->buf->sb_size);
+    } else if (job->in_stdin) {
+        if (src_input_open_fd(&src_in, STDIN_FILENO) < 0)
+            return -1;
+    } else if (src_input_open(&src_in, job->path) < 0) {
+        return -1;
+    }
+
+    /* Only sources held in memory in full can be hashed up front. */
+    if (cache && src_input_data(&src_in, &data, &size)) {
+        rcache_key(cache, (cfg->last_phase >= 4) ? job->path : NULL, data, size, &key);
+        keyed = true;
+    }
+
+    /* A cached result is the headers the file depends on, its diagnostics,
+     * and its output.
+     */
+    osink_init_mem(&res);
+    pp_deps_init(&deps);
+
+    if (keyed && !src_job_load(job, &key, &res)) {
+        job->st.ss_cached = 1;
+        job->st.ss_diags = aprint_buf_diags(&job->diags, diags_start);
+        ret_val = 0;
+    } else {
+        ret_val = src_parser_cpp_input(&src_in, job->path, cfg, &job->run->hdrs,
+                                       keyed ? &deps : NULL, job->run->stats ? &job->st : NULL);
+
+        if (keyed && !ret_val && !job->out.osk_err) {
+            res.osk_size = 0;
+            pp_deps_save(&deps, &res);
+            aprint_buf_save(&job->diags, diags_start, &res);
+            osink_write(&res, job->out.osk_buf, job->out.osk_size);
+
+            if (!res.osk_err)
+                rcache_store(cache, &key, res.osk_buf, res.osk_size);
+        }
+    }
+
+    osink_release(&res);
+    pp_deps_release(&deps);
+
+    src_input_close(&src_in);
+
+    return ret_val;
+}
+
+static void src_job_run(void *arg)
+{
+    struct src_job *job = (struct src_job *)arg;
+    struct src_run *run = job->run;
+    struct aprint_buf *prev_diags = aprint_cur();
+    int ret_val;
+
+    osink_init_mem(&job->out);
+    osink_set_cur(&job->out);
+    osink_set_cur_err(run->err);
+    aprint_buf_init(&job->diags);
+    aprint_set_cur(&job->diags);
+
+    aprint_report(APRINT_R_PROCESSING, 0, 0, job->name);
+    ret_val = src_job_analyze(job);
+
+    osink_set_cur(NULL);
+    osink_set_cur_err(NULL);
+    aprint_set_cur(prev_diags);
+
+    if (ret_val < 0)
+        __atomic_add_fetch(&run->failed, 1, __ATOMIC_RELAXED);
+
+    src_job_done(job);
+}
+
+static void src_job_submit(struct src_run *run, struct src_job *job)
+{
+    if (!run->pool || tpool_submit_group(run->pool, &run->grp, src_job_run, job))
+        /* Can't go parallel; do it ourselves. */
+        src_job_run(job);
+}
+
+static void src_walk_found(struct src_walk *walk, const char *path, struct src_walk_slot *slot)
+{
+    struct src_run *run = (struct src_run *)walk->ctx;
+    struct src_job *job;
+
+    /* Found files go to the analysis right away, while the walk goes on. */
+    job = src_job_alloc(run, path);
+    if (!job) {
+        osink_err_printf(run->err, "**Error: Could not queue file: %s\n", path);
+        __atomic_add_fetch(&run->failed, 1, __ATOMIC_RELAXED);
+        src_walk_done(walk, slot, NULL);
+        return;
+    }
+
+    job->slot = slot;
+    src_job_submit(run, job);
+}
+
+static int src_job_cmp(const void *a, const void *b)
+{
+    const struct src_job *job_a = *(const struct src_job **)a;
+    const struct src_job *job_b = *(const struct src_job **)b;
+
+    /* Standard input first, its writer may be waiting on it. Then the
+     * largest files, so they don't end up as a long tail.
+     */
+    if (job_a->in_stdin != job_b->in_stdin)
+        return job_a->in_stdin ? -1 : 1;
+
+    if (job_a->size != job_b->size)
+        return (job_a->size < job_b->size) ? 1 : -1;
+
+    return job_a->indx - job_b->indx;
+}
+
+int src_analysis_run(struct gilcc_opts *opts, const struct src_buf *bufs, int bufs_num,
+                     struct tpool *pool, struct osink *out, struct osink *err)
+{
+    struct src_run run = {
+        .cfg = &opts->cfg,
+        .pool = pool,
+        .cache = NULL,
+        .out = out,
+        .err = err,
+        .failed = 0,
+        .stats = opts->stats,
+        .stats_num = 0,
+        .stats_out = NULL,
+    };
+    struct aprint_buf *prev_diags = aprint_cur();
+    struct aprint_buf run_diags;
+    struct osink stats_file;
+    int stats_fd = -1;
+    unsigned int jobs_num = opts->jobs_num;
+    char *cache_dir = opts->cache_dir;
+    char **srcs = opts->srcs;
+    int srcs_num = opts->srcs_num;
+    struct rcache cache;
+    struct src_job **jobs;
+    struct stat st;
+    int jobs_cnt = 0;
+    int dirs_cnt = 0;
+    bool bad_exts = false;
+    int ret_val = 0;
+    int i;
+
+    /* The command-line's diagnostics come first. */
+    aprint_emit_init(&run.emit, opts->diag_fmt, out);
+    aprint_emit_begin(&run.emit);
+    aprint_emit_buf(&run.emit, &opts->diags, NULL);
+
+    if (!srcs_num && !bufs_num && !opts->stdin_src) {
+        aprint_emit_end(&run.emit);
+
+        if (opts->args_num > 2)
+            /* We have multiple flags with no input files. */
+            return 2;
+
+        /* We have a single flag, no input files (probably a -v or -h). */
+        /* TODO: verify this ^ */
+        return 0;
+    }
+
+    if (set_std_limits(&opts->cfg.lim, opts->cfg.std)) {
+        osink_err_printf(err, "**Error: Could Not configure standard limits\n");
+        aprint_emit_end(&run.emit);
+        return 1;
+    }
+
+    if (pp_hcache_init(&run.hdrs, &opts->cfg)) {
+        osink_err_printf(err, "**Error: Could not set up the header cache\n");
+        aprint_emit_end(&run.emit);
+        return 1;
+    }
+
+    /* Every file and directory of the command-line has a place in the
+     * output order.
+     */
+    jobs = (struct src_job **)calloc(srcs_num + bufs_num + 1, sizeof(struct src_job *));
+    if (!jobs || src_walk_init(&run.walk, NULL, srcs_num + bufs_num + 1,
+                               src_walk_found, src_walk_emit, &run)) {
+        free(jobs);
+        pp_hcache_release(&run.hdrs);
+        aprint_emit_end(&run.emit);
+        return 1;
+    }
+
+    run.walk.grp = &run.grp;
+    run.walk.err = err;
+    run.walk.base_dir = opts->cfg.base_dir;
+    if (opts->src_exts && src_walk_set_exts(&run.walk, opts->src_exts)) {
+        osink_err_printf(err, "**Error: invalid source extensions list: %s\n", opts->src_exts);
+        bad_exts = true;
+        ret_val = 1;
+    }
+
+    /* Diagnostics of the run itself */
+    aprint_buf_init(&run_diags);
+    aprint_set_cur(&run_diags);
+
+    tgroup_init(&run.grp);
+
+    if (run.stats && opts->stats_file) {
+        stats_fd = open(opts->stats_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (stats_fd < 0) {
+            osink_err_printf(err, "**Error: Could not create stats file: %s\n", opts->stats_file);
+            ret_val = 1;
+            run.stats = GILCC_STATS_NONE;
+        } else {
+            osink_init_fd(&stats_file, stats_fd);
+            run.stats_out = &stats_file;
+        }
+    }
+
+    for (i = 0; i <= srcs_num; i++) {
+        /* Standard input, in its place among the files */
+        if (opts->stdin_src && (i == opts->stdin_indx)) {
+            jobs[jobs_cnt] = src_job_alloc(&run, opts->stdin_name ? opts->stdin_name : "<stdin>");
+            if (jobs[jobs_cnt]) {
+                jobs[jobs_cnt]->indx = i;
+                jobs[jobs_cnt]->slot = src_walk_add(&run.walk);
+                jobs[jobs_cnt]->in_stdin = true;
+                if (!fstat(STDIN_FILENO, &st) && S_ISREG(st.st_mode))
+                    jobs[jobs_cnt]->size = st.st_size;
+                jobs_cnt++;
+            } else {
+                osink_err_printf(err, "**Error: Could not queue standard input\n");
+                ret_val = 1;
+            }
+        }
+
+        if (i == srcs_num)
+            break;
+
+        if (access(srcs[i], R_OK) || stat(srcs[i], &st)) {
+            osink_err_printf(err, "**Error: Could Not access file: %s\n",
+                             src_input_path_shown(opts->cfg.base_dir, srcs[i]));
+            ret_val = 1;
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            /* Not with a bad extensions list, it's been reported already */
+            if (bad_exts)
+                continue;
+
+            if (src_walk_add_dir(&run.walk, srcs[i])) {
+                osink_err_printf(err, "**Error: Could not walk directory: %s\n",
+                                 src_input_path_shown(opts->cfg.base_dir, srcs[i]));
+                ret_val = 1;
+                continue;
+            }
+
+            dirs_cnt++;
+            continue;
+        }
+
+        jobs[jobs_cnt] = src_job_alloc(&run, srcs[i]);
+        if (!jobs[jobs_cnt]) {
+            osink_err_printf(err, "**Error: Could not queue file: %s\n",
+                             src_input_path_shown(opts->cfg.base_dir, srcs[i]));
+            ret_val = 1;
+            continue;
+        }
+
+        jobs[jobs_cnt]->indx = i;
+        jobs[jobs_cnt]->slot = src_walk_add(&run.walk);
+        jobs[jobs_cnt]->size = st.st_size;
+        jobs_cnt++;
+    }
+
+    for (i = 0; i < bufs_num; i++) {
+        jobs[jobs_cnt] = src_job_alloc(&run, bufs[i].sb_name);
+        if (!jobs[jobs_cnt]) {
+            osink_err_printf(err, "**Error: Could not queue file: %s\n", bufs[i].sb_name);
+            ret_val = 1;
+            continue;
+        }
+
+        jobs[jobs_cnt]->indx = srcs_num + i;
+        jobs[jobs_cnt]->slot = src_walk_add(&run.walk);
+        jobs[jobs_cnt]->size = bufs[i].sb_size;
+        jobs[jobs_cnt]->buf = &bufs[i];
+        jobs_cnt++;
+    }
+
+    qsort(jobs, jobs_cnt, sizeof(struct src_job *), src_job_cmp);
+
+    if (!cache_dir)
+        cache_dir = getenv("GILCC_CACHE_DIR");
+
+    if (cache_dir && !rcache_init(&cache, cache_dir, opts->cache_size_max, opts->cache_evict, &opts->cfg))
+        run.cache = &cache;
+
+    /* There's no use for more workers than files. */
+    if (!jobs_num)
+        jobs_num = tpool_cpus_num();
+    if (!dirs_cnt && (jobs_num > (unsigned int)jobs_cnt))
+        jobs_num = jobs_cnt;
+
+    if (!pool && (jobs_cnt || dirs_cnt))
+        run.pool = tpool_create(jobs_num);
+
+    /* Directories are walked along with the analysis of the files. */
+    run.walk.pool = run.pool;
+    src_walk_start(&run.walk);
+
+    for (i = 0; i < jobs_cnt; i++)
+        src_job_submit(&run, jobs[i]);
+
+    /* A shared pool also runs the jobs of others; only ours are waited on. */
+    tgroup_wait(&run.grp);
+    tgroup_destroy(&run.grp);
+    src_walk_release(&run.walk);
+
+    if (run.pool && !pool)
+        tpool_destroy(run.pool);
+
+    if (run.cache) {
+        rcache_trim(&cache);
+
+        aprint_report(APRINT_R_CACHE_SUMMARY, 0, 0, cache.rc_hits, cache.rc_misses,
+                      cache.rc_stores, cache.rc_evicted);
+        rcache_release(&cache);
+    }
+
+    aprint_set_cur(prev_diags);
+    aprint_emit_buf(&run.emit, &run_diags, NULL);
+    aprint_emit_end(&run.emit);
+    osink_flush(out);
+    aprint_buf_release(&run_diags);
+
+    if (run.stats)
+        src_run_stats_print(&run, NULL, &run.stats_total);
+
+    if (run.stats_out) {
+        osink_release(run.stats_out);
+        close(stats_fd);
+    }
+
+    if (run.failed || run.walk.errors)
+        ret_val = 1;
+
+    pp_hcache_release(&run.hdrs);
+    free(jobs);
+
+    return ret_val;
+}
+
@@ -0,0 +1,45 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _SRC_ANALYSIS_H__
+#define _SRC_ANALYSIS_H__
+
+#include <stddef.h>
+
+#include "cmd_parse.h"
+#include "out_sink.h"
+#include "thread_pool.h"
+
+/* A source held in memory, analyzed in place of a file */
+struct src_buf {
+    const char *sb_name;
+    const char *sb_data;
+    size_t sb_size;
+};
+
+/* Analyze all the sources of opts, and the in-memory sources bufs.
+ *
+ * The analysis runs on pool if given (which may be shared with other
+ * analysis runs), or on a pool of its own. The results of every file are
+ * written to out in one piece, when the file is done; errors go to err
+ * (NULL - osink_stderr).
+ *
+ * Returns the exit status of the run.
+ */
+int src_analysis_run(struct gilcc_opts *opts, const struct src_buf *bufs, int bufs_num,
+                     struct tpool *pool, struct osink *out, struct osink *err);
+
+#endif /* _SRC_ANALYSIS_H__ */
@@ -0,0 +1,211 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "src_idsig.h"
+#include "src_lex.h"
+
+#define SIDS_INIT_SIZE          1024
+#define SIDS_INIT_ENTS          256
+#define SIDS_INIT_NAMES         (16 * 1024)
+
+void sids_init(struct src_idsig *sis, unsigned int sig)
+{
+    memset(sis, 0, sizeof(struct src_idsig));
+    sis->sis_sig = sig;
+}
+
+void sids_release(struct src_idsig *sis)
+{
+    free(sis->sis_slots);
+    free(sis->sis_ents);
+    free(sis->sis_names);
+    sids_init(sis, 0);
+}
+
+static uint32_t sids_hash(const char *name, size_t len)
+{
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619U;
+
+    return h;
+}
+
+/* The slot of an entry: where it is, or where it goes. */
+static uint32_t *sids_slot(const struct src_idsig *sis, const char *name, size_t len,
+                           uint32_t h, bool sig)
+{
+    const struct sids_ent *ent;
+    size_t i = h & (sis->sis_size - 1);
+
+    while (sis->sis_slots[i]) {
+        ent = &sis->sis_ents[sis->sis_slots[i] - 1];
+        if ((ent->se_hash == h) && (ent->se_len == len) && (ent->se_sig == sig) &&
+                !memcmp(&sis->sis_names[ent->se_off], name, len))
+            break;
+        i = (i + 1) & (sis->sis_size - 1);
+    }
+
+    return &sis->sis_slots[i];
+}
+
+/* Makes room for two more entries, and a name of len. */
+static int sids_reserve(struct src_idsig *sis, size_t len)
+{
+    struct sids_ent *new_ents;
+    uint32_t *new_slots;
+    char *new_names;
+    size_t new_size;
+    size_t i;
+
+    if (sis->sis_ents_num + 2 > sis->sis_ents_cap) {
+        new_size = sis->sis_ents_cap ? (sis->sis_ents_cap << 1) : SIDS_INIT_ENTS;
+        if (new_size > UINT32_MAX)
+            return -1;
+
+        new_ents = (struct sids_ent *)realloc(sis->sis_ents, new_size * sizeof(struct sids_ent));
+        if (!new_ents)
+            return -1;
+
+        sis->sis_ents = new_ents;
+        sis->sis_ents_cap = new_size;
+    }
+
+    if (sis->sis_names_size + len + 1 > sis->sis_names_cap) {
+        new_size = sis->sis_names_cap ? (sis->sis_names_cap << 1) : SIDS_INIT_NAMES;
+        while (new_size < sis->sis_names_size + len + 1)
+            new_size <<= 1;
+        if (new_size > UINT32_MAX)
+            return -1;
+
+        new_names = (char *)realloc(sis->sis_names, new_size);
+        if (!new_names)
+            return -1;
+
+        sis->sis_names = new_names;
+        sis->sis_names_cap = new_size;
+    }
+
+    /* Kept at most half full. The entries are put back in their order of
+     * insertion, so that the last one is never in the way of another.
+     */
+    if ((sis->sis_ents_num + 2) * 2 > sis->sis_size) {
+        new_size = sis->sis_size ? (sis->sis_size << 1) : SIDS_INIT_SIZE;
+        new_slots = (uint32_t *)calloc(new_size, sizeof(uint32_t));
+        if (!new_slots)
+            return -1;
+
+        free(sis->sis_slots);
+        sis->sis_slots = new_slots;
+        sis->sis_size = new_size;
+
+        for (i = 0; i < sis->sis_ents_num; i++)
+            *sids_slot(sis, NULL, 0, sis->sis_ents[i].se_hash, false) = i + 1;
+    }
+
+    return 0;
+}
+
+static void sids_insert(struct src_idsig *sis, uint32_t *slot, uint32_t off, size_t len,
+                        uint32_t h, bool sig)
+{
+    struct sids_ent *ent = &sis->sis_ents[sis->sis_ents_num];
+
+    ent->se_off = off;
+    ent->se_len = len;
+    ent->se_hash = h;
+    ent->se_depth = sis->sis_depth;
+    ent->se_sig = sig;
+
+    *slot = ++sis->sis_ents_num;
+}
+
+/* Drops the entries first seen in the block being closed. */
+static void sids_close(struct src_idsig *sis)
+{
+    struct sids_ent *ent;
+
+    while (sis->sis_ents_num) {
+        ent = &sis->sis_ents[sis->sis_ents_num - 1];
+        if (ent->se_depth < sis->sis_depth)
+            break;
+
+        *sids_slot(sis, &sis->sis_names[ent->se_off], ent->se_len, ent->se_hash,
+                   ent->se_sig) = 0;
+        sis->sis_names_size = ent->se_off;
+        sis->sis_ents_num--;
+    }
+
+    sis->sis_depth--;
+}
+
+int sids_tok(struct src_idsig *sis, uint8_t kind, const char *str, size_t len,
+             const char **name, const char **other)
+{
+    const size_t sig = sis->sis_sig;
+    const struct sids_ent *ent;
+    uint32_t *slot;
+    uint32_t h;
+    uint32_t off;
+
+    if ((kind == PP_TOK_PUNCT) && (len == 1)) {
+        if (str[0] == '{')
+            sis->sis_depth++;
+        else if ((str[0] == '}') && sis->sis_depth)
+            sids_close(sis);
+        return 0;
+    }
+
+    /* Most identifiers are done with right here. */
+    if ((kind != PP_TOK_IDENT) || !sig || (len < sig) || sis->sis_err)
+        return 0;
+
+    if (sids_reserve(sis, len)) {
+        sis->sis_err = true;
+        return 0;
+    }
+
+    h = sids_hash(str, len);
+    slot = sids_slot(sis, str, len, h, false);
+    if (*slot)
+        return 0;
+
+    off = sis->sis_names_size;
+    memcpy(&sis->sis_names[off], str, len);
+    sis->sis_names[off + len] = '\0';
+    sis->sis_names_size += len + 1;
+
+    sids_insert(sis, slot, off, len, h, false);
+
+    /* Its significant characters: the first identifier with them is kept. */
+    h = (len == sig) ? h : sids_hash(str, sig);
+    slot = sids_slot(sis, str, sig, h, true);
+    if (!*slot) {
+        sids_insert(sis, slot, off, sig, h, true);
+        return 0;
+    }
+
+    ent = &sis->sis_ents[*slot - 1];
+    *name = &sis->sis_names[off];
+    *other = &sis->sis_names[ent->se_off];
+
+    return 1;
+}
@@ -0,0 +1,92 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _SRC_IDSIG_H__
+#define _SRC_IDSIG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Identifier significance checker.
+ *
+ * Only so many initial characters of an internal identifier are significant
+ * (init_char_intern_ident_num); two identifiers which differ past them only
+ * are the same one, as far as the standard goes. The tokens of a translation
+ * unit are fed to the checker one by one, as they come out of phase 4 (or
+ * of phase 3, on runs stopping there), and it reports the identifiers which
+ * collide so with one seen before, in a scope still open.
+ *
+ * Identifiers shorter than the limit never collide, and are let through.
+ * The others are kept in an open addressing table, twice: by their name,
+ * and by their significant characters (under the first identifier with
+ * them). Scopes are told by braces only; the identifiers first seen in a
+ * block are dropped as it's closed. Being dropped in the reverse order of
+ * their insertion, the identifiers are kept in a stack, their names in
+ * another, and their slots simply emptied.
+ */
+
+struct sids_ent {
+    /* Offset of its name in the names stack, its length and hash */
+    uint32_t se_off;
+    uint32_t se_len;
+    uint32_t se_hash;
+
+    /* Brace nesting it was first seen at */
+    uint32_t se_depth;
+
+    /* An entry of the significant characters of se_off, rather than of
+     * the name.
+     */
+    bool se_sig;
+};
+
+struct src_idsig {
+    /* Significant characters (0 - the check is off) */
+    unsigned int sis_sig;
+
+    uint32_t sis_depth;
+
+    /* Slots: index of the entry in it, plus 1 (0 - empty) */
+    uint32_t *sis_slots;
+    size_t sis_size;
+
+    /* Entries, in their order of insertion */
+    struct sids_ent *sis_ents;
+    size_t sis_ents_num;
+    size_t sis_ents_cap;
+
+    /* Names, each null terminated */
+    char *sis_names;
+    size_t sis_names_size;
+    size_t sis_names_cap;
+
+    /* Out of memory: nothing more is checked */
+    bool sis_err;
+};
+
+/* Identifier significance checker API */
+void sids_init(struct src_idsig *sis, unsigned int sig);
+void sids_release(struct src_idsig *sis);
+
+/* Feeds a token (its kind an enum pp_tok_kind). Returns 1 if it's an
+ * identifier colliding with an earlier one, setting their names (valid up
+ * to the next token fed), and 0 if not.
+ */
+int sids_tok(struct src_idsig *sis, uint8_t kind, const char *str, size_t len,
+             const char **name, const char **other);
+
+#endif /* _SRC_IDSIG_H__ */
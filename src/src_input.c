@@ -0,0 +1,164 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "src_input.h"
+#include "out_sink.h"
+
+static void src_input_init(struct src_input *in, int fd)
+{
+    in->sin_fd = fd;
+    in->sin_fd_owned = false;
+    in->sin_mem = false;
+    in->sin_mapped = false;
+    in->sin_data = NULL;
+    in->sin_size = 0;
+    in->sin_buf = NULL;
+    in->sin_eof = false;
+    in->sin_read = 0;
+}
+
+/* Reads from fd, which is left open (standard input, a pipe, etc.) */
+int src_input_open_fd(struct src_input *in, int fd)
+{
+    struct stat st;
+    void *map;
+
+    src_input_init(in, fd);
+
+    /* Regular files are mapped and scanned in place, unless partly read
+     * already. An empty file can not be mapped, but there is nothing to read
+     * from it either.
+     */
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode) && !lseek(fd, 0, SEEK_CUR)) {
+        if (!st.st_size) {
+            in->sin_mem = true;
+            return 0;
+        }
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            in->sin_data = (const char *)map;
+            in->sin_size = st.st_size;
+            in->sin_mem = true;
+            in->sin_mapped = true;
+            return 0;
+        }
+    }
+
+    /* Anything else is streamed through a large read buffer. */
+    in->sin_buf = (char *)malloc(SRC_INPUT_STREAM_BUF_SIZE);
+    if (!in->sin_buf)
+        return -1;
+
+    return 0;
+}
+
+int src_input_open(struct src_input *in, const char *path)
+{
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        osink_err_printf(NULL, "**Error: Could not open source file: %s.\n", path);
+        return -1;
+    }
+
+    if (src_input_open_fd(in, fd) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    in->sin_fd_owned = true;
+
+    return 0;
+}
+
+void src_input_open_mem(struct src_input *in, const char *data, size_t size)
+{
+    src_input_init(in, -1);
+
+    in->sin_mem = true;
+    in->sin_data = data;
+    in->sin_size = size;
+}
+
+ssize_t src_input_next(struct src_input *in, const char **data)
+{
+    ssize_t read_size;
+
+    if (in->sin_eof)
+        return 0;
+
+    if (in->sin_mem) {
+        in->sin_eof = true;
+        in->sin_read = in->sin_size;
+        *data = in->sin_data;
+        return in->sin_size;
+    }
+
+    do {
+        read_size = read(in->sin_fd, in->sin_buf, SRC_INPUT_STREAM_BUF_SIZE);
+    } while ((read_size < 0) && (errno == EINTR));
+
+    if (read_size <= 0) {
+        in->sin_eof = true;
+        return read_size;
+    }
+
+    in->sin_read += read_size;
+    *data = in->sin_buf;
+    return read_size;
+}
+
+const char *src_input_path_shown(const char *base_dir, const char *path)
+{
+    size_t base_len;
+
+    if (!base_dir)
+        return path;
+
+    base_len = strlen(base_dir);
+    if (strncmp(path, base_dir, base_len) || (path[base_len] != '/') || !path[base_len + 1])
+        return path;
+
+    return &path[base_len + 1];
+}
+
+void src_input_close(struct src_input *in)
+{
+    if (in->sin_mapped)
+        munmap((void *)in->sin_data, in->sin_size);
+
+    free(in->sin_buf);
+
+    if (in->sin_fd_owned)
+        close(in->sin_fd);
+
+    in->sin_mem = false;
+    in->sin_mapped = false;
+    in->sin_data = NULL;
+    in->sin_buf = NULL;
+}
@@ -0,0 +1,75 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _SRC_INPUT_H__
+#define _SRC_INPUT_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Read size used for sources which can not be mapped (pipes, etc.). Only
+ * the reads are bounded by it: phase 1 writes the whole source out, and the
+ * phases after it take it in full.
+ */
+#define SRC_INPUT_STREAM_BUF_SIZE   (256 * 1024)
+
+struct src_input {
+    int sin_fd;
+
+    /* The descriptor is closed along with the input. */
+    bool sin_fd_owned;
+
+    /* Whole source in memory (mapped regular file, or caller's buffer) */
+    bool sin_mem;
+    bool sin_mapped;
+    const char *sin_data;
+    size_t sin_size;
+
+    /* Streaming fallback buffer */
+    char *sin_buf;
+
+    bool sin_eof;
+
+    /* Number of bytes handed out so far */
+    size_t sin_read;
+};
+
+/* Source Input API */
+int src_input_open(struct src_input *in, const char *path);
+int src_input_open_fd(struct src_input *in, int fd);
+void src_input_open_mem(struct src_input *in, const char *data, size_t size);
+ssize_t src_input_next(struct src_input *in, const char **data);
+void src_input_close(struct src_input *in);
+
+/* Path as shown: relative to base_dir, if it's under it (as given, before
+ * it was resolved against it), or path itself.
+ */
+const char *src_input_path_shown(const char *base_dir, const char *path);
+
+/* Whole source contents, for inputs which are held in memory. */
+static inline bool src_input_data(const struct src_input *in, const char **data, size_t *size)
+{
+    if (!in->sin_mem)
+        return false;
+
+    *data = in->sin_data;
+    *size = in->sin_size;
+
+    return true;
+}
+
+#endif /* _SRC_INPUT_H__ */
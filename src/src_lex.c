@@ -0,0 +1,334 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "src_lex.h"
+
+/* Tokens first made room for: one per so many bytes of text */
+#define SLEX_BYTES_PER_TOK      8
+#define SLEX_INIT_CAP           64
+
+/* Bytes a token takes in the arrays */
+#define SLEX_TOK_SIZE           (2 * sizeof(uint32_t) + 2 * sizeof(uint8_t))
+
+#define SLEX_CC_SPACE   0x01
+#define SLEX_CC_NL      0x02
+#define SLEX_CC_IDENT   0x04    /* Starts an identifier */
+#define SLEX_CC_DIGIT   0x08
+#define SLEX_CC_PREFIX  0x10    /* ... or maybe a literal (its prefix) */
+#define SLEX_CC_PUNCT1  0x20    /* A punctuator on its own, always */
+#define SLEX_CC_IDCHAR  (SLEX_CC_IDENT | SLEX_CC_DIGIT)
+
+static const uint8_t slex_cclass[256] = {
+    [' '] = SLEX_CC_SPACE,
+    ['\t'] = SLEX_CC_SPACE,
+    ['\v'] = SLEX_CC_SPACE,
+    ['\f'] = SLEX_CC_SPACE,
+    ['\r'] = SLEX_CC_SPACE,
+    ['\n'] = SLEX_CC_NL,
+    ['0' ... '9'] = SLEX_CC_DIGIT,
+    ['a' ... 't'] = SLEX_CC_IDENT,
+    ['u'] = SLEX_CC_IDENT | SLEX_CC_PREFIX,
+    ['v' ... 'z'] = SLEX_CC_IDENT,
+    ['A' ... 'K'] = SLEX_CC_IDENT,
+    ['L'] = SLEX_CC_IDENT | SLEX_CC_PREFIX,
+    ['M' ... 'T'] = SLEX_CC_IDENT,
+    ['U'] = SLEX_CC_IDENT | SLEX_CC_PREFIX,
+    ['V' ... 'Z'] = SLEX_CC_IDENT,
+    ['_'] = SLEX_CC_IDENT,
+    ['$'] = SLEX_CC_IDENT,
+    ['('] = SLEX_CC_PUNCT1,
+    [')'] = SLEX_CC_PUNCT1,
+    ['['] = SLEX_CC_PUNCT1,
+    [']'] = SLEX_CC_PUNCT1,
+    ['{'] = SLEX_CC_PUNCT1,
+    ['}'] = SLEX_CC_PUNCT1,
+    [';'] = SLEX_CC_PUNCT1,
+    [','] = SLEX_CC_PUNCT1,
+    ['~'] = SLEX_CC_PUNCT1,
+    ['?'] = SLEX_CC_PUNCT1,
+
+    /* UTF-8 in identifiers */
+    [0x80 ... 0xff] = SLEX_CC_IDENT,
+};
+
+void src_toks_init(struct src_toks *toks)
+{
+    memset(toks, 0, sizeof(struct src_toks));
+}
+
+void src_toks_release(struct src_toks *toks)
+{
+    free(toks->stk_block);
+    src_toks_init(toks);
+}
+
+/* Makes room for num more tokens. */
+static int src_toks_reserve(struct src_toks *toks, size_t num)
+{
+    size_t new_cap = toks->stk_cap ? (toks->stk_cap << 1) : SLEX_INIT_CAP;
+    uint8_t *block;
+    uint32_t *offs;
+    uint32_t *len;
+    uint8_t *kind;
+    uint8_t *flags;
+
+    if (toks->stk_num + num <= toks->stk_cap)
+        return 0;
+
+    if (new_cap < toks->stk_num + num)
+        new_cap = toks->stk_num + num;
+
+    block = (uint8_t *)malloc(new_cap * SLEX_TOK_SIZE);
+    if (!block)
+        return -1;
+
+    offs = (uint32_t *)block;
+    len = &offs[new_cap];
+    kind = (uint8_t *)&len[new_cap];
+    flags = &kind[new_cap];
+
+    if (toks->stk_num) {
+        memcpy(offs, toks->stk_offs, toks->stk_num * sizeof(uint32_t));
+        memcpy(len, toks->stk_len, toks->stk_num * sizeof(uint32_t));
+        memcpy(kind, toks->stk_kind, toks->stk_num);
+        memcpy(flags, toks->stk_flags, toks->stk_num);
+    }
+
+    free(toks->stk_block);
+
+    toks->stk_block = block;
+    toks->stk_offs = offs;
+    toks->stk_len = len;
+    toks->stk_kind = kind;
+    toks->stk_flags = flags;
+    toks->stk_cap = new_cap;
+
+    return 0;
+}
+
+size_t src_lex_punct_len(const char *data, size_t size)
+{
+    const char c1 = (size > 1) ? data[1] : '\0';
+    const char c2 = (size > 2) ? data[2] : '\0';
+
+    switch (data[0]) {
+    case '[': case ']': case '(': case ')': case '{': case '}':
+    case '~': case '?': case ';': case ',':
+        return 1;
+
+    case '.':
+        return ((c1 == '.') && (c2 == '.')) ? 3 : 1;
+
+    case '-':
+        return ((c1 == '>') || (c1 == '-') || (c1 == '=')) ? 2 : 1;
+
+    case '+':
+        return ((c1 == '+') || (c1 == '=')) ? 2 : 1;
+
+    case '&':
+        return ((c1 == '&') || (c1 == '=')) ? 2 : 1;
+
+    case '|':
+        return ((c1 == '|') || (c1 == '=')) ? 2 : 1;
+
+    case '*': case '/': case '!': case '^': case '=':
+        return (c1 == '=') ? 2 : 1;
+
+    case '<':
+        if (c1 == '<')
+            return (c2 == '=') ? 3 : 2;
+        return ((c1 == '=') || (c1 == ':') || (c1 == '%')) ? 2 : 1;
+
+    case '>':
+        if (c1 == '>')
+            return (c2 == '=') ? 3 : 2;
+        return (c1 == '=') ? 2 : 1;
+
+    case '#':
+        return (c1 == '#') ? 2 : 1;
+
+    case ':':
+        return (c1 == '>') ? 2 : 1;
+
+    case '%':
+        if (c1 == ':')
+            return ((c2 == '%') && (size > 3) && (data[3] == ':')) ? 4 : 2;
+        return ((c1 == '=') || (c1 == '>')) ? 2 : 1;
+    }
+
+    return 0;
+}
+
+/* End of the character or string literal whose quote is at q, setting its
+ * kind (PP_TOK_OTHER, for the quote alone, if it's not terminated on its
+ * line).
+ */
+static inline size_t src_lex_lit(const char *data, size_t size, size_t q, uint8_t *kind)
+{
+    const char quote = data[q];
+    size_t i = q + 1;
+
+    while ((i < size) && (data[i] != quote) && (data[i] != '\n')) {
+        if ((data[i] == '\\') && (i + 1 < size) && (data[i + 1] != '\n'))
+            i++;
+        i++;
+    }
+
+    if ((i < size) && (data[i] == quote)) {
+        *kind = (quote == '"') ? PP_TOK_STRING : PP_TOK_CHAR;
+        return i + 1;
+    }
+
+    *kind = PP_TOK_OTHER;
+    return q + 1;
+}
+
+static inline size_t src_lex_tok_at(const char *data, size_t size, size_t i, uint8_t *kind)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t start = i;
+    size_t q;
+
+    if (slex_cclass[p[i]] & SLEX_CC_IDENT) {
+        /* Encoding prefix of a literal */
+        if (slex_cclass[p[i]] & SLEX_CC_PREFIX) {
+            q = i + 1;
+            if ((p[i] == 'u') && (q < size) && (p[q] == '8'))
+                q++;
+
+            if ((q < size) && ((p[q] == '"') || (p[q] == '\''))) {
+                i = src_lex_lit(data, size, q, kind);
+                if (*kind != PP_TOK_OTHER)
+                    return i;
+                i = start;
+            }
+        }
+
+        for (i++; (i < size) && (slex_cclass[p[i]] & SLEX_CC_IDCHAR); i++);
+        *kind = PP_TOK_IDENT;
+
+        return i;
+    }
+
+    if ((slex_cclass[p[i]] & SLEX_CC_DIGIT) ||
+            ((p[i] == '.') && (i + 1 < size) && (slex_cclass[p[i + 1]] & SLEX_CC_DIGIT))) {
+        i++;
+        while (i < size) {
+            if ((((p[i] | 0x20) == 'e') || ((p[i] | 0x20) == 'p')) &&
+                    (i + 1 < size) && ((p[i + 1] == '+') || (p[i + 1] == '-')))
+                i += 2;
+            else if ((slex_cclass[p[i]] & SLEX_CC_IDCHAR) || (p[i] == '.'))
+                i++;
+            else
+                break;
+        }
+        *kind = PP_TOK_NUMBER;
+
+        return i;
+    }
+
+    if ((p[i] == '"') || (p[i] == '\''))
+        return src_lex_lit(data, size, i, kind);
+
+    q = src_lex_punct_len(&data[i], size - i);
+    *kind = q ? PP_TOK_PUNCT : PP_TOK_OTHER;
+
+    return i + (q ? q : 1);
+}
+
+size_t src_lex_tok(const char *data, size_t size, size_t i, uint8_t *kind)
+{
+    return src_lex_tok_at(data, size, i, kind);
+}
+
+int src_lex(struct src_toks *toks, const char *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    uint8_t flags = PP_TOK_F_BOL;
+    uint32_t *offs, *len;
+    uint8_t *kinds, *flagss;
+    size_t n = toks->stk_num;
+    size_t cap;
+    size_t i = 0;
+    size_t start;
+    uint8_t cc;
+    uint8_t kind;
+
+    if (size > UINT32_MAX)
+        return -1;
+
+    if (src_toks_reserve(toks, size / SLEX_BYTES_PER_TOK + 1))
+        return -1;
+
+    /* In locals: stores to the arrays may alias anything else. */
+    offs = toks->stk_offs;
+    len = toks->stk_len;
+    kinds = toks->stk_kind;
+    flagss = toks->stk_flags;
+    cap = toks->stk_cap;
+
+    while (i < size) {
+        cc = slex_cclass[p[i]];
+
+        if (cc & (SLEX_CC_SPACE | SLEX_CC_NL)) {
+            flags = (cc & SLEX_CC_NL) ? PP_TOK_F_BOL : (flags | PP_TOK_F_SPACE);
+            i++;
+            continue;
+        }
+
+        if (n == cap) {
+            toks->stk_num = n;
+            if (src_toks_reserve(toks, 1))
+                return -1;
+
+            offs = toks->stk_offs;
+            len = toks->stk_len;
+            kinds = toks->stk_kind;
+            flagss = toks->stk_flags;
+            cap = toks->stk_cap;
+        }
+
+        start = i;
+
+        /* Identifiers and single punctuators, most of the tokens, are
+         * lexed right here.
+         */
+        if ((cc & (SLEX_CC_IDENT | SLEX_CC_PREFIX)) == SLEX_CC_IDENT) {
+            for (i++; (i < size) && (slex_cclass[p[i]] & SLEX_CC_IDCHAR); i++);
+            kind = PP_TOK_IDENT;
+        } else if (cc & SLEX_CC_PUNCT1) {
+            i++;
+            kind = PP_TOK_PUNCT;
+        } else {
+            i = src_lex_tok_at(data, size, i, &kind);
+        }
+
+        offs[n] = start;
+        len[n] = i - start;
+        kinds[n] = kind;
+        flagss[n] = flags;
+        n++;
+
+        flags = 0;
+    }
+
+    toks->stk_num = n;
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _SRC_LEX_H__
+#define _SRC_LEX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Preprocessing token lexer.
+ *
+ * The phase 3 output of a file is cut into preprocessing tokens (section
+ * 6.4 of the standard): identifiers, pp-numbers, character constants and
+ * string literals, punctuators, and any other character on its own.
+ *
+ * The tokens are kept as a struct of arrays, each array of one property
+ * of all the tokens, carved from a single block: a pass over the tokens
+ * reads only the properties it needs, and the spelling of a token is at
+ * its offset in the text it was cut from.
+ */
+
+enum pp_tok_kind {
+    PP_TOK_EOF,
+    PP_TOK_IDENT,
+    PP_TOK_NUMBER,
+    PP_TOK_CHAR,
+    PP_TOK_STRING,
+    PP_TOK_PUNCT,
+    PP_TOK_OTHER,
+
+    /* An empty macro argument, an operand of ## */
+    PP_TOK_PLACEMARKER,
+};
+
+/* Token flags, as lexed */
+#define PP_TOK_F_BOL        0x01    /* First of its line */
+#define PP_TOK_F_SPACE      0x02    /* White space before it */
+
+struct src_toks {
+    /* Kind (enum pp_tok_kind), flags, offset in the text, and length */
+    uint8_t *stk_kind;
+    uint8_t *stk_flags;
+    uint32_t *stk_offs;
+    uint32_t *stk_len;
+
+    size_t stk_num;
+    size_t stk_cap;
+
+    /* The block all arrays are in */
+    void *stk_block;
+};
+
+/* Lexer API */
+void src_toks_init(struct src_toks *toks);
+void src_toks_release(struct src_toks *toks);
+
+/* Appends the tokens of data (phase 3 output, under 4G) to toks. */
+int src_lex(struct src_toks *toks, const char *data, size_t size);
+
+/* Lexes the token at data[i] (not a white space): sets its kind, and
+ * returns its end.
+ */
+size_t src_lex_tok(const char *data, size_t size, size_t i, uint8_t *kind);
+
+/* Length of the punctuator data starts with (0 - none). */
+size_t src_lex_punct_len(const char *data, size_t size);
+
+#endif /* _SRC_LEX_H__ */
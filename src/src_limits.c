@@ -0,0 +1,247 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <string.h>
+#include <ctype.h>
+
+#include "src_limits.h"
+#include "src_lex.h"
+
+#define slim_is(STR, LEN, WORD) \
+    (((LEN) == sizeof(WORD) - 1) && !memcmp((STR), (WORD), sizeof(WORD) - 1))
+
+void slim_init(struct src_limits *sl, const struct std_trans_lim *lim)
+{
+    memset(sl, 0, sizeof(struct src_limits));
+    sl->sl_lim = lim;
+}
+
+unsigned int slim_limit(const struct src_limits *sl, enum slim_event ev)
+{
+    const struct std_trans_lim *lim = sl->sl_lim;
+
+    switch (ev) {
+    case SLIM_STR_LEN:
+        return lim->char_src_str_num;
+    case SLIM_PAREN_NST:
+        return lim->paren_exp_nst_lvl;
+    case SLIM_BLOCK_NST:
+        return lim->cmpnd_statements_nst_lvl;
+    case SLIM_STRUCT_NST:
+        return lim->cmpnd_nst_lvl;
+    case SLIM_CASES:
+        return lim->cslbl_num;
+    case SLIM_MEMBERS:
+        return lim->membrs_cmpnd_num;
+    case SLIM_ENUM_CONSTS:
+        return lim->enm_cnst_num;
+    default:
+        return 0;
+    }
+}
+
+/* Characters of a string literal: escape sequences count as one, the
+ * quotes and an encoding prefix not at all.
+ */
+static unsigned long slim_str_chars(const char *str, size_t len)
+{
+    unsigned long chars = 0;
+    size_t i = 0;
+    size_t j;
+
+    while ((i < len) && (str[i] != '"'))
+        i++;
+
+    for (i++; i + 1 < len; i++, chars++) {
+        if (str[i] != '\\')
+            continue;
+
+        i++;
+        if (str[i] == 'x') {
+            while ((i + 2 < len) && isxdigit((unsigned char)str[i + 1]))
+                i++;
+        } else if ((str[i] >= '0') && (str[i] <= '7')) {
+            for (j = 0; (j < 2) && (i + 2 < len) &&
+                    (str[i + 1] >= '0') && (str[i + 1] <= '7'); j++)
+                i++;
+        }
+    }
+
+    return chars;
+}
+
+/* The innermost block of kind, in the stack (NULL - none there) */
+static struct slim_blk *slim_blk_find(struct src_limits *sl, enum slim_blk_kind kind)
+{
+    size_t i = (sl->sl_braces < SLIM_BLKS_MAX) ? sl->sl_braces : SLIM_BLKS_MAX;
+
+    while (i--) {
+        if (sl->sl_blks[i].sb_kind == kind)
+            return &sl->sl_blks[i];
+    }
+
+    return NULL;
+}
+
+/* Opens a block, at a '{' following prev. */
+static enum slim_event slim_open(struct src_limits *sl, char prev)
+{
+    const struct std_trans_lim *lim = sl->sl_lim;
+    struct slim_blk *top = sl->sl_braces ? &sl->sl_blks[sl->sl_braces - 1] : NULL;
+    enum slim_event ev = SLIM_NONE;
+    uint8_t kind = SLIM_BLK_CODE;
+
+    if (sl->sl_braces > SLIM_BLKS_MAX)
+        top = NULL;
+
+    /* An initializer, or braces in one; or as told by the tokens ahead. */
+    if ((prev == '=') || (top && (top->sb_kind == SLIM_BLK_INIT)))
+        kind = SLIM_BLK_INIT;
+    else if (sl->sl_next && (sl->sl_next_parens == sl->sl_parens))
+        kind = sl->sl_next;
+
+    sl->sl_next = SLIM_BLK_NONE;
+
+    if (kind == SLIM_BLK_MEMBERS) {
+        if (++sl->sl_member_blks == (unsigned long)lim->cmpnd_nst_lvl + 1)
+            ev = SLIM_STRUCT_NST;
+    } else if ((kind == SLIM_BLK_CODE) || (kind == SLIM_BLK_SWITCH)) {
+        if (++sl->sl_code_blks == (unsigned long)lim->cmpnd_statements_nst_lvl + 1)
+            ev = SLIM_BLOCK_NST;
+    }
+
+    if (sl->sl_braces < SLIM_BLKS_MAX) {
+        sl->sl_blks[sl->sl_braces].sb_kind = kind;
+        sl->sl_blks[sl->sl_braces].sb_count = 0;
+        sl->sl_blks[sl->sl_braces].sb_parens = sl->sl_parens;
+    }
+
+    sl->sl_braces++;
+
+    return ev;
+}
+
+static void slim_close(struct src_limits *sl)
+{
+    uint8_t kind;
+
+    if (!sl->sl_braces)
+        return;
+
+    sl->sl_braces--;
+
+    /* Blocks deeper than the stack are of code, most likely. */
+    kind = (sl->sl_braces < SLIM_BLKS_MAX) ? sl->sl_blks[sl->sl_braces].sb_kind : SLIM_BLK_CODE;
+
+    if (kind == SLIM_BLK_MEMBERS) {
+        sl->sl_member_blks--;
+    } else if (((kind == SLIM_BLK_CODE) || (kind == SLIM_BLK_SWITCH)) && sl->sl_code_blks) {
+        sl->sl_code_blks--;
+    }
+}
+
+/* Counts one more in blk, returning ev once the count takes over limit. */
+static inline enum slim_event slim_count(struct slim_blk *blk, unsigned int limit,
+                                         enum slim_event ev)
+{
+    return (++blk->sb_count == (uint32_t)limit + 1) ? ev : SLIM_NONE;
+}
+
+enum slim_event slim_tok(struct src_limits *sl, uint8_t kind, const char *str, size_t len)
+{
+    const struct std_trans_lim *lim = sl->sl_lim;
+    enum slim_event ev = SLIM_NONE;
+    struct slim_blk *top = NULL;
+    unsigned long prev_str = sl->sl_str;
+    char prev = sl->sl_prev;
+    char c = ((kind == PP_TOK_PUNCT) && (len == 1)) ? str[0] : '\0';
+
+    sl->sl_prev = c;
+    sl->sl_str = 0;
+
+    if (sl->sl_braces && (sl->sl_braces <= SLIM_BLKS_MAX) &&
+            (sl->sl_blks[sl->sl_braces - 1].sb_parens == sl->sl_parens))
+        top = &sl->sl_blks[sl->sl_braces - 1];
+
+    switch (kind) {
+    case PP_TOK_STRING:
+        /* Adjacent literals are concatenated. */
+        sl->sl_str = prev_str + slim_str_chars(str, len);
+        if ((sl->sl_str > lim->char_src_str_num) && (prev_str <= lim->char_src_str_num))
+            return SLIM_STR_LEN;
+        return SLIM_NONE;
+
+    case PP_TOK_IDENT:
+        if (slim_is(str, len, "switch")) {
+            sl->sl_next = SLIM_BLK_SWITCH;
+            sl->sl_next_parens = sl->sl_parens;
+        } else if (slim_is(str, len, "struct") || slim_is(str, len, "union")) {
+            sl->sl_next = SLIM_BLK_MEMBERS;
+            sl->sl_next_parens = sl->sl_parens;
+        } else if (slim_is(str, len, "enum")) {
+            sl->sl_next = SLIM_BLK_ENUM;
+            sl->sl_next_parens = sl->sl_parens;
+        } else if (slim_is(str, len, "case")) {
+            top = slim_blk_find(sl, SLIM_BLK_SWITCH);
+            if (top)
+                return slim_count(top, lim->cslbl_num, SLIM_CASES);
+        } else if (top && (top->sb_kind == SLIM_BLK_ENUM) && ((prev == '{') || (prev == ','))) {
+            return slim_count(top, lim->enm_cnst_num, SLIM_ENUM_CONSTS);
+        }
+        return SLIM_NONE;
+
+    case PP_TOK_PUNCT:
+        break;
+
+    default:
+        return SLIM_NONE;
+    }
+
+    switch (c) {
+    case '(':
+        /* A function returning a struct, rather than its definition */
+        if ((sl->sl_next != SLIM_BLK_SWITCH) && (sl->sl_next_parens == sl->sl_parens))
+            sl->sl_next = SLIM_BLK_NONE;
+
+        if (++sl->sl_parens == (unsigned long)lim->paren_exp_nst_lvl + 1)
+            ev = SLIM_PAREN_NST;
+        break;
+
+    case ')':
+        if (sl->sl_parens)
+            sl->sl_parens--;
+        break;
+
+    case '{':
+        ev = slim_open(sl, prev);
+        break;
+
+    case '}':
+        slim_close(sl);
+        break;
+
+    /* Members: one a declarator */
+    case ';':
+        sl->sl_next = SLIM_BLK_NONE;
+        /* fall through */
+    case ',':
+        if (top && (top->sb_kind == SLIM_BLK_MEMBERS) && (prev != ';') && (prev != '{'))
+            ev = slim_count(top, lim->membrs_cmpnd_num, SLIM_MEMBERS);
+        break;
+    }
+
+    return ev;
+}
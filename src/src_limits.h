@@ -0,0 +1,115 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _SRC_LIMITS_H__
+#define _SRC_LIMITS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "std_comp.h"
+
+/* Translation limits checker.
+ *
+ * The tokens of a translation unit are fed to the checker one by one, as
+ * they come out of phase 4 (or of phase 3, as they are in the source, on
+ * runs stopping there). It keeps the nesting of parentheses and braces,
+ * the length of the string literal being concatenated, and for every block
+ * open the case labels of its switch statement, the members of its struct
+ * or union, or the constants of its enumeration. Blocks are told apart by
+ * the tokens ahead of their '{' only: there's no parsing.
+ *
+ * The blocks are kept in a stack as deep as the largest of the standard
+ * limits on their nesting; deeper ones are over the limit anyway, and are
+ * only counted. So the memory the checker takes is fixed.
+ *
+ * The limits checked elsewhere, as part of the translation phases: the
+ * length of a logical source line (phase 2), and the nesting of
+ * conditional inclusion and of included files (phase 4).
+ */
+
+#define SLIM_BLKS_MAX   128
+
+/* A limit exceeded, as a token is fed */
+enum slim_event {
+    SLIM_NONE,
+    SLIM_STR_LEN,
+    SLIM_PAREN_NST,
+    SLIM_BLOCK_NST,
+    SLIM_STRUCT_NST,
+    SLIM_CASES,
+    SLIM_MEMBERS,
+    SLIM_ENUM_CONSTS,
+
+    SLIM_EVENTS_NUM
+};
+
+enum slim_blk_kind {
+    SLIM_BLK_NONE,
+    SLIM_BLK_CODE,
+    SLIM_BLK_SWITCH,
+    SLIM_BLK_MEMBERS,
+    SLIM_BLK_ENUM,
+    SLIM_BLK_INIT,
+};
+
+struct slim_blk {
+    uint8_t sb_kind;
+
+    /* Case labels, members or constants so far */
+    uint32_t sb_count;
+
+    /* Parenthesis nesting at its '{' */
+    uint32_t sb_parens;
+};
+
+struct src_limits {
+    const struct std_trans_lim *sl_lim;
+
+    unsigned long sl_parens;
+    unsigned long sl_braces;
+
+    /* Blocks open, and how many of them are of code or of members */
+    struct slim_blk sl_blks[SLIM_BLKS_MAX];
+    unsigned long sl_code_blks;
+    unsigned long sl_member_blks;
+
+    /* What the next '{' opens (SLIM_BLK_NONE - not known), as told at
+     * parenthesis nesting sl_next_parens.
+     */
+    uint8_t sl_next;
+    unsigned long sl_next_parens;
+
+    /* The previous token, if a punctuator of one character (0 - not) */
+    char sl_prev;
+
+    /* Characters of the string literals being concatenated (0 - none) */
+    unsigned long sl_str;
+};
+
+/* Translation limits checker API */
+void slim_init(struct src_limits *sl, const struct std_trans_lim *lim);
+
+/* Feeds a token (its kind an enum pp_tok_kind); returns the limit it
+ * takes over, if any.
+ */
+enum slim_event slim_tok(struct src_limits *sl, uint8_t kind, const char *str, size_t len);
+
+/* The value of the limit of an event */
+unsigned int slim_limit(const struct src_limits *sl, enum slim_event ev);
+
+#endif /* _SRC_LIMITS_H__ */
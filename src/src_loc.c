@@ -0,0 +1,219 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "src_loc.h"
+
+/* Longest encoding of a 64 bit value */
+#define SLOC_VARINT_MAX     10
+
+void sloc_map_init(struct sloc_map *map)
+{
+    memset(map, 0, sizeof(struct sloc_map));
+}
+
+void sloc_map_release(struct sloc_map *map)
+{
+    free(map->slm_data);
+    free(map->slm_cps);
+    sloc_map_init(map);
+}
+
+static inline size_t sloc_varint_put(uint8_t *dst, uint64_t val)
+{
+    size_t len = 0;
+
+    while (val >= 0x80) {
+        dst[len++] = (uint8_t)val | 0x80;
+        val >>= 7;
+    }
+
+    dst[len++] = (uint8_t)val;
+
+    return len;
+}
+
+static inline uint64_t sloc_varint_get(const uint8_t *src, size_t *pos)
+{
+    uint64_t val = 0;
+    int shift = 0;
+
+    while (src[*pos] & 0x80) {
+        val |= (uint64_t)(src[(*pos)++] & 0x7f) << shift;
+        shift += 7;
+    }
+
+    val |= (uint64_t)src[(*pos)++] << shift;
+
+    return val;
+}
+
+int sloc_map_add(struct sloc_map *map, uint64_t key, uint64_t val)
+{
+    if (map->slm_err)
+        return -1;
+
+    /* Pairs only go forward. */
+    if (map->slm_num && ((key < map->slm_key) || (val < map->slm_val)))
+        return -1;
+
+    if (!(map->slm_num % SLOC_CP_INTERVAL)) {
+        if (map->slm_cps_num == map->slm_cps_cap) {
+            size_t new_cap = map->slm_cps_cap ? (map->slm_cps_cap << 1) : 16;
+            struct sloc_cp *new_cps;
+
+            new_cps = (struct sloc_cp *)realloc(map->slm_cps, sizeof(struct sloc_cp) * new_cap);
+            if (!new_cps)
+                goto err;
+
+            map->slm_cps = new_cps;
+            map->slm_cps_cap = new_cap;
+        }
+
+        map->slm_cps[map->slm_cps_num].slc_key = key;
+        map->slm_cps[map->slm_cps_num].slc_val = val;
+        map->slm_cps[map->slm_cps_num].slc_pos = map->slm_size;
+        map->slm_cps_num++;
+
+    } else {
+        if (map->slm_size + (2 * SLOC_VARINT_MAX) > map->slm_cap) {
+            size_t new_cap = map->slm_cap ? (map->slm_cap << 1) : 256;
+            uint8_t *new_data;
+
+            new_data = (uint8_t *)realloc(map->slm_data, new_cap);
+            if (!new_data)
+                goto err;
+
+            map->slm_data = new_data;
+            map->slm_cap = new_cap;
+        }
+
+        map->slm_size += sloc_varint_put(&map->slm_data[map->slm_size], key - map->slm_key);
+        map->slm_size += sloc_varint_put(&map->slm_data[map->slm_size], val - map->slm_val);
+    }
+
+    map->slm_key = key;
+    map->slm_val = val;
+    map->slm_num++;
+
+    return 0;
+
+err:
+    /* Lookups past this point would be off; better not to have them. */
+    map->slm_err = 1;
+    return -1;
+}
+
+/* Finds the last pair with a key up to key. */
+int sloc_map_find(const struct sloc_map *map, uint64_t key, uint64_t *pkey, uint64_t *pval)
+{
+    const struct sloc_cp *cp;
+    uint64_t cur_key, cur_val;
+    uint64_t d_key, d_val;
+    size_t lo = 0, hi = map->slm_cps_num;
+    size_t pos, end, mid;
+    size_t cp_indx;
+
+    if (map->slm_err || !map->slm_num || (key < map->slm_cps[0].slc_key))
+        return -1;
+
+    while (hi - lo > 1) {
+        mid = lo + ((hi - lo) / 2);
+        if (map->slm_cps[mid].slc_key <= key)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    cp_indx = lo;
+    cp = &map->slm_cps[cp_indx];
+    cur_key = cp->slc_key;
+    cur_val = cp->slc_val;
+    pos = cp->slc_pos;
+    end = (cp_indx + 1 < map->slm_cps_num) ? map->slm_cps[cp_indx + 1].slc_pos : map->slm_size;
+
+    while (pos < end) {
+        d_key = sloc_varint_get(map->slm_data, &pos);
+        d_val = sloc_varint_get(map->slm_data, &pos);
+
+        if (cur_key + d_key > key)
+            break;
+
+        cur_key += d_key;
+        cur_val += d_val;
+    }
+
+    *pkey = cur_key;
+    *pval = cur_val;
+
+    return 0;
+}
+
+/* Maps an output offset to the input offset it came from. */
+uint64_t sloc_map_trans(const struct sloc_map *map, uint64_t key)
+{
+    uint64_t pkey, pval;
+
+    if (sloc_map_find(map, key, &pkey, &pval) < 0)
+        return key;
+
+    return pval + (key - pkey);
+}
+
+void src_locs_init(struct src_locs *locs)
+{
+    int i;
+
+    for (i = 0; i < SLOC_PHASES_NUM; i++)
+        sloc_map_init(&locs->sl_phases[i]);
+
+    sloc_map_init(&locs->sl_lines);
+}
+
+void src_locs_release(struct src_locs *locs)
+{
+    int i;
+
+    for (i = 0; i < SLOC_PHASES_NUM; i++)
+        sloc_map_release(&locs->sl_phases[i]);
+
+    sloc_map_release(&locs->sl_lines);
+}
+
+/* Finds the source file line and column of offset offs in the output of
+ * phase.
+ */
+int src_locs_lookup(const struct src_locs *locs, enum src_loc_phase phase, size_t offs,
+                    unsigned int *line, unsigned int *col)
+{
+    uint64_t line_offs, line_num;
+    int i;
+
+    /* Down to the phase 1 output, where the lines are kept. */
+    for (i = phase; i > SLOC_PHASE_1; i--)
+        offs = sloc_map_trans(&locs->sl_phases[i], offs);
+
+    if (sloc_map_find(&locs->sl_lines, offs, &line_offs, &line_num) < 0)
+        return -1;
+
+    *line = line_num;
+    *col = sloc_map_trans(&locs->sl_phases[SLOC_PHASE_1], offs) -
+           sloc_map_trans(&locs->sl_phases[SLOC_PHASE_1], line_offs) + 1;
+
+    return 0;
+}
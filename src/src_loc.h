@@ -0,0 +1,106 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _SRC_LOC_H__
+#define _SRC_LOC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Source location map.
+ *
+ * The translation phases only ever drop characters (or replace a sequence
+ * with a shorter one), so the offset of an output character minus the
+ * offset of the input character it came from only grows. A map keeps a
+ * (key, value) pair where that difference changes, delta encoded as two
+ * variable length integers; a key maps to the value of the closest pair
+ * at or before it, plus the distance from it.
+ *
+ * Every SLOC_CP_INTERVAL pairs a checkpoint keeps the absolute values, so
+ * a lookup is a binary search over the checkpoints and a short decode.
+ */
+
+#define SLOC_CP_INTERVAL    64
+
+struct sloc_cp {
+    uint64_t slc_key;
+    uint64_t slc_val;
+
+    /* Offset in the encoded data of the pair following it */
+    size_t slc_pos;
+};
+
+struct sloc_map {
+    uint8_t *slm_data;
+    size_t slm_size;
+    size_t slm_cap;
+
+    struct sloc_cp *slm_cps;
+    size_t slm_cps_num;
+    size_t slm_cps_cap;
+
+    /* Number of pairs, and the last one */
+    size_t slm_num;
+    uint64_t slm_key;
+    uint64_t slm_val;
+
+    int slm_err;
+};
+
+/* The translation phases mapped, and their locations */
+enum src_loc_phase {
+    SLOC_PHASE_1,
+    SLOC_PHASE_2,
+    SLOC_PHASE_3,
+
+    SLOC_PHASES_NUM
+};
+
+struct src_locs {
+    /* Output offset of each phase, to its input offset */
+    struct sloc_map sl_phases[SLOC_PHASES_NUM];
+
+    /* Offset of each line start in the phase 1 output (which has the
+     * lines of the source file), to its line number.
+     */
+    struct sloc_map sl_lines;
+};
+
+/* Location Map API */
+void sloc_map_init(struct sloc_map *map);
+void sloc_map_release(struct sloc_map *map);
+int sloc_map_add(struct sloc_map *map, uint64_t key, uint64_t val);
+int sloc_map_find(const struct sloc_map *map, uint64_t key, uint64_t *pkey, uint64_t *pval);
+uint64_t sloc_map_trans(const struct sloc_map *map, uint64_t key);
+
+/* Notes that output offset key came from input offset val. Only a change
+ * of the distance between the two is recorded.
+ */
+static inline void sloc_map_note(struct sloc_map *map, uint64_t key, uint64_t val)
+{
+    if (map->slm_num && (val - key == map->slm_val - map->slm_key))
+        return;
+
+    sloc_map_add(map, key, val);
+}
+
+/* Source Locations API */
+void src_locs_init(struct src_locs *locs);
+void src_locs_release(struct src_locs *locs);
+int src_locs_lookup(const struct src_locs *locs, enum src_loc_phase phase, size_t offs,
+                    unsigned int *line, unsigned int *col);
+
+#endif /* _SRC_LOC_H__ */
@@ -14,150 +14,189 @@
  * distribution in a file called "COPYING" or "LICENSE".
  ***********************************************************************/
 
-#include <unistd.h>
 #include <string.h>
-#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "src_parser.h"
+#include "src_input.h"
+#include "out_sink.h"
+#include "byte_dfa.h"
 #include "analysis_print.h"
-
-#define TMP_FILE_NAME           ".gilcc-tmpfile-XXXXXX"
-#define TMP_FILE_NAME_SIZE      22
-
-/* Parser file-buffer/stack */
-#define PSTACK_BUF_SIZE     2
-#define PARSER_BUF_SIZE     200
-
-struct pbuf {
-    char pbuf_buf[PARSER_BUF_SIZE];
-    int pbuf_content_size;
-    int pbuf_indx;
+#include "src_stats.h"
+#include "src_loc.h"
+#include "src_pp.h"
+
+/* Parser memory cursor (translation phase input) */
+struct mcur {
+    const char *mcur_data;
+    size_t mcur_size;
+    size_t mcur_indx;
+
+    /* Offset of the data in the input */
+    size_t mcur_base;
 };
 
-#define PBUF_CUR_CHAR(B) (B.pbuf_buf[B.pbuf_indx])
-#define PBUF_DATA_SIZE(B) (B.pbuf_content_size - B.pbuf_indx)
-#define PBUF_ADVN(B) (B.pbuf_indx++)
 
-static int pbuf_fill(struct pbuf *buf, const int ifd)
+static int mcur_fill(struct mcur *buf, struct src_input *in)
 {
-    int read_size;
+    ssize_t read_size;
 
-    if (buf->pbuf_content_size - buf->pbuf_indx)
-        return (buf->pbuf_content_size - buf->pbuf_indx);
+    if (buf->mcur_size - buf->mcur_indx)
+        return (buf->mcur_size - buf->mcur_indx);
 
-    read_size = read(ifd, buf->pbuf_buf, PARSER_BUF_SIZE);
-    buf->pbuf_indx = 0;
-    buf->pbuf_content_size = read_size;
+    read_size = src_input_next(in, &buf->mcur_data);
+    buf->mcur_base += buf->mcur_size;
+    buf->mcur_indx = 0;
+    buf->mcur_size = (read_size > 0) ? read_size : 0;
 
     return read_size;
 }
 
-static inline int pbuf_write_char(struct pbuf *buf, const int ofd)
+static void print_buf_full(const struct osink *buf)
 {
-    return write(ofd, &buf->pbuf_buf[buf->pbuf_indx], 1);
+    osink_write(osink_cur(), buf->osk_buf, buf->osk_size);
+    osink_put_char(osink_cur(), '\n');
 }
 
-struct pstack {
-    char pstack_buf[PSTACK_BUF_SIZE];
-    int pstack_indx;
-};
-
-#define PSTACK_DATA_SIZE(S) (S.pstack_indx)
-#define PSTACK_PUSH_CHAR(S, C) (S.pstack_buf[S.pstack_indx++] = C)
-#define PSTACK_CLEAR(S) (S.pstack_indx = 0)
+/* Longest run of input held back from the output before it's copied,
+ * while still in the cache.
+ */
+#define TSTAGE_COPY_RUN     (32 * 1024)
 
-static inline int pstack_write(struct pstack *stk, const int ofd)
+static inline int write_char(const char c, struct osink *dst)
 {
-    int write_size;
-
-    if (!stk->pstack_indx)
-        return 0;
-
-    if ((write_size = write(ofd, stk->pstack_buf, stk->pstack_indx)) > 0)
-        stk->pstack_indx = 0;
-
-    return write_size;
-}
-
-int *line_reduce_lst = NULL;
-static int line_reduce_lst_size;
-
-static inline int line_reduce_add_line(int line_num, int seq_num)
-{
-    if (!line_reduce_lst)
-        return -1;
-
-    if (seq_num >= line_reduce_lst_size)
-        return -1;
-
-    line_reduce_lst[seq_num] = line_num;
-
-    return 0;
+    return osink_put_char(dst, c);
 }
 
-/* TODO: add file tracking and per-file line/char count. */
+/* Translation phase 1 DFA.
+ *
+ * A new-line may be followed by a carriage return, and a carriage return
+ * by a new-line, to make a single end-of-line; '?' and '??' may start a
+ * trigraph.
+ *
+ * The second character of an end-of-line pair is looked at by the action
+ * of the first, so that lines go back to the code state (and its skip) at
+ * once. The LF and CR states are only left at the end of the data.
+ */
+enum tstage_1_class {
+    T1_C_OTHER,
+    T1_C_LF,
+    T1_C_CR,
+    T1_C_RS,
+    T1_C_QMARK,
+    T1_C_TRIGRAPH,
+
+    T1_CLASSES_NUM
+};
 
-static void print_file_full(int fd)
-{
-    char f_buf[PARSER_BUF_SIZE];
-    int read_size;
+enum tstage_1_state {
+    T1_S_CODE,
+    T1_S_LF,
+    T1_S_CR,
+    T1_S_Q1,
+    T1_S_Q2,
 
-    if (lseek(fd, 0, SEEK_SET)) {
-        fprintf(stderr, "**Error: Could not set offset.\n");
-        return;
-    }
+    T1_STATES_NUM
+};
 
-    while ((read_size = read(fd, f_buf, PARSER_BUF_SIZE)) > 0) {
-        int read_indx = 0;
+enum tstage_1_act {
+    T1_A_NONE,
+    T1_A_LF,            /* New-line */
+    T1_A_CR,            /* Carriage return, written as a new-line */
+    T1_A_RS,            /* Record separator, written as a new-line */
+    T1_A_EOL_PAIR,      /* Second character of an end-of-line pair */
+    T1_A_NO_TRIGRAPH,   /* The pending '?'s make no trigraph */
+    T1_A_TRIGRAPH,
+};
 
-        while (read_indx < read_size)
-            putchar(f_buf[read_indx++]);
-    }
-    printf("\n");
-}
+static const uint8_t tstage_1_classes[256] = {
+    ['\n'] = T1_C_LF,
+    ['\r'] = T1_C_CR,
+    [30] = T1_C_RS,
+    ['?'] = T1_C_QMARK,
+    ['='] = T1_C_TRIGRAPH,
+    ['('] = T1_C_TRIGRAPH,
+    [')'] = T1_C_TRIGRAPH,
+    ['/'] = T1_C_TRIGRAPH,
+    ['\''] = T1_C_TRIGRAPH,
+    ['<'] = T1_C_TRIGRAPH,
+    ['>'] = T1_C_TRIGRAPH,
+    ['!'] = T1_C_TRIGRAPH,
+    ['-'] = T1_C_TRIGRAPH,
+};
 
-static inline int write_char(const char c, const int ofd)
-{
-    return write(ofd, &c, 1);
-}
+/* Trigraph replacements, by last character */
+static const char tstage_1_trigraphs[256] = {
+    ['='] = '#',
+    ['('] = '[',
+    [')'] = ']',
+    ['/'] = '\\',
+    ['\''] = '^',
+    ['<'] = '{',
+    ['>'] = '}',
+    ['!'] = '|',
+    ['-'] = '~',
+};
 
-/* TODO: Add current file-name to the error message */
+#define T1(S, A) BDFA_TRANS(T1_S_ ## S, T1_CLASSES_NUM, T1_A_ ## A)
+#define T1_ROW(S) (T1_S_ ## S * T1_CLASSES_NUM)
 
-static void cpp_warning_analysis_print(int line_num, int char_num, char *msg)
-{
-    char p_msg[120];
+static const uint16_t tstage_1_trans[T1_STATES_NUM * T1_CLASSES_NUM] = {
+    /*          OTHER               LF                  CR                  RS                  QMARK               TRIGRAPH */
+    /* CODE */  T1(CODE, NONE),     T1(CODE, LF),       T1(CODE, CR),       T1(CODE, RS),       T1(Q1, NONE),       T1(CODE, NONE),
+    /* LF */    T1(CODE, NONE),     T1(CODE, LF),       T1(CODE, EOL_PAIR), T1(CODE, RS),       T1(Q1, NONE),       T1(CODE, NONE),
+    /* CR */    T1(CODE, NONE),     T1(CODE, EOL_PAIR), T1(CODE, CR),       T1(CODE, RS),       T1(Q1, NONE),       T1(CODE, NONE),
+    /* Q1 */    T1(CODE, NO_TRIGRAPH), T1(CODE, NO_TRIGRAPH), T1(CODE, NO_TRIGRAPH), T1(CODE, NO_TRIGRAPH), T1(Q2, NONE), T1(CODE, NO_TRIGRAPH),
+    /* Q2 */    T1(CODE, NO_TRIGRAPH), T1(CODE, NO_TRIGRAPH), T1(CODE, NO_TRIGRAPH), T1(CODE, NO_TRIGRAPH), T1(CODE, NO_TRIGRAPH), T1(CODE, TRIGRAPH),
+};
 
-    sprintf(p_msg, "CPP code: (line %d, at %d) %s", line_num, char_num, msg);
-    analysis_print(APRINT_WARNING, 2, p_msg);
-}
+/* Code runs up to the next end-of-line or '?' */
+static const struct fscan_set tstage_1_code_stops = FSCAN_SET_4('\r', '\n', 30, '?');
 
-static void cpp_warning_analysis_line_print(int line_num, char *msg)
-{
-    char p_msg[120];
+static const struct fscan_set *const tstage_1_skips[T1_STATES_NUM] = {
+    [T1_S_CODE] = &tstage_1_code_stops,
+};
 
-    sprintf(p_msg, "CPP code: (line %d) %s", line_num, msg);
-    analysis_print(APRINT_WARNING, 2, p_msg);
-}
+static const struct byte_dfa tstage_1_dfa = {
+    .bd_classes = tstage_1_classes,
+    .bd_trans = tstage_1_trans,
+    .bd_classes_num = T1_CLASSES_NUM,
+    .bd_skips = tstage_1_skips
+};
 
-static int src_parser_tstage_1( const int dst_fd,
-                                const int src_fd,
-                                const bool exp_trigraphs)
+static int src_parser_tstage_1( struct osink *dst,
+                                struct src_input *src,
+                                const bool exp_trigraphs,
+                                struct src_locs *locs,
+                                struct src_stats *st)
 {
-    struct pbuf buf = {
-        .pbuf_indx = 0,
-        .pbuf_content_size = 0
+    struct mcur buf = {
+        .mcur_data = NULL,
+        .mcur_size = 0,
+        .mcur_indx = 0,
+        .mcur_base = 0
     };
+    struct sloc_map *map = &locs->sl_phases[SLOC_PHASE_1];
 
-    struct pstack stk = {
-        .pstack_indx = 0
-    };
-
-    int state = 0;
+    unsigned int row = T1_ROW(CODE);
+    uint16_t t;
 
     int line_indx = 1;
-    int char_indx = 1;
+    size_t line_start = 0;
+    int col_adj = 0;
+    unsigned long trigraphs = 0;
+
+    const char *data;
+    size_t size;
+    size_t i;
+
+    /* Start of the data not written yet, and the number of pending '?'s
+     * held over from the data before it.
+     */
+    size_t copy_indx;
+    size_t held = 0;
+    size_t pending;
 
     /* CPP Translation phase 1:
      *  - Map physical characters to source character set.
@@ -172,576 +211,714 @@ static int src_parser_tstage_1( const int dst_fd,
      *  - RS (Record Separator), ASCII: 30
      *
      * Trigraphs all start with the sequence '??'.
+     *
+     * The input is written as is between the characters acted on. Characters
+     * are only dropped by the end-of-line pairs and by trigraphs; the
+     * location map takes note after each. Line starts are kept as well.
+     *
+     * Columns count a step for each character, and another whenever a
+     * character is looked at again (after an end-of-line not completed to a
+     * pair, or '?'s making no trigraph).
      */
 
-    pbuf_fill(&buf, src_fd);
-    while (PBUF_DATA_SIZE(buf) || (pbuf_fill(&buf, src_fd) > 0)) {
-        switch(state) {
-        case 0:
-            switch (PBUF_CUR_CHAR(buf)) {
-            case '\r':
-                state++;
-            case '\n':
-                state++;
-            case 30:
-                line_indx++;
-                char_indx = 1;
-                write_char('\n', dst_fd);
-                PBUF_ADVN(buf);
-                break;
-
-            case '?':
-                PSTACK_PUSH_CHAR(stk, '?');
-                PBUF_ADVN(buf);
-                state = 3;
-                break;
+    sloc_map_add(map, 0, 0);
+    sloc_map_add(&locs->sl_lines, 0, 1);
+
+    while (mcur_fill(&buf, src) > 0) {
+        data = buf.mcur_data;
+        size = buf.mcur_size;
+        copy_indx = 0;
+        i = 0;
+
+        while ((i += bdfa_run(&tstage_1_dfa, &row, &t, &data[i], size - i)) < size) {
+
+            switch (BDFA_ACT(t)) {
+            case T1_A_LF:
+            case T1_A_CR:
+            case T1_A_RS:
+                /* A new-line is written as it is (along with the lines
+                 * before, once they're a good part of the cache).
+                 */
+                if (BDFA_ACT(t) != T1_A_LF) {
+                    osink_write(dst, &data[copy_indx], i - copy_indx);
+                    write_char('\n', dst);
+                    copy_indx = i + 1;
+                } else if (i - copy_indx >= TSTAGE_COPY_RUN) {
+                    osink_write(dst, &data[copy_indx], i + 1 - copy_indx);
+                    copy_indx = i + 1;
+                }
 
-            default:
-                pbuf_write_char(&buf, dst_fd);
-                PBUF_ADVN(buf);
-            }
+                line_indx++;
+                line_start = buf.mcur_base + i;
+                col_adj = (BDFA_ACT(t) != T1_A_RS);
+                sloc_map_add(&locs->sl_lines, dst->osk_size + (i + 1 - copy_indx), line_indx);
 
-            break;
+                if (BDFA_ACT(t) == T1_A_RS)
+                    break;
 
-        case 1:
-            if (PBUF_CUR_CHAR(buf) == '\r')
-                PBUF_ADVN(buf);
-            state = 0;
-            break;
+                if (i + 1 == size) {
+                    t = (BDFA_ACT(t) == T1_A_LF) ? T1(LF, NONE) : T1(CR, NONE);
+                    break;
+                }
 
-        case 2:
-            if (PBUF_CUR_CHAR(buf) == '\n')
-                PBUF_ADVN(buf);
-            state = 0;
-            break;
+                if (data[i + 1] != ((BDFA_ACT(t) == T1_A_LF) ? '\r' : '\n'))
+                    break;
 
-        case 3:
-            if (PBUF_CUR_CHAR(buf) == '?') {
-                PSTACK_PUSH_CHAR(stk, '?');
-                PBUF_ADVN(buf);
-                state = 4;
-            } else {
-                pstack_write(&stk, dst_fd);
-                state = 0;
-            }
-            break;
+                i++;
+                /* fall through */
 
-        case 4:
-            {
-                char c;
+            case T1_A_EOL_PAIR:
+                if (i > copy_indx)
+                    osink_write(dst, &data[copy_indx], i - copy_indx);
+                copy_indx = i + 1;
+                col_adj--;
+                sloc_map_note(map, dst->osk_size, buf.mcur_base + i + 1);
+                break;
 
-                switch (PBUF_CUR_CHAR(buf)) {
-                case '=':
-                    c = '#';
-                    break;
-                case '(':
-                    c = '[';
-                    break;
-                case ')':
-                    c = ']';
-                    break;
-                case '/':
-                    c = '\\';
-                    break;
-                case '\'':
-                    c = '^';
-                    break;
-                case '<':
-                    c = '{';
-                    break;
-                case '>':
-                    c = '}';
-                    break;
-                case '!':
-                    c = '|';
-                    break;
-                case '-':
-                    c = '~';
-                    break;
-                default:
-                    c = '\0';
+            case T1_A_TRIGRAPH:
+                if (exp_trigraphs) {
+                    /* Up to the '??' (the part of it in this data) */
+                    osink_write(dst, &data[copy_indx], i + held - 2 - copy_indx);
+                    write_char(tstage_1_trigraphs[(unsigned char)data[i]], dst);
+                    copy_indx = i + 1;
+                    held = 0;
+                    sloc_map_note(map, dst->osk_size, buf.mcur_base + i + 1);
+                    trigraphs++;
                     break;
                 }
 
-                if (c && exp_trigraphs) {
-                    write_char(c, dst_fd);
-                    PSTACK_CLEAR(stk);
-                    PBUF_ADVN(buf);
-                } else if (c && !exp_trigraphs) {
-                    cpp_warning_analysis_print(line_indx, char_indx, "unsupported trigraph sequence.");
-                    pstack_write(&stk, dst_fd);
-                } else {
-                    pstack_write(&stk, dst_fd);
-                }
+                aprint_report(APRINT_R_TRIGRAPH_UNSUPPORTED, line_indx,
+                              (int)(1 + (buf.mcur_base + i - line_start)) + col_adj);
+                /* fall through */
+
+            case T1_A_NO_TRIGRAPH:
+                /* The '?'s are written as they are, and the character is
+                 * looked at again.
+                 */
+                osink_write(dst, "??", held);
+                held = 0;
+                col_adj++;
+                row = T1_ROW(CODE);
+                continue;
             }
 
-            state = 0;
-            break;
+            row = BDFA_NEXT(t);
+            i++;
 
-        default:
-            return -1;
+            /* Mostly the start of a line: the code up to its end at once */
+            if (row == T1_ROW(CODE))
+                i += fscan_span(&data[i], size - i, &tstage_1_code_stops);
         }
-        char_indx++;
+
+        /* The '?'s pending at the end of the data are held over (and
+         * dropped at the end of the input).
+         */
+        pending = (row == T1_ROW(Q1)) ? 1 : ((row == T1_ROW(Q2)) ? 2 : 0);
+        osink_write(dst, &data[copy_indx], size - copy_indx - (pending - held));
+        held = pending;
+        buf.mcur_indx = size;
     }
 
+    if (st)
+        st->ss_trigraphs = trigraphs;
+
+    if (dst->osk_err || map->slm_err || locs->sl_lines.slm_err)
+        return -1;
+
     return 0;
 }
 
-static int src_parser_pre_stage_2(const int src_fd)
+/* Translation phase 2 DFA, along with the style checker.
+ *
+ * States follow the last character (a back-slash followed by a new-line
+ * is a splice); the _E ones are those where the style checker still takes
+ * the line as empty.
+ */
+enum tstage_2_class {
+    T2_C_OTHER,
+    T2_C_SPACE,
+    T2_C_TAB,
+    T2_C_LF,
+    T2_C_BSLASH,
+
+    T2_CLASSES_NUM
+};
+
+enum tstage_2_state {
+    T2_S_CODE_E,
+    T2_S_CODE,
+    T2_S_SPACE_E,
+    T2_S_SPACE,
+    T2_S_TAB_E,
+    T2_S_TAB,
+    T2_S_LF_E,
+    T2_S_LF,
+    T2_S_BSLASH_E,
+    T2_S_BSLASH,
+
+    T2_STATES_NUM
+};
+
+enum tstage_2_act {
+    T2_A_NONE,
+    T2_A_MIXED,         /* Tabs mixed with spaces */
+    T2_A_LINE,          /* First character of a line */
+    T2_A_LINE_LF,       /* First character of a line, a new-line */
+    T2_A_SPLICE,
+};
+
+static const uint8_t tstage_2_classes[256] = {
+    [' '] = T2_C_SPACE,
+    ['\t'] = T2_C_TAB,
+    ['\n'] = T2_C_LF,
+    ['\\'] = T2_C_BSLASH,
+};
+
+#define T2(S, A) BDFA_TRANS(T2_S_ ## S, T2_CLASSES_NUM, T2_A_ ## A)
+#define T2_ROW(S) (T2_S_ ## S * T2_CLASSES_NUM)
+
+static const uint16_t tstage_2_trans[T2_STATES_NUM * T2_CLASSES_NUM] = {
+    /*              OTHER               SPACE               TAB                 LF                  BSLASH */
+    /* CODE_E */    T2(CODE, NONE),     T2(SPACE_E, NONE),  T2(TAB_E, NONE),    T2(LF_E, NONE),     T2(BSLASH_E, NONE),
+    /* CODE */      T2(CODE, NONE),     T2(SPACE, NONE),    T2(TAB, NONE),      T2(LF, NONE),       T2(BSLASH, NONE),
+    /* SPACE_E */   T2(CODE, NONE),     T2(SPACE_E, NONE),  T2(TAB_E, MIXED),   T2(LF_E, NONE),     T2(BSLASH, NONE),
+    /* SPACE */     T2(CODE, NONE),     T2(SPACE, NONE),    T2(TAB, MIXED),     T2(LF, NONE),       T2(BSLASH, NONE),
+    /* TAB_E */     T2(CODE, NONE),     T2(SPACE_E, MIXED), T2(TAB_E, NONE),    T2(LF_E, NONE),     T2(BSLASH, NONE),
+    /* TAB */       T2(CODE, NONE),     T2(SPACE, MIXED),   T2(TAB, NONE),      T2(LF, NONE),       T2(BSLASH, NONE),
+    /* LF_E */      T2(CODE, LINE),     T2(SPACE_E, LINE),  T2(TAB_E, LINE),    T2(LF_E, LINE_LF),  T2(BSLASH, LINE),
+    /* LF */        T2(CODE, LINE),     T2(SPACE_E, LINE),  T2(TAB_E, LINE),    T2(LF_E, LINE_LF),  T2(BSLASH, LINE),
+    /* BSLASH_E */  T2(CODE_E, NONE),   T2(SPACE_E, NONE),  T2(TAB_E, NONE),    T2(CODE_E, SPLICE), T2(BSLASH_E, NONE),
+    /* BSLASH */    T2(CODE, NONE),     T2(SPACE, NONE),    T2(TAB, NONE),      T2(CODE_E, SPLICE), T2(BSLASH, NONE),
+};
+
+static const struct byte_dfa tstage_2_dfa = {
+    .bd_classes = tstage_2_classes,
+    .bd_trans = tstage_2_trans,
+    .bd_classes_num = T2_CLASSES_NUM
+};
+
+/* Column the style checker gives the character at indx. It counts a step
+ * for each character from the line start, and another for each character
+ * of code following a blank or a back-slash (looked at again as code).
+ */
+static int tstage_2_col(const char *data, size_t line_start, size_t indx, int col_adj)
+{
+    int col = 1 + (indx - line_start) + col_adj;
+    size_t i;
+
+    for (i = line_start + 1; i < indx; i++) {
+        if ((tstage_2_classes[(unsigned char)data[i]] == T2_C_OTHER) &&
+            (tstage_2_classes[(unsigned char)data[i - 1]] != T2_C_OTHER) &&
+            (tstage_2_classes[(unsigned char)data[i - 1]] != T2_C_LF))
+            col++;
+    }
+
+    return col;
+}
+
+static int src_parser_tstage_2( struct osink *dst,
+                                const struct osink *src,
+                                unsigned int line_max,
+                                struct src_locs *locs,
+                                struct src_stats *st)
 {
-    struct pbuf buf = {
-        .pbuf_indx = 0,
-        .pbuf_content_size = 0
-    };
+    const char *data = src->osk_buf;
+    size_t size = src->osk_size;
+    struct sloc_map *map = &locs->sl_phases[SLOC_PHASE_2];
+
+    unsigned int row = T2_ROW(CODE_E);
+    uint16_t t;
 
+    unsigned long line_split_cntr = 0;
+    unsigned long line_cntr = 0;
+
+    /* Style checker line, where it starts, and its column adjustment */
     int line_indx = 1;
-    int char_indx = 1;
+    size_t line_start = 0;
+    int col_adj = 0;
+    int new_line_cnt = 0;
+
+    /* Logical line: its physical line, and where it starts in the output */
+    unsigned long lline_indx = 1;
+    size_t lline_start = 0;
+    size_t lline_len;
 
-    int state = 0;
-    int new_line_cnt;
-    bool line_empty = true;
+    /* Start of the input not written yet */
+    size_t copy_indx = 0;
+    size_t i = 0;
 
-    /* Pre-stage 2 processing:
+    /* CPP Translation phase 2:
+     * Join split lines.
      *
-     *  - Find style errors:
-     *      - Tabs mixed with spaces.
-     *      - Multiple sequential new lines.
-     *      - Line containing nothing but white spaces.
+     * Only the splices drop characters, so the input is written in whole
+     * between them. Each splice drops two characters; the location map
+     * takes note.
      *
-     *  - Get number of line splits and allocate split-line record
-     *    object.
+     * Looks for style errors on the way:
+     *  - Tabs mixed with spaces.
+     *  - Multiple sequential new lines.
+     *  - Line containing nothing but white spaces.
+     *
+     * And for logical lines longer than line_max (0 - no limit).
      */
 
     /* TODO: search for Sequential split lines. */
     /* TODO: allow for mixing tabs and spaces in comments */
 
-    line_reduce_lst_size = 0;
-    pbuf_fill(&buf, src_fd);
-
-    while (PBUF_DATA_SIZE(buf) || (pbuf_fill(&buf, src_fd) > 0)) {
-        switch (state) {
-        case 0:
-
-            switch (PBUF_CUR_CHAR(buf)) {
-            case '\\':
-                state++;
-            case '\n':
-                state++;
-            case '\t':
-                state++;
-            case ' ':
-                state++;
-                break;
-
-            default:
-                break;
-            }
-
-            PBUF_ADVN(buf);
-            break;
+    sloc_map_add(map, 0, 0);
 
-        case 1:
-            switch (PBUF_CUR_CHAR(buf)) {
-            case '\t':
-                cpp_warning_analysis_print(line_indx, char_indx, "Mixing spaces and tabs");
-                state++;
-            case ' ':
-                PBUF_ADVN(buf);
-                break;
-
-            case '\\':
-                line_empty = false;
-                state++;
-            case '\n':
-                state += 2;
-                PBUF_ADVN(buf);
-                break;
+    while ((i += bdfa_run(&tstage_2_dfa, &row, &t, &data[i], size - i)) < size) {
 
-            default:
-                line_empty = false;
-                state = 0;
-                break;
-            }
+        switch (BDFA_ACT(t)) {
+        case T2_A_MIXED:
+            aprint_report(APRINT_R_MIXED_INDENT, line_indx,
+                          tstage_2_col(data, line_start, i, col_adj));
             break;
 
-        case 2:
-            switch (PBUF_CUR_CHAR(buf)) {
-            case ' ':
-                cpp_warning_analysis_print(line_indx, char_indx, "Mixing spaces and tabs");
-                state = 1;
-            case '\t':
-                PBUF_ADVN(buf);
-                break;
-
-            case '\\':
-                line_empty = false;
-                state++;
-            case '\n':
-                state++;
-                PBUF_ADVN(buf);
-                break;
+        case T2_A_LINE:
+        case T2_A_LINE_LF:
+            if ((new_line_cnt < 1) && (row == T2_ROW(LF_E)))
+                aprint_report(APRINT_R_BLANK_LINE, line_indx, 0);
 
-            default:
-                line_empty = false;
-                state = 0;
-                break;
-            }
-            break;
+            line_indx++;
+            line_start = i;
+            line_cntr++;
 
-        case 3:
-            if (new_line_cnt < 1 && line_empty)
-                cpp_warning_analysis_line_print(line_indx, "Line contains only white spaces");
-            else
-                line_empty = true;
+            /* Output offsets: the splices so far dropped two characters each */
+            if (line_max && ((i - 1 - 2 * line_split_cntr) - lline_start > line_max))
+                aprint_report(APRINT_R_LIMIT_LINE_LENGTH, lline_indx, 0, (unsigned long)line_max);
 
-            line_indx++;
-            char_indx = 1;
+            lline_indx = line_cntr + 1;
+            lline_start = i - 2 * line_split_cntr;
 
-            switch (PBUF_CUR_CHAR(buf)) {
-            case '\n':
+            if (BDFA_ACT(t) == T2_A_LINE_LF) {
+                col_adj = 0;
                 new_line_cnt++;
                 if (new_line_cnt > 1)
-                    cpp_warning_analysis_line_print(line_indx, "Multiple sequential new-lines");
-                PBUF_ADVN(buf);
-                break;
-
-            case ' ':
-                state--;
-            case '\t':
-                state--;
-                new_line_cnt = 0;
-                PBUF_ADVN(buf);
-                break;
-
-            case '\\':
-                new_line_cnt = 0;
-                line_empty = false;
-                state++;
-                PBUF_ADVN(buf);
-                break;
-
-            default:
+                    aprint_report(APRINT_R_MULTIPLE_NEW_LINES, line_indx, 0);
+            } else {
+                col_adj = (tstage_2_classes[(unsigned char)data[i]] == T2_C_OTHER);
                 new_line_cnt = 0;
-                line_empty = false;
-                state = 0;
-                break;
             }
             break;
 
-        case 4:
-            switch (PBUF_CUR_CHAR(buf)) {
-            case '\n':
-                line_empty = true;
-                line_reduce_lst_size++;
-                state = 0;
-            case '\\':
-                PBUF_ADVN(buf);
-                break;
+        case T2_A_SPLICE:
+            line_cntr++;
+            line_split_cntr++;
 
-            case ' ':
-                state--;
-            case '\t':
-                state -= 2;
-                PBUF_ADVN(buf);
-                break;
-            default:
-                state = 0;
-                break;
-            }
+            /* Everything up to the back-slash */
+            osink_write(dst, &data[copy_indx], i - 1 - copy_indx);
+            copy_indx = i + 1;
+            sloc_map_note(map, dst->osk_size, copy_indx);
             break;
-
-        default:
-            return -1;
         }
-        char_indx++;
+
+        row = BDFA_NEXT(t);
+        i++;
+    }
+
+    /* The rest, less a back-slash ending the input */
+    osink_write(dst, &data[copy_indx], size - copy_indx -
+                ((row == T2_ROW(BSLASH_E)) || (row == T2_ROW(BSLASH))));
+
+    /* The last line, ended by the input */
+    if (line_max) {
+        lline_len = dst->osk_size - lline_start;
+        if ((row == T2_ROW(LF_E)) || (row == T2_ROW(LF)))
+            lline_len--;
+
+        if (lline_len > line_max)
+            aprint_report(APRINT_R_LIMIT_LINE_LENGTH, lline_indx, 0, (unsigned long)line_max);
     }
 
-    /* Allocate reduced lines record object. */
-    if (line_reduce_lst_size) {
-        line_reduce_lst = (int *)malloc(sizeof(int) * line_reduce_lst_size);
-        if (!line_reduce_lst)
-            return -1;
+    if (st) {
+        /* A new-line ending the input (not followed by a line), and a last
+         * line with no new-line, count as well.
+         */
+        st->ss_lines = line_cntr;
+        if ((row == T2_ROW(LF_E)) || (row == T2_ROW(LF)))
+            st->ss_lines++;
+        if (size && (data[size - 1] != '\n'))
+            st->ss_lines++;
+
+        st->ss_splices = line_split_cntr;
     }
 
+    if (dst->osk_err || map->slm_err)
+        return -1;
+
     return 0;
 }
 
-static int src_parser_tstage_2( const int dst_fd,
-                                const int src_fd)
-{
-    struct pbuf buf = {
-        .pbuf_indx = 0,
-        .pbuf_content_size = 0
-    };
+/* TODO: analyze comments (mixed comment sequences, comments inside of strings, etc.) */
 
-    int line_split_cntr = 0;
-    int line_cntr = 1;
-    int state = 0;
+/* Translation phase 3 DFA */
+enum tstage_3_class {
+    T3_C_OTHER,
+    T3_C_SLASH,
+    T3_C_STAR,
+    T3_C_SPACE,
+    T3_C_TAB,
+    T3_C_DQUOTE,
+    T3_C_SQUOTE,
+    T3_C_BSLASH,
+    T3_C_LF,
+
+    T3_CLASSES_NUM
+};
 
-    /* CPP Translation phase 2:
-     * Join split lines.
-     */
+enum tstage_3_state {
+    T3_S_CODE,
+    T3_S_SLASH,
+    T3_S_CMNT,
+    T3_S_CMNT_STAR,
+    T3_S_LINE_CMNT,
+    T3_S_SPACE,
+    T3_S_BLANKS,
+    T3_S_STR,
+    T3_S_STR_ESC,
+    T3_S_CHR,
+    T3_S_CHR_ESC,
+
+    T3_STATES_NUM
+};
 
-    pbuf_fill(&buf, src_fd);
-    while (PBUF_DATA_SIZE(buf) || (pbuf_fill(&buf, src_fd) > 0)) {
-        switch (state) {
-        case 0:
-            if (PBUF_CUR_CHAR(buf) == '\\') {
-                state = 1;
-            } else {
+enum tstage_3_act {
+    T3_A_NONE,
+    T3_A_TAB,           /* Tab, written as a space */
+    T3_A_BLANKS,        /* Blanks past the first */
+    T3_A_BLANKS_END,
+    T3_A_CMNT,
+    T3_A_LINE_CMNT,
+    T3_A_CMNT_END,
+    T3_A_LINE_CMNT_END, /* The new-line is kept */
+};
 
-                if (PBUF_CUR_CHAR(buf) == '\n')
-                    line_cntr++;
+static const uint8_t tstage_3_classes[256] = {
+    ['/'] = T3_C_SLASH,
+    ['*'] = T3_C_STAR,
+    [' '] = T3_C_SPACE,
+    ['\t'] = T3_C_TAB,
+    ['\"'] = T3_C_DQUOTE,
+    ['\''] = T3_C_SQUOTE,
+    ['\\'] = T3_C_BSLASH,
+    ['\n'] = T3_C_LF,
+};
 
-                pbuf_write_char(&buf, dst_fd);
-            }
+#define T3(S, A) BDFA_TRANS(T3_S_ ## S, T3_CLASSES_NUM, T3_A_ ## A)
+#define T3_ROW(S) (T3_S_ ## S * T3_CLASSES_NUM)
+
+/* A comment ends as a space, so the blanks following it are dropped. String
+ * and character literals end at the end of their line, if not before.
+ */
+static const uint16_t tstage_3_trans[T3_STATES_NUM * T3_CLASSES_NUM] = {
+    /*              OTHER               SLASH                   STAR                SPACE               TAB                 DQUOTE          SQUOTE          BSLASH              LF */
+    /* CODE */      T3(CODE, NONE),     T3(SLASH, NONE),        T3(CODE, NONE),     T3(SPACE, NONE),    T3(BLANKS, TAB),    T3(STR, NONE),  T3(CHR, NONE),  T3(CODE, NONE),     T3(CODE, NONE),
+    /* SLASH */     T3(CODE, NONE),     T3(LINE_CMNT, LINE_CMNT), T3(CMNT, CMNT),   T3(SPACE, NONE),    T3(BLANKS, TAB),    T3(STR, NONE),  T3(CHR, NONE),  T3(CODE, NONE),     T3(CODE, NONE),
+    /* CMNT */      T3(CMNT, NONE),     T3(CMNT, NONE),         T3(CMNT_STAR, NONE), T3(CMNT, NONE),    T3(CMNT, NONE),     T3(CMNT, NONE), T3(CMNT, NONE), T3(CMNT, NONE),     T3(CMNT, NONE),
+    /* CMNT_STAR */ T3(CMNT, NONE),     T3(SPACE, CMNT_END),    T3(CMNT_STAR, NONE), T3(CMNT, NONE),    T3(CMNT, NONE),     T3(CMNT, NONE), T3(CMNT, NONE), T3(CMNT, NONE),     T3(CMNT, NONE),
+    /* LINE_CMNT */ T3(LINE_CMNT, NONE), T3(LINE_CMNT, NONE),   T3(LINE_CMNT, NONE), T3(LINE_CMNT, NONE), T3(LINE_CMNT, NONE), T3(LINE_CMNT, NONE), T3(LINE_CMNT, NONE), T3(LINE_CMNT, NONE), T3(CODE, LINE_CMNT_END),
+    /* SPACE */     T3(CODE, NONE),     T3(SLASH, NONE),        T3(CODE, NONE),     T3(BLANKS, BLANKS), T3(BLANKS, BLANKS), T3(STR, NONE),  T3(CHR, NONE),  T3(CODE, NONE),     T3(CODE, NONE),
+    /* BLANKS */    T3(CODE, BLANKS_END), T3(CODE, BLANKS_END), T3(CODE, BLANKS_END), T3(BLANKS, NONE), T3(BLANKS, NONE), T3(CODE, BLANKS_END), T3(CODE, BLANKS_END), T3(CODE, BLANKS_END), T3(CODE, BLANKS_END),
+    /* STR */       T3(STR, NONE),      T3(STR, NONE),          T3(STR, NONE),      T3(STR, NONE),      T3(STR, NONE),      T3(CODE, NONE), T3(STR, NONE),  T3(STR_ESC, NONE),  T3(CODE, NONE),
+    /* STR_ESC */   T3(STR, NONE),      T3(STR, NONE),          T3(STR, NONE),      T3(STR, NONE),      T3(STR, NONE),      T3(STR, NONE),  T3(STR, NONE),  T3(STR, NONE),      T3(STR, NONE),
+    /* CHR */       T3(CHR, NONE),      T3(CHR, NONE),          T3(CHR, NONE),      T3(CHR, NONE),      T3(CHR, NONE),      T3(CHR, NONE),  T3(CODE, NONE), T3(CHR_ESC, NONE),  T3(CODE, NONE),
+    /* CHR_ESC */   T3(CHR, NONE),      T3(CHR, NONE),          T3(CHR, NONE),      T3(CHR, NONE),      T3(CHR, NONE),      T3(CHR, NONE),  T3(CHR, NONE),  T3(CHR, NONE),      T3(CHR, NONE),
+};
 
-            PBUF_ADVN(buf);
-            break;
+/* Bytes leaving the states looping over long runs */
+static const struct fscan_set tstage_3_code_stops = FSCAN_SET_5('/', ' ', '\t', '\"', '\'');
+static const struct fscan_set tstage_3_cmnt_stops = FSCAN_SET_1('*');
+static const struct fscan_set tstage_3_line_stops = FSCAN_SET_1('\n');
+static const struct fscan_set tstage_3_str_stops = FSCAN_SET_3('\"', '\\', '\n');
+
+static const struct fscan_set *const tstage_3_skips[T3_STATES_NUM] = {
+    [T3_S_CODE] = &tstage_3_code_stops,
+    [T3_S_CMNT] = &tstage_3_cmnt_stops,
+    [T3_S_LINE_CMNT] = &tstage_3_line_stops,
+    [T3_S_STR] = &tstage_3_str_stops,
+};
 
-        case 1:
-            if (PBUF_CUR_CHAR(buf) == '\\') {
-                write_char('\\', dst_fd);
-                PBUF_ADVN(buf);
-            } else {
-                state = 0;
-                if (PBUF_CUR_CHAR(buf) == '\n') {
-                    /* TODO: Check return value of this */
-                    line_reduce_add_line(line_cntr++, line_split_cntr++);
-                    PBUF_ADVN(buf);
-                } else {
-                    write_char('\\', dst_fd);
-                }
-            }
+static const struct byte_dfa tstage_3_dfa = {
+    .bd_classes = tstage_3_classes,
+    .bd_trans = tstage_3_trans,
+    .bd_classes_num = T3_CLASSES_NUM,
+    .bd_skips = tstage_3_skips
+};
+
+/* Skips the body of a comment, from i, up to the character ending it
+ * ("*\/"'s '/', or a line comment's new-line), leaving row at the state
+ * before it. Comment bodies are most of some sources; taking them a
+ * character at a time (as the DFA does, between the '*'s) is much slower.
+ */
+static inline size_t tstage_3_cmnt_body(const char *data, size_t size, size_t i,
+                                        const bool line, unsigned int *row)
+{
+    if (line) {
+        *row = T3_ROW(LINE_CMNT);
+        return i + fscan_span(&data[i], size - i, &tstage_3_line_stops);
+    }
+
+    *row = T3_ROW(CMNT);
+    while ((i += fscan_span(&data[i], size - i, &tstage_3_cmnt_stops)) < size) {
+        *row = T3_ROW(CMNT_STAR);
+        while ((++i < size) && (data[i] == '*'));
+
+        if (i == size)
             break;
 
-        default:
-            return -1;
-        }
+        if (data[i] == '/')
+            return i;
+
+        *row = T3_ROW(CMNT);
     }
 
-    return 0;
+    return size;
 }
 
-/* TODO: analyze comments (mixed comment sequences, comments inside of strings, etc.) */
-
-static int src_parser_tstage_3( const int dst_fd,
-                                const int src_fd,
-                                const bool exp_cpp_cmnts)
+static int src_parser_tstage_3( struct osink *dst,
+                                const struct osink *src,
+                                const bool exp_cpp_cmnts,
+                                struct src_locs *locs,
+                                struct src_stats *st)
 {
-    struct pbuf buf = {
-        .pbuf_indx = 0,
-        .pbuf_content_size = 0
-    };
+    const char *data = src->osk_buf;
+    size_t size = src->osk_size;
+    struct sloc_map *map = &locs->sl_phases[SLOC_PHASE_3];
+
+    unsigned int row = T3_ROW(CODE);
+    uint16_t t;
 
-    int state = 0;
+    unsigned long comments = 0;
+    size_t cmnt_start = 0;
+    unsigned int line = 0;
+    unsigned int col = 0;
+
+    /* Start of the input not written yet (in the states writing it) */
+    size_t copy_indx = 0;
+    size_t i = 0;
 
     /* CPP Translation phase 3:
-     *  - Replace comments with white spaces.
+     *  - Replace comments with white spaces (a line comment ends before
+     *      its new-line).
      *  - Turn horizontal tabs (not in strings) into white spaces
      *      (not required by standard).
      *  - Truncate sequential white spaces.
+     *
+     * The input is written as is between comments and blanks. A '/' is
+     * only known not to start a comment by the character following it (and
+     * is dropped, ending the input). The location map takes note after each
+     * comment and white space run dropped.
      */
 
     /* TODO: do not replace comments/spaces inside strings */
     /* TODO: do not Truncate sequential new-lines */
 
-    pbuf_fill(&buf, src_fd);
-    while (PBUF_DATA_SIZE(buf) || (pbuf_fill(&buf, src_fd) > 0)) {
-        switch (state) {
-        case 0:
-            switch (PBUF_CUR_CHAR(buf)) {
-            case '/':
-                state = 1;
-                PBUF_ADVN(buf);
-                break;
-
-            case ' ':
-            case '\t':
-                write_char(' ', dst_fd);
-                state = 5;
-                PBUF_ADVN(buf);
-                break;
-
-            case '\"':
-                write_char('\"', dst_fd);
-                state = 6;
-                PBUF_ADVN(buf);
-                break;
-
-            default:
-                pbuf_write_char(&buf, dst_fd);
-                PBUF_ADVN(buf);
-            }
-            break;
+    sloc_map_add(map, 0, 0);
 
-        case 1:
-            switch (PBUF_CUR_CHAR(buf)) {
-            case '*':
-                state = 2;
-                PBUF_ADVN(buf);
-                break;
+    while ((i += bdfa_run(&tstage_3_dfa, &row, &t, &data[i], size - i)) < size) {
 
-            case '/':
-                if (exp_cpp_cmnts == true) {
-                    state = 4;
-                    PBUF_ADVN(buf);
-                    break;
-                }
-
-            default:
-                write_char('/', dst_fd);
-                state = 0;
-            }
+        switch (BDFA_ACT(t)) {
+        case T3_A_TAB:
+            osink_write(dst, &data[copy_indx], i - copy_indx);
+            write_char(' ', dst);
             break;
 
-        case 2:
-            if (PBUF_CUR_CHAR(buf) == '*')
-                state = 3;
-            PBUF_ADVN(buf);
+        case T3_A_BLANKS:
+            /* Up to (and with) the first space */
+            osink_write(dst, &data[copy_indx], i - copy_indx);
             break;
 
-        case 3:
-            if (PBUF_CUR_CHAR(buf) == '/')
-                state = 0;
-            else
-                state = 2;
-            PBUF_ADVN(buf);
+        case T3_A_BLANKS_END:
+            /* The character is looked at again as code. */
+            copy_indx = i;
+            sloc_map_note(map, dst->osk_size, copy_indx);
+            row = T3_ROW(CODE);
+            continue;
+
+        case T3_A_LINE_CMNT:
+            if (!exp_cpp_cmnts) {
+                /* The first '/' is code, the second may start a comment. */
+                row = T3_ROW(SLASH);
+                i++;
+                continue;
+            }
+            /* fall through */
+
+        case T3_A_CMNT:
+            /* Up to the '/', and the space the comment turns into (unless
+             * following one).
+             */
+            osink_write(dst, &data[copy_indx], i - 1 - copy_indx);
+            if (!dst->osk_size || (dst->osk_buf[dst->osk_size - 1] != ' '))
+                write_char(' ', dst);
+            cmnt_start = i - 1;
+            comments++;
+
+            i = tstage_3_cmnt_body(data, size, i + 1, BDFA_ACT(t) == T3_A_LINE_CMNT, &row);
+            continue;
+
+        case T3_A_CMNT_END:
+            copy_indx = i + 1;
+            sloc_map_note(map, dst->osk_size, copy_indx);
             break;
 
-        case 4:
-            if (PBUF_CUR_CHAR(buf) == '\n')
-                state = 0;
-            PBUF_ADVN(buf);
+        case T3_A_LINE_CMNT_END:
+            copy_indx = i;
+            sloc_map_note(map, dst->osk_size, copy_indx);
             break;
+        }
 
-        case 5:
-            /* TODO: track reduced characters */
-            if ((PBUF_CUR_CHAR(buf) == ' ') || (PBUF_CUR_CHAR(buf) == '\t'))
-                PBUF_ADVN(buf);
-            else
-                state = 0;
-            break;
+        row = BDFA_NEXT(t);
+        i++;
+    }
 
-        case 6:
-            if (PBUF_CUR_CHAR(buf) == '\\')
-                state = 7;
-            else if (PBUF_CUR_CHAR(buf) == '\"')
-                state = 0;
+    /* The rest, if in a state writing it (less a '/' ending the input) */
+    if ((row == T3_ROW(CODE)) || (row == T3_ROW(SPACE)) ||
+        (row == T3_ROW(STR)) || (row == T3_ROW(STR_ESC)) ||
+        (row == T3_ROW(CHR)) || (row == T3_ROW(CHR_ESC)))
+        osink_write(dst, &data[copy_indx], size - copy_indx);
+    else if (row == T3_ROW(SLASH))
+        osink_write(dst, &data[copy_indx], size - 1 - copy_indx);
 
-            pbuf_write_char(&buf, dst_fd);
-            PBUF_ADVN(buf);
-            break;
+    if (st)
+        st->ss_comments = comments;
 
-        case 7:
-            pbuf_write_char(&buf, dst_fd);
-            PBUF_ADVN(buf);
-            state = 6;
-            break;
+    if (dst->osk_err || map->slm_err)
+        return -1;
 
-        default:
-            return -1;
-        }
+    /* Reported where the comment starts, in the source file. */
+    if ((row == T3_ROW(CMNT)) || (row == T3_ROW(CMNT_STAR))) {
+        src_locs_lookup(locs, SLOC_PHASE_2, cmnt_start, &line, &col);
+        aprint_report(APRINT_R_UNTERMINATED_COMMENT, line, col);
     }
 
-    if ((state == 2) || (state == 3))
-        analysis_print(APRINT_ERROR, 2, "file ends with an unterminated comment.");
-
     /* TODO: check if file ends with '\n' and warn */
 
     return 0;
 }
 
-int src_parser_cpp(const char *src, const struct trans_config *cfg)
+int src_parser_phases(struct src_input *src_in, const struct trans_config *cfg,
+                      struct osink *out, struct src_locs *locs, struct src_stats *st)
 {
-    int tmp_fd1, tmp_fd2, tmp_fd3;
-    int src_fd;
-    char fname1[TMP_FILE_NAME_SIZE];
-    char fname2[TMP_FILE_NAME_SIZE];
-    char fname3[TMP_FILE_NAME_SIZE];
+    struct osink tbuf1, tbuf2;
+    struct src_stats_clock clk;
     int ret_val;
 
-    /* Open the source file */
-    src_fd = open(src, O_RDONLY);
-    if (src_fd == -1) {
-        fprintf(stderr, "**Error: Could not open source file: %s.\n", src);
-        return -1;
-    }
+    osink_init_mem(&tbuf1);
+    osink_init_mem(&tbuf2);
 
-    /* Open temporary work-file for stage 1 */
-    strncpy(fname1, TMP_FILE_NAME, TMP_FILE_NAME_SIZE);
-    tmp_fd1 = mkstemp(fname1);
-    if (tmp_fd1 == -1) {
-        fprintf(stderr, "**Error: could not create a working file.\n");
-        return -1;
-    }
+    if (st)
+        src_stats_start(&clk);
 
     /* Do stage 1 parsing */
-    ret_val = src_parser_tstage_1(tmp_fd1, src_fd, cfg->exp_trigraphs);
+    ret_val = src_parser_tstage_1(&tbuf1, src_in, cfg->exp_trigraphs, locs, st);
     if (ret_val < 0)
-        return ret_val;
-
-    /* Source file no longer needed */
-    close(src_fd);
+        goto out;
 
-    /* Rewind stage 1 output file */
-    if (lseek(tmp_fd1, 0, SEEK_SET)) {
-        fprintf(stderr, "**Error: Could not set offset.\n");
-        return -1;
-    }
-    /* Count the number of split lines we have */
-    /* TODO: check return value */
-    src_parser_pre_stage_2(tmp_fd1);
-
-    /* Open temporary work-file for stage 2 */
-    strncpy(fname2, TMP_FILE_NAME, TMP_FILE_NAME_SIZE);
-    tmp_fd2 = mkstemp(fname2);
-    if (tmp_fd2 == -1) {
-        fprintf(stderr, "**Error: could not create a working file.\n");
-        return -1;
+    if (st) {
+        src_stats_stop(st, SSTATS_TSTAGE_1, &clk, src_in->sin_read, tbuf1.osk_size);
+        src_stats_start(&clk);
     }
 
-    /* Rewind stage 1 output file */
-    if (lseek(tmp_fd1, 0, SEEK_SET)) {
-        fprintf(stderr, "**Error: Could not set offset.\n");
-        return -1;
+    /* Do stage 2 parsing (and style checks) */
+    ret_val = src_parser_tstage_2(&tbuf2, &tbuf1, cfg->lim.char_src_line_num, locs, st);
+    if (ret_val < 0)
+        goto out;
+
+    if (st) {
+        src_stats_stop(st, SSTATS_TSTAGE_2, &clk, tbuf1.osk_size, tbuf2.osk_size);
+        src_stats_start(&clk);
     }
 
-    /* Do stage 2 parsing */
-    ret_val = src_parser_tstage_2(tmp_fd2, tmp_fd1);
+    /* Stage 1 buffer no longer needed */
+    osink_release(&tbuf1);
+
+    /* Do stage 3 parsing */
+    ret_val = src_parser_tstage_3(out, &tbuf2, cfg->exp_cpp_cmnts, locs, st);
     if (ret_val < 0)
-        return ret_val;
+        goto out;
 
-    /* Stage 1 file no longer needed */
-    unlink(fname1);
+    if (st)
+        src_stats_stop(st, SSTATS_TSTAGE_3, &clk, tbuf2.osk_size, out->osk_size);
 
-    /* Open temporary work-file for stage 3 */
-    strncpy(fname3, TMP_FILE_NAME, TMP_FILE_NAME_SIZE);
-    tmp_fd3 = mkstemp(fname3);
-    if (tmp_fd2 == -1) {
-        fprintf(stderr, "**Error: could not create a working file.\n");
-        return -1;
-    }
+out:
+    osink_release(&tbuf1);
+    osink_release(&tbuf2);
 
-    /* Rewind stage 2 output file */
-    if (lseek(tmp_fd2, 0, SEEK_SET)) {
-        fprintf(stderr, "**Error: Could not set offset.\n");
-        return -1;
+    return ret_val;
+}
+
+int src_parser_cpp_input(struct src_input *src_in, const char *name,
+                         const struct trans_config *cfg, struct pp_hcache *hc,
+                         struct pp_deps *deps, struct src_stats *st)
+{
+    struct osink tbuf3, tbuf4;
+    struct src_locs locs;
+    struct src_stats_clock clk;
+    unsigned long diags = 0;
+    int ret_val;
+
+    osink_init_mem(&tbuf3);
+    osink_init_mem(&tbuf4);
+    src_locs_init(&locs);
+
+    if (st)
+        diags = analysis_print_diags();
+
+    ret_val = src_parser_phases(src_in, cfg, &tbuf3, &locs, st);
+    if (ret_val < 0)
+        goto out;
+
+    if (cfg->last_phase < 4) {
+        ret_val = pp_check(&tbuf3, name, &locs, cfg);
+        if (ret_val < 0)
+            goto out;
+
+        osink_printf(osink_cur(), "Stage 3 output:\n");
+        print_buf_full(&tbuf3);
+        goto out;
     }
 
-    /* Do stage 3 parsing */
-    ret_val = src_parser_tstage_3(tmp_fd3, tmp_fd2, cfg->exp_cpp_cmnts);
+    if (st)
+        src_stats_start(&clk);
+
+    /* Do stage 4 (preprocessing) */
+    ret_val = pp_run(&tbuf4, &tbuf3, name, &locs, cfg, hc, deps, st);
     if (ret_val < 0)
-        return ret_val;
+        goto out;
 
-    /* Stage 2 file no longer needed */
-    unlink(fname2);
-    printf("Stage 3 output:\n");
-    print_file_full(tmp_fd3);
+    if (st)
+        src_stats_stop(st, SSTATS_TSTAGE_4, &clk, tbuf3.osk_size, tbuf4.osk_size);
 
-    /* Stage 3 file no longer needed */
-    unlink(fname3);
+    /* Stage 3 buffer no longer needed */
+    osink_release(&tbuf3);
+    osink_printf(osink_cur(), "Stage 4 output:\n");
+    print_buf_full(&tbuf4);
 
-    return 0;
+out:
+    if (st)
+        st->ss_diags = analysis_print_diags() - diags;
+
+    src_locs_release(&locs);
+    osink_release(&tbuf3);
+    osink_release(&tbuf4);
+
+    return ret_val;
 }
 
+int src_parser_cpp(const char *src, const struct trans_config *cfg)
+{
+    struct src_input src_in;
+    int ret_val;
+
+    /* Open (map) the source file */
+    if (src_input_open(&src_in, src) < 0)
+        return -1;
+
+    ret_val = src_parser_cpp_input(&src_in, src, cfg, NULL, NULL, NULL);
+
+    src_input_close(&src_in);
+
+    return ret_val;
+}
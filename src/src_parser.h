@@ -18,8 +18,26 @@
 #define _SRC_PARSER_H__
 
 #include "std_comp.h"
+#include "src_input.h"
+#include "src_stats.h"
+#include "src_loc.h"
+#include "out_sink.h"
+
+struct pp_hcache;
+struct pp_deps;
 
 /* Source Parser API */
 int src_parser_cpp(const char *src, const struct trans_config *cfg);
 
+/* Translation phases 1-3 of src_in onto out, its locations noted in locs. */
+int src_parser_phases(struct src_input *src_in, const struct trans_config *cfg,
+                      struct osink *out, struct src_locs *locs, struct src_stats *st);
+
+/* Runs the translation phases up to cfg->last_phase on file name, printing
+ * the output. Phase 4 takes headers from hc, and notes them in deps.
+ */
+int src_parser_cpp_input(struct src_input *src_in, const char *name,
+                         const struct trans_config *cfg, struct pp_hcache *hc,
+                         struct pp_deps *deps, struct src_stats *st);
+
 #endif /* _SRC_PARSER_H__ */
@@ -0,0 +1,3400 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+#include "src_pp.h"
+#include "src_parser.h"
+#include "src_limits.h"
+#include "src_idsig.h"
+#include "src_input.h"
+#include "analysis_print.h"
+#include "hash.h"
+
+/* Include nesting past which a header is not entered (a cycle with no
+ * guard, most likely).
+ */
+#define PP_INCL_NST_MAX         200
+
+#define PP_HCACHE_INIT_SIZE     1024
+#define PP_IDENTS_INIT_SIZE     1024
+#define PP_TOKS_INIT_CAP        64
+#define PP_ARENA_CHUNK_SIZE     (64 * 1024)
+
+/* Longest name (directive, macro) quoted in a diagnostic */
+#define PP_NAME_PRINT_MAX       128
+
+/* Most tokens on the line of an include guard's #if */
+#define PP_GUARD_TOKS_MAX       8
+
+/* Greatest line number #line may set */
+#define PP_LINE_MAX             2147483647UL
+
+/* Tokens */
+
+static void pp_toks_init(struct pp_toks *toks)
+{
+    memset(toks, 0, sizeof(struct pp_toks));
+}
+
+static void pp_toks_release(struct pp_toks *toks)
+{
+    free(toks->pts_toks);
+    pp_toks_init(toks);
+}
+
+static struct pp_tok *pp_toks_add(struct pp_toks *toks, size_t num)
+{
+    if (toks->pts_num + num > toks->pts_cap) {
+        size_t new_cap = toks->pts_cap ? toks->pts_cap : PP_TOKS_INIT_CAP;
+        struct pp_tok *new_toks;
+
+        while (new_cap < toks->pts_num + num)
+            new_cap <<= 1;
+
+        new_toks = (struct pp_tok *)realloc(toks->pts_toks, sizeof(struct pp_tok) * new_cap);
+        if (!new_toks)
+            return NULL;
+
+        toks->pts_toks = new_toks;
+        toks->pts_cap = new_cap;
+    }
+
+    toks->pts_num += num;
+
+    return &toks->pts_toks[toks->pts_num - num];
+}
+
+static int pp_toks_append(struct pp_toks *toks, const struct pp_tok *src, size_t num)
+{
+    struct pp_tok *dst;
+
+    if (!num)
+        return 0;
+
+    dst = pp_toks_add(toks, num);
+    if (!dst)
+        return -1;
+
+    memcpy(dst, src, sizeof(struct pp_tok) * num);
+
+    return 0;
+}
+
+static inline bool pp_tok_eq(const struct pp_tok *tok, const char *str, size_t len)
+{
+    return (tok->pt_len == len) && !memcmp(tok->pt_str, str, len);
+}
+
+#define pp_tok_is(TOK, STR) pp_tok_eq((TOK), (STR), sizeof(STR) - 1)
+
+static inline bool pp_tok_punct(const struct pp_tok *tok, const char c)
+{
+    return (tok->pt_kind == PP_TOK_PUNCT) && (tok->pt_len == 1) && (tok->pt_str[0] == c);
+}
+
+/* '#' and '##', or their digraphs */
+static inline bool pp_tok_hash(const struct pp_tok *tok)
+{
+    return (tok->pt_kind == PP_TOK_PUNCT) && (pp_tok_is(tok, "#") || pp_tok_is(tok, "%:"));
+}
+
+static inline bool pp_tok_hashhash(const struct pp_tok *tok)
+{
+    return (tok->pt_kind == PP_TOK_PUNCT) && (pp_tok_is(tok, "##") || pp_tok_is(tok, "%:%:"));
+}
+
+/* Token i of those lexed from text */
+static inline void pp_stok(const struct src_toks *toks, const char *text, size_t i,
+                           struct pp_tok *tok)
+{
+    tok->pt_str = &text[toks->stk_offs[i]];
+    tok->pt_len = toks->stk_len[i];
+    tok->pt_offs = toks->stk_offs[i];
+    tok->pt_kind = toks->stk_kind[i];
+    tok->pt_flags = toks->stk_flags[i];
+    tok->pt_aux = 0;
+}
+
+/* Token spelling as a string, for diagnostics */
+static const char *pp_tok_cstr(const struct pp_tok *tok, char *buf)
+{
+    snprintf(buf, PP_NAME_PRINT_MAX, "%.*s", (int)tok->pt_len, tok->pt_str);
+
+    return buf;
+}
+
+/* Directives */
+
+enum pp_dir {
+    PP_DIR_NONE,
+    PP_DIR_DEFINE,
+    PP_DIR_UNDEF,
+    PP_DIR_INCLUDE,
+    PP_DIR_INCLUDE_NEXT,
+    PP_DIR_IF,
+    PP_DIR_IFDEF,
+    PP_DIR_IFNDEF,
+    PP_DIR_ELIF,
+    PP_DIR_ELIFDEF,
+    PP_DIR_ELIFNDEF,
+    PP_DIR_ELSE,
+    PP_DIR_ENDIF,
+    PP_DIR_LINE,
+    PP_DIR_ERROR,
+    PP_DIR_WARNING,
+    PP_DIR_PRAGMA,
+    PP_DIR_IDENT,
+    PP_DIR_SCCS,
+    PP_DIR_ASSERT,
+    PP_DIR_UNASSERT,
+
+    PP_DIRS_NUM
+};
+
+static const char *pp_dir_names[PP_DIRS_NUM] = {
+    [PP_DIR_DEFINE]         = "define",
+    [PP_DIR_UNDEF]          = "undef",
+    [PP_DIR_INCLUDE]        = "include",
+    [PP_DIR_INCLUDE_NEXT]   = "include_next",
+    [PP_DIR_IF]             = "if",
+    [PP_DIR_IFDEF]          = "ifdef",
+    [PP_DIR_IFNDEF]         = "ifndef",
+    [PP_DIR_ELIF]           = "elif",
+    [PP_DIR_ELIFDEF]        = "elifdef",
+    [PP_DIR_ELIFNDEF]       = "elifndef",
+    [PP_DIR_ELSE]           = "else",
+    [PP_DIR_ENDIF]          = "endif",
+    [PP_DIR_LINE]           = "line",
+    [PP_DIR_ERROR]          = "error",
+    [PP_DIR_WARNING]        = "warning",
+    [PP_DIR_PRAGMA]         = "pragma",
+    [PP_DIR_IDENT]          = "ident",
+    [PP_DIR_SCCS]           = "sccs",
+    [PP_DIR_ASSERT]         = "assert",
+    [PP_DIR_UNASSERT]       = "unassert",
+};
+
+static enum pp_dir pp_dir_find(const struct pp_tok *name)
+{
+    int i;
+
+    if (name->pt_kind != PP_TOK_IDENT)
+        return PP_DIR_NONE;
+
+    for (i = PP_DIR_NONE + 1; i < PP_DIRS_NUM; i++) {
+        if (pp_tok_eq(name, pp_dir_names[i], strlen(pp_dir_names[i])))
+            return i;
+    }
+
+    return PP_DIR_NONE;
+}
+
+/* The directive at token i of those lexed from text (PP_DIR_NONE - not a
+ * directive).
+ */
+static enum pp_dir pp_dir_at(const struct src_toks *toks, const char *text, size_t i)
+{
+    struct pp_tok t;
+
+    if (!(toks->stk_flags[i] & PP_TOK_F_BOL) || (toks->stk_kind[i] != PP_TOK_PUNCT) ||
+            (i + 1 == toks->stk_num) || (toks->stk_flags[i + 1] & PP_TOK_F_BOL))
+        return PP_DIR_NONE;
+
+    pp_stok(toks, text, i, &t);
+    if (!pp_tok_hash(&t))
+        return PP_DIR_NONE;
+
+    pp_stok(toks, text, i + 1, &t);
+
+    return pp_dir_find(&t);
+}
+
+static inline bool pp_dir_is_if(enum pp_dir dir)
+{
+    return (dir == PP_DIR_IF) || (dir == PP_DIR_IFDEF) || (dir == PP_DIR_IFNDEF);
+}
+
+static inline bool pp_dir_is_else(enum pp_dir dir)
+{
+    return (dir == PP_DIR_ELIF) || (dir == PP_DIR_ELIFDEF) ||
+           (dir == PP_DIR_ELIFNDEF) || (dir == PP_DIR_ELSE);
+}
+
+/* Name of the macro guarding all of the tokens lexed from text (NULL -
+ * none): the first directive is "#ifndef NAME" (or "#if !defined NAME"),
+ * and the #endif closing it ends the file.
+ */
+static char *pp_guard_find(const struct src_toks *toks, const char *text)
+{
+    const struct pp_tok *name = NULL;
+    size_t num = toks->stk_num;
+    struct pp_tok t[PP_GUARD_TOKS_MAX];
+    enum pp_dir dir;
+    bool paren = false;
+    size_t end = 1;
+    size_t i;
+    int depth = 0;
+
+    if (num < 3)
+        return NULL;
+
+    /* Its first line, which is short */
+    while ((end < num) && !(toks->stk_flags[end] & PP_TOK_F_BOL))
+        end++;
+
+    if (end > PP_GUARD_TOKS_MAX)
+        return NULL;
+
+    for (i = 0; i < end; i++)
+        pp_stok(toks, text, i, &t[i]);
+
+    if (!pp_tok_hash(&t[0]))
+        return NULL;
+
+    dir = pp_dir_find(&t[1]);
+    if ((dir == PP_DIR_IFNDEF) && (end == 3) && (t[2].pt_kind == PP_TOK_IDENT)) {
+        name = &t[2];
+    } else if ((dir == PP_DIR_IF) && pp_tok_punct(&t[2], '!')) {
+        i = 3;
+        if ((i < end) && pp_tok_is(&t[i], "defined"))
+            i++;
+        else
+            return NULL;
+
+        if ((i < end) && pp_tok_punct(&t[i], '(')) {
+            paren = true;
+            i++;
+        }
+
+        if ((i < end) && (t[i].pt_kind == PP_TOK_IDENT))
+            name = &t[i++];
+
+        if (paren && !((i < end) && pp_tok_punct(&t[i++], ')')))
+            return NULL;
+
+        if (i != end)
+            return NULL;
+    }
+
+    if (!name)
+        return NULL;
+
+    for (i = 0; i < num; i++) {
+        dir = pp_dir_at(toks, text, i);
+
+        if (pp_dir_is_if(dir)) {
+            depth++;
+        } else if (dir == PP_DIR_ENDIF) {
+            if (--depth)
+                continue;
+
+            /* Nothing may follow its line. */
+            for (i += 2; (i < num) && !(toks->stk_flags[i] & PP_TOK_F_BOL); i++);
+
+            return (i == num) ? strndup(name->pt_str, name->pt_len) : NULL;
+        } else if ((depth == 1) && pp_dir_is_else(dir)) {
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/* Header cache */
+
+static const char *pp_std_version(unsigned long std)
+{
+    switch (std) {
+    case C_STANDARD_C95_AMD1:
+        return "199409L";
+
+    case C_STANDARD_C99_ORIG:
+    case C_STANDARD_C99_GNU:
+        return "199901L";
+
+    case C_STANDARD_C11_ORIG:
+    case C_STANDARD_C11_GNU:
+        return "201112L";
+
+    case C_STANDARD_C17_ORIG:
+        return "201710L";
+    }
+
+    return NULL;
+}
+
+/* The predefined macros, and the definitions of the command-line, are read
+ * as directives ahead of every file.
+ */
+static int pp_predef_init(struct pp_hcache *hc)
+{
+    const struct trans_config *cfg = hc->phc_cfg;
+    const char *version = pp_std_version(cfg->std);
+    struct osink *text = &hc->phc_predef;
+    const char *val;
+    int i;
+
+    osink_init_mem(text);
+    src_toks_init(&hc->phc_predef_toks);
+
+    osink_printf(text, "#define __STDC__ 1\n#define __STDC_HOSTED__ 1\n");
+    if (version)
+        osink_printf(text, "#define __STDC_VERSION__ %s\n", version);
+
+    for (i = 0; i < cfg->defs_num; i++) {
+        val = strchr(cfg->defs[i], '=');
+        if (val)
+            osink_printf(text, "#define %.*s %s\n", (int)(val - cfg->defs[i]),
+                         cfg->defs[i], val + 1);
+        else
+            osink_printf(text, "#define %s 1\n", cfg->defs[i]);
+    }
+
+    if (text->osk_err || src_lex(&hc->phc_predef_toks, text->osk_buf, text->osk_size)) {
+        osink_release(text);
+        src_toks_release(&hc->phc_predef_toks);
+        return -1;
+    }
+
+    return 0;
+}
+
+int pp_hcache_init(struct pp_hcache *hc, const struct trans_config *cfg)
+{
+    memset(hc, 0, sizeof(struct pp_hcache));
+    hc->phc_cfg = cfg;
+
+    hc->phc_tab = (struct pp_hdr **)calloc(PP_HCACHE_INIT_SIZE, sizeof(struct pp_hdr *));
+    if (!hc->phc_tab)
+        return -1;
+    hc->phc_size = PP_HCACHE_INIT_SIZE;
+
+    if (pp_predef_init(hc)) {
+        free(hc->phc_tab);
+        return -1;
+    }
+
+    pthread_mutex_init(&hc->phc_lock, NULL);
+    pthread_cond_init(&hc->phc_cond, NULL);
+
+    return 0;
+}
+
+static void pp_hdr_free(struct pp_hdr *hdr)
+{
+    osink_release(&hdr->ph_text);
+    src_locs_release(&hdr->ph_locs);
+    src_toks_release(&hdr->ph_toks);
+    free(hdr->ph_guard);
+    free(hdr->ph_path);
+    free(hdr);
+}
+
+void pp_hcache_release(struct pp_hcache *hc)
+{
+    struct pp_hdr *hdr;
+    size_t i;
+
+    for (i = 0; i < hc->phc_size; i++) {
+        while ((hdr = hc->phc_tab[i])) {
+            hc->phc_tab[i] = hdr->ph_next;
+            pp_hdr_free(hdr);
+        }
+    }
+
+    free(hc->phc_tab);
+    osink_release(&hc->phc_predef);
+    src_toks_release(&hc->phc_predef_toks);
+
+    pthread_cond_destroy(&hc->phc_cond);
+    pthread_mutex_destroy(&hc->phc_lock);
+}
+
+/* Doubles the table, if it can; under the lock. */
+static void pp_hcache_grow(struct pp_hcache *hc)
+{
+    size_t new_size = hc->phc_size << 1;
+    struct pp_hdr **new_tab;
+    struct pp_hdr *hdr;
+    size_t i;
+
+    new_tab = (struct pp_hdr **)calloc(new_size, sizeof(struct pp_hdr *));
+    if (!new_tab)
+        return;
+
+    for (i = 0; i < hc->phc_size; i++) {
+        while ((hdr = hc->phc_tab[i])) {
+            hc->phc_tab[i] = hdr->ph_next;
+            hdr->ph_next = new_tab[hdr->ph_path_hash & (new_size - 1)];
+            new_tab[hdr->ph_path_hash & (new_size - 1)] = hdr;
+        }
+    }
+
+    free(hc->phc_tab);
+    hc->phc_tab = new_tab;
+    hc->phc_size = new_size;
+}
+
+/* Takes the header at its path up to state upto (PP_HDR_FOUND or
+ * PP_HDR_READY), or as far as it goes; not under the lock, but held busy.
+ */
+static void pp_hdr_load(struct pp_hcache *hc, struct pp_hdr *hdr, enum pp_hdr_state upto)
+{
+    struct aprint_buf *prev_diags = aprint_cur();
+    struct aprint_buf diags;
+    struct src_input in;
+    const char *data;
+    struct stat st;
+    size_t size;
+    int ret_val;
+
+    if (hdr->ph_state == PP_HDR_NEW) {
+        /* Anything but a file is not there to be included. */
+        if (stat(hdr->ph_path, &st) || !S_ISREG(st.st_mode)) {
+            hdr->ph_state = PP_HDR_MISSING;
+            return;
+        }
+
+        hdr->ph_dev = st.st_dev;
+        hdr->ph_ino = st.st_ino;
+    }
+
+    if (src_input_open(&in, hdr->ph_path) < 0) {
+        hdr->ph_state = PP_HDR_FAILED;
+        return;
+    }
+
+    if (hdr->ph_state == PP_HDR_NEW) {
+        if (!src_input_data(&in, &data, &size)) {
+            hdr->ph_state = PP_HDR_FAILED;
+            goto out;
+        }
+
+        hdr->ph_hash = hash64(data, size, 0);
+        hdr->ph_state = PP_HDR_FOUND;
+    }
+
+    if (upto == PP_HDR_FOUND)
+        goto out;
+
+    /* The header's own diagnostics are reported when it's analyzed itself,
+     * rather than in every file including it.
+     */
+    aprint_buf_init(&diags);
+    aprint_set_cur(&diags);
+
+    osink_init_mem(&hdr->ph_text);
+    src_locs_init(&hdr->ph_locs);
+
+    ret_val = src_parser_phases(&in, hc->phc_cfg, &hdr->ph_text, &hdr->ph_locs, NULL);
+    if (!ret_val)
+        ret_val = src_lex(&hdr->ph_toks, hdr->ph_text.osk_buf, hdr->ph_text.osk_size);
+
+    if (ret_val) {
+        osink_release(&hdr->ph_text);
+        src_locs_release(&hdr->ph_locs);
+        src_toks_release(&hdr->ph_toks);
+        hdr->ph_state = PP_HDR_FAILED;
+    } else {
+        hdr->ph_guard = pp_guard_find(&hdr->ph_toks, hdr->ph_text.osk_buf);
+        hdr->ph_state = PP_HDR_READY;
+    }
+
+    aprint_set_cur(prev_diags);
+    aprint_buf_release(&diags);
+
+out:
+    src_input_close(&in);
+}
+
+/* The header at path (of len), taken up to state upto, or as far as it
+ * goes; its state is set in *state (NULL - out of memory).
+ */
+static struct pp_hdr *pp_hcache_get(struct pp_hcache *hc, const char *path, size_t len,
+                                    enum pp_hdr_state upto, enum pp_hdr_state *state)
+{
+    uint64_t path_hash = hash64(path, len, 0);
+    struct pp_hdr *hdr;
+    size_t bucket;
+
+    pthread_mutex_lock(&hc->phc_lock);
+
+    bucket = path_hash & (hc->phc_size - 1);
+    for (hdr = hc->phc_tab[bucket]; hdr; hdr = hdr->ph_next) {
+        if ((hdr->ph_path_hash == path_hash) && !strncmp(hdr->ph_path, path, len) &&
+                !hdr->ph_path[len])
+            break;
+    }
+
+    if (!hdr) {
+        hdr = (struct pp_hdr *)calloc(1, sizeof(struct pp_hdr));
+        if (!hdr || !(hdr->ph_path = strndup(path, len))) {
+            free(hdr);
+            pthread_mutex_unlock(&hc->phc_lock);
+            return NULL;
+        }
+
+        hdr->ph_path_hash = path_hash;
+        hdr->ph_state = PP_HDR_NEW;
+
+        if (hc->phc_num >= hc->phc_size) {
+            pp_hcache_grow(hc);
+            bucket = path_hash & (hc->phc_size - 1);
+        }
+
+        hdr->ph_next = hc->phc_tab[bucket];
+        hc->phc_tab[bucket] = hdr;
+        hc->phc_num++;
+    }
+
+    while (hdr->ph_busy)
+        pthread_cond_wait(&hc->phc_cond, &hc->phc_lock);
+
+    if ((hdr->ph_state == PP_HDR_NEW) ||
+            ((upto == PP_HDR_READY) && (hdr->ph_state == PP_HDR_FOUND))) {
+        hdr->ph_busy = true;
+        pthread_mutex_unlock(&hc->phc_lock);
+
+        pp_hdr_load(hc, hdr, upto);
+
+        pthread_mutex_lock(&hc->phc_lock);
+        hdr->ph_busy = false;
+        pthread_cond_broadcast(&hc->phc_cond);
+    }
+
+    *state = hdr->ph_state;
+
+    pthread_mutex_unlock(&hc->phc_lock);
+
+    return hdr;
+}
+
+/* Dependencies */
+
+void pp_deps_init(struct pp_deps *deps)
+{
+    memset(deps, 0, sizeof(struct pp_deps));
+}
+
+void pp_deps_release(struct pp_deps *deps)
+{
+    free(deps->pd_hdrs);
+    pp_deps_init(deps);
+}
+
+static int pp_deps_add(struct pp_deps *deps, struct pp_hdr *hdr)
+{
+    struct pp_hdr **new_hdrs;
+    size_t new_cap;
+
+    if (!deps)
+        return 0;
+
+    if (deps->pd_num == deps->pd_cap) {
+        new_cap = deps->pd_cap ? (deps->pd_cap << 1) : 16;
+        new_hdrs = (struct pp_hdr **)realloc(deps->pd_hdrs, sizeof(struct pp_hdr *) * new_cap);
+        if (!new_hdrs)
+            return -1;
+
+        deps->pd_hdrs = new_hdrs;
+        deps->pd_cap = new_cap;
+    }
+
+    deps->pd_hdrs[deps->pd_num++] = hdr;
+
+    return 0;
+}
+
+static int pp_hdr_ptr_cmp(const void *a, const void *b)
+{
+    uintptr_t hdr_a = (uintptr_t)*(struct pp_hdr *const *)a;
+    uintptr_t hdr_b = (uintptr_t)*(struct pp_hdr *const *)b;
+
+    return (hdr_a > hdr_b) - (hdr_a < hdr_b);
+}
+
+/* A serialized dependency, followed by its path */
+struct pp_dep_rec {
+    uint64_t pdr_hash;
+    uint32_t pdr_found;
+    uint32_t pdr_path_len;
+};
+
+/* Serialized: the number of headers (32 bit), and a record per header. A
+ * header is looked for once its state is final, so it's read as is.
+ */
+int pp_deps_save(struct pp_deps *deps, struct osink *out)
+{
+    struct pp_dep_rec rec;
+    struct pp_hdr *hdr;
+    uint32_t num = 0;
+    size_t i;
+
+    qsort(deps->pd_hdrs, deps->pd_num, sizeof(struct pp_hdr *), pp_hdr_ptr_cmp);
+    for (i = 0; i < deps->pd_num; i++) {
+        if (!num || (deps->pd_hdrs[num - 1] != deps->pd_hdrs[i]))
+            deps->pd_hdrs[num++] = deps->pd_hdrs[i];
+    }
+    deps->pd_num = num;
+
+    osink_write(out, (const char *)&num, sizeof(num));
+
+    for (i = 0; i < num; i++) {
+        hdr = deps->pd_hdrs[i];
+
+        memset(&rec, 0, sizeof(rec));
+        rec.pdr_found = (hdr->ph_state != PP_HDR_MISSING);
+        rec.pdr_hash = hdr->ph_hash;
+        rec.pdr_path_len = strlen(hdr->ph_path);
+
+        osink_write(out, (const char *)&rec, sizeof(rec));
+        osink_write(out, hdr->ph_path, rec.pdr_path_len);
+    }
+
+    return out->osk_err ? -1 : 0;
+}
+
+ssize_t pp_deps_check(struct pp_hcache *hc, const char *data, size_t size)
+{
+    enum pp_hdr_state state;
+    struct pp_dep_rec rec;
+    struct pp_hdr *hdr;
+    size_t offs;
+    uint32_t num;
+    bool found;
+
+    if (size < sizeof(num))
+        return -1;
+
+    memcpy(&num, data, sizeof(num));
+    offs = sizeof(num);
+
+    while (num--) {
+        if (size - offs < sizeof(rec))
+            return -1;
+
+        memcpy(&rec, &data[offs], sizeof(rec));
+        offs += sizeof(rec);
+
+        if (size - offs < rec.pdr_path_len)
+            return -1;
+
+        hdr = pp_hcache_get(hc, &data[offs], rec.pdr_path_len, PP_HDR_FOUND, &state);
+        if (!hdr)
+            return -1;
+        offs += rec.pdr_path_len;
+
+        found = (state != PP_HDR_MISSING);
+        if ((found != !!rec.pdr_found) || (found && (hdr->ph_hash != rec.pdr_hash)))
+            return -1;
+    }
+
+    return offs;
+}
+
+/* Translation unit */
+
+enum pp_builtin {
+    PP_BUILTIN_NONE,
+    PP_BUILTIN_FILE,
+    PP_BUILTIN_LINE,
+};
+
+struct pp_macro {
+    const char *pm_name;
+    uint32_t pm_name_len;
+
+    /* Number of parameters (-1 - object-like); a variadic macro's last
+     * one takes the variable arguments.
+     */
+    int pm_params_num;
+    bool pm_variadic;
+    enum pp_builtin pm_builtin;
+
+    /* Its expansion is being read */
+    bool pm_disabled;
+
+    struct pp_tok *pm_body;
+    size_t pm_body_num;
+};
+
+/* A context tokens are read from: a file (the tokens lexed from its text),
+ * or a list of tokens (a macro expansion, or tokens pushed back).
+ */
+struct pp_ctx {
+    const struct pp_tok *pc_toks;
+    const struct src_toks *pc_ftoks;
+    const char *pc_text;
+    size_t pc_num;
+    size_t pc_indx;
+
+    /* Tokens freed when done with (NULL - not owned) */
+    struct pp_tok *pc_owned;
+
+    /* Macro disabled while its expansion is read */
+    struct pp_macro *pc_macro;
+
+    /* Files: path and locations, header (NULL - not one), the include path
+     * it was found in (-1 - none), and the depth of the conditional
+     * inclusion stack when entered.
+     */
+    bool pc_file;
+    const char *pc_path;
+    const struct src_locs *pc_locs;
+    struct pp_hdr *pc_hdr;
+    int pc_ipath;
+    size_t pc_conds;
+
+    /* Set by #line: added to the lines of the file, and the name it goes
+     * by (NULL - its path).
+     */
+    long pc_line_adj;
+    const char *pc_line_path;
+};
+
+/* Conditional inclusion, from its #if */
+struct pp_cond {
+    uint32_t pcd_offs;
+
+    /* A group of it was included already, or #else seen */
+    bool pcd_taken;
+    bool pcd_else;
+};
+
+/* The arena of a translation unit: macros, their names and bodies, and the
+ * strings made while preprocessing (# and ## results, ...). Nothing in it is
+ * freed before the unit is done with.
+ */
+struct pp_chunk {
+    struct pp_chunk *pch_next;
+    size_t pch_used;
+    size_t pch_size;
+    char pch_data[];
+};
+
+/* An identifier interned, by its slot in the macro table (open addressing,
+ * linear probing), and the macro it names (NULL - none, or undefined).
+ */
+struct pp_ident {
+    const char *pi_name;
+    uint32_t pi_len;
+    uint32_t pi_hash;
+    struct pp_macro *pi_macro;
+};
+
+struct pp_tu {
+    const struct trans_config *cfg;
+    struct pp_hcache *hc;
+    struct pp_deps *deps;
+    struct osink *out;
+
+    /* Identifiers ever defined as macros, and the number of macros defined
+     * now (the builtins aside). An undefined macro stays in the arena: its
+     * expansion may still be read.
+     */
+    struct pp_ident *idents;
+    size_t idents_size;
+    size_t idents_num;
+    size_t macros_num;
+
+    /* The line of the directive being carried out */
+    struct pp_toks dline;
+
+    /* Parameters of the macro being defined */
+    const struct pp_tok **params;
+    size_t params_cap;
+
+    /* Macro limits reported (once a unit), and the limits of the output */
+    bool lim_macros;
+    struct src_limits lims;
+    struct src_idsig idsig;
+
+    struct pp_ctx *ctxs;
+    size_t ctxs_num;
+    size_t ctxs_cap;
+    size_t files_num;
+
+    struct pp_cond *conds;
+    size_t conds_num;
+    size_t conds_cap;
+
+    /* Headers which had "#pragma once" */
+    struct pp_hdr **once;
+    size_t once_num;
+    size_t once_cap;
+
+    struct pp_chunk *arena;
+
+    /* Output so far: anything at all, and the last token's kind, last
+     * character, and whether it came out of an expansion.
+     */
+    bool out_any;
+    uint8_t out_kind;
+    unsigned char out_last;
+    bool out_exp;
+
+    unsigned long includes;
+    unsigned long expansions;
+};
+
+static const struct pp_tok pp_tok_one = { "1", 1, 0, PP_TOK_NUMBER, 0, 0 };
+static const struct pp_tok pp_tok_zero = { "0", 1, 0, PP_TOK_NUMBER, 0, 0 };
+static const struct pp_tok pp_tok_va_args = { "__VA_ARGS__", 11, 0, PP_TOK_IDENT, 0, 0 };
+
+static void *pp_alloc(struct pp_tu *pp, size_t size, size_t align)
+{
+    struct pp_chunk *chunk = pp->arena;
+    size_t chunk_size;
+    size_t offs = 0;
+
+    if (chunk)
+        offs = (chunk->pch_used + align - 1) & ~(align - 1);
+
+    if (!chunk || (offs + size > chunk->pch_size)) {
+        chunk_size = (size > PP_ARENA_CHUNK_SIZE) ? size : PP_ARENA_CHUNK_SIZE;
+
+        chunk = (struct pp_chunk *)malloc(sizeof(struct pp_chunk) + chunk_size);
+        if (!chunk)
+            return NULL;
+
+        chunk->pch_next = pp->arena;
+        chunk->pch_size = chunk_size;
+        pp->arena = chunk;
+        offs = 0;
+    }
+
+    chunk->pch_used = offs + size;
+
+    return &chunk->pch_data[offs];
+}
+
+static char *pp_str_alloc(struct pp_tu *pp, size_t size)
+{
+    return (char *)pp_alloc(pp, size, 1);
+}
+
+/* Macro table */
+
+static uint32_t pp_name_hash(const char *name, size_t len)
+{
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619U;
+
+    return h;
+}
+
+/* The slot of an identifier: where it is, or where it goes. */
+static struct pp_ident *pp_ident_slot(struct pp_ident *idents, size_t size,
+                                      const char *name, size_t len, uint32_t h)
+{
+    size_t i = h & (size - 1);
+
+    while (idents[i].pi_name) {
+        if ((idents[i].pi_hash == h) && (idents[i].pi_len == len) &&
+                !memcmp(idents[i].pi_name, name, len))
+            break;
+        i = (i + 1) & (size - 1);
+    }
+
+    return &idents[i];
+}
+
+static struct pp_ident *pp_ident_find(struct pp_tu *pp, const char *name, size_t len)
+{
+    struct pp_ident *id;
+
+    id = pp_ident_slot(pp->idents, pp->idents_size, name, len, pp_name_hash(name, len));
+
+    return id->pi_name ? id : NULL;
+}
+
+/* The identifier, interned if new (NULL - out of memory). */
+static struct pp_ident *pp_ident_get(struct pp_tu *pp, const char *name, size_t len)
+{
+    uint32_t h = pp_name_hash(name, len);
+    struct pp_ident *new_idents;
+    struct pp_ident *id;
+    size_t new_size;
+    size_t i;
+    char *str;
+
+    id = pp_ident_slot(pp->idents, pp->idents_size, name, len, h);
+    if (id->pi_name)
+        return id;
+
+    /* Kept at most half full */
+    if ((pp->idents_num + 1) * 2 > pp->idents_size) {
+        new_size = pp->idents_size << 1;
+        new_idents = (struct pp_ident *)calloc(new_size, sizeof(struct pp_ident));
+        if (!new_idents)
+            return NULL;
+
+        for (i = 0; i < pp->idents_size; i++) {
+            if (pp->idents[i].pi_name)
+                *pp_ident_slot(new_idents, new_size, NULL, 0, pp->idents[i].pi_hash) =
+                    pp->idents[i];
+        }
+
+        free(pp->idents);
+        pp->idents = new_idents;
+        pp->idents_size = new_size;
+
+        id = pp_ident_slot(pp->idents, pp->idents_size, name, len, h);
+    }
+
+    str = pp_str_alloc(pp, len + 1);
+    if (!str)
+        return NULL;
+    memcpy(str, name, len);
+    str[len] = '\0';
+
+    id->pi_name = str;
+    id->pi_len = len;
+    id->pi_hash = h;
+    id->pi_macro = NULL;
+    pp->idents_num++;
+
+    return id;
+}
+
+static struct pp_macro *pp_macro_find(struct pp_tu *pp, const char *name, size_t len)
+{
+    struct pp_ident *id = pp_ident_find(pp, name, len);
+
+    return id ? id->pi_macro : NULL;
+}
+
+/* Defines m by its name (interned), in place of the macro it names now (if
+ * any), and returns the latter (or NULL).
+ */
+static struct pp_macro *pp_macro_set(struct pp_tu *pp, struct pp_ident *id, struct pp_macro *m)
+{
+    struct pp_macro *old = id->pi_macro;
+
+    m->pm_name = id->pi_name;
+    m->pm_name_len = id->pi_len;
+    id->pi_macro = m;
+
+    if (!old && !m->pm_builtin)
+        pp->macros_num++;
+
+    return old;
+}
+
+static void pp_macro_del(struct pp_tu *pp, const char *name, size_t len)
+{
+    struct pp_ident *id = pp_ident_find(pp, name, len);
+
+    if (!id || !id->pi_macro)
+        return;
+
+    if (!id->pi_macro->pm_builtin)
+        pp->macros_num--;
+    id->pi_macro = NULL;
+}
+
+static bool pp_macro_same(const struct pp_macro *a, const struct pp_macro *b)
+{
+    const uint8_t flags = PP_TOK_F_SPACE | PP_TOK_F_PARAM | PP_TOK_F_STR;
+    size_t i;
+
+    if ((a->pm_params_num != b->pm_params_num) || (a->pm_variadic != b->pm_variadic) ||
+            (a->pm_body_num != b->pm_body_num) || a->pm_builtin)
+        return false;
+
+    for (i = 0; i < a->pm_body_num; i++) {
+        if ((a->pm_body[i].pt_kind != b->pm_body[i].pt_kind) ||
+                ((a->pm_body[i].pt_flags & flags) != (b->pm_body[i].pt_flags & flags)) ||
+                (a->pm_body[i].pt_aux != b->pm_body[i].pt_aux) ||
+                !pp_tok_eq(&a->pm_body[i], b->pm_body[i].pt_str, b->pm_body[i].pt_len))
+            return false;
+    }
+
+    return true;
+}
+
+/* Contexts */
+
+static struct pp_ctx *pp_ctx_push(struct pp_tu *pp)
+{
+    struct pp_ctx *new_ctxs;
+    struct pp_ctx *ctx;
+    size_t new_cap;
+
+    if (pp->ctxs_num == pp->ctxs_cap) {
+        new_cap = pp->ctxs_cap ? (pp->ctxs_cap << 1) : 64;
+        new_ctxs = (struct pp_ctx *)realloc(pp->ctxs, sizeof(struct pp_ctx) * new_cap);
+        if (!new_ctxs)
+            return NULL;
+
+        pp->ctxs = new_ctxs;
+        pp->ctxs_cap = new_cap;
+    }
+
+    ctx = &pp->ctxs[pp->ctxs_num++];
+    memset(ctx, 0, sizeof(struct pp_ctx));
+    ctx->pc_ipath = -1;
+
+    return ctx;
+}
+
+static void pp_ctx_pop(struct pp_tu *pp)
+{
+    struct pp_ctx *ctx = &pp->ctxs[--pp->ctxs_num];
+
+    if (ctx->pc_macro)
+        ctx->pc_macro->pm_disabled = false;
+
+    free(ctx->pc_owned);
+}
+
+/* Pushes tokens to be read next; owned ones are freed when done with, even
+ * if they can't be pushed. Macro m (if any) is disabled meanwhile.
+ */
+static int pp_push_toks(struct pp_tu *pp, const struct pp_tok *toks, size_t num,
+                        struct pp_tok *owned, struct pp_macro *m)
+{
+    struct pp_ctx *ctx = pp_ctx_push(pp);
+
+    if (!ctx) {
+        free(owned);
+        return -1;
+    }
+
+    ctx->pc_toks = toks;
+    ctx->pc_num = num;
+    ctx->pc_owned = owned;
+    ctx->pc_macro = m;
+
+    if (m)
+        m->pm_disabled = true;
+
+    return 0;
+}
+
+static int pp_push_back(struct pp_tu *pp, const struct pp_tok *toks, size_t num)
+{
+    struct pp_tok *copy;
+
+    copy = (struct pp_tok *)malloc(sizeof(struct pp_tok) * num);
+    if (!copy)
+        return -1;
+
+    memcpy(copy, toks, sizeof(struct pp_tok) * num);
+
+    return pp_push_toks(pp, copy, num, copy, NULL);
+}
+
+static int pp_push_file(struct pp_tu *pp, const struct src_toks *toks, const char *text,
+                        const char *path, const struct src_locs *locs, struct pp_hdr *hdr,
+                        int ipath)
+{
+    struct pp_ctx *ctx = pp_ctx_push(pp);
+
+    if (!ctx)
+        return -1;
+
+    ctx->pc_ftoks = toks;
+    ctx->pc_text = text;
+    ctx->pc_num = toks->stk_num;
+    ctx->pc_file = true;
+    ctx->pc_path = path;
+    ctx->pc_locs = locs;
+    ctx->pc_hdr = hdr;
+    ctx->pc_ipath = ipath;
+    ctx->pc_conds = pp->conds_num;
+
+    pp->files_num++;
+
+    return 0;
+}
+
+static struct pp_ctx *pp_file_top(struct pp_tu *pp)
+{
+    size_t i = pp->ctxs_num;
+
+    while (--i && !pp->ctxs[i].pc_file);
+
+    return &pp->ctxs[i];
+}
+
+/* The file being read, and the line and column of tok in it (NULL - or a
+ * token out of an expansion: the last one read from the file).
+ */
+static const char *pp_where(struct pp_tu *pp, const struct pp_tok *tok,
+                            unsigned int *line, unsigned int *col)
+{
+    struct pp_ctx *file = pp_file_top(pp);
+    size_t offs = 0;
+
+    *line = 0;
+    *col = 0;
+
+    if (tok && !(tok->pt_flags & PP_TOK_F_EXP))
+        offs = tok->pt_offs;
+    else if (file->pc_indx)
+        offs = file->pc_ftoks->stk_offs[file->pc_indx - 1];
+
+    if (file->pc_locs)
+        src_locs_lookup(file->pc_locs, SLOC_PHASE_3, offs, line, col);
+
+    /* Lines before a #line may fall below 1 */
+    if (*line)
+        *line = ((long)*line + file->pc_line_adj > 0) ? (*line + file->pc_line_adj) : 1;
+
+    if (file->pc_line_path)
+        return file->pc_line_path;
+
+    return src_input_path_shown(pp->cfg->base_dir, file->pc_path);
+}
+
+static void pp_pop_file(struct pp_tu *pp)
+{
+    struct pp_ctx *ctx = &pp->ctxs[pp->ctxs_num - 1];
+    struct pp_tok at = { .pt_offs = 0 };
+    unsigned int line, col;
+    const char *path;
+
+    if (pp->conds_num > ctx->pc_conds) {
+        at.pt_offs = pp->conds[ctx->pc_conds].pcd_offs;
+        path = pp_where(pp, &at, &line, &col);
+        aprint_report(APRINT_R_PP_COND_UNTERMINATED, line, col, path);
+
+        pp->conds_num = ctx->pc_conds;
+    }
+
+    pp->files_num--;
+    pp_ctx_pop(pp);
+}
+
+static int pp_directive(struct pp_tu *pp);
+
+/* Reads the next token from the contexts from floor up, leaving those done
+ * with (but floor's, and files'), and carrying out directives. Returns 0
+ * at the end of floor's context, or of a file.
+ */
+static int pp_read(struct pp_tu *pp, size_t floor, struct pp_tok *tok)
+{
+    struct pp_ctx *ctx;
+
+    for (;;) {
+        ctx = &pp->ctxs[pp->ctxs_num - 1];
+
+        if (ctx->pc_indx == ctx->pc_num) {
+            if (ctx->pc_file || (pp->ctxs_num - 1 == floor))
+                return 0;
+
+            pp_ctx_pop(pp);
+            continue;
+        }
+
+        if (!ctx->pc_file) {
+            *tok = ctx->pc_toks[ctx->pc_indx++];
+            return 1;
+        }
+
+        pp_stok(ctx->pc_ftoks, ctx->pc_text, ctx->pc_indx, tok);
+        if ((tok->pt_flags & PP_TOK_F_BOL) && pp_tok_hash(tok)) {
+            if (pp_directive(pp) < 0)
+                return -1;
+            continue;
+        }
+
+        ctx->pc_indx++;
+
+        return 1;
+    }
+}
+
+static int pp_expand_next(struct pp_tu *pp, size_t floor, struct pp_tok *tok);
+
+/* Macro-expands toks on their own, into exp. */
+static int pp_expand_toks(struct pp_tu *pp, const struct pp_tok *toks, size_t num,
+                          struct pp_toks *exp)
+{
+    size_t floor = pp->ctxs_num;
+    struct pp_tok tok;
+    int ret_val;
+
+    if (pp_push_toks(pp, toks, num, NULL, NULL) < 0)
+        return -1;
+
+    while ((ret_val = pp_expand_next(pp, floor, &tok)) > 0) {
+        if (pp_toks_append(exp, &tok, 1) < 0) {
+            ret_val = -1;
+            break;
+        }
+    }
+
+    while (pp->ctxs_num > floor)
+        pp_ctx_pop(pp);
+
+    return ret_val;
+}
+
+/* Macro expansion */
+
+/* Reads the arguments of an invocation of m (by name), its '(' read, up to
+ * the closing parenthesis. Argument i is laid in raw from (*pargs)[i] up to
+ * (*pargs)[i + 1]. Returns 1, or 0 if they don't make a valid invocation
+ * (reported, and all read pushed back).
+ */
+static int pp_collect_args(struct pp_tu *pp, size_t floor, const struct pp_macro *m,
+                           const struct pp_tok *name, const struct pp_tok *lparen,
+                           struct pp_toks *raw, size_t **pargs)
+{
+    int params_num = m->pm_params_num;
+    char buf[PP_NAME_PRINT_MAX];
+    unsigned int line, col;
+    struct pp_toks read;
+    const char *path;
+    size_t *args;
+    size_t *new_args;
+    size_t args_cap = params_num + 2;
+    unsigned int commas = 0;
+    int args_num = 0;
+    int depth = 0;
+    struct pp_tok tok;
+    int ret_val = -1;
+    int r;
+
+    pp_toks_init(&read);
+
+    args = (size_t *)malloc(sizeof(size_t) * args_cap);
+    if (!args || pp_toks_append(&read, lparen, 1))
+        goto out;
+    args[0] = 0;
+
+    for (;;) {
+        r = pp_read(pp, floor, &tok);
+        if (r < 0)
+            goto out;
+
+        if (!r) {
+            path = pp_where(pp, NULL, &line, &col);
+            aprint_report(APRINT_R_PP_MACRO_UNTERMINATED, line, col, path,
+                          pp_tok_cstr(name, buf));
+            goto back;
+        }
+
+        if (pp_toks_append(&read, &tok, 1))
+            goto out;
+
+        if (pp_tok_punct(&tok, '(')) {
+            depth++;
+        } else if (pp_tok_punct(&tok, ')')) {
+            if (!depth)
+                break;
+            depth--;
+        } else if (pp_tok_punct(&tok, ',') && !depth) {
+            commas++;
+
+            /* Not between the variable arguments */
+            if (!(m->pm_variadic && (args_num == params_num - 1))) {
+                if ((size_t)args_num + 2 == args_cap) {
+                    new_args = (size_t *)realloc(args, sizeof(size_t) * args_cap * 2);
+                    if (!new_args)
+                        goto out;
+                    args = new_args;
+                    args_cap *= 2;
+                }
+
+                args[++args_num] = raw->pts_num;
+                continue;
+            }
+        }
+
+        /* The arguments are on a line of their own. */
+        if (tok.pt_flags & PP_TOK_F_BOL)
+            tok.pt_flags = (tok.pt_flags & ~PP_TOK_F_BOL) | PP_TOK_F_SPACE;
+
+        if (pp_toks_append(raw, &tok, 1))
+            goto out;
+    }
+
+    args[++args_num] = raw->pts_num;
+
+    /* No arguments to a macro of no parameters, or variable arguments left
+     * out altogether.
+     */
+    if (!params_num && (args_num == 1) && !raw->pts_num)
+        args_num = 0;
+    else if (m->pm_variadic && (args_num == params_num - 1))
+        args[++args_num] = raw->pts_num;
+
+    if (args_num != params_num) {
+        path = pp_where(pp, NULL, &line, &col);
+        aprint_report(APRINT_R_PP_MACRO_ARGS, line, col, path,
+                      pp_tok_cstr(name, buf),
+                      (unsigned long)params_num, (unsigned long)args_num);
+        goto back;
+    }
+
+    /* Variable arguments count one by one. */
+    if (args_num && ((unsigned long)commas + 1 > pp->cfg->lim.arg_macro_num)) {
+        path = pp_where(pp, NULL, &line, &col);
+        aprint_report(APRINT_R_LIMIT_MACRO_ARGS, line, col, path,
+                      pp_tok_cstr(name, buf), (unsigned long)pp->cfg->lim.arg_macro_num);
+    }
+
+    *pargs = args;
+    args = NULL;
+    ret_val = 1;
+    goto out;
+
+back:
+    ret_val = pp_push_back(pp, read.pts_toks, read.pts_num) ? -1 : 0;
+
+out:
+    pp_toks_release(&read);
+    free(args);
+
+    return ret_val;
+}
+
+/* Spelling of toks, as a string literal */
+static int pp_stringify(struct pp_tu *pp, const struct pp_tok *toks, size_t num,
+                        struct pp_tok *res)
+{
+    size_t size = 2;
+    char *str, *p;
+    const char *c;
+    size_t i;
+
+    for (i = 0; i < num; i++)
+        size += (toks[i].pt_len * 2) + 1;
+
+    str = pp_str_alloc(pp, size);
+    if (!str)
+        return -1;
+
+    p = str;
+    *p++ = '"';
+
+    for (i = 0; i < num; i++) {
+        if (i && (toks[i].pt_flags & PP_TOK_F_SPACE))
+            *p++ = ' ';
+
+        for (c = toks[i].pt_str; c < toks[i].pt_str + toks[i].pt_len; c++) {
+            if (((toks[i].pt_kind == PP_TOK_STRING) || (toks[i].pt_kind == PP_TOK_CHAR)) &&
+                    ((*c == '"') || (*c == '\\')))
+                *p++ = '\\';
+            *p++ = *c;
+        }
+    }
+
+    *p++ = '"';
+
+    memset(res, 0, sizeof(struct pp_tok));
+    res->pt_str = str;
+    res->pt_len = p - str;
+    res->pt_kind = PP_TOK_STRING;
+
+    return 0;
+}
+
+/* Pastes rhs onto lhs. Returns 1, or 0 if they don't make a single token
+ * (reported, and lhs left as is).
+ */
+static int pp_paste(struct pp_tu *pp, struct pp_tok *lhs, const struct pp_tok *rhs)
+{
+    size_t len = lhs->pt_len + rhs->pt_len;
+    char buf_l[PP_NAME_PRINT_MAX];
+    char buf_r[PP_NAME_PRINT_MAX];
+    unsigned int line, col;
+    const char *path;
+    struct pp_tok tok;
+    char *str;
+
+    str = pp_str_alloc(pp, len);
+    if (!str)
+        return -1;
+
+    memcpy(str, lhs->pt_str, lhs->pt_len);
+    memcpy(&str[lhs->pt_len], rhs->pt_str, rhs->pt_len);
+
+    if (src_lex_tok(str, len, 0, &tok.pt_kind) != len) {
+        path = pp_where(pp, NULL, &line, &col);
+        aprint_report(APRINT_R_PP_PASTE_INVALID, line, col, path,
+                      pp_tok_cstr(lhs, buf_l), pp_tok_cstr(rhs, buf_r));
+        return 0;
+    }
+
+    tok.pt_str = str;
+    tok.pt_len = len;
+    tok.pt_offs = lhs->pt_offs;
+    tok.pt_flags = lhs->pt_flags & (PP_TOK_F_BOL | PP_TOK_F_SPACE);
+    tok.pt_aux = 0;
+    *lhs = tok;
+
+    return 1;
+}
+
+/* Arguments of an invocation: raw, and macro-expanded as needed. */
+struct pp_args {
+    const struct pp_toks *pa_raw;
+    const size_t *pa_bounds;
+    struct pp_toks *pa_exp;
+    bool *pa_expanded;
+};
+
+static const struct pp_tok *pp_arg_raw(const struct pp_args *args, int i, size_t *num)
+{
+    *num = args->pa_bounds[i + 1] - args->pa_bounds[i];
+
+    return &args->pa_raw->pts_toks[args->pa_bounds[i]];
+}
+
+static const struct pp_tok *pp_arg_exp(struct pp_tu *pp, struct pp_args *args, int i, size_t *num)
+{
+    const struct pp_tok *raw;
+    size_t raw_num;
+
+    if (!args->pa_expanded[i]) {
+        raw = pp_arg_raw(args, i, &raw_num);
+        if (pp_expand_toks(pp, raw, raw_num, &args->pa_exp[i]) < 0)
+            return NULL;
+        args->pa_expanded[i] = true;
+    }
+
+    *num = args->pa_exp[i].pts_num;
+
+    /* Not NULL, even if empty */
+    return args->pa_exp[i].pts_toks ? args->pa_exp[i].pts_toks : &pp_tok_zero;
+}
+
+/* Appends toks, the first one spaced as first. */
+static int pp_subst_append(struct pp_toks *res, const struct pp_tok *toks, size_t num,
+                           const struct pp_tok *first)
+{
+    size_t start = res->pts_num;
+
+    if (pp_toks_append(res, toks, num))
+        return -1;
+
+    if (num) {
+        res->pts_toks[start].pt_flags &= ~PP_TOK_F_SPACE;
+        res->pts_toks[start].pt_flags |= first->pt_flags & PP_TOK_F_SPACE;
+    }
+
+    return 0;
+}
+
+/* The body of m, with its parameters replaced by args, into res. */
+static int pp_subst(struct pp_tu *pp, const struct pp_macro *m, struct pp_args *args,
+                    struct pp_toks *res)
+{
+    const struct pp_tok placemarker = { "", 0, 0, PP_TOK_PLACEMARKER, 0, 0 };
+    const struct pp_tok *body = m->pm_body;
+    size_t body_num = m->pm_body_num;
+    const struct pp_tok *t, *rhs, *op;
+    struct pp_tok str_tok;
+    struct pp_tok *lhs;
+    size_t op_num;
+    size_t i;
+    int r;
+
+    for (i = 0; i < body_num; i++) {
+        t = &body[i];
+
+        if (pp_tok_hashhash(t)) {
+            rhs = &body[++i];
+
+            /* GNU: ", ## __VA_ARGS__" drops the comma, if there are no
+             * variable arguments (and pastes nothing otherwise).
+             */
+            if ((rhs->pt_flags & PP_TOK_F_PARAM) && !(rhs->pt_flags & PP_TOK_F_STR) &&
+                    m->pm_variadic && (rhs->pt_aux == m->pm_params_num - 1) &&
+                    res->pts_num && pp_tok_punct(&res->pts_toks[res->pts_num - 1], ',')) {
+                op = pp_arg_raw(args, rhs->pt_aux, &op_num);
+                if (!op_num)
+                    res->pts_num--;
+                else if (pp_subst_append(res, op, op_num, rhs))
+                    return -1;
+                continue;
+            }
+
+            if (rhs->pt_flags & PP_TOK_F_STR) {
+                op = pp_arg_raw(args, rhs->pt_aux, &op_num);
+                if (pp_stringify(pp, op, op_num, &str_tok))
+                    return -1;
+                op = &str_tok;
+                op_num = 1;
+            } else if (rhs->pt_flags & PP_TOK_F_PARAM) {
+                op = pp_arg_raw(args, rhs->pt_aux, &op_num);
+                if (!op_num) {
+                    op = &placemarker;
+                    op_num = 1;
+                }
+            } else {
+                op = rhs;
+                op_num = 1;
+            }
+
+            lhs = &res->pts_toks[res->pts_num - 1];
+            if (lhs->pt_kind == PP_TOK_PLACEMARKER) {
+                *lhs = op[0];
+                lhs->pt_flags &= ~PP_TOK_F_SPACE;
+            } else if (op[0].pt_kind != PP_TOK_PLACEMARKER) {
+                r = pp_paste(pp, lhs, &op[0]);
+                if (r < 0)
+                    return -1;
+                if (!r && pp_toks_append(res, &op[0], 1))
+                    return -1;
+            }
+
+            if (pp_toks_append(res, &op[1], op_num - 1))
+                return -1;
+            continue;
+        }
+
+        if (t->pt_flags & PP_TOK_F_STR) {
+            op = pp_arg_raw(args, t->pt_aux, &op_num);
+            if (pp_stringify(pp, op, op_num, &str_tok))
+                return -1;
+
+            str_tok.pt_flags = t->pt_flags & PP_TOK_F_SPACE;
+            if (pp_toks_append(res, &str_tok, 1))
+                return -1;
+            continue;
+        }
+
+        if (t->pt_flags & PP_TOK_F_PARAM) {
+            /* An operand of ## is taken as is. */
+            if ((i + 1 < body_num) && pp_tok_hashhash(&body[i + 1])) {
+                op = pp_arg_raw(args, t->pt_aux, &op_num);
+                if (!op_num) {
+                    op = &placemarker;
+                    op_num = 1;
+                }
+            } else {
+                op = pp_arg_exp(pp, args, t->pt_aux, &op_num);
+                if (!op)
+                    return -1;
+            }
+
+            if (pp_subst_append(res, op, op_num, t))
+                return -1;
+            continue;
+        }
+
+        if (pp_toks_append(res, t, 1))
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Expands __FILE__ and __LINE__ into tok. */
+static int pp_builtin(struct pp_tu *pp, const struct pp_macro *m, struct pp_tok *tok)
+{
+    unsigned int line, col;
+    const char *path;
+    char buf[16];
+    char *str, *p;
+    size_t len;
+
+    path = pp_where(pp, NULL, &line, &col);
+
+    if (m->pm_builtin == PP_BUILTIN_LINE) {
+        len = snprintf(buf, sizeof(buf), "%u", line);
+        str = pp_str_alloc(pp, len);
+        if (!str)
+            return -1;
+
+        memcpy(str, buf, len);
+        tok->pt_kind = PP_TOK_NUMBER;
+    } else {
+        str = pp_str_alloc(pp, (strlen(path) * 2) + 2);
+        if (!str)
+            return -1;
+
+        p = str;
+        *p++ = '"';
+        for (; *path; path++) {
+            if ((*path == '"') || (*path == '\\'))
+                *p++ = '\\';
+            *p++ = *path;
+        }
+        *p++ = '"';
+
+        len = p - str;
+        tok->pt_kind = PP_TOK_STRING;
+    }
+
+    tok->pt_str = str;
+    tok->pt_len = len;
+    tok->pt_flags |= PP_TOK_F_EXP;
+
+    return 0;
+}
+
+/* Expands m, invoked by name: its expansion is pushed, to be read next.
+ * Returns 0 if it's not an invocation after all (a function-like macro
+ * with no arguments).
+ */
+static int pp_expand(struct pp_tu *pp, size_t floor, struct pp_macro *m, const struct pp_tok *name)
+{
+    struct pp_args args = { NULL, NULL, NULL, NULL };
+    size_t *bounds = NULL;
+    struct pp_toks raw;
+    struct pp_toks res;
+    struct pp_tok next;
+    size_t i, j;
+    int ret_val = -1;
+    int r;
+
+    pp_toks_init(&raw);
+    pp_toks_init(&res);
+
+    if (m->pm_params_num >= 0) {
+        r = pp_read(pp, floor, &next);
+        if (r <= 0)
+            return r;
+
+        if (!pp_tok_punct(&next, '('))
+            return pp_push_back(pp, &next, 1) ? -1 : 0;
+
+        r = pp_collect_args(pp, floor, m, name, &next, &raw, &bounds);
+        if (r <= 0) {
+            pp_toks_release(&raw);
+            return r;
+        }
+
+        args.pa_raw = &raw;
+        args.pa_bounds = bounds;
+        args.pa_exp = (struct pp_toks *)calloc(m->pm_params_num + 1, sizeof(struct pp_toks));
+        args.pa_expanded = (bool *)calloc(m->pm_params_num + 1, sizeof(bool));
+        if (!args.pa_exp || !args.pa_expanded)
+            goto out;
+    }
+
+    if (pp_subst(pp, m, &args, &res))
+        goto out;
+
+    /* Placemarkers go, and the rest is out of an expansion. */
+    for (i = 0, j = 0; i < res.pts_num; i++) {
+        if (res.pts_toks[i].pt_kind == PP_TOK_PLACEMARKER)
+            continue;
+
+        res.pts_toks[j] = res.pts_toks[i];
+        res.pts_toks[j].pt_flags &= ~PP_TOK_F_BOL;
+        res.pts_toks[j].pt_flags |= PP_TOK_F_EXP;
+        j++;
+    }
+    res.pts_num = j;
+
+    pp->expansions++;
+    ret_val = 1;
+
+    if (res.pts_num) {
+        if (pp_push_toks(pp, res.pts_toks, res.pts_num, res.pts_toks, m))
+            ret_val = -1;
+        pp_toks_init(&res);
+    }
+
+out:
+    if (args.pa_exp) {
+        for (r = 0; r <= m->pm_params_num; r++)
+            pp_toks_release(&args.pa_exp[r]);
+    }
+    free(args.pa_exp);
+    free(args.pa_expanded);
+    free(bounds);
+    pp_toks_release(&raw);
+    pp_toks_release(&res);
+
+    return ret_val;
+}
+
+/* Reads the next token, macro-expanded. */
+static int pp_expand_next(struct pp_tu *pp, size_t floor, struct pp_tok *tok)
+{
+    uint8_t pend = 0;
+    struct pp_macro *m;
+    int r;
+
+    for (;;) {
+        r = pp_read(pp, floor, tok);
+        if (r <= 0)
+            return r;
+
+        if ((tok->pt_kind != PP_TOK_IDENT) || (tok->pt_flags & PP_TOK_F_NOEXP))
+            break;
+
+        m = pp_macro_find(pp, tok->pt_str, tok->pt_len);
+        if (!m)
+            break;
+
+        /* Never to expand, wherever it ends up */
+        if (m->pm_disabled) {
+            tok->pt_flags |= PP_TOK_F_NOEXP;
+            break;
+        }
+
+        if (m->pm_builtin) {
+            if (pp_builtin(pp, m, tok))
+                return -1;
+            break;
+        }
+
+        r = pp_expand(pp, floor, m, tok);
+        if (r < 0)
+            return -1;
+        if (!r)
+            break;
+
+        /* The expansion takes the place of the name (kept apart from what
+         * came before, even if it's empty).
+         */
+        pend |= (tok->pt_flags & (PP_TOK_F_BOL | PP_TOK_F_SPACE)) | PP_TOK_F_EXP;
+    }
+
+    tok->pt_flags |= pend;
+
+    return 1;
+}
+
+/* Directives */
+
+static void pp_report_malformed(struct pp_tu *pp, const struct pp_tok *hash, enum pp_dir dir)
+{
+    unsigned int line, col;
+    const char *path;
+
+    path = pp_where(pp, hash, &line, &col);
+    aprint_report(APRINT_R_PP_DIRECTIVE_MALFORMED, line, col, path, pp_dir_names[dir]);
+}
+
+static int pp_define(struct pp_tu *pp, const struct pp_tok *hash,
+                     const struct pp_tok *line, size_t num)
+{
+    const struct pp_tok **params = pp->params;
+    const struct std_trans_lim *lim = &pp->cfg->lim;
+    char buf[PP_NAME_PRINT_MAX];
+    unsigned int l, c;
+    struct pp_macro *m;
+    struct pp_macro *old;
+    struct pp_ident *id;
+    struct pp_tok *t;
+    const char *path;
+    int params_num = -1;
+    bool variadic = false;
+    size_t i = 1;
+    size_t j;
+    int k;
+
+    if (!num || (line[0].pt_kind != PP_TOK_IDENT) || pp_tok_is(&line[0], "defined"))
+        goto bad;
+
+    /* Function-like: the '(' right after the name */
+    if ((num > 1) && pp_tok_punct(&line[1], '(') && !(line[1].pt_flags & PP_TOK_F_SPACE)) {
+        if (pp->params_cap < num) {
+            params = (const struct pp_tok **)realloc(pp->params, sizeof(struct pp_tok *) * num);
+            if (!params)
+                return -1;
+            pp->params = params;
+            pp->params_cap = num;
+        }
+
+        params_num = 0;
+        i = 2;
+
+        for (;;) {
+            if (i >= num)
+                goto bad;
+
+            if (!params_num && pp_tok_punct(&line[i], ')')) {
+                i++;
+                break;
+            }
+
+            if (pp_tok_is(&line[i], "...")) {
+                variadic = true;
+                params[params_num++] = &pp_tok_va_args;
+                i++;
+            } else if (line[i].pt_kind == PP_TOK_IDENT) {
+                for (k = 0; k < params_num; k++) {
+                    if (pp_tok_eq(params[k], line[i].pt_str, line[i].pt_len))
+                        goto bad;
+                }
+
+                params[params_num++] = &line[i++];
+
+                /* GNU: named variable arguments */
+                if ((i < num) && pp_tok_is(&line[i], "...")) {
+                    variadic = true;
+                    i++;
+                }
+            } else {
+                goto bad;
+            }
+
+            if (i >= num)
+                goto bad;
+
+            if (pp_tok_punct(&line[i], ')')) {
+                i++;
+                break;
+            }
+
+            if (variadic || !pp_tok_punct(&line[i], ','))
+                goto bad;
+            i++;
+        }
+    }
+
+    m = (struct pp_macro *)pp_alloc(pp, sizeof(struct pp_macro), sizeof(void *));
+    if (!m)
+        return -1;
+
+    memset(m, 0, sizeof(struct pp_macro));
+    m->pm_params_num = params_num;
+    m->pm_variadic = variadic;
+
+    if (i < num) {
+        m->pm_body = (struct pp_tok *)pp_alloc(pp, sizeof(struct pp_tok) * (num - i),
+                                               sizeof(void *));
+        if (!m->pm_body)
+            return -1;
+    }
+
+    for (; i < num; i++) {
+        t = &m->pm_body[m->pm_body_num++];
+        *t = line[i];
+        t->pt_flags &= PP_TOK_F_SPACE;
+
+        if (params_num < 0)
+            continue;
+
+        /* The operand of # takes its place. */
+        if (pp_tok_hash(t)) {
+            if (++i == num)
+                goto bad;
+
+            *t = line[i];
+            t->pt_flags = (line[i - 1].pt_flags & PP_TOK_F_SPACE) | PP_TOK_F_STR;
+        }
+
+        for (k = 0; (t->pt_kind == PP_TOK_IDENT) && (k < params_num); k++) {
+            if (pp_tok_eq(t, params[k]->pt_str, params[k]->pt_len)) {
+                t->pt_flags |= PP_TOK_F_PARAM;
+                t->pt_aux = k;
+                break;
+            }
+        }
+
+        if ((t->pt_flags & PP_TOK_F_STR) && !(t->pt_flags & PP_TOK_F_PARAM))
+            goto bad;
+    }
+
+    if (m->pm_body_num) {
+        m->pm_body[0].pt_flags &= ~PP_TOK_F_SPACE;
+
+        if (pp_tok_hashhash(&m->pm_body[0]) || pp_tok_hashhash(&m->pm_body[m->pm_body_num - 1]))
+            goto bad;
+    }
+
+    /* ## operands are never a lone ## in the middle */
+    for (j = 1; j < m->pm_body_num; j++) {
+        if (pp_tok_hashhash(&m->pm_body[j]) && pp_tok_hashhash(&m->pm_body[j - 1]))
+            goto bad;
+    }
+
+    id = pp_ident_get(pp, line[0].pt_str, line[0].pt_len);
+    if (!id)
+        return -1;
+
+    old = pp_macro_set(pp, id, m);
+    if (old && !pp_macro_same(old, m)) {
+        path = pp_where(pp, hash, &l, &c);
+        aprint_report(APRINT_R_PP_MACRO_REDEFINED, l, c, path, pp_tok_cstr(&line[0], buf));
+    }
+
+    if ((params_num > 0) && ((unsigned int)params_num > lim->param_macro_num)) {
+        path = pp_where(pp, hash, &l, &c);
+        aprint_report(APRINT_R_LIMIT_MACRO_PARAMS, l, c, path, pp_tok_cstr(&line[0], buf),
+                      (unsigned long)lim->param_macro_num);
+    }
+
+    if (!pp->lim_macros && (pp->macros_num > lim->ident_macro_num)) {
+        pp->lim_macros = true;
+        path = pp_where(pp, hash, &l, &c);
+        aprint_report(APRINT_R_LIMIT_MACROS, l, c, path,
+                      (unsigned long)lim->ident_macro_num);
+    }
+
+    return 0;
+
+bad:
+    pp_report_malformed(pp, hash, PP_DIR_DEFINE);
+
+    return 0;
+}
+
+/* "defined NAME" or "defined ( NAME )" at toks[*i]: its value, with *i at
+ * its last token (-1 - malformed).
+ */
+static int pp_defined(struct pp_tu *pp, const struct pp_tok *toks, size_t num, size_t *i)
+{
+    const struct pp_tok *name;
+    bool paren = false;
+    size_t j = *i + 1;
+
+    if ((j < num) && pp_tok_punct(&toks[j], '(')) {
+        paren = true;
+        j++;
+    }
+
+    if ((j >= num) || (toks[j].pt_kind != PP_TOK_IDENT))
+        return -1;
+    name = &toks[j];
+
+    if (paren && (++j >= num || !pp_tok_punct(&toks[j], ')')))
+        return -1;
+
+    *i = j;
+
+    return pp_macro_find(pp, name->pt_str, name->pt_len) != NULL;
+}
+
+/* Header name at toks[*i]: "name" or <name>; the latter as spelled between
+ * the brackets if read from a file, and made of the tokens' spellings
+ * otherwise. Returns it (malloc'ed) with *i past it (NULL - none).
+ */
+static char *pp_hdr_name(const struct pp_tok *toks, size_t num, size_t *i, bool *quoted)
+{
+    const struct pp_tok *t = &toks[*i];
+    struct osink name;
+    bool exp = false;
+    size_t j;
+
+    if (*i >= num)
+        return NULL;
+
+    if ((t->pt_kind == PP_TOK_STRING) && (t->pt_str[0] == '"')) {
+        *quoted = true;
+        (*i)++;
+        return strndup(t->pt_str + 1, t->pt_len - 2);
+    }
+
+    if (!pp_tok_punct(t, '<'))
+        return NULL;
+
+    for (j = *i + 1; (j < num) && !pp_tok_punct(&toks[j], '>'); j++)
+        exp |= !!(toks[j].pt_flags & PP_TOK_F_EXP);
+
+    if (j == num)
+        return NULL;
+
+    *quoted = false;
+    *i = j + 1;
+
+    if (!exp && !(t->pt_flags & PP_TOK_F_EXP) && !(toks[j].pt_flags & PP_TOK_F_EXP))
+        return strndup(t->pt_str + 1, toks[j].pt_str - (t->pt_str + 1));
+
+    osink_init_mem(&name);
+    for (t++; t < &toks[j]; t++) {
+        if ((t->pt_flags & PP_TOK_F_SPACE) && name.osk_size)
+            osink_put_char(&name, ' ');
+        osink_write(&name, t->pt_str, t->pt_len);
+    }
+    osink_put_char(&name, '\0');
+
+    if (name.osk_err) {
+        osink_release(&name);
+        return NULL;
+    }
+
+    return name.osk_buf;
+}
+
+/* Looks for header name in dir (of dir_len) and records it as a
+ * dependency. Returns it if found, its tokens ready.
+ */
+static struct pp_hdr *pp_include_probe(struct pp_tu *pp, const char *dir, size_t dir_len,
+                                       const char *name, bool *err)
+{
+    size_t name_len = strlen(name);
+    enum pp_hdr_state state;
+    struct pp_hdr *hdr;
+    size_t len = 0;
+    char *path;
+
+    path = (char *)malloc(dir_len + name_len + 2);
+    if (!path) {
+        *err = true;
+        return NULL;
+    }
+
+    if (dir_len) {
+        memcpy(path, dir, dir_len);
+        len = dir_len;
+        if (path[len - 1] != '/')
+            path[len++] = '/';
+    }
+
+    memcpy(&path[len], name, name_len + 1);
+    len += name_len;
+
+    hdr = pp_hcache_get(pp->hc, path, len, PP_HDR_READY, &state);
+    free(path);
+
+    if (!hdr || pp_deps_add(pp->deps, hdr)) {
+        *err = true;
+        return NULL;
+    }
+
+    return (state == PP_HDR_READY) ? hdr : NULL;
+}
+
+/* Looks for header name ("name" if quoted, in the includer's directory
+ * first) in the include paths from ipath_from on, setting *ipath to the one
+ * it's found in (-1 - none).
+ */
+static struct pp_hdr *pp_include_find(struct pp_tu *pp, const char *name, bool quoted,
+                                      int ipath_from, int *ipath, bool *err)
+{
+    const struct trans_config *cfg = pp->cfg;
+    struct pp_ctx *file = pp_file_top(pp);
+    struct pp_hdr *hdr;
+    const char *sep;
+    int i;
+
+    *ipath = -1;
+
+    if (name[0] == '/')
+        return pp_include_probe(pp, NULL, 0, name, err);
+
+    if (quoted) {
+        sep = strrchr(file->pc_path, '/');
+        hdr = pp_include_probe(pp, file->pc_path, sep ? (sep - file->pc_path + 1) : 0, name, err);
+        if (hdr || *err)
+            return hdr;
+    }
+
+    for (i = ipath_from; i < cfg->ipaths_num; i++) {
+        hdr = pp_include_probe(pp, cfg->ipaths[i], strlen(cfg->ipaths[i]), name, err);
+        if (hdr || *err) {
+            *ipath = i;
+            return hdr;
+        }
+    }
+
+    return NULL;
+}
+
+/* Where #include_next (and __has_include_next) look from */
+static int pp_include_next_from(struct pp_tu *pp, bool *quoted)
+{
+    struct pp_ctx *file = pp_file_top(pp);
+
+    /* As #include, out of the main file */
+    if (!file->pc_hdr)
+        return 0;
+
+    *quoted = false;
+
+    return file->pc_ipath + 1;
+}
+
+static bool pp_once_has(struct pp_tu *pp, const struct pp_hdr *hdr)
+{
+    size_t i;
+
+    for (i = 0; i < pp->once_num; i++) {
+        if ((pp->once[i] == hdr) ||
+                ((pp->once[i]->ph_dev == hdr->ph_dev) && (pp->once[i]->ph_ino == hdr->ph_ino)))
+            return true;
+    }
+
+    return false;
+}
+
+static int pp_include(struct pp_tu *pp, const struct pp_tok *hash,
+                      const struct pp_tok *line, size_t num, bool next)
+{
+    enum pp_dir dir = next ? PP_DIR_INCLUDE_NEXT : PP_DIR_INCLUDE;
+    unsigned int l, c;
+    struct pp_toks exp;
+    struct pp_hdr *hdr;
+    const char *path;
+    char *name;
+    bool quoted = false;
+    bool err = false;
+    int ipath_from = 0;
+    int ipath;
+    size_t i = 0;
+
+    name = pp_hdr_name(line, num, &i, &quoted);
+    if (!name) {
+        /* Macro-expanded into one */
+        pp_toks_init(&exp);
+
+        if (pp_expand_toks(pp, line, num, &exp) < 0) {
+            pp_toks_release(&exp);
+            return -1;
+        }
+
+        name = pp_hdr_name(exp.pts_toks, exp.pts_num, &i, &quoted);
+        pp_toks_release(&exp);
+    }
+
+    if (!name) {
+        pp_report_malformed(pp, hash, dir);
+        return 0;
+    }
+
+    if (next)
+        ipath_from = pp_include_next_from(pp, &quoted);
+
+    hdr = pp_include_find(pp, name, quoted, ipath_from, &ipath, &err);
+    if (err) {
+        free(name);
+        return -1;
+    }
+
+    if (!hdr) {
+        path = pp_where(pp, hash, &l, &c);
+        aprint_report(APRINT_R_PP_INCLUDE_NOT_FOUND, l, c, path, name);
+        free(name);
+        return 0;
+    }
+
+    free(name);
+
+    /* Not entered again: its guard is defined, or it had #pragma once. */
+    if ((hdr->ph_guard && pp_macro_find(pp, hdr->ph_guard, strlen(hdr->ph_guard))) ||
+            pp_once_has(pp, hdr))
+        return 0;
+
+    if (pp->files_num > PP_INCL_NST_MAX) {
+        path = pp_where(pp, hash, &l, &c);
+        aprint_report(APRINT_R_PP_INCLUDE_DEPTH, l, c, path, (unsigned long)PP_INCL_NST_MAX);
+        return 0;
+    }
+
+    /* Its nesting level: one past that of the file including it (the main
+     * file at level 0).
+     */
+    if (pp->files_num == (size_t)pp->cfg->lim.f_incl_nst_lvl + 1) {
+        path = pp_where(pp, hash, &l, &c);
+        aprint_report(APRINT_R_LIMIT_INCLUDE_NESTING, l, c, path,
+                      (unsigned long)pp->cfg->lim.f_incl_nst_lvl);
+    }
+
+    pp->includes++;
+
+    return pp_push_file(pp, &hdr->ph_toks, hdr->ph_text.osk_buf, hdr->ph_path,
+                        &hdr->ph_locs, hdr, ipath);
+}
+
+/* #if expressions */
+
+struct pp_val {
+    int64_t pv_val;
+    bool pv_unsigned;
+};
+
+struct pp_eval {
+    const struct pp_tok *pe_toks;
+    size_t pe_num;
+    size_t pe_indx;
+
+    /* Set on the first error */
+    bool pe_err;
+    bool pe_div_zero;
+};
+
+static struct pp_val pp_eval_comma(struct pp_eval *ev, bool eval);
+static struct pp_val pp_eval_unary(struct pp_eval *ev, bool eval);
+
+static const struct pp_tok *pp_eval_peek(struct pp_eval *ev)
+{
+    return (ev->pe_indx < ev->pe_num) ? &ev->pe_toks[ev->pe_indx] : NULL;
+}
+
+static struct pp_val pp_eval_number(struct pp_eval *ev, const struct pp_tok *t)
+{
+    struct pp_val v = { 0, false };
+    char buf[72];
+    const char *p = buf;
+    char *end;
+    int base = 10;
+
+    if (t->pt_len >= sizeof(buf)) {
+        ev->pe_err = true;
+        return v;
+    }
+
+    memcpy(buf, t->pt_str, t->pt_len);
+    buf[t->pt_len] = '\0';
+
+    if ((buf[0] == '0') && ((buf[1] | 0x20) == 'x')) {
+        base = 16;
+    } else if ((buf[0] == '0') && ((buf[1] | 0x20) == 'b')) {
+        base = 2;
+        p += 2;
+    } else if (buf[0] == '0') {
+        base = 8;
+    }
+
+    errno = 0;
+    v.pv_val = (int64_t)strtoull(p, &end, base);
+    if (errno || (end == p))
+        ev->pe_err = true;
+
+    for (; *end; end++) {
+        if ((*end | 0x20) == 'u')
+            v.pv_unsigned = true;
+        else if ((*end | 0x20) != 'l')
+            ev->pe_err = true;
+    }
+
+    /* Too large for a signed one */
+    if (v.pv_val < 0)
+        v.pv_unsigned = true;
+
+    return v;
+}
+
+static struct pp_val pp_eval_char(struct pp_eval *ev, const struct pp_tok *t)
+{
+    struct pp_val v = { 0, false };
+    const char *c = (const char *)memchr(t->pt_str, '\'', t->pt_len) + 1;
+    const char *end = t->pt_str + t->pt_len - 1;
+    bool plain = (c == t->pt_str + 1);
+    int64_t ch;
+    int chars = 0;
+    int digits;
+
+    while (c < end) {
+        ch = (unsigned char)*c++;
+
+        if ((ch == '\\') && (c < end)) {
+            ch = (unsigned char)*c++;
+
+            switch (ch) {
+            case 'n': ch = '\n'; break;
+            case 't': ch = '\t'; break;
+            case 'r': ch = '\r'; break;
+            case 'a': ch = '\a'; break;
+            case 'b': ch = '\b'; break;
+            case 'f': ch = '\f'; break;
+            case 'v': ch = '\v'; break;
+            case 'e': ch = 27; break;
+
+            case 'x':
+                for (ch = 0; (c < end) && isxdigit((unsigned char)*c); c++)
+                    ch = (ch << 4) | ((*c <= '9') ? (*c - '0') : ((*c | 0x20) - 'a' + 10));
+                break;
+
+            case '0': case '1': case '2': case '3':
+            case '4': case '5': case '6': case '7':
+                ch -= '0';
+                for (digits = 1; (digits < 3) && (c < end) && (*c >= '0') && (*c <= '7'); digits++)
+                    ch = (ch << 3) | (*c++ - '0');
+                break;
+            }
+        }
+
+        v.pv_val = (v.pv_val << 8) | (ch & 0xff);
+        chars++;
+    }
+
+    if (!chars)
+        ev->pe_err = true;
+
+    /* A plain char is signed. */
+    if (plain && (chars == 1))
+        v.pv_val = (signed char)v.pv_val;
+
+    return v;
+}
+
+static struct pp_val pp_eval_primary(struct pp_eval *ev, bool eval)
+{
+    const struct pp_tok *t = pp_eval_peek(ev);
+    struct pp_val v = { 0, false };
+
+    if (!t) {
+        ev->pe_err = true;
+        return v;
+    }
+
+    ev->pe_indx++;
+
+    switch (t->pt_kind) {
+    case PP_TOK_NUMBER:
+        return pp_eval_number(ev, t);
+
+    case PP_TOK_CHAR:
+        return pp_eval_char(ev, t);
+
+    /* Identifiers left after expansion */
+    case PP_TOK_IDENT:
+        return v;
+
+    case PP_TOK_PUNCT:
+        if (pp_tok_punct(t, '(')) {
+            v = pp_eval_comma(ev, eval);
+            t = pp_eval_peek(ev);
+            if (!t || !pp_tok_punct(t, ')'))
+                ev->pe_err = true;
+            ev->pe_indx++;
+            return v;
+        }
+        break;
+    }
+
+    ev->pe_err = true;
+
+    return v;
+}
+
+static struct pp_val pp_eval_unary(struct pp_eval *ev, bool eval)
+{
+    const struct pp_tok *t = pp_eval_peek(ev);
+    struct pp_val v;
+
+    if (!t || (t->pt_kind != PP_TOK_PUNCT) || (t->pt_len != 1))
+        return pp_eval_primary(ev, eval);
+
+    switch (t->pt_str[0]) {
+    case '+':
+        ev->pe_indx++;
+        return pp_eval_unary(ev, eval);
+
+    case '-':
+        ev->pe_indx++;
+        v = pp_eval_unary(ev, eval);
+        v.pv_val = (int64_t)(0 - (uint64_t)v.pv_val);
+        return v;
+
+    case '~':
+        ev->pe_indx++;
+        v = pp_eval_unary(ev, eval);
+        v.pv_val = ~v.pv_val;
+        return v;
+
+    case '!':
+        ev->pe_indx++;
+        v = pp_eval_unary(ev, eval);
+        v.pv_val = !v.pv_val;
+        v.pv_unsigned = false;
+        return v;
+    }
+
+    return pp_eval_primary(ev, eval);
+}
+
+enum pp_binop {
+    PP_OP_NONE,
+    PP_OP_LOR,
+    PP_OP_LAND,
+    PP_OP_OR,
+    PP_OP_XOR,
+    PP_OP_AND,
+    PP_OP_EQ,
+    PP_OP_NE,
+    PP_OP_LT,
+    PP_OP_GT,
+    PP_OP_LE,
+    PP_OP_GE,
+    PP_OP_SHL,
+    PP_OP_SHR,
+    PP_OP_ADD,
+    PP_OP_SUB,
+    PP_OP_MUL,
+    PP_OP_DIV,
+    PP_OP_MOD,
+};
+
+/* Binary operators, and their precedence (higher binds tighter) */
+static const struct {
+    const char *name;
+    enum pp_binop op;
+    int prec;
+} pp_binops[] = {
+    { "||", PP_OP_LOR, 1 },
+    { "&&", PP_OP_LAND, 2 },
+    { "|", PP_OP_OR, 3 },
+    { "^", PP_OP_XOR, 4 },
+    { "&", PP_OP_AND, 5 },
+    { "==", PP_OP_EQ, 6 },
+    { "!=", PP_OP_NE, 6 },
+    { "<", PP_OP_LT, 7 },
+    { ">", PP_OP_GT, 7 },
+    { "<=", PP_OP_LE, 7 },
+    { ">=", PP_OP_GE, 7 },
+    { "<<", PP_OP_SHL, 8 },
+    { ">>", PP_OP_SHR, 8 },
+    { "+", PP_OP_ADD, 9 },
+    { "-", PP_OP_SUB, 9 },
+    { "*", PP_OP_MUL, 10 },
+    { "/", PP_OP_DIV, 10 },
+    { "%", PP_OP_MOD, 10 },
+};
+
+static enum pp_binop pp_eval_binop(const struct pp_tok *t, int *prec)
+{
+    size_t i;
+
+    if (!t || (t->pt_kind != PP_TOK_PUNCT))
+        return PP_OP_NONE;
+
+    for (i = 0; i < sizeof(pp_binops) / sizeof(pp_binops[0]); i++) {
+        if (pp_tok_eq(t, pp_binops[i].name, strlen(pp_binops[i].name))) {
+            *prec = pp_binops[i].prec;
+            return pp_binops[i].op;
+        }
+    }
+
+    return PP_OP_NONE;
+}
+
+static struct pp_val pp_eval_apply(struct pp_eval *ev, enum pp_binop op, struct pp_val l,
+                                   struct pp_val r, bool eval)
+{
+    bool u = l.pv_unsigned || r.pv_unsigned;
+    uint64_t ul = l.pv_val, ur = r.pv_val;
+    struct pp_val v = { 0, u };
+
+    switch (op) {
+    case PP_OP_OR:  v.pv_val = ul | ur; break;
+    case PP_OP_XOR: v.pv_val = ul ^ ur; break;
+    case PP_OP_AND: v.pv_val = ul & ur; break;
+    case PP_OP_ADD: v.pv_val = ul + ur; break;
+    case PP_OP_SUB: v.pv_val = ul - ur; break;
+    case PP_OP_MUL: v.pv_val = ul * ur; break;
+
+    case PP_OP_EQ: v.pv_val = (ul == ur); v.pv_unsigned = false; break;
+    case PP_OP_NE: v.pv_val = (ul != ur); v.pv_unsigned = false; break;
+
+    case PP_OP_LT: v.pv_val = u ? (ul < ur) : (l.pv_val < r.pv_val); v.pv_unsigned = false; break;
+    case PP_OP_GT: v.pv_val = u ? (ul > ur) : (l.pv_val > r.pv_val); v.pv_unsigned = false; break;
+    case PP_OP_LE: v.pv_val = u ? (ul <= ur) : (l.pv_val <= r.pv_val); v.pv_unsigned = false; break;
+    case PP_OP_GE: v.pv_val = u ? (ul >= ur) : (l.pv_val >= r.pv_val); v.pv_unsigned = false; break;
+
+    /* Shifts take the type of the left operand. */
+    case PP_OP_SHL:
+        v.pv_unsigned = l.pv_unsigned;
+        v.pv_val = (ur < 64) ? (int64_t)(ul << ur) : 0;
+        break;
+
+    case PP_OP_SHR:
+        v.pv_unsigned = l.pv_unsigned;
+        if (l.pv_unsigned)
+            v.pv_val = (ur < 64) ? (int64_t)(ul >> ur) : 0;
+        else
+            v.pv_val = l.pv_val >> ((ur < 64) ? ur : 63);
+        break;
+
+    case PP_OP_DIV:
+    case PP_OP_MOD:
+        if (!ur) {
+            if (eval)
+                ev->pe_div_zero = true;
+            break;
+        }
+
+        if (u)
+            v.pv_val = (op == PP_OP_DIV) ? (ul / ur) : (ul % ur);
+        else if ((l.pv_val == INT64_MIN) && (r.pv_val == -1))
+            v.pv_val = (op == PP_OP_DIV) ? INT64_MIN : 0;
+        else
+            v.pv_val = (op == PP_OP_DIV) ? (l.pv_val / r.pv_val) : (l.pv_val % r.pv_val);
+        break;
+
+    default:
+        break;
+    }
+
+    return v;
+}
+
+static struct pp_val pp_eval_binary(struct pp_eval *ev, int min_prec, bool eval)
+{
+    struct pp_val l = pp_eval_unary(ev, eval);
+    struct pp_val r;
+    enum pp_binop op;
+    int prec;
+
+    while (!ev->pe_err) {
+        op = pp_eval_binop(pp_eval_peek(ev), &prec);
+        if ((op == PP_OP_NONE) || (prec < min_prec))
+            break;
+
+        ev->pe_indx++;
+
+        if (op == PP_OP_LOR) {
+            r = pp_eval_binary(ev, prec + 1, eval && !l.pv_val);
+            l.pv_val = l.pv_val || r.pv_val;
+            l.pv_unsigned = false;
+        } else if (op == PP_OP_LAND) {
+            r = pp_eval_binary(ev, prec + 1, eval && l.pv_val);
+            l.pv_val = l.pv_val && r.pv_val;
+            l.pv_unsigned = false;
+        } else {
+            r = pp_eval_binary(ev, prec + 1, eval);
+            l = pp_eval_apply(ev, op, l, r, eval);
+        }
+    }
+
+    return l;
+}
+
+static struct pp_val pp_eval_cond(struct pp_eval *ev, bool eval)
+{
+    struct pp_val c = pp_eval_binary(ev, 1, eval);
+    const struct pp_tok *t = pp_eval_peek(ev);
+    struct pp_val a, b;
+
+    if (!t || !pp_tok_punct(t, '?'))
+        return c;
+
+    ev->pe_indx++;
+    a = pp_eval_comma(ev, eval && c.pv_val);
+
+    t = pp_eval_peek(ev);
+    if (!t || !pp_tok_punct(t, ':')) {
+        ev->pe_err = true;
+        return c;
+    }
+
+    ev->pe_indx++;
+    b = pp_eval_cond(ev, eval && !c.pv_val);
+
+    a = c.pv_val ? a : b;
+    a.pv_unsigned = a.pv_unsigned || b.pv_unsigned;
+
+    return a;
+}
+
+static struct pp_val pp_eval_comma(struct pp_eval *ev, bool eval)
+{
+    struct pp_val v = pp_eval_cond(ev, eval);
+    const struct pp_tok *t;
+
+    while (!ev->pe_err && (t = pp_eval_peek(ev)) && pp_tok_punct(t, ',')) {
+        ev->pe_indx++;
+        v = pp_eval_cond(ev, eval);
+    }
+
+    return v;
+}
+
+/* Whether name is defined, as far as "defined" and #ifdef go */
+static bool pp_is_defined(struct pp_tu *pp, const struct pp_tok *name)
+{
+    return pp_macro_find(pp, name->pt_str, name->pt_len) ||
+           pp_tok_is(name, "__has_include") || pp_tok_is(name, "__has_include_next");
+}
+
+/* "__has_include ( header-name )" at toks[*i]: its value, with *i at its
+ * last token (-1 - malformed, or out of memory).
+ */
+static int pp_has_include(struct pp_tu *pp, const struct pp_tok *toks, size_t num, size_t *i,
+                          bool *err)
+{
+    bool next = pp_tok_is(&toks[*i], "__has_include_next");
+    struct pp_hdr *hdr;
+    bool quoted = false;
+    int ipath_from = 0;
+    size_t j = *i + 1;
+    char *name;
+    int ipath;
+
+    if ((j >= num) || !pp_tok_punct(&toks[j], '('))
+        return -1;
+    j++;
+
+    name = pp_hdr_name(toks, num, &j, &quoted);
+    if (!name)
+        return -1;
+
+    if ((j >= num) || !pp_tok_punct(&toks[j], ')')) {
+        free(name);
+        return -1;
+    }
+
+    if (next)
+        ipath_from = pp_include_next_from(pp, &quoted);
+
+    hdr = pp_include_find(pp, name, quoted, ipath_from, &ipath, err);
+    free(name);
+
+    *i = j;
+
+    return hdr != NULL;
+}
+
+/* Value of the expression of an #if (or #elif) line: 1 or 0. */
+static int pp_cond_eval(struct pp_tu *pp, const struct pp_tok *hash, enum pp_dir dir,
+                        const struct pp_tok *line, size_t num)
+{
+    struct pp_eval ev;
+    struct pp_toks pre;
+    struct pp_toks exp;
+    struct pp_val v;
+    unsigned int l, c;
+    const char *path;
+    bool err = false;
+    int ret_val = -1;
+    size_t i;
+    int r;
+
+    pp_toks_init(&pre);
+    pp_toks_init(&exp);
+
+    /* "defined" and "__has_include" are taken before any expansion. */
+    for (i = 0; i < num; i++) {
+        if (line[i].pt_kind != PP_TOK_IDENT) {
+            r = -2;
+        } else if (pp_tok_is(&line[i], "defined")) {
+            r = pp_defined(pp, line, num, &i);
+        } else if (pp_tok_is(&line[i], "__has_include") ||
+                   pp_tok_is(&line[i], "__has_include_next")) {
+            r = pp_has_include(pp, line, num, &i, &err);
+            if (err)
+                goto out;
+        } else {
+            r = -2;
+        }
+
+        if (r == -1)
+            goto bad;
+
+        if (pp_toks_append(&pre, (r == -2) ? &line[i] : r ? &pp_tok_one : &pp_tok_zero, 1))
+            goto out;
+    }
+
+    if (!pre.pts_num)
+        goto bad;
+
+    if (pp_expand_toks(pp, pre.pts_toks, pre.pts_num, &exp) < 0)
+        goto out;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.pe_toks = exp.pts_toks;
+    ev.pe_num = exp.pts_num;
+
+    v = pp_eval_comma(&ev, true);
+    if (ev.pe_err || (ev.pe_indx != ev.pe_num))
+        goto bad;
+
+    if (ev.pe_div_zero) {
+        path = pp_where(pp, hash, &l, &c);
+        aprint_report(APRINT_R_PP_DIV_ZERO, l, c, path, pp_dir_names[dir]);
+        ret_val = 0;
+        goto out;
+    }
+
+    ret_val = !!v.pv_val;
+    goto out;
+
+bad:
+    path = pp_where(pp, hash, &l, &c);
+    aprint_report(APRINT_R_PP_EXPR_INVALID, l, c, path, pp_dir_names[dir]);
+    ret_val = 0;
+
+out:
+    pp_toks_release(&pre);
+    pp_toks_release(&exp);
+
+    return ret_val;
+}
+
+/* Conditional inclusion */
+
+/* Skips the group the file on top is in, up to the #elif, #else or #endif
+ * ending it (left to be read), or to the end of the file.
+ */
+static void pp_skip_group(struct pp_tu *pp)
+{
+    struct pp_ctx *ctx = &pp->ctxs[pp->ctxs_num - 1];
+    enum pp_dir dir;
+    int depth = 0;
+    size_t i;
+
+    for (i = ctx->pc_indx; i < ctx->pc_num; i++) {
+        dir = pp_dir_at(ctx->pc_ftoks, ctx->pc_text, i);
+        if (dir == PP_DIR_NONE)
+            continue;
+
+        if (pp_dir_is_if(dir)) {
+            depth++;
+        } else if (!depth && ((dir == PP_DIR_ENDIF) || pp_dir_is_else(dir))) {
+            break;
+        } else if (dir == PP_DIR_ENDIF) {
+            depth--;
+        }
+    }
+
+    ctx->pc_indx = i;
+}
+
+static int pp_cond_push(struct pp_tu *pp, const struct pp_tok *hash, bool taken)
+{
+    struct pp_cond *new_conds;
+    struct pp_cond *cond;
+    unsigned int l, c;
+    const char *path;
+    size_t new_cap;
+
+    if (pp->conds_num == pp->conds_cap) {
+        new_cap = pp->conds_cap ? (pp->conds_cap << 1) : 64;
+        new_conds = (struct pp_cond *)realloc(pp->conds, sizeof(struct pp_cond) * new_cap);
+        if (!new_conds)
+            return -1;
+
+        pp->conds = new_conds;
+        pp->conds_cap = new_cap;
+    }
+
+    cond = &pp->conds[pp->conds_num++];
+    cond->pcd_offs = hash->pt_offs;
+    cond->pcd_taken = taken;
+    cond->pcd_else = false;
+
+    if (pp->conds_num == (size_t)pp->cfg->lim.cond_nst_lvl + 1) {
+        path = pp_where(pp, hash, &l, &c);
+        aprint_report(APRINT_R_LIMIT_COND_NESTING, l, c, path,
+                      (unsigned long)pp->cfg->lim.cond_nst_lvl);
+    }
+
+    return 0;
+}
+
+/* #ifdef, #ifndef, #elifdef and #elifndef: 1 or 0 */
+static int pp_cond_def(struct pp_tu *pp, const struct pp_tok *hash, enum pp_dir dir,
+                       const struct pp_tok *line, size_t num)
+{
+    bool neg = (dir == PP_DIR_IFNDEF) || (dir == PP_DIR_ELIFNDEF);
+
+    if ((num != 1) || (line[0].pt_kind != PP_TOK_IDENT)) {
+        pp_report_malformed(pp, hash, dir);
+        return 0;
+    }
+
+    return pp_is_defined(pp, &line[0]) != neg;
+}
+
+static int pp_cond(struct pp_tu *pp, struct pp_ctx *ctx, const struct pp_tok *hash,
+                   enum pp_dir dir, const struct pp_tok *line, size_t num)
+{
+    unsigned int l, c;
+    struct pp_cond *cond;
+    const char *path;
+    int taken;
+
+    if (pp_dir_is_if(dir)) {
+        taken = (dir == PP_DIR_IF) ? pp_cond_eval(pp, hash, dir, line, num) :
+                                     pp_cond_def(pp, hash, dir, line, num);
+        if ((taken < 0) || pp_cond_push(pp, hash, taken))
+            return -1;
+
+        if (!taken)
+            pp_skip_group(pp);
+
+        return 0;
+    }
+
+    /* The rest close a group of a conditional of the file. */
+    cond = (pp->conds_num > ctx->pc_conds) ? &pp->conds[pp->conds_num - 1] : NULL;
+    if (!cond || (cond->pcd_else && (dir != PP_DIR_ENDIF))) {
+        path = pp_where(pp, hash, &l, &c);
+        aprint_report(APRINT_R_PP_COND_UNBALANCED, l, c, path, pp_dir_names[dir]);
+        return 0;
+    }
+
+    if (dir == PP_DIR_ENDIF) {
+        pp->conds_num--;
+        return 0;
+    }
+
+    if (dir == PP_DIR_ELSE)
+        cond->pcd_else = true;
+
+    if (cond->pcd_taken) {
+        pp_skip_group(pp);
+        return 0;
+    }
+
+    if (dir == PP_DIR_ELSE)
+        taken = 1;
+    else if (dir == PP_DIR_ELIF)
+        taken = pp_cond_eval(pp, hash, dir, line, num);
+    else
+        taken = pp_cond_def(pp, hash, dir, line, num);
+
+    if (taken < 0)
+        return -1;
+
+    cond->pcd_taken = taken;
+    if (!taken)
+        pp_skip_group(pp);
+
+    return 0;
+}
+
+static void pp_out(struct pp_tu *pp, const struct pp_tok *tok);
+
+static int pp_pragma(struct pp_tu *pp, struct pp_ctx *ctx, const struct pp_tok *hash,
+                     const struct pp_tok *line, size_t num)
+{
+    struct pp_hdr **new_once;
+    size_t new_cap;
+    size_t i;
+
+    /* Other pragmas are for the compiler: passed on, as they are. */
+    if ((num != 1) || !pp_tok_is(&line[0], "once")) {
+        for (i = 0; i < num + 2; i++)
+            pp_out(pp, &hash[i]);
+        return 0;
+    }
+
+    if (!ctx->pc_hdr || pp_once_has(pp, ctx->pc_hdr))
+        return 0;
+
+    if (pp->once_num == pp->once_cap) {
+        new_cap = pp->once_cap ? (pp->once_cap << 1) : 16;
+        new_once = (struct pp_hdr **)realloc(pp->once, sizeof(struct pp_hdr *) * new_cap);
+        if (!new_once)
+            return -1;
+
+        pp->once = new_once;
+        pp->once_cap = new_cap;
+    }
+
+    pp->once[pp->once_num++] = ctx->pc_hdr;
+
+    return 0;
+}
+
+/* #error and #warning, their message as spelled */
+static int pp_diag(struct pp_tu *pp, const struct pp_tok *hash, enum pp_dir dir,
+                   const struct pp_tok *line, size_t num)
+{
+    unsigned int l, c;
+    const char *path;
+    char *msg;
+
+    if (num)
+        msg = strndup(line[0].pt_str,
+                      line[num - 1].pt_str + line[num - 1].pt_len - line[0].pt_str);
+    else
+        msg = strdup("");
+
+    if (!msg)
+        return -1;
+
+    path = pp_where(pp, hash, &l, &c);
+    aprint_report((dir == PP_DIR_ERROR) ? APRINT_R_PP_ERROR_DIRECTIVE :
+                  APRINT_R_PP_WARNING_DIRECTIVE, l, c, path, msg);
+    free(msg);
+
+    return 0;
+}
+
+/* Line number of a #line directive, a digit sequence (-1 - not one, or
+ * past PP_LINE_MAX).
+ */
+static long pp_line_num(const struct pp_tok *tok)
+{
+    unsigned long num = 0;
+    uint32_t i;
+
+    if (tok->pt_kind != PP_TOK_NUMBER)
+        return -1;
+
+    for (i = 0; i < tok->pt_len; i++) {
+        if (!isdigit((unsigned char)tok->pt_str[i]))
+            return -1;
+
+        num = (num * 10) + (tok->pt_str[i] - '0');
+        if (num > PP_LINE_MAX)
+            return -1;
+    }
+
+    return (long)num;
+}
+
+/* File name of a #line directive, its string literal unescaped, in the
+ * arena (NULL - not a plain string literal, or out of memory: err set).
+ */
+static const char *pp_line_path(struct pp_tu *pp, const struct pp_tok *tok, bool *err)
+{
+    char *path, *p;
+    uint32_t i;
+
+    if ((tok->pt_kind != PP_TOK_STRING) || (tok->pt_str[0] != '"'))
+        return NULL;
+
+    path = pp_str_alloc(pp, tok->pt_len - 1);
+    if (!path) {
+        *err = true;
+        return NULL;
+    }
+
+    p = path;
+    for (i = 1; i + 1 < tok->pt_len; i++) {
+        if (tok->pt_str[i] == '\\')
+            i++;
+        *p++ = tok->pt_str[i];
+    }
+    *p = '\0';
+
+    return path;
+}
+
+/* #line, and line markers ("# 33 "file" 1"): the line following the
+ * directive takes the number given, and the file the name given (if any),
+ * in the diagnostics and for __LINE__ and __FILE__ from there on. The
+ * operands of #line are macro-expanded first.
+ */
+static int pp_line(struct pp_tu *pp, const struct pp_tok *hash,
+                   const struct pp_tok *line, size_t num, bool marker)
+{
+    const struct pp_tok *last = &line[num - 1];
+    const struct pp_tok *toks = line;
+    const char *name = NULL;
+    struct pp_toks exp;
+    struct pp_ctx *ctx;
+    unsigned int l, c;
+    size_t offs, next;
+    bool err = false;
+    long line_num = -1;
+
+    pp_toks_init(&exp);
+
+    if (!marker) {
+        if (pp_expand_toks(pp, line, num, &exp) < 0) {
+            pp_toks_release(&exp);
+            return -1;
+        }
+
+        toks = exp.pts_toks;
+        num = exp.pts_num;
+    }
+
+    if (num)
+        line_num = pp_line_num(&toks[0]);
+
+    if ((line_num >= 0) && (num > 1))
+        name = pp_line_path(pp, &toks[1], &err);
+
+    pp_toks_release(&exp);
+
+    if (err)
+        return -1;
+
+    /* Line markers may go on with flags, and set line 0. */
+    if ((line_num < 0) || (!marker && !line_num) || ((num > 1) && !name) ||
+            (!marker && (num > 2))) {
+        pp_report_malformed(pp, hash, PP_DIR_LINE);
+        return 0;
+    }
+
+    /* The line following is the one after the new-line ending the
+     * directive (a comment spanning lines may come before it).
+     */
+    ctx = pp_file_top(pp);
+    offs = last->pt_offs + last->pt_len;
+    next = (ctx->pc_indx < ctx->pc_num) ? ctx->pc_ftoks->stk_offs[ctx->pc_indx] : offs;
+
+    while ((offs < next) && (ctx->pc_text[offs] != '\n'))
+        offs++;
+
+    l = 0;
+    if (ctx->pc_locs)
+        src_locs_lookup(ctx->pc_locs, SLOC_PHASE_3, offs, &l, &c);
+
+    ctx->pc_line_adj = line_num - (long)(l + 1);
+    if (name)
+        ctx->pc_line_path = name;
+
+    return 0;
+}
+
+/* Carries out the directive the file on top is at. */
+static int pp_directive(struct pp_tu *pp)
+{
+    struct pp_ctx *ctx = &pp->ctxs[pp->ctxs_num - 1];
+    char buf[PP_NAME_PRINT_MAX];
+    const struct pp_tok *hash;
+    const struct pp_tok *line;
+    struct pp_tok *t;
+    unsigned int l, c;
+    const char *path;
+    enum pp_dir dir;
+    size_t end;
+    size_t num;
+    size_t i;
+
+    for (end = ctx->pc_indx + 1; (end < ctx->pc_num) &&
+            !(ctx->pc_ftoks->stk_flags[end] & PP_TOK_F_BOL); end++);
+
+    num = end - ctx->pc_indx;
+
+    pp->dline.pts_num = 0;
+    t = pp_toks_add(&pp->dline, num);
+    if (!t)
+        return -1;
+
+    for (i = 0; i < num; i++)
+        pp_stok(ctx->pc_ftoks, ctx->pc_text, ctx->pc_indx + i, &t[i]);
+
+    hash = t;
+    ctx->pc_indx = end;
+
+    /* The null directive */
+    if (num == 1)
+        return 0;
+
+    if (hash[1].pt_kind == PP_TOK_NUMBER)
+        return pp_line(pp, hash, &hash[1], num - 1, true);
+
+    dir = pp_dir_find(&hash[1]);
+    line = &hash[2];
+    num -= 2;
+
+    switch (dir) {
+    case PP_DIR_DEFINE:
+        return pp_define(pp, hash, line, num);
+
+    case PP_DIR_UNDEF:
+        if ((num != 1) || (line[0].pt_kind != PP_TOK_IDENT)) {
+            pp_report_malformed(pp, hash, dir);
+            return 0;
+        }
+
+        pp_macro_del(pp, line[0].pt_str, line[0].pt_len);
+        return 0;
+
+    case PP_DIR_INCLUDE:
+    case PP_DIR_INCLUDE_NEXT:
+        return pp_include(pp, hash, line, num, dir == PP_DIR_INCLUDE_NEXT);
+
+    case PP_DIR_IF:
+    case PP_DIR_IFDEF:
+    case PP_DIR_IFNDEF:
+    case PP_DIR_ELIF:
+    case PP_DIR_ELIFDEF:
+    case PP_DIR_ELIFNDEF:
+    case PP_DIR_ELSE:
+    case PP_DIR_ENDIF:
+        return pp_cond(pp, ctx, hash, dir, line, num);
+
+    case PP_DIR_ERROR:
+    case PP_DIR_WARNING:
+        return pp_diag(pp, hash, dir, line, num);
+
+    case PP_DIR_PRAGMA:
+        return pp_pragma(pp, ctx, hash, line, num);
+
+    case PP_DIR_LINE:
+        if (!num) {
+            pp_report_malformed(pp, hash, dir);
+            return 0;
+        }
+
+        return pp_line(pp, hash, line, num, false);
+
+    case PP_DIR_IDENT:
+    case PP_DIR_SCCS:
+    case PP_DIR_ASSERT:
+    case PP_DIR_UNASSERT:
+        return 0;
+
+    default:
+        break;
+    }
+
+    path = pp_where(pp, hash, &l, &c);
+    aprint_report(APRINT_R_PP_DIRECTIVE_INVALID, l, c, path, pp_tok_cstr(&hash[1], buf));
+
+    return 0;
+}
+
+/* Output */
+
+/* A space is needed between the last token out and tok, for them not to
+ * read back as another token.
+ */
+static bool pp_avoid_paste(const struct pp_tu *pp, const struct pp_tok *tok)
+{
+    const unsigned char first = tok->pt_str[0];
+    const unsigned char last = pp->out_last;
+    char pair[2];
+
+    switch (pp->out_kind) {
+    case PP_TOK_IDENT:
+        return (tok->pt_kind == PP_TOK_IDENT) || (tok->pt_kind == PP_TOK_NUMBER) ||
+               (tok->pt_kind == PP_TOK_CHAR) || (tok->pt_kind == PP_TOK_STRING);
+
+    case PP_TOK_NUMBER:
+        return (tok->pt_kind == PP_TOK_IDENT) || (tok->pt_kind == PP_TOK_NUMBER) ||
+               (first == '.') || (first == '+') || (first == '-');
+
+    case PP_TOK_PUNCT:
+        if ((last == '.') && (tok->pt_kind == PP_TOK_NUMBER))
+            return true;
+
+        if (tok->pt_kind != PP_TOK_PUNCT)
+            return false;
+
+        if ((last == '/') && ((first == '/') || (first == '*')))
+            return true;
+
+        pair[0] = last;
+        pair[1] = first;
+
+        return src_lex_punct_len(pair, 2) == 2;
+    }
+
+    return false;
+}
+
+/* Rules of the limits on the output */
+static const enum analysis_print_rule pp_limit_rules[SLIM_EVENTS_NUM] = {
+    [SLIM_STR_LEN]      = APRINT_R_LIMIT_STRING_LENGTH,
+    [SLIM_PAREN_NST]    = APRINT_R_LIMIT_PAREN_NESTING,
+    [SLIM_BLOCK_NST]    = APRINT_R_LIMIT_BLOCK_NESTING,
+    [SLIM_STRUCT_NST]   = APRINT_R_LIMIT_STRUCT_NESTING,
+    [SLIM_CASES]        = APRINT_R_LIMIT_CASE_LABELS,
+    [SLIM_MEMBERS]      = APRINT_R_LIMIT_MEMBERS,
+    [SLIM_ENUM_CONSTS]  = APRINT_R_LIMIT_ENUM_CONSTS,
+};
+
+static void pp_out(struct pp_tu *pp, const struct pp_tok *tok)
+{
+    const char *name, *other;
+    enum slim_event ev;
+    unsigned int l, c;
+    const char *path;
+
+    ev = slim_tok(&pp->lims, tok->pt_kind, tok->pt_str, tok->pt_len);
+    if (ev != SLIM_NONE) {
+        path = pp_where(pp, tok, &l, &c);
+        aprint_report(pp_limit_rules[ev], l, c, path,
+                      (unsigned long)slim_limit(&pp->lims, ev));
+    }
+
+    if (sids_tok(&pp->idsig, tok->pt_kind, tok->pt_str, tok->pt_len, &name, &other)) {
+        path = pp_where(pp, tok, &l, &c);
+        aprint_report(APRINT_R_LIMIT_IDENT_SIGNIFICANCE, l, c, path, name, other,
+                      (unsigned long)pp->cfg->lim.init_char_intern_ident_num);
+    }
+
+    if (pp->out_any) {
+        if (tok->pt_flags & PP_TOK_F_BOL)
+            osink_put_char(pp->out, '\n');
+        else if ((tok->pt_flags & PP_TOK_F_SPACE) ||
+                 (((tok->pt_flags & PP_TOK_F_EXP) || pp->out_exp) && pp_avoid_paste(pp, tok)))
+            osink_put_char(pp->out, ' ');
+    }
+
+    osink_write(pp->out, tok->pt_str, tok->pt_len);
+
+    pp->out_any = true;
+    pp->out_kind = tok->pt_kind;
+    pp->out_last = tok->pt_str[tok->pt_len - 1];
+    pp->out_exp = !!(tok->pt_flags & PP_TOK_F_EXP);
+}
+
+static int pp_tu_init(struct pp_tu *pp, struct osink *out, const struct trans_config *cfg,
+                      struct pp_hcache *hc, struct pp_deps *deps)
+{
+    static const char *builtins[] = {
+        [PP_BUILTIN_FILE] = "__FILE__",
+        [PP_BUILTIN_LINE] = "__LINE__",
+    };
+    struct pp_macro *m;
+    struct pp_ident *id;
+    int i;
+
+    memset(pp, 0, sizeof(struct pp_tu));
+    pp->cfg = cfg;
+    pp->hc = hc;
+    pp->deps = deps;
+    pp->out = out;
+    slim_init(&pp->lims, &cfg->lim);
+    sids_init(&pp->idsig, cfg->lim.init_char_intern_ident_num);
+
+    pp->idents = (struct pp_ident *)calloc(PP_IDENTS_INIT_SIZE, sizeof(struct pp_ident));
+    if (!pp->idents)
+        return -1;
+    pp->idents_size = PP_IDENTS_INIT_SIZE;
+
+    for (i = PP_BUILTIN_FILE; i <= PP_BUILTIN_LINE; i++) {
+        m = (struct pp_macro *)pp_alloc(pp, sizeof(struct pp_macro), sizeof(void *));
+        id = pp_ident_get(pp, builtins[i], strlen(builtins[i]));
+        if (!m || !id)
+            return -1;
+
+        memset(m, 0, sizeof(struct pp_macro));
+        m->pm_params_num = -1;
+        m->pm_builtin = i;
+        pp_macro_set(pp, id, m);
+    }
+
+    return 0;
+}
+
+static void pp_tu_release(struct pp_tu *pp)
+{
+    struct pp_chunk *chunk;
+
+    while (pp->ctxs_num)
+        pp_ctx_pop(pp);
+
+    while ((chunk = pp->arena)) {
+        pp->arena = chunk->pch_next;
+        free(chunk);
+    }
+
+    free(pp->idents);
+    free(pp->params);
+    sids_release(&pp->idsig);
+    pp_toks_release(&pp->dline);
+    free(pp->ctxs);
+    free(pp->conds);
+    free(pp->once);
+}
+
+int pp_check(const struct osink *text, const char *name, const struct src_locs *locs,
+             const struct trans_config *cfg)
+{
+    const char *path = src_input_path_shown(cfg->base_dir, name);
+    const char *id, *other;
+    struct src_limits lims;
+    struct src_idsig idsig;
+    struct src_toks toks;
+    enum slim_event ev;
+    struct pp_tok tok;
+    unsigned int l, c;
+    bool dir = false;
+    int ret_val = -1;
+    size_t i;
+
+    slim_init(&lims, &cfg->lim);
+    sids_init(&idsig, cfg->lim.init_char_intern_ident_num);
+    src_toks_init(&toks);
+
+    if (src_lex(&toks, text->osk_buf, text->osk_size))
+        goto out;
+
+    for (i = 0; i < toks.stk_num; i++) {
+        pp_stok(&toks, text->osk_buf, i, &tok);
+
+        /* Directive lines are left out. */
+        if (tok.pt_flags & PP_TOK_F_BOL)
+            dir = pp_tok_hash(&tok);
+
+        if (dir)
+            continue;
+
+        ev = slim_tok(&lims, tok.pt_kind, tok.pt_str, tok.pt_len);
+        if (ev != SLIM_NONE) {
+            src_locs_lookup(locs, SLOC_PHASE_3, tok.pt_offs, &l, &c);
+            aprint_report(pp_limit_rules[ev], l, c, path, (unsigned long)slim_limit(&lims, ev));
+        }
+
+        if (sids_tok(&idsig, tok.pt_kind, tok.pt_str, tok.pt_len, &id, &other)) {
+            src_locs_lookup(locs, SLOC_PHASE_3, tok.pt_offs, &l, &c);
+            aprint_report(APRINT_R_LIMIT_IDENT_SIGNIFICANCE, l, c, path, id, other,
+                          (unsigned long)cfg->lim.init_char_intern_ident_num);
+        }
+    }
+
+    ret_val = idsig.sis_err ? -1 : 0;
+
+out:
+    sids_release(&idsig);
+    src_toks_release(&toks);
+
+    return ret_val;
+}
+
+int pp_run(struct osink *out, const struct osink *text, const char *name,
+           const struct src_locs *locs, const struct trans_config *cfg,
+           struct pp_hcache *hc, struct pp_deps *deps, struct src_stats *st)
+{
+    struct pp_hcache own_hc;
+    struct src_toks toks;
+    struct pp_tok tok;
+    struct pp_tu pp;
+    int ret_val = -1;
+    int r;
+
+    if (!hc) {
+        if (pp_hcache_init(&own_hc, cfg))
+            return -1;
+        hc = &own_hc;
+    }
+
+    src_toks_init(&toks);
+
+    if (pp_tu_init(&pp, out, cfg, hc, deps) ||
+            src_lex(&toks, text->osk_buf, text->osk_size))
+        goto out;
+
+    /* The predefined macros are read first, as if ahead of the file. */
+    if (pp_push_file(&pp, &toks, text->osk_buf, name, locs, NULL, -1) ||
+            pp_push_file(&pp, &hc->phc_predef_toks, hc->phc_predef.osk_buf, "<command-line>",
+                         NULL, NULL, -1))
+        goto out;
+
+    while (pp.ctxs_num) {
+        r = pp_expand_next(&pp, 0, &tok);
+        if (r < 0)
+            goto out;
+
+        if (r)
+            pp_out(&pp, &tok);
+        else
+            pp_pop_file(&pp);
+    }
+
+    if (pp.out_any)
+        osink_put_char(out, '\n');
+
+    if (st) {
+        st->ss_includes = pp.includes;
+        st->ss_expansions = pp.expansions;
+    }
+
+    ret_val = (out->osk_err || pp.idsig.sis_err) ? -1 : 0;
+
+out:
+    pp_tu_release(&pp);
+    src_toks_release(&toks);
+
+    if (hc == &own_hc)
+        pp_hcache_release(&own_hc);
+
+    return ret_val;
+}
@@ -0,0 +1,162 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _SRC_PP_H__
+#define _SRC_PP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "std_comp.h"
+#include "out_sink.h"
+#include "src_loc.h"
+#include "src_stats.h"
+#include "src_lex.h"
+
+/* Translation phase 4: the preprocessor.
+ *
+ * The phase 3 output of a file is cut into preprocessing tokens (see
+ * src_lex.h), and read through a stack of contexts: the files being
+ * included, and the macro expansions being rescanned. Directives are
+ * carried out as they're read, and a macro is disabled while its own
+ * expansion is read, the tokens naming it painted so they never expand
+ * (as GCC does).
+ *
+ * Headers are shared by all the files of a run: each goes through phases
+ * 1-3 and is cut into tokens once, when first included, and is kept in the
+ * header cache. A header wrapped in an include guard (or which had
+ * "#pragma once") is not entered again once the guard is defined.
+ */
+
+/* Token flags, past those of src_lex.h */
+#define PP_TOK_F_NOEXP      0x04    /* Names a macro, but never expands */
+#define PP_TOK_F_EXP        0x08    /* Comes out of a macro expansion */
+#define PP_TOK_F_PARAM      0x10    /* In a macro body: parameter pt_aux */
+#define PP_TOK_F_STR        0x20    /* ... the operand of # */
+
+struct pp_tok {
+    const char *pt_str;
+    uint32_t pt_len;
+
+    /* Offset in the phase 3 output of its file */
+    uint32_t pt_offs;
+
+    uint8_t pt_kind;
+    uint8_t pt_flags;
+    uint16_t pt_aux;
+};
+
+struct pp_toks {
+    struct pp_tok *pts_toks;
+    size_t pts_num;
+    size_t pts_cap;
+};
+
+enum pp_hdr_state {
+    PP_HDR_NEW,
+    PP_HDR_MISSING,
+
+    /* Found: its contents hash, and identity, known */
+    PP_HDR_FOUND,
+
+    /* Tokens ready */
+    PP_HDR_READY,
+
+    /* Found, but could not be read */
+    PP_HDR_FAILED,
+};
+
+/* A header, by the path it was looked for at */
+struct pp_hdr {
+    struct pp_hdr *ph_next;
+    char *ph_path;
+    uint64_t ph_path_hash;
+
+    /* Only moves forward; a thread working on the header holds it busy. */
+    enum pp_hdr_state ph_state;
+    bool ph_busy;
+
+    dev_t ph_dev;
+    ino_t ph_ino;
+    uint64_t ph_hash;
+
+    /* Phase 3 output, its locations, and its tokens */
+    struct osink ph_text;
+    struct src_locs ph_locs;
+    struct src_toks ph_toks;
+
+    /* Macro of the guard wrapping it all (NULL - none) */
+    char *ph_guard;
+};
+
+/* The headers of a run, shared by its threads. */
+struct pp_hcache {
+    const struct trans_config *phc_cfg;
+
+    pthread_mutex_t phc_lock;
+    pthread_cond_t phc_cond;
+
+    struct pp_hdr **phc_tab;
+    size_t phc_size;
+    size_t phc_num;
+
+    /* Predefined macros and the -D definitions, as directives */
+    struct osink phc_predef;
+    struct src_toks phc_predef_toks;
+};
+
+/* Headers looked for by a file: its results depend on them all. */
+struct pp_deps {
+    struct pp_hdr **pd_hdrs;
+    size_t pd_num;
+    size_t pd_cap;
+};
+
+/* Preprocessor API */
+int pp_hcache_init(struct pp_hcache *hc, const struct trans_config *cfg);
+void pp_hcache_release(struct pp_hcache *hc);
+
+void pp_deps_init(struct pp_deps *deps);
+void pp_deps_release(struct pp_deps *deps);
+
+/* Serialized dependencies, and checking them against the headers as they
+ * are now: returns the size of the dependencies if none changed, and -1
+ * otherwise.
+ */
+int pp_deps_save(struct pp_deps *deps, struct osink *out);
+ssize_t pp_deps_check(struct pp_hcache *hc, const char *data, size_t size);
+
+/* Runs stopping at phase 3: checks the tokens of text, the phase 3 output
+ * of file name (its locations in locs), against the limits, and for
+ * identifiers colliding, as they are in the source. Directive lines are
+ * left out, macros are not expanded, and all the groups of conditional
+ * inclusion are in; the number of macros is only checked by pp_run().
+ */
+int pp_check(const struct osink *text, const char *name, const struct src_locs *locs,
+             const struct trans_config *cfg);
+
+/* Preprocesses text, the phase 3 output of file name (its locations in
+ * locs), onto out. Headers come from hc (NULL - a cache of its own), and
+ * are noted in deps (if given).
+ */
+int pp_run(struct osink *out, const struct osink *text, const char *name,
+           const struct src_locs *locs, const struct trans_config *cfg,
+           struct pp_hcache *hc, struct pp_deps *deps, struct src_stats *st);
+
+#endif /* _SRC_PP_H__ */
@@ -0,0 +1,136 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <time.h>
+#include <string.h>
+
+#include "src_stats.h"
+
+static const char *sstats_phase_names[SSTATS_PHASES_NUM] = {
+    [SSTATS_TSTAGE_1]       = "tstage_1",
+    [SSTATS_TSTAGE_2]       = "tstage_2",
+    [SSTATS_TSTAGE_3]       = "tstage_3",
+    [SSTATS_TSTAGE_4]       = "tstage_4",
+};
+
+static uint64_t sstats_clock_ns(clockid_t clk_id)
+{
+    struct timespec ts;
+
+    clock_gettime(clk_id, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+void src_stats_start(struct src_stats_clock *clk)
+{
+    clk->ssc_wall = sstats_clock_ns(CLOCK_MONOTONIC);
+    clk->ssc_cpu = sstats_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void src_stats_stop(struct src_stats *st, enum src_stats_phase phase,
+                    const struct src_stats_clock *clk, uint64_t bytes_in, uint64_t bytes_out)
+{
+    struct src_stats_phase_rec *rec = &st->ss_phases[phase];
+
+    rec->ssp_wall += sstats_clock_ns(CLOCK_MONOTONIC) - clk->ssc_wall;
+    rec->ssp_cpu += sstats_clock_ns(CLOCK_THREAD_CPUTIME_ID) - clk->ssc_cpu;
+    rec->ssp_bytes_in += bytes_in;
+    rec->ssp_bytes_out += bytes_out;
+}
+
+void src_stats_add(struct src_stats *total, const struct src_stats *st)
+{
+    int i;
+
+    for (i = 0; i < SSTATS_PHASES_NUM; i++) {
+        total->ss_phases[i].ssp_wall += st->ss_phases[i].ssp_wall;
+        total->ss_phases[i].ssp_cpu += st->ss_phases[i].ssp_cpu;
+        total->ss_phases[i].ssp_bytes_in += st->ss_phases[i].ssp_bytes_in;
+        total->ss_phases[i].ssp_bytes_out += st->ss_phases[i].ssp_bytes_out;
+    }
+
+    total->ss_lines += st->ss_lines;
+    total->ss_splices += st->ss_splices;
+    total->ss_trigraphs += st->ss_trigraphs;
+    total->ss_comments += st->ss_comments;
+    total->ss_includes += st->ss_includes;
+    total->ss_expansions += st->ss_expansions;
+    total->ss_diags += st->ss_diags;
+    total->ss_files += st->ss_files;
+    total->ss_cached += st->ss_cached;
+}
+
+void src_stats_print(struct osink *out, const char *name, const struct src_stats *st)
+{
+    int i;
+
+    if (name)
+        osink_printf(out, "stats: %s%s\n", name, st->ss_cached ? " (cached)" : "");
+    else
+        osink_printf(out, "stats: total, %lu files (%lu cached)\n", st->ss_files, st->ss_cached);
+
+    osink_printf(out, "  %-12s %10s %10s %12s %12s\n",
+                 "phase", "wall ms", "cpu ms", "bytes in", "bytes out");
+
+    for (i = 0; i < SSTATS_PHASES_NUM; i++) {
+        const struct src_stats_phase_rec *rec = &st->ss_phases[i];
+
+        osink_printf(out, "  %-12s %10.3f %10.3f %12llu %12llu\n", sstats_phase_names[i],
+                     rec->ssp_wall / 1e6, rec->ssp_cpu / 1e6,
+                     (unsigned long long)rec->ssp_bytes_in,
+                     (unsigned long long)rec->ssp_bytes_out);
+    }
+
+    osink_printf(out, "  lines %lu, splices %lu, trigraphs %lu, comments %lu, includes %lu, "
+                 "expansions %lu, diagnostics %lu\n",
+                 st->ss_lines, st->ss_splices, st->ss_trigraphs, st->ss_comments,
+                 st->ss_includes, st->ss_expansions, st->ss_diags);
+}
+
+void src_stats_print_json(struct osink *out, const char *name, const struct src_stats *st)
+{
+    int i;
+
+    osink_printf(out, "{");
+
+    if (name) {
+        osink_printf(out, "\"file\": ");
+        osink_json_str(out, name, strlen(name));
+        osink_printf(out, ", \"cached\": %s", st->ss_cached ? "true" : "false");
+    } else {
+        osink_printf(out, "\"files\": %lu, \"cached\": %lu", st->ss_files, st->ss_cached);
+    }
+
+    osink_printf(out, ", \"phases\": {");
+
+    for (i = 0; i < SSTATS_PHASES_NUM; i++) {
+        const struct src_stats_phase_rec *rec = &st->ss_phases[i];
+
+        osink_printf(out, "%s\"%s\": {\"wall_s\": %.6f, \"cpu_s\": %.6f, "
+                     "\"bytes_in\": %llu, \"bytes_out\": %llu}",
+                     i ? ", " : "", sstats_phase_names[i],
+                     rec->ssp_wall / 1e9, rec->ssp_cpu / 1e9,
+                     (unsigned long long)rec->ssp_bytes_in,
+                     (unsigned long long)rec->ssp_bytes_out);
+    }
+
+    osink_printf(out, "}, \"lines\": %lu, \"splices\": %lu, \"trigraphs\": %lu, "
+                 "\"comments\": %lu, \"includes\": %lu, \"expansions\": %lu, "
+                 "\"diagnostics\": %lu}",
+                 st->ss_lines, st->ss_splices, st->ss_trigraphs, st->ss_comments,
+                 st->ss_includes, st->ss_expansions, st->ss_diags);
+}
@@ -0,0 +1,80 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _SRC_STATS_H__
+#define _SRC_STATS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "out_sink.h"
+
+/* Analysis statistics.
+ *
+ * The parser only collects statistics when handed a src_stats object, so
+ * there's no cost to them when they're not asked for.
+ */
+
+enum src_stats_phase {
+    SSTATS_TSTAGE_1,
+    SSTATS_TSTAGE_2,
+    SSTATS_TSTAGE_3,
+    SSTATS_TSTAGE_4,
+
+    SSTATS_PHASES_NUM
+};
+
+struct src_stats_phase_rec {
+    /* Wall clock and thread CPU time (ns) */
+    uint64_t ssp_wall;
+    uint64_t ssp_cpu;
+
+    uint64_t ssp_bytes_in;
+    uint64_t ssp_bytes_out;
+};
+
+struct src_stats {
+    struct src_stats_phase_rec ss_phases[SSTATS_PHASES_NUM];
+
+    /* Event counters */
+    unsigned long ss_lines;
+    unsigned long ss_splices;
+    unsigned long ss_trigraphs;
+    unsigned long ss_comments;
+    unsigned long ss_includes;
+    unsigned long ss_expansions;
+    unsigned long ss_diags;
+
+    /* Number of files (aggregates), and of those served by the cache */
+    unsigned long ss_files;
+    unsigned long ss_cached;
+};
+
+/* Start time of a phase */
+struct src_stats_clock {
+    uint64_t ssc_wall;
+    uint64_t ssc_cpu;
+};
+
+/* Source Statistics API */
+void src_stats_start(struct src_stats_clock *clk);
+void src_stats_stop(struct src_stats *st, enum src_stats_phase phase,
+                    const struct src_stats_clock *clk, uint64_t bytes_in, uint64_t bytes_out);
+void src_stats_add(struct src_stats *total, const struct src_stats *st);
+void src_stats_print(struct osink *out, const char *name, const struct src_stats *st);
+void src_stats_print_json(struct osink *out, const char *name, const struct src_stats *st);
+
+#endif /* _SRC_STATS_H__ */
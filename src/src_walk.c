@@ -0,0 +1,457 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "src_walk.h"
+#include "src_input.h"
+
+/* GCC's C/C++ source and header extensions */
+static const char *src_walk_default_exts[] = {
+    "c", "h", "cc", "cp", "cpp", "cxx", "c++", "C",
+    "hh", "hp", "hpp", "hxx", "h++", "H", "tcc",
+    NULL
+};
+
+struct src_walk_dir_job {
+    struct src_walk *walk;
+    struct src_walk_node *node;
+};
+
+/* An entry of a directory being read */
+struct src_walk_ent {
+    char *name;
+    bool dir;
+};
+
+int src_walk_init(struct src_walk *walk, struct tpool *pool, int num,
+                  void (*found)(struct src_walk *walk, const char *path, struct src_walk_slot *slot),
+                  void (*emit)(struct src_walk *walk, void *item), void *ctx)
+{
+    int i;
+
+    memset(walk, 0, sizeof(struct src_walk));
+
+    /* Room for one at least, calloc() may well give NULL for none. */
+    walk->root.wn_slots = (struct src_walk_slot *)calloc(num + 1, sizeof(struct src_walk_slot));
+    if (!walk->root.wn_slots)
+        return -1;
+
+    walk->pool = pool;
+    walk->found = found;
+    walk->emit = emit;
+    walk->ctx = ctx;
+
+    pthread_mutex_init(&walk->lock, NULL);
+    walk->root.wn_num = -1;
+    walk->root_cap = num;
+    walk->cur = &walk->root;
+
+    for (i = 0; src_walk_default_exts[i]; i++)
+        walk->exts[i] = src_walk_default_exts[i];
+    walk->exts[i] = NULL;
+
+    return 0;
+}
+
+/* Once started, the walk is released after all its files are done. */
+void src_walk_release(struct src_walk *walk)
+{
+    pthread_mutex_destroy(&walk->lock);
+    free(walk->root.wn_slots);
+    walk->root.wn_slots = NULL;
+}
+
+int src_walk_set_exts(struct src_walk *walk, char *exts)
+{
+    int exts_num = 0;
+    char *ext;
+
+    /* Comma separated list, modified in place. */
+    for (ext = strtok(exts, ","); ext; ext = strtok(NULL, ",")) {
+        if (ext[0] == '.')
+            ext++;
+
+        if (exts_num >= SRC_WALK_EXTS_MAX)
+            return -1;
+
+        walk->exts[exts_num++] = ext;
+    }
+
+    walk->exts[exts_num] = NULL;
+
+    return exts_num ? 0 : -1;
+}
+
+bool src_walk_is_src(const struct src_walk *walk, const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    int i;
+
+    if (!ext || (ext == name))
+        return false;
+
+    for (i = 0; walk->exts[i]; i++) {
+        if (!strcmp(ext + 1, walk->exts[i]))
+            return true;
+    }
+
+    return false;
+}
+
+/* Emits whatever's next in order and done, and drops the directories
+ * done with. Under lock.
+ */
+static void src_walk_advance(struct src_walk *walk)
+{
+    struct src_walk_node *node = walk->cur;
+    struct src_walk_node *parent;
+    struct src_walk_slot *slot;
+
+    for (;;) {
+        /* Not read yet */
+        if (node->wn_num < 0)
+            break;
+
+        if (node->wn_next == node->wn_num) {
+            if (node == &walk->root)
+                break;
+
+            parent = node->wn_parent;
+            free(node->wn_slots);
+            free(node);
+
+            node = parent;
+            node->wn_next++;
+            continue;
+        }
+
+        slot = &node->wn_slots[node->wn_next];
+        if (slot->ws_dir) {
+            node = slot->ws_dir;
+            continue;
+        }
+
+        if (!slot->ws_done)
+            break;
+
+        if (slot->ws_item)
+            walk->emit(walk, slot->ws_item);
+        node->wn_next++;
+    }
+
+    walk->cur = node;
+}
+
+/* Sets the number of entries of a directory, now read. */
+static void src_walk_node_read(struct src_walk *walk, struct src_walk_node *node, int num)
+{
+    pthread_mutex_lock(&walk->lock);
+    node->wn_num = num;
+    src_walk_advance(walk);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+void src_walk_done(struct src_walk *walk, struct src_walk_slot *slot, void *item)
+{
+    pthread_mutex_lock(&walk->lock);
+    slot->ws_item = item;
+    slot->ws_done = true;
+    src_walk_advance(walk);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+static void src_walk_dir_run(void *arg);
+
+static int src_walk_submit(struct src_walk *walk, struct src_walk_node *node)
+{
+    struct src_walk_dir_job *job;
+
+    job = (struct src_walk_dir_job *)malloc(sizeof(struct src_walk_dir_job));
+    if (!job) {
+        osink_err_printf(walk->err, "**Error: Could not walk directory: %s\n",
+                         src_input_path_shown(walk->base_dir, node->wn_path));
+        __atomic_add_fetch(&walk->errors, 1, __ATOMIC_RELAXED);
+        free(node->wn_path);
+        node->wn_path = NULL;
+        src_walk_node_read(walk, node, 0);
+        return -1;
+    }
+
+    job->walk = walk;
+    job->node = node;
+
+    if (tpool_submit_group(walk->pool, walk->grp, src_walk_dir_run, job)) {
+        /* No room in the pool; walk it on this thread. */
+        src_walk_dir_run(job);
+    }
+
+    return 0;
+}
+
+/* Path order: a directory goes as its name and a '/'. */
+static int src_walk_ent_cmp(const void *a, const void *b)
+{
+    const struct src_walk_ent *ent_a = (const struct src_walk_ent *)a;
+    const struct src_walk_ent *ent_b = (const struct src_walk_ent *)b;
+    const unsigned char *name_a = (const unsigned char *)ent_a->name;
+    const unsigned char *name_b = (const unsigned char *)ent_b->name;
+    int c_a, c_b;
+
+    while (*name_a && (*name_a == *name_b)) {
+        name_a++;
+        name_b++;
+    }
+
+    c_a = *name_a ? *name_a : (ent_a->dir ? '/' : '\0');
+    c_b = *name_b ? *name_b : (ent_b->dir ? '/' : '\0');
+
+    return c_a - c_b;
+}
+
+static char *src_walk_path(const char *dir, const char *name)
+{
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *path;
+
+    path = (char *)malloc(dir_len + name_len + 2);
+    if (!path)
+        return NULL;
+
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(&path[dir_len + 1], name, name_len + 1);
+
+    return path;
+}
+
+/* Reads the source files and sub-directories of directory path. */
+static int src_walk_read(struct src_walk *walk, const char *path,
+                         struct src_walk_ent **ents, int *ents_num)
+{
+    struct src_walk_ent *new_ents;
+    int ents_cap = 0;
+    struct dirent *de;
+    DIR *dir;
+
+    *ents = NULL;
+    *ents_num = 0;
+
+    dir = opendir(path);
+    if (!dir)
+        return -1;
+
+    while ((de = readdir(dir))) {
+        unsigned char type = de->d_type;
+        struct stat st;
+        char *ent_path;
+
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+            continue;
+
+        /* Symbolic links are followed to files only, so there are no
+         * directory cycles to worry about.
+         */
+        if ((type == DT_UNKNOWN) || (type == DT_LNK)) {
+            ent_path = src_walk_path(path, de->d_name);
+            if (!ent_path)
+                break;
+
+            if ((type == DT_UNKNOWN) && !lstat(ent_path, &st))
+                type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_LNK);
+
+            if ((type == DT_LNK) && !stat(ent_path, &st) && S_ISREG(st.st_mode))
+                type = DT_REG;
+
+            free(ent_path);
+        }
+
+        if ((type != DT_DIR) && ((type != DT_REG) || !src_walk_is_src(walk, de->d_name)))
+            continue;
+
+        if (*ents_num == ents_cap) {
+            ents_cap = ents_cap ? (ents_cap << 1) : 64;
+            new_ents = (struct src_walk_ent *)realloc(*ents, sizeof(struct src_walk_ent) * ents_cap);
+            if (!new_ents)
+                break;
+
+            *ents = new_ents;
+        }
+
+        (*ents)[*ents_num].name = strdup(de->d_name);
+        if (!(*ents)[*ents_num].name)
+            break;
+
+        (*ents)[*ents_num].dir = (type == DT_DIR);
+        (*ents_num)++;
+    }
+
+    /* Out of memory: what was read is walked still. */
+    if (de)
+        __atomic_add_fetch(&walk->errors, 1, __ATOMIC_RELAXED);
+
+    closedir(dir);
+
+    return 0;
+}
+
+static void src_walk_dir_run(void *arg)
+{
+    struct src_walk_dir_job *job = (struct src_walk_dir_job *)arg;
+    struct src_walk *walk = job->walk;
+    struct src_walk_node *node = job->node;
+    struct src_walk_node *sub;
+    struct src_walk_slot *slot;
+    struct src_walk_ent *ents;
+    int ents_num;
+    int num = 0;
+    char *path;
+    int i;
+
+    free(job);
+
+    if (src_walk_read(walk, node->wn_path, &ents, &ents_num)) {
+        osink_err_printf(walk->err, "**Error: Could not read directory: %s\n",
+                         src_input_path_shown(walk->base_dir, node->wn_path));
+        __atomic_add_fetch(&walk->errors, 1, __ATOMIC_RELAXED);
+        goto out;
+    }
+
+    if (ents_num) {
+        qsort(ents, ents_num, sizeof(struct src_walk_ent), src_walk_ent_cmp);
+
+        node->wn_slots = (struct src_walk_slot *)calloc(ents_num, sizeof(struct src_walk_slot));
+        if (!node->wn_slots) {
+            __atomic_add_fetch(&walk->errors, 1, __ATOMIC_RELAXED);
+            ents_num = 0;
+        }
+    }
+
+    /* The directory is not emitted from before its number of entries is
+     * set, so its slots stay put meanwhile.
+     */
+    for (i = 0; i < ents_num; i++) {
+        path = src_walk_path(node->wn_path, ents[i].name);
+        free(ents[i].name);
+        if (!path) {
+            __atomic_add_fetch(&walk->errors, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        slot = &node->wn_slots[num];
+
+        if (!ents[i].dir) {
+            num++;
+            walk->found(walk, path, slot);
+            free(path);
+            continue;
+        }
+
+        sub = (struct src_walk_node *)calloc(1, sizeof(struct src_walk_node));
+        if (!sub) {
+            __atomic_add_fetch(&walk->errors, 1, __ATOMIC_RELAXED);
+            free(path);
+            continue;
+        }
+
+        /* The sub-directory takes over the path. */
+        sub->wn_parent = node;
+        sub->wn_path = path;
+        sub->wn_num = -1;
+        slot->ws_dir = sub;
+        num++;
+
+        src_walk_submit(walk, sub);
+    }
+
+    for (; i < ents_num; i++)
+        free(ents[i].name);
+    free(ents);
+
+out:
+    free(node->wn_path);
+    node->wn_path = NULL;
+    src_walk_node_read(walk, node, num);
+}
+
+struct src_walk_slot *src_walk_add(struct src_walk *walk)
+{
+    if (walk->root_num == walk->root_cap)
+        return NULL;
+
+    return &walk->root.wn_slots[walk->root_num++];
+}
+
+int src_walk_add_dir(struct src_walk *walk, const char *path)
+{
+    struct src_walk_node *node;
+    size_t len;
+
+    if (walk->root_num == walk->root_cap)
+        return -1;
+
+    node = (struct src_walk_node *)calloc(1, sizeof(struct src_walk_node));
+    if (!node)
+        return -1;
+
+    node->wn_path = strdup(path);
+    if (!node->wn_path) {
+        free(node);
+        return -1;
+    }
+
+    /* Keep reported paths tidy: "dir/" walks as "dir". */
+    len = strlen(node->wn_path);
+    while ((len > 1) && (node->wn_path[len - 1] == '/'))
+        node->wn_path[--len] = '\0';
+
+    node->wn_parent = &walk->root;
+    node->wn_num = -1;
+    walk->root.wn_slots[walk->root_num++].ws_dir = node;
+
+    return 0;
+}
+
+void src_walk_start(struct src_walk *walk)
+{
+    struct src_walk_node *node;
+    int i;
+
+    for (i = 0; i < walk->root_num; i++) {
+        node = walk->root.wn_slots[i].ws_dir;
+        if (!node)
+            continue;
+
+        if (walk->pool) {
+            src_walk_submit(walk, node);
+            continue;
+        }
+
+        osink_err_printf(walk->err, "**Error: Could not walk directory: %s\n",
+                         src_input_path_shown(walk->base_dir, node->wn_path));
+        __atomic_add_fetch(&walk->errors, 1, __ATOMIC_RELAXED);
+        free(node->wn_path);
+        node->wn_path = NULL;
+        src_walk_node_read(walk, node, 0);
+    }
+
+    src_walk_node_read(walk, &walk->root, walk->root_num);
+}
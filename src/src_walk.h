@@ -0,0 +1,121 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _SRC_WALK_H__
+#define _SRC_WALK_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "thread_pool.h"
+#include "out_sink.h"
+
+/* Source tree walk.
+ *
+ * Every directory is read by a task of its own on the thread pool, so
+ * sibling directories are read in parallel. Source files are handed to the
+ * found() callback (on the walking worker thread) as soon as they are seen.
+ *
+ * The walk also keeps the order the results of the files are emitted in,
+ * whatever the order they're done in: the files and directories added,
+ * in order, each directory's files in path order. Every file has a slot in
+ * a tree of the directories, and is handed back with its item (results)
+ * when done; the emit() callback is called for the items next in order as
+ * soon as they're all in, so only those done out of order are held.
+ */
+
+#define SRC_WALK_EXTS_MAX   32
+
+struct src_walk_node;
+
+/* A file (or a directory) in the output order */
+struct src_walk_slot {
+    /* The directory (NULL - a file) */
+    struct src_walk_node *ws_dir;
+
+    /* The file's item (NULL - nothing to emit), once done */
+    void *ws_item;
+    bool ws_done;
+};
+
+/* A directory, or the files and directories added to the walk */
+struct src_walk_node {
+    struct src_walk_node *wn_parent;
+    char *wn_path;
+
+    /* Its entries, in order (wn_num -1 - not read yet), and the next one
+     * to emit.
+     */
+    struct src_walk_slot *wn_slots;
+    int wn_num;
+    int wn_next;
+};
+
+struct src_walk {
+    struct tpool *pool;
+
+    /* Task group of the walk tasks (NULL - none) */
+    struct tgroup *grp;
+
+    /* File name extensions (without the '.') of source files */
+    const char *exts[SRC_WALK_EXTS_MAX + 1];
+
+    /* Called for every source file found; path is only valid for the call.
+     * The file is handed back to src_walk_done() with its slot.
+     */
+    void (*found)(struct src_walk *walk, const char *path, struct src_walk_slot *slot);
+
+    /* Called for the items of the files, in order (under the walk's lock) */
+    void (*emit)(struct src_walk *walk, void *item);
+    void *ctx;
+
+    /* Output order: the files and directories added, and the directory
+     * (or the root) of the next slot to emit. Under lock.
+     */
+    pthread_mutex_t lock;
+    struct src_walk_node root;
+    int root_num;
+    int root_cap;
+    struct src_walk_node *cur;
+
+    /* Number of directories which could not be read, where to report
+     * them (NULL - the thread's error sink), and the directory their paths
+     * are shown relative to (see src_input_path_shown()).
+     */
+    int errors;
+    struct osink *err;
+    const char *base_dir;
+};
+
+/* Source Walk API */
+int src_walk_init(struct src_walk *walk, struct tpool *pool, int num,
+                  void (*found)(struct src_walk *walk, const char *path, struct src_walk_slot *slot),
+                  void (*emit)(struct src_walk *walk, void *item), void *ctx);
+void src_walk_release(struct src_walk *walk);
+int src_walk_set_exts(struct src_walk *walk, char *exts);
+bool src_walk_is_src(const struct src_walk *walk, const char *name);
+
+/* Adds a file, or a directory to walk, next in order (up to num, as
+ * initialized). The directories are walked once all are added.
+ */
+struct src_walk_slot *src_walk_add(struct src_walk *walk);
+int src_walk_add_dir(struct src_walk *walk, const char *path);
+void src_walk_start(struct src_walk *walk);
+
+/* Hands a file back, done, with its item (NULL - nothing to emit). */
+void src_walk_done(struct src_walk *walk, struct src_walk_slot *slot, void *item);
+
+#endif /* _SRC_WALK_H__ */
@@ -134,6 +134,23 @@ struct trans_config {
     /* Other common translation configurations */
     bool exp_trigraphs;
     bool exp_cpp_cmnts;
+
+    /* Last translation phase run (3 or 4) */
+    unsigned int last_phase;
+
+    /* Phase 4: include paths, searched in order, and the macros defined
+     * up front ("NAME" or "NAME=VALUE").
+     */
+    char **ipaths;
+    int ipaths_num;
+    char **defs;
+    int defs_num;
+
+    /* Relative paths are taken relative to this directory (NULL - the
+     * working directory), and shown as given: resolved paths under it are
+     * shown relative to it.
+     */
+    const char *base_dir;
 };
 
 /* std_comp API Functions */
@@ -0,0 +1,54 @@
+/* Conditional inclusion */
+#define ONE 1
+#define ZERO 0
+#define EMPTY
+
+#if ONE
+int if_taken;
+#else
+int if_not_taken;
+#endif
+
+#if ZERO
+int elif_0;
+#elif ONE + 1 == 2
+int elif_1;
+#elif 1
+int elif_2;
+#else
+int elif_else;
+#endif
+
+#ifdef EMPTY
+int ifdef_taken;
+#endif
+#ifndef EMPTY
+int ifndef_not_taken;
+#endif
+
+#if defined(ONE) && defined ZERO && !defined(UNDEFINED)
+int defined_taken;
+#endif
+
+#if UNDEFINED
+int undefined_is_0;
+#endif
+
+#if (2 + 3 * 4 == 14) && (-1 < 0) && (-1 > 0u) && (7 / 2 == 3) && (7 % 3 == 1)
+int arithmetic;
+#endif
+
+#if (1 ? 2 : 3) == 2 && (0x10 == 16) && (010 == 8) && ('A' == 65) && (1 << 4 == 16)
+int constants;
+#endif
+
+#if 0
+#if 1
+int nested_skipped;
+#else
+int nested_skipped_else;
+#endif
+#garbage directives are not looked at in skipped groups
+#else
+int outer_else;
+#endif
@@ -0,0 +1,15 @@
+/* __has_include: quoted and angle-bracketed, found or not */
+#if __has_include("guard.h")
+int quoted_found;
+#endif
+#if __has_include(<once.h>)
+int angled_found;
+#endif
+#if __has_include("no_such_header.h")
+int quoted_missing;
+#elif !__has_include(<no_such_header.h>)
+int angled_missing;
+#endif
+#ifdef __has_include
+int has_include_defined;
+#endif
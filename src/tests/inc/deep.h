@@ -0,0 +1 @@
+#include "deep.h"
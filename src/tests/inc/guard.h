@@ -0,0 +1,7 @@
+#ifndef GUARD_H
+#define GUARD_H
+
+#define GUARD_VALUE 42
+int guarded;
+
+#endif /* GUARD_H */
@@ -0,0 +1,3 @@
+/* A header including itself stops at the nesting limit (15 in C11). */
+#include "deep.h"
+int after_deep;
@@ -0,0 +1,5 @@
+/* A header wrapped in an include guard is only entered once. */
+#include "guard.h"
+#include "guard.h"
+#include <guard.h>
+int after_guard = GUARD_VALUE;
@@ -0,0 +1,7 @@
+/*
+ * Diagnostics and output through the library
+ */
+
+int a; ??= 
+    
+int b; // trailing
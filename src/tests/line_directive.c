@@ -0,0 +1,18 @@
+/* #line sets the line, and file, of the lines following it */
+#define NAME "renamed.c"
+#define LINE 200
+
+int at_line = __LINE__;
+#line 100
+int line_100 = __LINE__;
+#error on line 101
+#line LINE NAME
+const char *file = __FILE__;
+int line_201 = __LINE__;
+#error on line 202
+# 50 "marker.c" 2
+int line_50 = __LINE__;
+#line 0
+#line 7 not_a_string
+#line
+int last = __LINE__;
@@ -0,0 +1,6 @@
+/* C11 6.10.3.5, examples 1 and 2 */
+#define TABSIZE 100
+int table[TABSIZE];
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+int m = max(x + 1, y);
@@ -0,0 +1,8 @@
+/* C11 6.10.3.5, example 6: valid redefinitions */
+#define OBJ_LIKE (1-1)
+#define OBJ_LIKE /* white space */ (1-1) /* other */
+#define FUNC_LIKE(a) ( a )
+#define FUNC_LIKE( a )( /* note the white space */ \
+ a /* other stuff on this line
+ */ )
+int o = OBJ_LIKE, f = FUNC_LIKE(1);
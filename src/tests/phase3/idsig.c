@@ -0,0 +1,6 @@
+/* Identifiers which differ past their first 63 characters only collide:
+ * reported on runs stopping at phase 3 too.
+ */
+
+int aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa_one;
+int aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa_two;
@@ -0,0 +1,9 @@
+/* Translation limits, up to phase 3 (the default): checked on the tokens
+ * as they are in the source, directive lines left out.
+ */
+#define SIXTY_FOUR_PARENS ((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((
+
+int deep(void)
+{
+    return ((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((0))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))));
+}
@@ -0,0 +1,5 @@
+/* A header which had #pragma once is only entered once. */
+#include "once.h"
+#include "once.h"
+#include "once.h"
+int after_once;
@@ -0,0 +1,6 @@
+/*****************************************************************
+ * A file starting with a banner comment: no line of it is empty.
+ *****************************************************************/
+int a;
+    
+int b;
@@ -0,0 +1,346 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "thread_pool.h"
+
+#define TQUEUE_INIT_SIZE    64
+
+struct ttask {
+    tpool_task_fn fn;
+    void *arg;
+    struct tgroup *grp;
+};
+
+/* Per-worker task queue (ring buffer) */
+struct tqueue {
+    pthread_mutex_t tq_lock;
+    struct ttask *tq_tasks;
+    unsigned int tq_cap;
+    unsigned int tq_head;
+    unsigned int tq_size;
+};
+
+struct tworker {
+    struct tpool *pool;
+    unsigned int indx;
+    pthread_t thread;
+    struct tqueue queue;
+};
+
+struct tpool {
+    struct tworker *workers;
+    unsigned int workers_num;
+    unsigned int next_queue;
+
+    /* Tasks submitted but not yet completed */
+    unsigned long pending;
+
+    /* Tasks sitting in the queues, counted once pushed */
+    unsigned long queued;
+
+    bool stop;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+};
+
+/* Worker of the calling thread, if it is a pool thread, and the group of
+ * the task it runs.
+ */
+static __thread struct tworker *cur_worker;
+static __thread struct tgroup *cur_grp;
+
+static void tgroup_done(struct tgroup *grp)
+{
+    if (!grp)
+        return;
+
+    pthread_mutex_lock(&grp->tg_lock);
+    if (!--grp->tg_pending)
+        pthread_cond_broadcast(&grp->tg_cond);
+    pthread_mutex_unlock(&grp->tg_lock);
+}
+
+static int tqueue_push(struct tqueue *q, const struct ttask *task)
+{
+    pthread_mutex_lock(&q->tq_lock);
+
+    if (q->tq_size == q->tq_cap) {
+        unsigned int new_cap = q->tq_cap ? (q->tq_cap << 1) : TQUEUE_INIT_SIZE;
+        struct ttask *new_tasks;
+        unsigned int i;
+
+        new_tasks = (struct ttask *)malloc(sizeof(struct ttask) * new_cap);
+        if (!new_tasks) {
+            pthread_mutex_unlock(&q->tq_lock);
+            return -1;
+        }
+
+        for (i = 0; i < q->tq_size; i++)
+            new_tasks[i] = q->tq_tasks[(q->tq_head + i) % q->tq_cap];
+
+        free(q->tq_tasks);
+        q->tq_tasks = new_tasks;
+        q->tq_cap = new_cap;
+        q->tq_head = 0;
+    }
+
+    q->tq_tasks[(q->tq_head + q->tq_size) % q->tq_cap] = *task;
+    q->tq_size++;
+
+    pthread_mutex_unlock(&q->tq_lock);
+
+    return 0;
+}
+
+static bool tqueue_pop(struct tqueue *q, struct ttask *task)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&q->tq_lock);
+
+    if (q->tq_size) {
+        *task = q->tq_tasks[q->tq_head];
+        q->tq_head = (q->tq_head + 1) % q->tq_cap;
+        q->tq_size--;
+        found = true;
+    }
+
+    pthread_mutex_unlock(&q->tq_lock);
+
+    return found;
+}
+
+static bool tpool_take(struct tworker *worker, struct ttask *task)
+{
+    struct tpool *pool = worker->pool;
+    unsigned int i;
+
+    /* Own queue first, then steal going around the other workers. */
+    for (i = 0; i < pool->workers_num; i++) {
+        struct tworker *victim = &pool->workers[(worker->indx + i) % pool->workers_num];
+
+        if (tqueue_pop(&victim->queue, task))
+            return true;
+    }
+
+    return false;
+}
+
+static void *tpool_worker_run(void *arg)
+{
+    struct tworker *worker = (struct tworker *)arg;
+    struct tpool *pool = worker->pool;
+    struct ttask task;
+
+    cur_worker = worker;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->queued && !pool->stop)
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+
+        if (!pool->queued) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        /* Tasks are pushed before they're counted as queued, and only
+         * taken under the pool lock: one counted is there to be found.
+         */
+        if (!tpool_take(worker, &task)) {
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+
+        cur_grp = task.grp;
+        task.fn(task.arg);
+        cur_grp = NULL;
+
+        tgroup_done(task.grp);
+
+        pthread_mutex_lock(&pool->lock);
+        if (!--pool->pending)
+            pthread_cond_broadcast(&pool->done_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+struct tpool *tpool_create(unsigned int workers_num)
+{
+    struct tpool *pool;
+    unsigned int i;
+
+    if (!workers_num)
+        workers_num = 1;
+    if (workers_num > TPOOL_WORKERS_MAX)
+        workers_num = TPOOL_WORKERS_MAX;
+
+    pool = (struct tpool *)calloc(1, sizeof(struct tpool));
+    if (!pool)
+        return NULL;
+
+    pool->workers = (struct tworker *)calloc(workers_num, sizeof(struct tworker));
+    if (!pool->workers) {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    for (i = 0; i < workers_num; i++) {
+        struct tworker *worker = &pool->workers[i];
+
+        worker->pool = pool;
+        worker->indx = i;
+        pthread_mutex_init(&worker->queue.tq_lock, NULL);
+    }
+
+    for (i = 0; i < workers_num; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, tpool_worker_run, &pool->workers[i]))
+            break;
+
+        pool->workers_num++;
+    }
+
+    if (!pool->workers_num) {
+        tpool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+int tpool_submit(struct tpool *pool, tpool_task_fn fn, void *arg)
+{
+    /* Tasks submitted by a task stay in its group. */
+    return tpool_submit_group(pool, cur_worker ? cur_grp : NULL, fn, arg);
+}
+
+int tpool_submit_group(struct tpool *pool, struct tgroup *grp, tpool_task_fn fn, void *arg)
+{
+    struct ttask task = {
+        .fn = fn,
+        .arg = arg,
+        .grp = grp,
+    };
+    struct tqueue *q;
+
+    if (grp) {
+        pthread_mutex_lock(&grp->tg_lock);
+        grp->tg_pending++;
+        pthread_mutex_unlock(&grp->tg_lock);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (cur_worker && (cur_worker->pool == pool))
+        q = &cur_worker->queue;
+    else
+        q = &pool->workers[pool->next_queue++ % pool->workers_num].queue;
+
+    pool->pending++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (tqueue_push(q, &task)) {
+        pthread_mutex_lock(&pool->lock);
+        if (!--pool->pending)
+            pthread_cond_broadcast(&pool->done_cond);
+        pthread_mutex_unlock(&pool->lock);
+
+        tgroup_done(grp);
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->queued++;
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+void tpool_wait(struct tpool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending)
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void tpool_destroy(struct tpool *pool)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->workers_num; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    for (i = 0; i < pool->workers_num; i++) {
+        pthread_mutex_destroy(&pool->workers[i].queue.tq_lock);
+        free(pool->workers[i].queue.tq_tasks);
+    }
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->lock);
+
+    free(pool->workers);
+    free(pool);
+}
+
+void tgroup_init(struct tgroup *grp)
+{
+    grp->tg_pending = 0;
+    pthread_mutex_init(&grp->tg_lock, NULL);
+    pthread_cond_init(&grp->tg_cond, NULL);
+}
+
+void tgroup_wait(struct tgroup *grp)
+{
+    pthread_mutex_lock(&grp->tg_lock);
+    while (grp->tg_pending)
+        pthread_cond_wait(&grp->tg_cond, &grp->tg_lock);
+    pthread_mutex_unlock(&grp->tg_lock);
+}
+
+void tgroup_destroy(struct tgroup *grp)
+{
+    pthread_cond_destroy(&grp->tg_cond);
+    pthread_mutex_destroy(&grp->tg_lock);
+}
+
+unsigned int tpool_cpus_num(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (cpus > 0) ? (unsigned int)cpus : 1;
+}
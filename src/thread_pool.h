@@ -0,0 +1,58 @@
+/************************************************************************
+ * Copyright (c) 2019, Gil Treibush
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * A copy of the full GNU General Public License is included in this
+ * distribution in a file called "COPYING" or "LICENSE".
+ ***********************************************************************/
+
+#ifndef _THREAD_POOL_H__
+#define _THREAD_POOL_H__
+
+#include <pthread.h>
+
+/* Work-stealing thread pool.
+ *
+ * Every worker owns a task queue. Tasks submitted from outside the pool are
+ * dealt to the queues round-robin, tasks submitted by a worker go to its own
+ * queue. Workers run their own tasks in submission order, and steal from the
+ * other queues once their own is empty.
+ */
+
+#define TPOOL_WORKERS_MAX   256
+
+typedef void (*tpool_task_fn)(void *arg);
+
+struct tpool;
+
+struct tgroup {
+    /* Tasks of the group submitted but not yet completed */
+    unsigned long tg_pending;
+
+    pthread_mutex_t tg_lock;
+    pthread_cond_t tg_cond;
+};
+
+/* Thread Pool API */
+struct tpool *tpool_create(unsigned int workers_num);
+int tpool_submit(struct tpool *pool, tpool_task_fn fn, void *arg);
+int tpool_submit_group(struct tpool *pool, struct tgroup *grp, tpool_task_fn fn, void *arg);
+void tpool_wait(struct tpool *pool);
+void tpool_destroy(struct tpool *pool);
+
+void tgroup_init(struct tgroup *grp);
+void tgroup_wait(struct tgroup *grp);
+void tgroup_destroy(struct tgroup *grp);
+
+/* Number of online CPUs (at least 1). */
+unsigned int tpool_cpus_num(void);
+
+#endif /* _THREAD_POOL_H__ */